@@ -2,8 +2,21 @@
 #define ASTAR_HPP
 
 #include <cmath>
+#include <climits>
 #include <set>
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include "DV1419Map.h"
+#include "GoalBounds.hpp"
+#include "DeadEndPruning.hpp"
+#include "GridLayout.hpp"
+#include "SparseNodeTable.hpp"
+#include "PagedMap.hpp"
+#include "VersionedMap.hpp"
+#include "SearchTrace.hpp"
+#include "RectangleSymmetry.hpp"
+#include "NeighbourKernel.hpp"
 
 class AStar
 {
@@ -21,23 +34,76 @@ public:
 		}
 	};
 
+	/// <summary>
+	/// Comparison function for the focal list of the bounded-suboptimal searches
+	/// </summary>
+	struct LowestPriority
+	{
+		bool operator()(const Node* l, const Node* r) const
+		{
+			return l->Priority < r->Priority;
+		}
+	};
+
+	/// <summary>
+	/// How far from optimal a search is allowed to be, see <see cref="SetSearchMode"/>.
+	/// </summary>
+	enum SearchMode
+	{
+		// Plain A*, always optimal
+		Optimal,
+		// Weighted A*, F = G + (1 + epsilon) * H
+		Weighted,
+		// Focal search, expands the node closest to the goal among those within (1 + epsilon) of the lowest F
+		Focal,
+		// Optimistic search, weighted A* with a weight of 1 + 2 * epsilon and then A* until the path is proven
+		Optimistic,
+		// Anytime Repairing A*, weighted A* that starts at 1 + epsilon and keeps improving its path, see PathAnytime
+		Anytime
+	};
+
+	/// <summary>
+	/// Where the nodes of a search are kept, see <see cref="SetStateBackend"/>.
+	/// </summary>
+	enum StateBackend
+	{
+		// A node for every cell, allocated the first time it is needed
+		DenseState,
+		// Nodes in a hash table, only for the cells the search touches
+		SparseState,
+		// Sparse for searches that look small next to the map, dense otherwise
+		AutomaticState
+	};
+
+	/// <summary>
+	/// Called with every path an anytime search finds, and the most it can be longer than the optimal one, as a factor.
+	/// </summary>
+	typedef std::function<void(const std::vector<Coordinate>& path, double bound)> AnytimeCallback;
+
 	/// <summary>
 	/// An internal node structure.
 	/// </summary>
 	struct Node
 	{
-		Node() : X(0), Y(0), G(0), H(0), F(0), Open(false), Closed(false), Parent(nullptr) { }
-		Node(int X, int Y): X(X), Y(Y), G(0), H(0), F(0), Open(false), Closed(false), Parent(nullptr) { }
+		Node() : X(0), Y(0), G(0), H(0), F(0), Priority(0), Open(false), Closed(false), Goal(false), InFocal(false), Parent(nullptr), Generation(0) { }
+		Node(int X, int Y): X(X), Y(Y), G(0), H(0), F(0), Priority(0), Open(false), Closed(false), Goal(false), InFocal(false), Parent(nullptr), Generation(0) { }
 		
 		int X, Y;
 		int G, H, F;
+		int Priority;
 
 		bool Open;
 		bool Closed;
+		bool Goal;
+		bool InFocal;
 
 		Node* Parent;
 
+		// The search this node was last reset for, see GetNode
+		unsigned int Generation;
+
 		std::multiset<Node*, LowestFCost>::iterator Iterator;
+		std::multiset<Node*, LowestPriority>::iterator FocalIterator;
 	};
 
 	/// <summary>
@@ -82,33 +148,117 @@ public:
 		}
 	};
 
-	AStar(DV1419Map* map) : m_RawMap(map), m_HeuristicMethod(Heuristics::Diagonal) { Initialize(); }
-	AStar(DV1419Map* map, Heuristics::HeuristicMethod heuriscitMethod) : m_RawMap(map), m_HeuristicMethod(heuriscitMethod) { Initialize(); }
+	AStar(const DV1419Map* map) : m_RawMap(map), m_PagedMap(nullptr), m_HeuristicMethod(Heuristics::Diagonal) { Initialize(); }
+	AStar(const DV1419Map* map, Heuristics::HeuristicMethod heuriscitMethod) : m_RawMap(map), m_PagedMap(nullptr), m_HeuristicMethod(heuriscitMethod) { Initialize(); }
+	AStar(PagedMap* map) : m_RawMap(nullptr), m_PagedMap(map), m_HeuristicMethod(Heuristics::Diagonal) { Initialize(); }
 	void Initialize();
 	~AStar();
 
 	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+	std::vector<Coordinate>* PathToNearest(Coordinate start, const std::vector<Coordinate>& goals);
+	std::vector<Coordinate>* PathAnytime(Coordinate start, Coordinate goal, std::chrono::steady_clock::time_point deadline, AnytimeCallback onSolution = AnytimeCallback());
 	void Prepare(Coordinate start, Coordinate goal);
+	void Prepare(Coordinate start, const std::vector<Coordinate>& goals);
 	Node* Update();
+	bool Improve();
+	double GetSuboptimalityBound() const;
 	std::vector<Coordinate>* ReconstructPath(Node* finalNode);
+	Node* GetNode(int x, int y);
+	void SetSearchMode(SearchMode mode, double epsilon = 0);
+	SearchMode GetSearchMode() const { return m_Mode; }
+	double GetEpsilon() const { return m_Epsilon; }
+	void SetAnytimeStep(double step) { m_AnytimeStep = step; }
+	double GetInflation() const { return m_Inflation; }
+	void SetGoalBounds(const GoalBounds* bounds) { m_GoalBounds = bounds; }
+	void SetDeadEndPruning(DeadEndPruning* pruning) { m_DeadEnds = pruning; }
+	void SetStateBackend(StateBackend backend) { m_Backend = backend; }
+	StateBackend GetStateBackend() const { return m_Backend; }
+	bool IsUsingSparseState() const { return m_Sparse; }
+	size_t GetStateMemoryUsage() const;
+	void ReserveDenseState();
+	void SetAgentSize(int size) { m_AgentSize = max(size, 1); }
+	int GetAgentSize() const { return m_AgentSize; }
+	int GetClearance(int x, int y);
+	void SetSnapshot(const MapSnapshot* snapshot) { m_Snapshot = snapshot; }
+	const MapSnapshot* GetSnapshot() const { return m_Snapshot; }
+	void SetTrace(SearchTrace* trace) { m_Trace = trace; }
+	void SetSymmetryReduction(const RectangleSymmetry* symmetry) { m_Symmetry = symmetry; }
+	void SetNeighbourKernel(NeighbourKernel::RelaxMethod kernel) { m_Kernel = kernel; }
 
+	// Indexed by the storage index of the layout, empty where a tile runs past the map.
+	// Null until a search uses the dense backend.
 	Node** m_Nodes;
 	std::multiset<Node*, LowestFCost> m_OpenList;
+	std::multiset<Node*, LowestPriority> m_FocalList;
 	Node* m_CurrentNode;
+	unsigned int m_ExpandedNodes;
 
 private:
 	bool IsWalkable(int x, int y);
-	Node* GetNode(int x, int y);
+	bool IsWalkableAt(int index, int x, int y);
+	Node* GetNodeAt(int index, int x, int y);
+	void CreatePool();
+	int Estimate(Node* node);
+	Node* SelectNode();
+	void Push(Node* node, int g);
+	void Remove(Node* node);
+	void Relax(Node* neighbour, int g);
+	bool IsWithinBounds(Node* node, int dx, int dy);
+	Node* GetReachedGoal() const;
+	bool CanUseKernel() const;
+	void RelaxNeighbours(int index);
 
-	DV1419Map* m_RawMap;
-	bool* m_Map;
+	const DV1419Map* m_RawMap;
+	// Set instead of m_RawMap for maps that are paged in as the search goes, m_Clearance is null then
+	PagedMap* m_PagedMap;
+	// The walkability and the nodes are both stored in the layout's order
+	GridLayout m_Layout;
+	// The side of the largest open square with its top left corner at each cell, capped at 255.
+	// Zero is a blocked cell, so this is the walkability grid for every agent size at once.
+	unsigned char* m_Clearance;
+	// Agents take up a square this many cells wide, anchored at their top left cell
+	int m_AgentSize;
+	// A pinned version of an edited map to read walkability from instead, see SetSnapshot
+	const MapSnapshot* m_Snapshot;
+	// Told about every step of the searches, only when compiled with SEARCH_TRACE
+	SearchTrace* m_Trace;
+	// Optional rectangle pruning with macro edges, only for 1x1 agents on the map itself
+	const RectangleSymmetry* m_Symmetry;
+	std::vector<RectangleSymmetry::Successor> m_MacroSuccessors;
+	// Relaxes the neighbours of plain searches in one go, null for the check by check loop
+	NeighbourKernel::RelaxMethod m_Kernel;
+	Node* m_Pool;
 	int m_MapWidth;
 	int m_MapHeight;
 
 	Heuristics::HeuristicMethod m_HeuristicMethod;
 
 	Node* m_StartNode;
-	Node* m_GoalNode;
+	std::vector<Node*> m_GoalNodes;
+	unsigned int m_Generation;
+
+	SearchMode m_Mode;
+	double m_Epsilon;
+	// Nodes with an F up to this are in the focal list
+	int m_FocalBound;
+	// The best path the optimistic search has found so far
+	Node* m_Incumbent;
+	// The weight of the anytime search is 1 + m_Inflation, lowered by m_AnytimeStep every round
+	double m_Inflation;
+	double m_AnytimeStep;
+	// Closed nodes of this round, and those of them that were given a better path after they were closed
+	std::vector<Node*> m_ClosedNodes;
+	std::vector<Node*> m_Inconsistent;
+	std::vector<Node*> m_Rekeyed;
+	// Optional move pruning, see SetGoalBounds
+	const GoalBounds* m_GoalBounds;
+	// Optional region pruning, prepared along with every search
+	DeadEndPruning* m_DeadEnds;
+
+	StateBackend m_Backend;
+	// Whether the current search keeps its nodes in m_SparseNodes instead of m_Pool
+	bool m_Sparse;
+	SparseNodeTable<Node> m_SparseNodes;
 };
 
 /// <summary>
@@ -116,32 +266,92 @@ private:
 /// </summary>
 void AStar::Initialize()
 {
+	m_CurrentNode = nullptr;
+	m_Generation = 0;
+	m_ExpandedNodes = 0;
+	m_Mode = Optimal;
+	m_Epsilon = 0;
+	m_Incumbent = nullptr;
+	m_Inflation = 0;
+	m_AnytimeStep = 0.25;
+	m_GoalBounds = nullptr;
+	m_DeadEnds = nullptr;
+	m_Backend = DenseState;
+	m_Sparse = false;
+	m_Pool = nullptr;
+	m_Nodes = nullptr;
+	m_AgentSize = 1;
+	m_Snapshot = nullptr;
+	m_Trace = nullptr;
+	m_Symmetry = nullptr;
+	m_Kernel = NeighbourKernel::GetMethod(NeighbourKernel::GetBestLevel());
+
+	// A paged map is read as the search goes, and only ever gets sparse nodes
+	if (m_PagedMap != nullptr)
+	{
+		m_MapWidth = m_PagedMap->GetWidth();
+		m_MapHeight = m_PagedMap->GetHeight();
+		m_Layout = GridLayout(m_MapWidth, m_MapHeight);
+		m_Clearance = nullptr;
+		m_Backend = SparseState;
+		return;
+	}
+
 	// Parse the map
 	m_MapWidth = m_RawMap->getWidth();
 	m_MapHeight = m_RawMap->getHeight();
-	m_Map = new bool[m_MapWidth * m_MapHeight];
+	m_Layout = GridLayout(m_MapWidth, m_MapHeight);
+	m_Clearance = new unsigned char[m_Layout.GetSize()];
+	std::fill(m_Clearance, m_Clearance + m_Layout.GetSize(), 0);
 	std::string map = m_RawMap->toString();
-	for (int i = 0; i < m_MapWidth * m_MapHeight; i++)
+	// Go from the bottom right, so the cells right, below and diagonally below are done first
+	for (int y = m_MapHeight - 1; y >= 0; y--)
 	{
-		switch (map[i])
+		for (int x = m_MapWidth - 1; x >= 0; x--)
 		{
-		case '.':
-		case 'S':
-		case 'G':
-			m_Map[i] = true;
-			break;
-		default:
-			m_Map[i] = false;
+			char cell = map[y * m_MapWidth + x];
+			if (cell != '.' && cell != 'S' && cell != 'G')
+				continue;
+
+			int clearance = 1;
+			if (x + 1 < m_MapWidth && y + 1 < m_MapHeight)
+			{
+				clearance += min((int)m_Clearance[m_Layout.GetIndex(x + 1, y)],
+					min((int)m_Clearance[m_Layout.GetIndex(x, y + 1)], (int)m_Clearance[m_Layout.GetIndex(x + 1, y + 1)]));
+			}
+			m_Clearance[m_Layout.GetIndex(x, y)] = (unsigned char)min(clearance, 255);
 		}
 	}
+}
 
-	m_CurrentNode = nullptr;
-
-	// Create a pool of nodes
-	m_Nodes = new Node*[m_MapWidth * m_MapHeight];
+/// <summary>
+/// Creates the dense pool of nodes, laid out like the map.
+/// </summary>
+void AStar::CreatePool()
+{
+	m_Pool = new Node[m_Layout.GetSize()];
+	m_Nodes = new Node*[m_Layout.GetSize()];
+	std::fill(m_Nodes, m_Nodes + m_Layout.GetSize(), (Node*)nullptr);
 	for (int x = 0; x < m_MapWidth; x++)
+	{
 		for (int y = 0; y < m_MapHeight; y++)
-			m_Nodes[y * m_MapWidth + x] = new Node(x, y);
+		{
+			int index = m_Layout.GetIndex(x, y);
+			m_Pool[index].X = x;
+			m_Pool[index].Y = y;
+			m_Nodes[index] = &m_Pool[index];
+		}
+	}
+}
+
+/// <summary>
+/// Creates the dense pool now instead of in the first search that needs it, for callers that
+/// can't have one search take that long. A paged map never uses the pool, so it gets none.
+/// </summary>
+void AStar::ReserveDenseState()
+{
+	if (m_Pool == nullptr && m_PagedMap == nullptr)
+		CreatePool();
 }
 
 /// <summary>
@@ -149,9 +359,8 @@ void AStar::Initialize()
 /// </summary>
 AStar::~AStar()
 {
-	delete[] m_Map;
-	for (int i = 0; i < m_MapWidth * m_MapHeight; i++)
-		delete m_Nodes[i];
+	delete[] m_Clearance;
+	delete[] m_Pool;
 	delete[] m_Nodes;
 }
 
@@ -175,35 +384,229 @@ std::vector<Coordinate>* AStar::Path(Coordinate start, Coordinate goal)
 	return ReconstructPath(goalNode);
 }
 
+/// <summary>
+/// Finds a path to whichever of the goals is closest, in a single search.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goals">The goal coordinates.</param>
+/// <returns>A vector of coordinates that represents the path, ending at the nearest goal</returns>
+std::vector<Coordinate>* AStar::PathToNearest(Coordinate start, const std::vector<Coordinate>& goals)
+{
+	std::vector<Coordinate> walkableGoals;
+	for (size_t i = 0; i < goals.size(); i++)
+	{
+		if (IsWalkable(goals[i].X, goals[i].Y))
+			walkableGoals.push_back(goals[i]);
+	}
+	if (!IsWalkable(start.X, start.Y) || walkableGoals.empty())
+		return new std::vector<Coordinate>;
+
+	Prepare(start, walkableGoals);
+
+	Node* goalNode = nullptr;
+	while (goalNode == nullptr)
+		goalNode = Update();
+
+	return ReconstructPath(goalNode);
+}
+
+/// <summary>
+/// Finds a path with an anytime search, see <see cref="Anytime"/>. A first path comes quickly from a
+/// search weighted by 1 + epsilon, then the weight is lowered a step at a time and the search picks
+/// up where it left off to improve it, until it is optimal or time runs out.
+/// Without the anytime mode set this is just <see cref="Path"/>.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <param name="deadline">When to stop, even if no path has been found yet.</param>
+/// <param name="onSolution">Called with every path as soon as it is found.</param>
+/// <returns>The best path found by the deadline, empty if there was none</returns>
+std::vector<Coordinate>* AStar::PathAnytime(Coordinate start, Coordinate goal, std::chrono::steady_clock::time_point deadline, AnytimeCallback onSolution)
+{
+	if (m_Mode != Anytime)
+		return Path(start, goal);
+	if (!IsWalkable(start.X, start.Y) || !IsWalkable(goal.X, goal.Y))
+		return new std::vector<Coordinate>;
+
+	Prepare(start, goal);
+
+	std::vector<Coordinate>* best = new std::vector<Coordinate>;
+	for (;;)
+	{
+		// Reading the clock every step would cost about as much as the step
+		Node* goalNode = nullptr;
+		for (unsigned int step = 0; goalNode == nullptr; step++)
+		{
+			if ((step & 63) == 0 && std::chrono::steady_clock::now() >= deadline)
+				return best;
+			goalNode = Update();
+		}
+		if (!goalNode->Goal)
+			return best;
+
+		delete best;
+		best = ReconstructPath(goalNode);
+		if (onSolution)
+			onSolution(*best, GetSuboptimalityBound());
+		if (!Improve())
+			return best;
+	}
+}
+
 /// <summary>
 /// Prepares the pathfinder.
 /// </summary>
 /// <param name="start">The start coordinate.</param>
 /// <param name="goal">The goal coordinate.</param>
 void AStar::Prepare(Coordinate start, Coordinate goal)
+{
+	Prepare(start, std::vector<Coordinate>(1, goal));
+}
+
+/// <summary>
+/// Prepares the pathfinder for a search that ends at the first of several goals it reaches.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goals">The goal coordinates.</param>
+void AStar::Prepare(Coordinate start, const std::vector<Coordinate>& goals)
 {
 	m_CurrentNode = nullptr;
-	// Reset the pooled nodes
-	for (int i = 0; i < m_MapWidth * m_MapHeight; i++)
+#ifdef SEARCH_TRACE
+	if (m_Trace != nullptr)
+		m_Trace->BeginQuery(start, goals);
+#endif
+
+	// A search that stays close to its start only touches a corner of a big map,
+	// so don't pay for a node per cell. The estimate is in cells.
+	m_Sparse = (m_Backend == SparseState);
+	if (m_Backend == AutomaticState)
+	{
+		long long reach = 0;
+		for (size_t i = 0; i < goals.size(); i++)
+			reach = max(reach, (long long)max(abs(goals[i].X - start.X), abs(goals[i].Y - start.Y)));
+		m_Sparse = (2 * reach + 1) * (2 * reach + 1) * 16 < (long long)m_MapWidth * m_MapHeight;
+	}
+	if (m_PagedMap != nullptr)
+		m_PagedMap->BeginQuery();
+	if (m_Sparse)
+		m_SparseNodes.Clear();
+	else if (m_Pool == nullptr)
+		CreatePool();
+
+	// Start a new generation instead of resetting the whole pool up front,
+	// the pooled nodes are reset as the search touches them in GetNode
+	m_Generation++;
+	if (m_Generation == 0)
 	{
-		m_Nodes[i]->G = 0;
-		m_Nodes[i]->H = 0;
-		m_Nodes[i]->F = 0;
-		m_Nodes[i]->Open = false;
-		m_Nodes[i]->Closed = false;
-		m_Nodes[i]->Parent = nullptr;
+		// The counter wrapped around, so old stamps could look current again
+		for (int i = 0; m_Pool != nullptr && i < m_Layout.GetSize(); i++)
+			m_Pool[i].Generation = 0;
+		m_Generation = 1;
 	}
 	// Reset the open list
 	m_OpenList.clear();
+	m_FocalList.clear();
+	m_FocalBound = -1;
+	m_Incumbent = nullptr;
+	m_Inflation = m_Epsilon;
+	m_ClosedNodes.clear();
+	m_Inconsistent.clear();
+	m_ExpandedNodes = 0;
+
+	// Find the regions this search can skip
+	if (m_DeadEnds != nullptr && m_Snapshot == nullptr)
+		m_DeadEnds->Prepare(start, goals);
 
 	// Set up the initial nodes
+	m_GoalNodes.clear();
+	for (size_t i = 0; i < goals.size(); i++)
+	{
+		Node* goalNode = GetNode(goals[i].X, goals[i].Y);
+		goalNode->Goal = true;
+		m_GoalNodes.push_back(goalNode);
+	}
 	m_StartNode = GetNode(start.X, start.Y);
-	m_GoalNode = GetNode(goal.X, goal.Y);
-	m_StartNode->H = (*m_HeuristicMethod)(m_StartNode, m_GoalNode);
-	m_StartNode->F = m_StartNode->H;
-	m_StartNode->Open = true;
-	// Insert the first node into the open list and store the iterator
-	m_StartNode->Iterator = m_OpenList.insert(m_StartNode);
+	m_StartNode->H = Estimate(m_StartNode);
+	// Insert the first node into the open list, unless the snapshot already knows no goal can be reached
+	bool reachable = (m_Snapshot == nullptr);
+	for (size_t i = 0; i < goals.size() && !reachable; i++)
+		reachable = m_Snapshot->AreConnected(start.X, start.Y, goals[i].X, goals[i].Y);
+	if (reachable)
+		Push(m_StartNode, 0);
+	else
+		m_CurrentNode = m_StartNode;
+}
+
+/// <summary>
+/// Chooses how far from optimal the following searches may be. Stays in effect until changed.
+/// Every mode but <see cref="Optimal"/> returns a path at most (1 + epsilon) times the optimal length,
+/// as long as the heuristic is consistent like the built-in ones.
+/// </summary>
+/// <param name="mode">The search mode.</param>
+/// <param name="epsilon">The allowed suboptimality, ignored by <see cref="Optimal"/>.</param>
+void AStar::SetSearchMode(SearchMode mode, double epsilon)
+{
+	m_Mode = (epsilon > 0) ? mode : Optimal;
+	m_Epsilon = (m_Mode == Optimal) ? 0 : epsilon;
+}
+
+/// <summary>
+/// Starts the next round of the anytime search, once <see cref="Update"/> has returned the path of
+/// the current one. The weight goes down a step, and instead of starting over the search goes on
+/// with the open nodes and the closed nodes that got a better path, under the new weight.
+/// </summary>
+/// <returns>Whether there is a round left, false once the path is optimal</returns>
+bool AStar::Improve()
+{
+	if (m_Mode != Anytime || m_Inflation <= 0)
+		return false;
+
+	// No point in a round with a weight above the bound the path already has
+	double bound = GetSuboptimalityBound();
+	if (bound <= 1)
+		return false;
+	m_Inflation = max(min(m_Inflation - m_AnytimeStep, bound - 1), 0.0);
+	for (size_t i = 0; i < m_ClosedNodes.size(); i++)
+		m_ClosedNodes[i]->Closed = false;
+	m_ClosedNodes.clear();
+
+	// The F of every open node depends on the weight
+	m_Rekeyed.assign(m_OpenList.begin(), m_OpenList.end());
+	m_OpenList.clear();
+	for (size_t i = 0; i < m_Rekeyed.size(); i++)
+		Push(m_Rekeyed[i], m_Rekeyed[i]->G);
+	// A node can have been improved more than once
+	for (size_t i = 0; i < m_Inconsistent.size(); i++)
+	{
+		if (!m_Inconsistent[i]->Open)
+			Push(m_Inconsistent[i], m_Inconsistent[i]->G);
+	}
+	m_Inconsistent.clear();
+
+	return true;
+}
+
+/// <summary>
+/// Gets how much longer than optimal the path of the current anytime round can be at most, as a
+/// factor. This is often much tighter than the weight: no path can be shorter than the lowest
+/// unweighted F among the nodes that still have to be expanded.
+/// </summary>
+/// <returns>The bound, 1 for an optimal path</returns>
+double AStar::GetSuboptimalityBound() const
+{
+	Node* goal = GetReachedGoal();
+	if (m_Mode != Anytime || goal == nullptr || m_Inflation <= 0)
+		return 1;
+
+	int lowest = goal->G;
+	for (auto it = m_OpenList.begin(); it != m_OpenList.end(); ++it)
+		lowest = min(lowest, (*it)->G + (*it)->H);
+	for (size_t i = 0; i < m_Inconsistent.size(); i++)
+		lowest = min(lowest, m_Inconsistent[i]->G + m_Inconsistent[i]->H);
+
+	if (lowest <= 0)
+		return 1;
+	return min(1 + m_Inflation, (double)goal->G / lowest);
 }
 
 /// <summary>
@@ -212,23 +615,61 @@ void AStar::Prepare(Coordinate start, Coordinate goal)
 /// <returns></returns>
 AStar::Node* AStar::Update()
 {
+	// A round of the anytime search is over once no open node can lead to a better path than the
+	// one found, within the round's weight. The goal is never expanded, it stays open for the next.
+	if (m_Mode == Anytime)
+	{
+		Node* goal = GetReachedGoal();
+		if (goal != nullptr && (m_OpenList.empty() || (*m_OpenList.begin())->F >= goal->G))
+			return goal;
+	}
+
 	// If the open list is empty, we're done here.
 	if (m_OpenList.empty())
-		return m_CurrentNode;
+		return (m_Incumbent != nullptr) ? m_Incumbent : m_CurrentNode;
 
-	// Look for the lowest F cost node in the open list
-	auto it = m_OpenList.begin();
-	m_CurrentNode = *it;
-	m_OpenList.erase(it);
+	// Look for the next node to expand, the lowest F cost node unless the mode says otherwise
+	Node* next = SelectNode();
+	// The optimistic search has proven its path is good enough
+	if (next == nullptr)
+		return m_Incumbent;
+	m_CurrentNode = next;
+	Remove(m_CurrentNode);
 	// Put it in the "closed list"
-	m_CurrentNode->Open = false;
 	m_CurrentNode->Closed = true;
+	if (m_Mode == Anytime)
+		m_ClosedNodes.push_back(m_CurrentNode);
+	m_ExpandedNodes++;
+#ifdef SEARCH_TRACE
+	if (m_Trace != nullptr)
+		m_Trace->Record(SearchTrace::Expand, m_CurrentNode->X, m_CurrentNode->Y);
+#endif
 
 	// Check if we reached the goal yet
-	if (m_CurrentNode == m_GoalNode)
-		return m_CurrentNode;
+	if (m_CurrentNode->Goal)
+	{
+		if (m_Mode != Optimistic)
+			return m_CurrentNode;
+
+		// The optimistic search keeps going until its best path is proven, see SelectNode
+		if (m_Incumbent == nullptr || m_CurrentNode->G < m_Incumbent->G)
+			m_Incumbent = m_CurrentNode;
+		return nullptr;
+	}
+
+	// Have the tiles the frontier is about to run into read in the background
+	if (m_PagedMap != nullptr)
+		m_PagedMap->PrefetchNear(m_CurrentNode->X, m_CurrentNode->Y);
+
+	// Add neighboring nodes to the open list, stepping through the layout instead of the coordinates
+	int index = m_Layout.GetIndex(m_CurrentNode->X, m_CurrentNode->Y);
+	// A plain search has no macro edges, so the kernel does all there is
+	if (CanUseKernel())
+	{
+		RelaxNeighbours(index);
+		return nullptr;
+	}
 
-	// Add neighboring nodes to the open list
 	for (int y = -1; y <= 1; y++)
 	{
 		for (int x = -1; x <= 1; x++)
@@ -244,59 +685,180 @@ AStar::Node* AStar::Update()
 			if (neighbourX < 0 || neighbourX >= m_MapWidth || neighbourY < 0 || neighbourY >= m_MapHeight)
 				continue;
 
-			Node* neighbour = GetNode(neighbourX, neighbourY);
+			// Can this move start an optimal path to the goal at all? The bounds are only right for 1x1 agents
+			if (m_GoalBounds != nullptr && m_AgentSize == 1 && m_Snapshot == nullptr && !IsWithinBounds(m_CurrentNode, x, y))
+				continue;
 
-			// Is the node already present in the closed list?
-			if (neighbour->Closed)
+			// Is the coordinate walkable, with room for the whole agent?
+			int neighbourIndex = m_Layout.GetNeighbour(index, x, y);
+			if (!IsWalkableAt(neighbourIndex, neighbourX, neighbourY))
 				continue;
 
-			// Is the coordinate walkable?
-			if (!IsWalkable(neighbourX, neighbourY))
+			// Is it in a dead end?
+			if (m_DeadEnds != nullptr && m_Snapshot == nullptr && !m_DeadEnds->IsAllowed(neighbourX, neighbourY))
 				continue;
 
-			// Don't cut corners
+			Node* neighbour = GetNodeAt(neighbourIndex, neighbourX, neighbourY);
+
+			// Is it inside an empty rectangle? The macro edges below jump over those, only a goal is reached there
+			if (m_Symmetry != nullptr && m_AgentSize == 1 && m_Snapshot == nullptr && !neighbour->Goal && m_Symmetry->IsPruned(neighbourX, neighbourY))
+				continue;
+
+			// Is the node already present in the closed list? Focal and optimistic search
+			// reopen closed nodes that get a better path, their bound depends on it
+			if (neighbour->Closed && (m_Mode == Optimal || m_Mode == Weighted))
+				continue;
+
+			// Don't cut corners, both sides are on the map whenever the diagonal is.
+			// A bigger agent sweeps over both side squares, so they need its clearance too.
 			bool isDiagonal = abs(x) == abs(y);
 			if (isDiagonal 
-				&& (!IsWalkable(m_CurrentNode->X + x, m_CurrentNode->Y) 
-					|| !IsWalkable(m_CurrentNode->X, m_CurrentNode->Y + y)))
+				&& (!IsWalkableAt(m_Layout.GetNeighbour(index, x, 0), neighbourX, m_CurrentNode->Y) 
+					|| !IsWalkableAt(m_Layout.GetNeighbour(index, 0, y), m_CurrentNode->X, neighbourY)))
 				continue;
 
-			// Is the node not in the open list already?
-			if (!neighbour->Open)
-			{
-				// Put it in the open list
-				int g = m_CurrentNode->G + ((isDiagonal) ? 14 : 10);
-				int h = (*m_HeuristicMethod)(neighbour, m_GoalNode) * 10;
-				neighbour->G = g;
-				neighbour->H = h;
-				neighbour->F = g + h;
-				neighbour->Parent = m_CurrentNode;
-				neighbour->Open = true;
-				neighbour->Iterator = m_OpenList.insert(neighbour);
-			}
-			// Otherwise, check if this path to that node is better
-			else if (m_CurrentNode->G + ((isDiagonal) ? 14 : 10) < neighbour->G)
+			int g = m_CurrentNode->G + ((isDiagonal) ? 14 : 10);
+
+			Relax(neighbour, g);
+		}
+	}
+
+	// Jump across the empty rectangle the node is on, and straight to a goal inside it
+	if (m_Symmetry != nullptr && m_AgentSize == 1 && m_Snapshot == nullptr)
+	{
+		m_Symmetry->GetSuccessors(m_CurrentNode->X, m_CurrentNode->Y, m_MacroSuccessors);
+		for (size_t i = 0; i < m_GoalNodes.size(); i++)
+		{
+			Node* goal = m_GoalNodes[i];
+			if (m_Symmetry->IsSameRectangle(m_CurrentNode->X, m_CurrentNode->Y, goal->X, goal->Y))
 			{
-				// Remove the node from the priority queue
-				m_OpenList.erase(neighbour->Iterator);
-
-				// Update it
-				int g = m_CurrentNode->G + ((isDiagonal) ? 14 : 10);
-				int h = (*m_HeuristicMethod)(neighbour, m_GoalNode) * 10;
-				neighbour->G = g;
-				neighbour->H = h;
-				neighbour->F = g + h;
-				neighbour->Parent = m_CurrentNode;
-
-				// Insert the node again with an updated F-score
-				neighbour->Iterator = m_OpenList.insert(neighbour);
+				RectangleSymmetry::Successor successor = { goal->X, goal->Y, RectangleSymmetry::GetCost(goal->X - m_CurrentNode->X, goal->Y - m_CurrentNode->Y) };
+				m_MacroSuccessors.push_back(successor);
 			}
 		}
+
+		for (size_t i = 0; i < m_MacroSuccessors.size(); i++)
+		{
+			const RectangleSymmetry::Successor& successor = m_MacroSuccessors[i];
+			if (m_DeadEnds != nullptr && !m_DeadEnds->IsAllowed(successor.X, successor.Y))
+				continue;
+			Node* neighbour = GetNode(successor.X, successor.Y);
+			if (neighbour->Closed && (m_Mode == Optimal || m_Mode == Weighted))
+				continue;
+			Relax(neighbour, m_CurrentNode->G + successor.Cost);
+		}
 	}
 
 	return nullptr;
 }
 
+/// <summary>
+/// Determines whether the neighbours of the current node can go through the kernel. It only
+/// knows the plain search: a 1x1 agent on the dense nodes of the map itself, no pruning, and
+/// closed nodes that stay closed.
+/// </summary>
+/// <returns></returns>
+bool AStar::CanUseKernel() const
+{
+	return m_Kernel != nullptr && !m_Sparse && m_Clearance != nullptr && m_AgentSize == 1 && m_Snapshot == nullptr
+		&& m_GoalBounds == nullptr && m_DeadEnds == nullptr && m_Symmetry == nullptr && (m_Mode == Optimal || m_Mode == Weighted);
+}
+
+/// <summary>
+/// Relaxes the neighbours of the current node with the kernel. Gathering what the kernel needs
+/// reads each neighbour once without a branch on it, and only the neighbours it says improved
+/// are relaxed, in the same order as the check by check loop so the paths are the same.
+/// </summary>
+/// <param name="index">The storage index of the current node.</param>
+void AStar::RelaxNeighbours(int index)
+{
+	int x = m_CurrentNode->X;
+	int y = m_CurrentNode->Y;
+	int neighbourIndex[8];
+	int neighbourG[8];
+	unsigned int walkable = 0;
+	for (int slot = 0; slot < 8; slot++)
+	{
+		// A neighbour off the map reads the current node instead, and is not walkable
+		bool onMap = (unsigned int)(x + NeighbourKernel::SlotX[slot]) < (unsigned int)m_MapWidth
+			&& (unsigned int)(y + NeighbourKernel::SlotY[slot]) < (unsigned int)m_MapHeight;
+		neighbourIndex[slot] = onMap ? m_Layout.GetNeighbour(index, NeighbourKernel::SlotX[slot], NeighbourKernel::SlotY[slot]) : index;
+		walkable |= (unsigned int)(onMap && m_Clearance[neighbourIndex[slot]] != 0) << slot;
+
+		// A node of an earlier search has no path yet, a closed one is never improved
+		const Node& neighbour = m_Pool[neighbourIndex[slot]];
+		int g = neighbour.Open ? neighbour.G : (neighbour.Closed ? 0 : INT_MAX);
+		neighbourG[slot] = (neighbour.Generation == m_Generation) ? g : INT_MAX;
+	}
+
+	unsigned int improved = m_Kernel(m_CurrentNode->G, neighbourG, walkable);
+	while (improved != 0)
+	{
+		int slot = NeighbourKernel::GetLowestSlot(improved);
+		improved &= improved - 1;
+		Node* neighbour = GetNodeAt(neighbourIndex[slot], x + NeighbourKernel::SlotX[slot], y + NeighbourKernel::SlotY[slot]);
+		Relax(neighbour, m_CurrentNode->G + NeighbourKernel::SlotCost[slot]);
+	}
+}
+
+/// <summary>
+/// Offers a node a path through the current node, opening or reopening it if the path is better.
+/// </summary>
+/// <param name="neighbour">The node.</param>
+/// <param name="g">The cost of the path.</param>
+void AStar::Relax(Node* neighbour, int g)
+{
+	// Reopen a closed node only if this path to it is better
+#ifdef SEARCH_TRACE
+	bool reopened = neighbour->Closed;
+#endif
+	if (neighbour->Closed)
+	{
+		if (g >= neighbour->G)
+			return;
+
+		// The anytime search doesn't reopen nodes within a round, it keeps them for the next one
+		if (m_Mode == Anytime)
+		{
+			neighbour->G = g;
+			neighbour->Parent = m_CurrentNode;
+			m_Inconsistent.push_back(neighbour);
+			return;
+		}
+		neighbour->Closed = false;
+	}
+
+	// Is the node not in the open list already?
+	if (!neighbour->Open)
+	{
+		// A node the anytime search closed in an earlier round is in neither list, but keeps its path
+		if (m_Mode == Anytime && (neighbour->Parent != nullptr || neighbour == m_StartNode) && g >= neighbour->G)
+			return;
+#ifdef SEARCH_TRACE
+		if (m_Trace != nullptr)
+			m_Trace->Record(reopened ? SearchTrace::Reopen : SearchTrace::Generate, neighbour->X, neighbour->Y);
+#endif
+		// Put it in the open list
+		neighbour->H = Estimate(neighbour);
+		neighbour->Parent = m_CurrentNode;
+		Push(neighbour, g);
+	}
+	// Otherwise, check if this path to that node is better
+	else if (g < neighbour->G)
+	{
+#ifdef SEARCH_TRACE
+		if (m_Trace != nullptr)
+			m_Trace->Record(SearchTrace::Improve, neighbour->X, neighbour->Y);
+#endif
+		// Remove the node from the priority queue
+		Remove(neighbour);
+
+		// Insert the node again with an updated F-score
+		neighbour->Parent = m_CurrentNode;
+		Push(neighbour, g);
+	}
+}
+
 /// <summary>
 /// Reconstructs the path by following the parents back up.
 /// </summary>
@@ -307,14 +869,25 @@ std::vector<Coordinate>* AStar::ReconstructPath(Node* finalNode)
 	std::vector<Coordinate>* pathCoordinates = new std::vector<Coordinate>;
 
 	// If a path wasn't found
-	if (finalNode != m_GoalNode)
+	if (finalNode == nullptr || !finalNode->Goal)
 		return pathCoordinates;
 
 	// Reconstruct the path
 	while (finalNode != nullptr)
 	{
 		pathCoordinates->push_back(Coordinate(finalNode->X, finalNode->Y));
-		finalNode = finalNode->Parent;
+
+		// A macro edge crosses an empty rectangle, so fill in its cells diagonally first
+		Node* parent = finalNode->Parent;
+		int x = finalNode->X;
+		int y = finalNode->Y;
+		while (parent != nullptr && max(abs(parent->X - x), abs(parent->Y - y)) > 1)
+		{
+			x += (parent->X > x) - (parent->X < x);
+			y += (parent->Y > y) - (parent->Y < y);
+			pathCoordinates->push_back(Coordinate(x, y));
+		}
+		finalNode = parent;
 	}
 	// Reverse the vector so the start is at the beginning
 	std::reverse(pathCoordinates->begin(), pathCoordinates->end());
@@ -323,19 +896,226 @@ std::vector<Coordinate>* AStar::ReconstructPath(Node* finalNode)
 }
 
 /// <summary>
-/// Gets the node that corresponds to the X and Y coordinates.
+/// Gets the node that corresponds to the X and Y coordinates,
+/// resetting it first if it was last touched by a previous search.
 /// </summary>
 /// <param name="x">The x-coordinate.</param>
 /// <param name="y">The y-coordinate.</param>
 /// <returns>A node</returns>
 AStar::Node* AStar::GetNode(int x, int y)
 {
-	int index = y * m_MapWidth + x;
-	Node* node = m_Nodes[index];
+	return GetNodeAt(m_Layout.GetIndex(x, y), x, y);
+}
+
+/// <summary>
+/// Gets the node at a storage index of the layout, resetting it like <see cref="GetNode"/>.
+/// </summary>
+/// <param name="index">The storage index.</param>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>A node</returns>
+AStar::Node* AStar::GetNodeAt(int index, int x, int y)
+{
+	Node* node;
+	if (m_Sparse)
+	{
+		bool created;
+		node = m_SparseNodes.Get(index, created);
+		if (created)
+		{
+			node->X = x;
+			node->Y = y;
+		}
+	}
+	else
+	{
+		if (m_Pool == nullptr)
+			CreatePool();
+		node = &m_Pool[index];
+	}
+
+	if (node->Generation != m_Generation)
+	{
+		node->G = 0;
+		node->H = 0;
+		node->F = 0;
+		node->Open = false;
+		node->Closed = false;
+		node->Priority = 0;
+		node->Goal = false;
+		node->InFocal = false;
+		node->Parent = nullptr;
+		node->Generation = m_Generation;
+	}
 
 	return node;
 }
 
+/// <summary>
+/// Estimates the cost from a node to the nearest goal. The smallest of several admissible
+/// estimates is still admissible, so searching for many goals at once stays optimal.
+/// </summary>
+/// <param name="node">The node.</param>
+/// <returns>The estimate, scaled like G</returns>
+int AStar::Estimate(Node* node)
+{
+	int best = INT_MAX;
+	for (size_t i = 0; i < m_GoalNodes.size(); i++)
+	{
+		int h = (*m_HeuristicMethod)(node, m_GoalNodes[i]) * 10;
+		if (h < best)
+			best = h;
+	}
+
+	return best;
+}
+
+/// <summary>
+/// Picks the node to expand next.
+/// </summary>
+/// <returns>The node, or nullptr once the optimistic search has proven its path</returns>
+AStar::Node* AStar::SelectNode()
+{
+	int lowestF = (*m_OpenList.begin())->F;
+
+	if (m_Mode == Focal)
+	{
+		// The lowest F never drops with a consistent heuristic, so the bound only grows
+		// and the nodes that come within it form one run of the open list
+		int bound = (int)(lowestF * (1 + m_Epsilon));
+		if (bound > m_FocalBound)
+		{
+			Node probe;
+			probe.F = m_FocalBound + 1;
+			for (auto it = m_OpenList.lower_bound(&probe); it != m_OpenList.end() && (*it)->F <= bound; ++it)
+			{
+				if (!(*it)->InFocal)
+				{
+					(*it)->InFocal = true;
+					(*it)->FocalIterator = m_FocalList.insert(*it);
+				}
+			}
+			m_FocalBound = bound;
+		}
+
+		return *m_FocalList.begin();
+	}
+
+	if (m_Mode == Optimistic)
+	{
+		// Greedy phase, until the first path is found
+		if (m_Incumbent == nullptr)
+			return *m_FocalList.begin();
+
+		// Cleanup phase, raise the lower bound on the optimal cost until the path is proven
+		if (m_Incumbent->G <= lowestF * (1 + m_Epsilon))
+			return nullptr;
+	}
+
+	return *m_OpenList.begin();
+}
+
+/// <summary>
+/// Gives a node a new cost and puts it in the open list, and in the focal list if it belongs there.
+/// The node's H must be up to date.
+/// </summary>
+/// <param name="node">The node.</param>
+/// <param name="g">The new cost from the start.</param>
+void AStar::Push(Node* node, int g)
+{
+	node->G = g;
+	if (m_Mode == Weighted)
+		node->F = g + (int)(node->H * (1 + m_Epsilon));
+	else if (m_Mode == Anytime)
+		node->F = g + (int)(node->H * (1 + m_Inflation));
+	else
+		node->F = g + node->H;
+	node->Open = true;
+	node->Iterator = m_OpenList.insert(node);
+
+	if (m_Mode == Focal)
+	{
+		// Within the bound the node closest to the goal goes first
+		node->Priority = node->H;
+		if (node->F <= m_FocalBound)
+		{
+			node->InFocal = true;
+			node->FocalIterator = m_FocalList.insert(node);
+		}
+	}
+	else if (m_Mode == Optimistic)
+	{
+		// Every open node is in the focal list, ordered by the aggressive weight
+		node->Priority = g + (int)(node->H * (1 + 2 * m_Epsilon));
+		node->InFocal = true;
+		node->FocalIterator = m_FocalList.insert(node);
+	}
+}
+
+/// <summary>
+/// Takes a node out of the open and focal lists.
+/// </summary>
+/// <param name="node">The node.</param>
+void AStar::Remove(Node* node)
+{
+	m_OpenList.erase(node->Iterator);
+	node->Open = false;
+	if (node->InFocal)
+	{
+		m_FocalList.erase(node->FocalIterator);
+		node->InFocal = false;
+	}
+}
+
+/// <summary>
+/// Determines whether a move can start an optimal path to any of the goals, according to the goal bounds.
+/// </summary>
+/// <param name="node">The node the move starts at.</param>
+/// <param name="dx">The x-offset of the move.</param>
+/// <param name="dy">The y-offset of the move.</param>
+/// <returns></returns>
+bool AStar::IsWithinBounds(Node* node, int dx, int dy)
+{
+	int direction = GoalBounds::GetDirection(dx, dy);
+	for (size_t i = 0; i < m_GoalNodes.size(); i++)
+	{
+		if (m_GoalBounds->Allows(node->X, node->Y, direction, m_GoalNodes[i]->X, m_GoalNodes[i]->Y))
+			return true;
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Gets the goal with the shortest path found so far.
+/// </summary>
+/// <returns>The goal, or nullptr if none has been reached yet</returns>
+AStar::Node* AStar::GetReachedGoal() const
+{
+	Node* best = nullptr;
+	for (size_t i = 0; i < m_GoalNodes.size(); i++)
+	{
+		Node* goal = m_GoalNodes[i];
+		if ((goal->Open || goal->Closed) && (best == nullptr || goal->G < best->G))
+			best = goal;
+	}
+
+	return best;
+}
+
+/// <summary>
+/// Gets the memory held for search nodes, by the dense pool and the sparse table together.
+/// </summary>
+/// <returns>The number of bytes</returns>
+size_t AStar::GetStateMemoryUsage() const
+{
+	size_t memory = m_SparseNodes.GetMemoryUsage();
+	if (m_Pool != nullptr)
+		memory += (size_t)m_Layout.GetSize() * (sizeof(Node) + sizeof(Node*));
+
+	return memory;
+}
+
 /// <summary>
 /// Determines whether the specified coordinate is walkable on the map.
 /// </summary>
@@ -347,7 +1127,56 @@ bool AStar::IsWalkable(int x, int y)
 	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
 		return false;
 
-	return m_Map[y * m_MapWidth + x];
+	return IsWalkableAt(m_Layout.GetIndex(x, y), x, y);
+}
+
+/// <summary>
+/// Determines whether a cell on the map is walkable, by its storage index or, for a paged map, its coordinates.
+/// </summary>
+/// <param name="index">The storage index.</param>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+inline bool AStar::IsWalkableAt(int index, int x, int y)
+{
+	if (m_Snapshot != nullptr)
+		return (m_AgentSize == 1) ? m_Snapshot->IsWalkable(x, y) : GetClearance(x, y) >= m_AgentSize;
+	if (m_Clearance == nullptr)
+		return (m_AgentSize == 1) ? m_PagedMap->IsWalkable(x, y) : GetClearance(x, y) >= m_AgentSize;
+
+	return m_Clearance[index] >= m_AgentSize;
+}
+
+/// <summary>
+/// Gets the side of the largest open square with its top left corner at a cell.
+/// A paged map or a snapshot has no stored clearance, so it is measured there, up to the agent size.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>The clearance, zero for a blocked cell</returns>
+int AStar::GetClearance(int x, int y)
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return 0;
+	if (m_Clearance != nullptr && m_Snapshot == nullptr)
+		return m_Clearance[m_Layout.GetIndex(x, y)];
+
+	// Grow the square one row and column at a time until something blocks it
+	int clearance = 0;
+	while (clearance < m_AgentSize)
+	{
+		for (int i = 0; i <= clearance; i++)
+		{
+			bool open = (m_Snapshot != nullptr)
+				? m_Snapshot->IsWalkable(x + clearance, y + i) && m_Snapshot->IsWalkable(x + i, y + clearance)
+				: m_PagedMap->IsWalkable(x + clearance, y + i) && m_PagedMap->IsWalkable(x + i, y + clearance);
+			if (!open)
+				return clearance;
+		}
+		clearance++;
+	}
+
+	return clearance;
 }
 
 #endif
\ No newline at end of file
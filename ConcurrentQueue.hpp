@@ -0,0 +1,152 @@
+#ifndef CONCURRENTQUEUE_HPP
+#define CONCURRENTQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/// <summary>
+/// Bounded lock-free multi-producer multi-consumer queue.
+/// Every cell carries a sequence number that tells producers and consumers whose turn it
+/// is, so the only contended operation is a single compare-and-swap on either end.
+/// </summary>
+template <typename T>
+class ConcurrentQueue
+{
+public:
+	ConcurrentQueue(size_t capacity);
+	~ConcurrentQueue();
+
+	bool TryPush(const T& data);
+	bool TryPop(T& data);
+	size_t GetCapacity() const { return m_Mask + 1; }
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> Sequence;
+		T Data;
+	};
+
+	// Keep the two ends on separate cache lines so producers and consumers don't fight over them
+	char m_Padding0[64];
+	Cell* m_Buffer;
+	size_t m_Mask;
+	char m_Padding1[64];
+	std::atomic<size_t> m_EnqueuePosition;
+	char m_Padding2[64];
+	std::atomic<size_t> m_DequeuePosition;
+	char m_Padding3[64];
+
+	ConcurrentQueue(const ConcurrentQueue&);
+	ConcurrentQueue& operator=(const ConcurrentQueue&);
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="ConcurrentQueue"/> class.
+/// </summary>
+/// <param name="capacity">The capacity, rounded up to a power of two.</param>
+template <typename T>
+ConcurrentQueue<T>::ConcurrentQueue(size_t capacity)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size *= 2;
+
+	m_Buffer = new Cell[size];
+	m_Mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		m_Buffer[i].Sequence.store(i, std::memory_order_relaxed);
+	m_EnqueuePosition.store(0, std::memory_order_relaxed);
+	m_DequeuePosition.store(0, std::memory_order_relaxed);
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="ConcurrentQueue"/> class.
+/// </summary>
+template <typename T>
+ConcurrentQueue<T>::~ConcurrentQueue()
+{
+	delete[] m_Buffer;
+}
+
+/// <summary>
+/// Adds an element to the back of the queue.
+/// </summary>
+/// <param name="data">The element.</param>
+/// <returns>False if the queue is full</returns>
+template <typename T>
+bool ConcurrentQueue<T>::TryPush(const T& data)
+{
+	Cell* cell;
+	size_t position = m_EnqueuePosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		cell = &m_Buffer[position & m_Mask];
+		size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+		// The cell is free for this lap, try to claim it
+		if (difference == 0)
+		{
+			if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		// The cell still holds an element from the previous lap
+		else if (difference < 0)
+		{
+			return false;
+		}
+		// Another producer got here first
+		else
+		{
+			position = m_EnqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	cell->Data = data;
+	cell->Sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+/// <summary>
+/// Removes the element at the front of the queue.
+/// </summary>
+/// <param name="data">Receives the element.</param>
+/// <returns>False if the queue is empty</returns>
+template <typename T>
+bool ConcurrentQueue<T>::TryPop(T& data)
+{
+	Cell* cell;
+	size_t position = m_DequeuePosition.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		cell = &m_Buffer[position & m_Mask];
+		size_t sequence = cell->Sequence.load(std::memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+		// The cell holds an element for this lap, try to claim it
+		if (difference == 0)
+		{
+			if (m_DequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				break;
+		}
+		// Nothing has been written here yet
+		else if (difference < 0)
+		{
+			return false;
+		}
+		// Another consumer got here first
+		else
+		{
+			position = m_DequeuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	data = cell->Data;
+	// Hand the cell over to the producers of the next lap
+	cell->Sequence.store(position + m_Mask + 1, std::memory_order_release);
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,693 @@
+#ifndef CONTRACTIONHIERARCHY_HPP
+#define CONTRACTIONHIERARCHY_HPP
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Contraction hierarchy over the grid graph, for answering many distance and path queries fast.
+/// Every walkable cell is a node and every move without corner cutting an edge, with the same 10/14
+/// costs as <see cref="AStar"/>. Building contracts the nodes one at a time, least important first by
+/// edge difference, adding a shortcut between two neighbours whenever the path through the contracted
+/// node is the only shortest one. A query then only has to go up the hierarchy from both ends, with
+/// a Dijkstra each way that stops at nodes that are provably reached shorter from above.
+/// Moves are symmetric, so one set of upward edges serves both directions. They are kept in one
+/// flat array with an offset per node.
+/// </summary>
+class ContractionHierarchy
+{
+public:
+	/// <summary>
+	/// An edge to a node higher up. A shortcut stands for the two edges through the node it skips.
+	/// </summary>
+	struct Edge
+	{
+		int To;
+		int Cost;
+		// The node the shortcut skips, -1 for a move between neighbouring cells
+		int Middle;
+	};
+
+	ContractionHierarchy(DV1419Map* map);
+
+	void Build();
+	bool Save(const char* filename) const;
+	bool Load(const char* filename);
+	int GetDistance(Coordinate start, Coordinate goal);
+	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+
+	int GetNodeCount() const { return (int)m_CellOf.size(); }
+	int GetEdgeCount() const { return (int)m_Edges.size(); }
+	int GetShortcutCount() const;
+	size_t GetMemoryUsage() const;
+
+	// What the last query did
+	unsigned int m_SettledNodes;
+	unsigned int m_StalledNodes;
+
+private:
+	/// <summary>
+	/// The start of a hierarchy file, followed by the cell and rank of every node, the edge offsets and the edges.
+	/// </summary>
+	struct Header
+	{
+		char Magic[4];
+		unsigned int Version;
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int NodeCount;
+		unsigned int EdgeCount;
+	};
+
+	typedef std::pair<int, int> QueueEntry;
+	typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > Queue;
+	typedef std::vector<std::vector<Edge> > Graph;
+
+	bool IsLegalMove(int x, int y, int direction) const;
+	int Contract(Graph& graph, int node, bool simulate, int settleLimit);
+	void WitnessSearch(const Graph& graph, int source, int skip, int maxCost, int settleLimit);
+	void AddEdge(Graph& graph, int from, int to, int cost, int middle) const;
+	int Search(int start, int goal);
+	const Edge* FindEdge(int from, int to) const;
+	void Unpack(int from, int to, std::vector<Coordinate>& path) const;
+	Coordinate GetCoordinate(int node) const { return Coordinate(m_CellOf[node] % m_MapWidth, m_CellOf[node] / m_MapWidth); }
+
+	static const int DirectionX[8];
+	static const int DirectionY[8];
+	static const int DirectionCost[8];
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	// The node of every cell, -1 for blocked cells, and the cell of every node
+	std::vector<int> m_NodeOf;
+	std::vector<int> m_CellOf;
+	std::vector<int> m_Rank;
+	// The upward edges of node i are m_Edges[m_FirstEdge[i]] up to m_Edges[m_FirstEdge[i + 1]]
+	std::vector<int> m_FirstEdge;
+	std::vector<Edge> m_Edges;
+
+	// Witness search state while building
+	std::vector<int> m_WitnessDistance;
+	std::vector<int> m_WitnessTouched;
+
+	// Query state, one of each per direction, kept between queries so only the touched entries need a reset
+	std::vector<int> m_Distance[2];
+	std::vector<int> m_Parent[2];
+	std::vector<int> m_Touched[2];
+	int m_Meeting;
+};
+
+// Directions go around the compass so that the opposite of d is (d + 4) % 8
+const int ContractionHierarchy::DirectionX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int ContractionHierarchy::DirectionY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const int ContractionHierarchy::DirectionCost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+/// <summary>
+/// Initializes a new instance of the <see cref="ContractionHierarchy"/> class. The hierarchy is empty until it is built or loaded.
+/// </summary>
+/// <param name="map">The map.</param>
+ContractionHierarchy::ContractionHierarchy(DV1419Map* map)
+	: m_SettledNodes(0), m_StalledNodes(0), m_Meeting(-1)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	m_NodeOf.assign(m_MapWidth * m_MapHeight, -1);
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			int cell = y * m_MapWidth + x;
+			m_Map[cell] = map->isWalkable(x, y);
+			if (m_Map[cell])
+			{
+				m_NodeOf[cell] = (int)m_CellOf.size();
+				m_CellOf.push_back(cell);
+			}
+		}
+	}
+
+	m_FirstEdge.assign(m_CellOf.size() + 1, 0);
+	m_Rank.assign(m_CellOf.size(), 0);
+	for (int direction = 0; direction < 2; direction++)
+	{
+		m_Distance[direction].assign(m_CellOf.size(), INT_MAX);
+		m_Parent[direction].assign(m_CellOf.size(), -1);
+	}
+}
+
+/// <summary>
+/// Orders and contracts every node. A node's priority is twice its edge difference, the shortcuts its
+/// contraction would add minus the edges it would remove, plus how many of its neighbours are
+/// contracted already and how deep in the hierarchy it would end up, so the contraction spreads
+/// evenly over the map and the hierarchy stays shallow. Priorities are brought up to
+/// date for the neighbours of every contracted node, and checked again before a node is contracted.
+/// </summary>
+void ContractionHierarchy::Build()
+{
+	int nodeCount = (int)m_CellOf.size();
+	Graph graph(nodeCount);
+	for (int node = 0; node < nodeCount; node++)
+	{
+		int x = m_CellOf[node] % m_MapWidth;
+		int y = m_CellOf[node] / m_MapWidth;
+		for (int direction = 0; direction < 8; direction++)
+		{
+			if (IsLegalMove(x, y, direction))
+			{
+				Edge edge = { m_NodeOf[(y + DirectionY[direction]) * m_MapWidth + x + DirectionX[direction]], DirectionCost[direction], -1 };
+				graph[node].push_back(edge);
+			}
+		}
+	}
+	m_WitnessDistance.assign(nodeCount, INT_MAX);
+
+	// Witness searches only look this far, a witness they miss costs an unneeded shortcut, never a wrong path
+	const int simulateLimit = 40;
+	const int contractLimit = 400;
+	std::vector<int> contractedNeighbours(nodeCount, 0);
+	std::vector<int> level(nodeCount, 0);
+	std::vector<int> priority(nodeCount);
+	std::vector<bool> contracted(nodeCount, false);
+	Queue queue;
+	for (int node = 0; node < nodeCount; node++)
+	{
+		priority[node] = 2 * (Contract(graph, node, true, simulateLimit) - (int)graph[node].size());
+		queue.push(QueueEntry(priority[node], node));
+	}
+
+	Graph upward(nodeCount);
+	int rank = 0;
+	while (!queue.empty())
+	{
+		int node = queue.top().second;
+		int key = queue.top().first;
+		queue.pop();
+		if (contracted[node] || key != priority[node])
+			continue;
+
+		// Lazy update, the priority may have gone up since it was queued
+		priority[node] = 2 * (Contract(graph, node, true, simulateLimit) - (int)graph[node].size()) + contractedNeighbours[node] + level[node];
+		if (!queue.empty() && priority[node] > queue.top().first)
+		{
+			queue.push(QueueEntry(priority[node], node));
+			continue;
+		}
+
+		Contract(graph, node, false, contractLimit);
+		contracted[node] = true;
+		m_Rank[node] = rank++;
+
+		// Whatever is left around the node is above it, those are its upward edges
+		upward[node].swap(graph[node]);
+		for (size_t i = 0; i < upward[node].size(); i++)
+		{
+			int neighbour = upward[node][i].To;
+			std::vector<Edge>& edges = graph[neighbour];
+			for (size_t j = 0; j < edges.size(); j++)
+			{
+				if (edges[j].To == node)
+				{
+					edges[j] = edges.back();
+					edges.pop_back();
+					break;
+				}
+			}
+
+			contractedNeighbours[neighbour]++;
+			level[neighbour] = max(level[neighbour], level[node] + 1);
+			priority[neighbour] = 2 * (Contract(graph, neighbour, true, simulateLimit) - (int)graph[neighbour].size()) + contractedNeighbours[neighbour] + level[neighbour];
+			queue.push(QueueEntry(priority[neighbour], neighbour));
+		}
+	}
+
+	m_FirstEdge.assign(nodeCount + 1, 0);
+	m_Edges.clear();
+	for (int node = 0; node < nodeCount; node++)
+	{
+		m_FirstEdge[node] = (int)m_Edges.size();
+		m_Edges.insert(m_Edges.end(), upward[node].begin(), upward[node].end());
+		std::vector<Edge>().swap(upward[node]);
+	}
+	m_FirstEdge[nodeCount] = (int)m_Edges.size();
+	std::vector<int>().swap(m_WitnessDistance);
+	std::vector<int>().swap(m_WitnessTouched);
+}
+
+/// <summary>
+/// Writes the hierarchy to a file, so it doesn't have to be built at every startup.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file couldn't be written</returns>
+bool ContractionHierarchy::Save(const char* filename) const
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	Header header;
+	memcpy(header.Magic, "CHGR", 4);
+	header.Version = 1;
+	header.Width = m_MapWidth;
+	header.Height = m_MapHeight;
+	header.NodeCount = (unsigned int)m_CellOf.size();
+	header.EdgeCount = (unsigned int)m_Edges.size();
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&m_CellOf[0], sizeof(int), m_CellOf.size(), file) == m_CellOf.size()
+		&& fwrite(&m_Rank[0], sizeof(int), m_Rank.size(), file) == m_Rank.size()
+		&& fwrite(&m_FirstEdge[0], sizeof(int), m_FirstEdge.size(), file) == m_FirstEdge.size()
+		&& (m_Edges.empty() || fwrite(&m_Edges[0], sizeof(Edge), m_Edges.size(), file) == m_Edges.size());
+
+	return (fclose(file) == 0) && written;
+}
+
+/// <summary>
+/// Reads a hierarchy written by <see cref="Save"/>.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file is missing, malformed or was built for another map</returns>
+bool ContractionHierarchy::Load(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+		return false;
+
+	Header header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.Magic, "CHGR", 4) == 0 && header.Version == 1
+		&& (int)header.Width == m_MapWidth && (int)header.Height == m_MapHeight && header.NodeCount == m_CellOf.size();
+	std::vector<int> cellOf, rank, firstEdge;
+	std::vector<Edge> edges;
+	if (valid)
+	{
+		cellOf.resize(header.NodeCount);
+		rank.resize(header.NodeCount);
+		firstEdge.resize(header.NodeCount + 1);
+		edges.resize(header.EdgeCount);
+		valid = (header.NodeCount == 0 || (fread(&cellOf[0], sizeof(int), cellOf.size(), file) == cellOf.size()
+			&& fread(&rank[0], sizeof(int), rank.size(), file) == rank.size()))
+			&& fread(&firstEdge[0], sizeof(int), firstEdge.size(), file) == firstEdge.size()
+			&& (edges.empty() || fread(&edges[0], sizeof(Edge), edges.size(), file) == edges.size());
+	}
+	fclose(file);
+
+	// The nodes have to be the walkable cells of this map, ranked in some order, with their edges in order
+	int nodeCount = (int)cellOf.size();
+	valid = valid && cellOf == m_CellOf && firstEdge[0] == 0 && firstEdge.back() == (int)edges.size();
+	std::vector<bool> ranked(nodeCount, false);
+	for (int node = 0; valid && node < nodeCount; node++)
+	{
+		valid = rank[node] >= 0 && rank[node] < nodeCount && !ranked[rank[node]] && firstEdge[node] <= firstEdge[node + 1];
+		if (valid)
+			ranked[rank[node]] = true;
+	}
+
+	// Every edge goes up, and a shortcut skips a node below both its ends so unpacking it ends.
+	// An edge without a middle node is a move to a neighbouring cell.
+	for (int node = 0; valid && node < nodeCount; node++)
+	{
+		for (int i = firstEdge[node]; valid && i < firstEdge[node + 1]; i++)
+		{
+			const Edge& edge = edges[i];
+			valid = edge.To >= 0 && edge.To < nodeCount && rank[edge.To] > rank[node] && edge.Cost > 0;
+			if (valid && edge.Middle == -1)
+			{
+				int dx = abs(cellOf[edge.To] % m_MapWidth - cellOf[node] % m_MapWidth);
+				int dy = abs(cellOf[edge.To] / m_MapWidth - cellOf[node] / m_MapWidth);
+				valid = max(dx, dy) == 1 && edge.Cost == ((dx == dy) ? 14 : 10);
+			}
+			else if (valid)
+			{
+				valid = edge.Middle >= 0 && edge.Middle < nodeCount && rank[edge.Middle] < rank[node];
+			}
+		}
+	}
+	if (!valid)
+		return false;
+
+	m_Rank.swap(rank);
+	m_FirstEdge.swap(firstEdge);
+	m_Edges.swap(edges);
+
+	// A shortcut stands for the two edges through its middle node, so those have to be there
+	for (int node = 0; valid && node < nodeCount; node++)
+	{
+		for (int i = m_FirstEdge[node]; valid && i < m_FirstEdge[node + 1]; i++)
+		{
+			const Edge& edge = m_Edges[i];
+			if (edge.Middle < 0)
+				continue;
+			const Edge* first = FindEdge(edge.Middle, node);
+			const Edge* second = FindEdge(edge.Middle, edge.To);
+			valid = first != nullptr && second != nullptr && first->Cost + second->Cost == edge.Cost;
+		}
+	}
+	if (!valid)
+	{
+		m_Rank.swap(rank);
+		m_FirstEdge.swap(firstEdge);
+		m_Edges.swap(edges);
+	}
+
+	return valid;
+}
+
+/// <summary>
+/// Gets the cost of the shortest path, without working out the path itself.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>The cost in the 10/14 units of the searches, -1 if there is no path</returns>
+int ContractionHierarchy::GetDistance(Coordinate start, Coordinate goal)
+{
+	int startNode = m_NodeOf[start.Y * m_MapWidth + start.X];
+	int goalNode = m_NodeOf[goal.Y * m_MapWidth + goal.X];
+	if (startNode < 0 || goalNode < 0)
+		return -1;
+
+	int distance = Search(startNode, goalNode);
+	return (distance == INT_MAX) ? -1 : distance;
+}
+
+/// <summary>
+/// Finds a path, unpacking the shortcuts back into cells.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>A vector of coordinates that represents the path, empty if there is none</returns>
+std::vector<Coordinate>* ContractionHierarchy::Path(Coordinate start, Coordinate goal)
+{
+	std::vector<Coordinate>* path = new std::vector<Coordinate>;
+	int startNode = m_NodeOf[start.Y * m_MapWidth + start.X];
+	int goalNode = m_NodeOf[goal.Y * m_MapWidth + goal.X];
+	if (startNode < 0 || goalNode < 0 || Search(startNode, goalNode) == INT_MAX)
+		return path;
+
+	// Up from the start to where the searches met, then down to the goal
+	std::vector<int> nodes;
+	for (int node = m_Meeting; node >= 0; node = m_Parent[0][node])
+		nodes.push_back(node);
+	std::reverse(nodes.begin(), nodes.end());
+	for (int node = m_Parent[1][m_Meeting]; node >= 0; node = m_Parent[1][node])
+		nodes.push_back(node);
+
+	path->push_back(start);
+	for (size_t i = 1; i < nodes.size(); i++)
+		Unpack(nodes[i - 1], nodes[i], *path);
+
+	return path;
+}
+
+/// <summary>
+/// Gets the number of edges that are shortcuts.
+/// </summary>
+/// <returns></returns>
+int ContractionHierarchy::GetShortcutCount() const
+{
+	int count = 0;
+	for (size_t i = 0; i < m_Edges.size(); i++)
+	{
+		if (m_Edges[i].Middle >= 0)
+			count++;
+	}
+
+	return count;
+}
+
+/// <summary>
+/// Gets the memory the hierarchy and its query state take.
+/// </summary>
+/// <returns>The number of bytes</returns>
+size_t ContractionHierarchy::GetMemoryUsage() const
+{
+	return m_Edges.size() * sizeof(Edge) + (m_NodeOf.size() + m_CellOf.size() + m_Rank.size() + m_FirstEdge.size()) * sizeof(int)
+		+ 2 * (m_Distance[0].size() + m_Parent[0].size()) * sizeof(int);
+}
+
+/// <summary>
+/// Determines whether a move in the given direction is legal, without cutting corners.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="direction">The direction.</param>
+/// <returns></returns>
+bool ContractionHierarchy::IsLegalMove(int x, int y, int direction) const
+{
+	int toX = x + DirectionX[direction];
+	int toY = y + DirectionY[direction];
+	if (toX < 0 || toX >= m_MapWidth || toY < 0 || toY >= m_MapHeight || !m_Map[toY * m_MapWidth + toX])
+		return false;
+
+	// A diagonal needs both of the cells it passes
+	if (direction % 2 == 1)
+		return m_Map[y * m_MapWidth + toX] && m_Map[toY * m_MapWidth + x];
+	return true;
+}
+
+/// <summary>
+/// Works out the shortcuts contracting a node needs: one between two of its neighbours whenever the
+/// path through it is shorter than any other the witness search finds between them.
+/// </summary>
+/// <param name="graph">The remaining graph.</param>
+/// <param name="node">The node.</param>
+/// <param name="simulate">Only count the shortcuts instead of adding them.</param>
+/// <param name="settleLimit">How many nodes a witness search settles at most.</param>
+/// <returns>The number of shortcuts</returns>
+int ContractionHierarchy::Contract(Graph& graph, int node, bool simulate, int settleLimit)
+{
+	// Adding shortcuts changes the node's own edges, so go over a copy
+	std::vector<Edge> edges = graph[node];
+	int shortcuts = 0;
+	for (size_t i = 0; i + 1 < edges.size(); i++)
+	{
+		int maxCost = 0;
+		for (size_t j = i + 1; j < edges.size(); j++)
+			maxCost = max(maxCost, edges[i].Cost + edges[j].Cost);
+		WitnessSearch(graph, edges[i].To, node, maxCost, settleLimit);
+
+		// Moves are symmetric, so a shortcut one way is the shortcut back too
+		for (size_t j = i + 1; j < edges.size(); j++)
+		{
+			int cost = edges[i].Cost + edges[j].Cost;
+			if (m_WitnessDistance[edges[j].To] <= cost)
+				continue;
+
+			shortcuts++;
+			if (!simulate)
+				AddEdge(graph, edges[i].To, edges[j].To, cost, node);
+		}
+	}
+
+	return shortcuts;
+}
+
+/// <summary>
+/// Runs a bounded Dijkstra from a neighbour of the node being contracted, around that node.
+/// </summary>
+/// <param name="graph">The remaining graph.</param>
+/// <param name="source">The source node.</param>
+/// <param name="skip">The node being contracted.</param>
+/// <param name="maxCost">The cost to stop at.</param>
+/// <param name="settleLimit">How many nodes to settle at most.</param>
+void ContractionHierarchy::WitnessSearch(const Graph& graph, int source, int skip, int maxCost, int settleLimit)
+{
+	for (size_t i = 0; i < m_WitnessTouched.size(); i++)
+		m_WitnessDistance[m_WitnessTouched[i]] = INT_MAX;
+	m_WitnessTouched.clear();
+
+	Queue queue;
+	m_WitnessDistance[source] = 0;
+	m_WitnessTouched.push_back(source);
+	queue.push(QueueEntry(0, source));
+	int settled = 0;
+	while (!queue.empty() && settled < settleLimit)
+	{
+		QueueEntry top = queue.top();
+		queue.pop();
+		if (top.first != m_WitnessDistance[top.second])
+			continue;
+		if (top.first > maxCost)
+			break;
+		settled++;
+
+		const std::vector<Edge>& edges = graph[top.second];
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			int to = edges[i].To;
+			int distance = top.first + edges[i].Cost;
+			if (to == skip || distance >= m_WitnessDistance[to])
+				continue;
+
+			if (m_WitnessDistance[to] == INT_MAX)
+				m_WitnessTouched.push_back(to);
+			m_WitnessDistance[to] = distance;
+			queue.push(QueueEntry(distance, to));
+		}
+	}
+}
+
+/// <summary>
+/// Adds an edge both ways, or lowers the cost of the one that is there.
+/// </summary>
+/// <param name="graph">The remaining graph.</param>
+/// <param name="from">One end.</param>
+/// <param name="to">The other end.</param>
+/// <param name="cost">The cost.</param>
+/// <param name="middle">The node the edge skips.</param>
+void ContractionHierarchy::AddEdge(Graph& graph, int from, int to, int cost, int middle) const
+{
+	for (int side = 0; side < 2; side++)
+	{
+		std::vector<Edge>& edges = graph[side == 0 ? from : to];
+		int other = (side == 0) ? to : from;
+		size_t i = 0;
+		while (i < edges.size() && edges[i].To != other)
+			i++;
+
+		if (i == edges.size())
+		{
+			Edge edge = { other, cost, middle };
+			edges.push_back(edge);
+		}
+		else if (cost < edges[i].Cost)
+		{
+			edges[i].Cost = cost;
+			edges[i].Middle = middle;
+		}
+	}
+}
+
+/// <summary>
+/// Runs the two upward searches, taking a step in whichever is behind, until neither can improve
+/// on the best meeting point. A node that one of its higher neighbours reaches shorter than the
+/// search did can't be on a shortest path, so the search stalls there instead of going on.
+/// </summary>
+/// <param name="start">The start node.</param>
+/// <param name="goal">The goal node.</param>
+/// <returns>The cost of the shortest path, INT_MAX if there is none</returns>
+int ContractionHierarchy::Search(int start, int goal)
+{
+	m_SettledNodes = 0;
+	m_StalledNodes = 0;
+	m_Meeting = -1;
+	for (int direction = 0; direction < 2; direction++)
+	{
+		for (size_t i = 0; i < m_Touched[direction].size(); i++)
+		{
+			m_Distance[direction][m_Touched[direction][i]] = INT_MAX;
+			m_Parent[direction][m_Touched[direction][i]] = -1;
+		}
+		m_Touched[direction].clear();
+	}
+
+	Queue queues[2];
+	int sources[2] = { start, goal };
+	for (int direction = 0; direction < 2; direction++)
+	{
+		m_Distance[direction][sources[direction]] = 0;
+		m_Touched[direction].push_back(sources[direction]);
+		queues[direction].push(QueueEntry(0, sources[direction]));
+	}
+
+	int best = INT_MAX;
+	for (;;)
+	{
+		// A direction is done once nothing it has left can beat the best path
+		for (int direction = 0; direction < 2; direction++)
+		{
+			if (!queues[direction].empty() && queues[direction].top().first >= best)
+				queues[direction] = Queue();
+		}
+		if (queues[0].empty() && queues[1].empty())
+			break;
+		int direction = (queues[1].empty() || (!queues[0].empty() && queues[0].top().first <= queues[1].top().first)) ? 0 : 1;
+
+		QueueEntry top = queues[direction].top();
+		queues[direction].pop();
+		int node = top.second;
+		std::vector<int>& distance = m_Distance[direction];
+		if (top.first != distance[node])
+			continue;
+		m_SettledNodes++;
+
+		if (m_Distance[1 - direction][node] != INT_MAX && top.first + m_Distance[1 - direction][node] < best)
+		{
+			best = top.first + m_Distance[1 - direction][node];
+			m_Meeting = node;
+		}
+
+		// Stall on demand
+		bool stalled = false;
+		for (int i = m_FirstEdge[node]; i < m_FirstEdge[node + 1] && !stalled; i++)
+			stalled = distance[m_Edges[i].To] != INT_MAX && distance[m_Edges[i].To] + m_Edges[i].Cost < top.first;
+		if (stalled)
+		{
+			m_StalledNodes++;
+			continue;
+		}
+
+		for (int i = m_FirstEdge[node]; i < m_FirstEdge[node + 1]; i++)
+		{
+			const Edge& edge = m_Edges[i];
+			int cost = top.first + edge.Cost;
+			if (cost >= distance[edge.To])
+				continue;
+
+			if (distance[edge.To] == INT_MAX)
+				m_Touched[direction].push_back(edge.To);
+			distance[edge.To] = cost;
+			m_Parent[direction][edge.To] = node;
+			queues[direction].push(QueueEntry(cost, edge.To));
+		}
+	}
+
+	return best;
+}
+
+/// <summary>
+/// Finds the edge between two nodes. It is stored with whichever of them is lower.
+/// </summary>
+/// <param name="from">One end.</param>
+/// <param name="to">The other end.</param>
+/// <returns>The edge, or nullptr if they aren't connected</returns>
+const ContractionHierarchy::Edge* ContractionHierarchy::FindEdge(int from, int to) const
+{
+	int lower = (m_Rank[from] < m_Rank[to]) ? from : to;
+	int upper = (lower == from) ? to : from;
+	for (int i = m_FirstEdge[lower]; i < m_FirstEdge[lower + 1]; i++)
+	{
+		if (m_Edges[i].To == upper)
+			return &m_Edges[i];
+	}
+
+	return nullptr;
+}
+
+/// <summary>
+/// Appends the cells of an edge to a path, going through the nodes a shortcut skips.
+/// </summary>
+/// <param name="from">The node the path is at.</param>
+/// <param name="to">The node to add the cells up to.</param>
+/// <param name="path">The path, which gets every cell after from up to and including to.</param>
+void ContractionHierarchy::Unpack(int from, int to, std::vector<Coordinate>& path) const
+{
+	const Edge* edge = FindEdge(from, to);
+	if (edge == nullptr || edge->Middle < 0)
+	{
+		path.push_back(GetCoordinate(to));
+		return;
+	}
+
+	int middle = edge->Middle;
+	Unpack(from, middle, path);
+	Unpack(middle, to, path);
+}
+
+#endif
\ No newline at end of file
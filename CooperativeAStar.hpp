@@ -0,0 +1,555 @@
+#ifndef COOPERATIVEASTAR_HPP
+#define COOPERATIVEASTAR_HPP
+
+#include <climits>
+#include <vector>
+#include <queue>
+#include <list>
+#include <map>
+#include "DV1419Map.h"
+#include "FlowField.hpp"
+#include "SparseNodeTable.hpp"
+
+/// <summary>
+/// Windowed Hierarchical Cooperative A* for many agents moving on the same map at once.
+/// Time goes in ticks, and every tick each agent moves to a neighbouring cell or waits. Agents plan
+/// one after the other through space and time, and every plan reserves the cells it passes through
+/// at each tick in a shared table, so the agents that plan later go around or wait instead of
+/// colliding. Plans only look a window of ticks ahead and are redone every half window, with the
+/// planning order rotated, so nobody stays last forever. The heuristic is the true distance to the
+/// goal on the empty map, from a <see cref="FlowField"/> built once per goal and kept in a cache.
+/// Agents leave the map when they reach their goal.
+/// </summary>
+class CooperativeAStar
+{
+public:
+	CooperativeAStar(DV1419Map* map, int window = 16, size_t cachedGoals = 64);
+	~CooperativeAStar();
+
+	int AddAgent(Coordinate start, Coordinate goal);
+	void Step();
+	bool IsFinished() const { return m_Remaining == 0; }
+
+	int GetAgentCount() const { return (int)m_Agents.size(); }
+	Coordinate GetPosition(int agent) const { return m_Agents[agent].Position; }
+	bool HasArrived(int agent) const { return m_Agents[agent].Arrived; }
+	int GetArrivalTick(int agent) const { return m_Agents[agent].ArrivalTick; }
+	unsigned int GetTick() const { return m_Tick; }
+	int GetWindow() const { return m_Window; }
+
+	// Totals since the planner was made
+	unsigned long long m_Plans;
+	unsigned long long m_FailedPlans;
+	unsigned long long m_ExpandedNodes;
+	unsigned long long m_HeuristicBuilds;
+	unsigned long long m_VertexConflicts;
+	unsigned long long m_EdgeConflicts;
+
+private:
+	// How often a round is planned before the agents still without a plan fall back to holding
+	static const int PlanAttempts = 2;
+
+	struct Agent
+	{
+		Coordinate Position;
+		Coordinate Previous;
+		Coordinate Goal;
+		// Where the agent is at each tick of the window since the last planning round
+		std::vector<Coordinate> Plan;
+		// Whether the last round found no plan, such agents plan first in the next one
+		bool Stuck;
+		bool Arrived;
+		int ArrivalTick;
+	};
+
+	/// <summary>
+	/// A cell at a tick of the window, keyed by tick * cells + cell. The key is 64-bit, a large map
+	/// times the window doesn't fit an int.
+	/// </summary>
+	struct SpaceTimeNode
+	{
+		int G;
+		long long Parent;
+		bool Closed;
+
+		SpaceTimeNode() : G(INT_MAX), Parent(-1), Closed(false) { }
+	};
+
+	/// <summary>
+	/// The agent holding a cell at a tick, same key as the nodes.
+	/// </summary>
+	struct Reservation
+	{
+		int Agent;
+
+		Reservation() : Agent(-1) { }
+	};
+
+	struct OpenEntry
+	{
+		int F;
+		int G;
+		long long Key;
+
+		// Lowest F first, and of those the deepest so ties run towards the goal
+		bool operator<(const OpenEntry& other) const { return F > other.F || (F == other.F && G < other.G); }
+	};
+
+	void PlanAll();
+	bool Plan(int agent);
+	void Hold(int agent);
+	void Reserve(int tick, int cell, int agent);
+	int GetReservation(int tick, int cell) const;
+	const FlowField* GetHeuristic(Coordinate goal);
+	void Execute();
+	bool IsWalkable(int x, int y) const;
+
+	std::vector<bool> m_Map;
+	DV1419Map* m_RawMap;
+	int m_MapWidth;
+	int m_MapHeight;
+	int m_Window;
+
+	std::vector<Agent> m_Agents;
+	int m_Remaining;
+	unsigned int m_Tick;
+	// The tick of the last planning round, plans are indexed from here
+	unsigned int m_PlanTick;
+	unsigned int m_Round;
+
+	SparseNodeTable<Reservation, long long> m_Reservations;
+	SparseNodeTable<SpaceTimeNode, long long> m_Nodes;
+	std::priority_queue<OpenEntry> m_OpenList;
+
+	// Goal fields by goal cell, the least recently used is dropped when the cache is full
+	size_t m_CachedGoals;
+	std::map<int, std::pair<FlowField*, std::list<int>::iterator> > m_Fields;
+	std::list<int> m_FieldOrder;
+
+	// Who stands where, and who stood where before the last move to catch agents swapping places
+	std::vector<int> m_Occupant;
+	std::vector<int> m_PreviousOccupant;
+
+	CooperativeAStar(const CooperativeAStar&);
+	CooperativeAStar& operator=(const CooperativeAStar&);
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="CooperativeAStar"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="window">The number of ticks a plan looks ahead.</param>
+/// <param name="cachedGoals">The number of goals to keep a heuristic for.</param>
+CooperativeAStar::CooperativeAStar(DV1419Map* map, int window, size_t cachedGoals)
+	: m_Plans(0), m_FailedPlans(0), m_ExpandedNodes(0), m_HeuristicBuilds(0), m_VertexConflicts(0), m_EdgeConflicts(0),
+	m_RawMap(map), m_Window(max(window, 2)), m_Remaining(0), m_Tick(0), m_PlanTick(0), m_Round(0), m_CachedGoals(max(cachedGoals, (size_t)1))
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	m_Occupant.assign(m_MapWidth * m_MapHeight, -1);
+	m_PreviousOccupant.assign(m_MapWidth * m_MapHeight, -1);
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="CooperativeAStar"/> class.
+/// </summary>
+CooperativeAStar::~CooperativeAStar()
+{
+	for (std::map<int, std::pair<FlowField*, std::list<int>::iterator> >::iterator it = m_Fields.begin(); it != m_Fields.end(); ++it)
+		delete it->second.first;
+}
+
+/// <summary>
+/// Adds an agent, it starts planning with the next step.
+/// </summary>
+/// <param name="start">The start coordinate, not shared with another agent.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>The agent</returns>
+int CooperativeAStar::AddAgent(Coordinate start, Coordinate goal)
+{
+	Agent agent;
+	agent.Position = start;
+	agent.Previous = start;
+	agent.Goal = goal;
+	agent.Stuck = false;
+	agent.Arrived = false;
+	agent.ArrivalTick = -1;
+	m_Agents.push_back(agent);
+	m_Remaining++;
+	m_Occupant[start.Y * m_MapWidth + start.X] = (int)m_Agents.size() - 1;
+
+	// Make sure it gets a plan before it moves
+	m_PlanTick = m_Tick - m_Window;
+	return (int)m_Agents.size() - 1;
+}
+
+/// <summary>
+/// Moves every agent one tick, planning first when half the window has passed.
+/// </summary>
+void CooperativeAStar::Step()
+{
+	if (m_Tick - m_PlanTick >= (unsigned int)m_Window / 2)
+		PlanAll();
+	Execute();
+	m_Tick++;
+}
+
+/// <summary>
+/// Plans every agent on the map for the next window, in an order that rotates every round. Agents
+/// that found no plan in the last round go first. An agent is usually left without one because
+/// agents planned before it walk into it later in the window, so a round where that happened is
+/// planned again with those agents moved to the front.
+/// </summary>
+void CooperativeAStar::PlanAll()
+{
+	m_PlanTick = m_Tick;
+
+	int count = (int)m_Agents.size();
+	int first = (count > 0) ? (int)(m_Round++ % count) : 0;
+	std::vector<int> order;
+	order.reserve(count);
+	for (int i = 0; i < count; i++)
+		if (m_Agents[(first + i) % count].Stuck)
+			order.push_back((first + i) % count);
+	for (int i = 0; i < count; i++)
+		if (!m_Agents[(first + i) % count].Stuck)
+			order.push_back((first + i) % count);
+
+	for (int attempt = 1; ; attempt++)
+	{
+		m_Reservations.Clear();
+		// Nobody may plan to walk into where another agent is now, or where it could still be
+		// after the first move, or the agents that plan later could be pushed with nowhere to go
+		for (size_t i = 0; i < m_Agents.size(); i++)
+		{
+			if (m_Agents[i].Arrived)
+				continue;
+			int cell = m_Agents[i].Position.Y * m_MapWidth + m_Agents[i].Position.X;
+			Reserve(0, cell, (int)i);
+			Reserve(1, cell, (int)i);
+		}
+
+		std::vector<int> failed;
+		std::vector<int> planned;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			int agent = order[i];
+			if (m_Agents[agent].Arrived)
+				continue;
+			if (Plan(agent))
+			{
+				planned.push_back(agent);
+				continue;
+			}
+
+			m_FailedPlans++;
+			failed.push_back(agent);
+			// Out of attempts, keep out of the way of the others until the next round
+			if (attempt == PlanAttempts)
+				Hold(agent);
+		}
+
+		for (size_t i = 0; i < order.size(); i++)
+			m_Agents[order[i]].Stuck = false;
+		for (size_t i = 0; i < failed.size(); i++)
+			m_Agents[failed[i]].Stuck = true;
+		if (failed.empty() || attempt == PlanAttempts)
+			break;
+		order.swap(failed);
+		order.insert(order.end(), planned.begin(), planned.end());
+	}
+}
+
+/// <summary>
+/// Plans one agent through space and time around the reservations of the agents planned before it,
+/// and reserves the plan. The search ends at the goal or at the end of the window. When neither can
+/// be reached, the part that gets furthest into the window is kept and reserved instead.
+/// </summary>
+/// <param name="agent">The agent.</param>
+/// <returns>Whether there is a plan to the goal or the end of the window</returns>
+bool CooperativeAStar::Plan(int agent)
+{
+	Agent& planned = m_Agents[agent];
+	const FlowField* heuristic = GetHeuristic(planned.Goal);
+	long long cells = m_MapWidth * m_MapHeight;
+	int start = planned.Position.Y * m_MapWidth + planned.Position.X;
+	int goal = planned.Goal.Y * m_MapWidth + planned.Goal.X;
+	planned.Plan.assign(1, planned.Position);
+	if (heuristic->GetDistance(planned.Position.X, planned.Position.Y) == FlowField::Unreachable)
+		return false;
+
+	m_Plans++;
+	m_Nodes.Clear();
+	while (!m_OpenList.empty())
+		m_OpenList.pop();
+
+	bool created;
+	m_Nodes.Get(start, created)->G = 0;
+	OpenEntry first = { heuristic->GetDistance(planned.Position.X, planned.Position.Y), 0, start };
+	m_OpenList.push(first);
+
+	long long last = -1;
+	long long deepest = start;
+	while (!m_OpenList.empty())
+	{
+		OpenEntry entry = m_OpenList.top();
+		m_OpenList.pop();
+		SpaceTimeNode* node = m_Nodes.Get(entry.Key, created);
+		// Entries that were pushed again with a better G are left behind in the heap
+		if (node->Closed || entry.G > node->G)
+			continue;
+		node->Closed = true;
+		m_ExpandedNodes++;
+
+		int tick = (int)(entry.Key / cells);
+		int cell = (int)(entry.Key % cells);
+		if (tick > deepest / cells)
+			deepest = entry.Key;
+		if (cell == goal || tick == m_Window)
+		{
+			last = entry.Key;
+			break;
+		}
+
+		int x = cell % m_MapWidth;
+		int y = cell / m_MapWidth;
+		// Every move of the compass, and waiting as the ninth
+		for (int direction = 0; direction <= 8; direction++)
+		{
+			int dx = (direction < 8) ? FlowField::DirectionX[direction] : 0;
+			int dy = (direction < 8) ? FlowField::DirectionY[direction] : 0;
+			int nextX = x + dx;
+			int nextY = y + dy;
+			if (!IsWalkable(nextX, nextY))
+				continue;
+			// Don't cut corners
+			if (dx != 0 && dy != 0 && (!IsWalkable(nextX, y) || !IsWalkable(x, nextY)))
+				continue;
+			int h = heuristic->GetDistance(nextX, nextY);
+			if (h == FlowField::Unreachable)
+				continue;
+
+			// Not into a cell someone holds then, and not through someone coming the other way
+			int next = nextY * m_MapWidth + nextX;
+			int holder = GetReservation(tick + 1, next);
+			if (holder != -1 && holder != agent)
+				continue;
+			int oncoming = GetReservation(tick, next);
+			if (oncoming != -1 && oncoming != agent && GetReservation(tick + 1, cell) == oncoming)
+				continue;
+
+			int g = entry.G + ((direction < 8) ? FlowField::DirectionCost[direction] : 10);
+			SpaceTimeNode* child = m_Nodes.Get((tick + 1) * cells + next, created);
+			if (child->Closed || g >= child->G)
+				continue;
+			child->G = g;
+			child->Parent = entry.Key;
+			OpenEntry open = { g + h, g, (tick + 1) * cells + next };
+			m_OpenList.push(open);
+		}
+	}
+
+	// Walk the parents back into a plan by tick, and hold every cell of it
+	std::vector<long long> keys;
+	for (long long key = (last >= 0) ? last : deepest; key >= 0; key = m_Nodes.Get(key, created)->Parent)
+		keys.push_back(key);
+	planned.Plan.resize(keys.size());
+	for (size_t t = 0; t < keys.size(); t++)
+	{
+		int cell = (int)(keys[keys.size() - 1 - t] % cells);
+		planned.Plan[t] = Coordinate(cell % m_MapWidth, cell / m_MapWidth);
+		Reserve((int)t, cell, agent);
+	}
+
+	return last >= 0;
+}
+
+/// <summary>
+/// Fills the rest of the window of an agent whose plan ends early, keeping out of the way of the
+/// reservations, and reserves it. It waits where it stands while nobody has planned through there,
+/// and otherwise steps aside to a free neighbour, preferably one that stays free for the tick after.
+/// </summary>
+/// <param name="agent">The agent.</param>
+void CooperativeAStar::Hold(int agent)
+{
+	Agent& stuck = m_Agents[agent];
+	int x = stuck.Plan.back().X;
+	int y = stuck.Plan.back().Y;
+	for (int t = (int)stuck.Plan.size(); t <= m_Window; t++)
+	{
+		int cell = y * m_MapWidth + x;
+		int holder = GetReservation(t, cell);
+		if (holder != -1 && holder != agent)
+		{
+			int bestX = x;
+			int bestY = y;
+			int bestScore = 0;
+			for (int direction = 0; direction < 8; direction++)
+			{
+				int nextX = x + FlowField::DirectionX[direction];
+				int nextY = y + FlowField::DirectionY[direction];
+				if (!IsWalkable(nextX, nextY))
+					continue;
+				if (nextX != x && nextY != y && (!IsWalkable(nextX, y) || !IsWalkable(x, nextY)))
+					continue;
+				int next = nextY * m_MapWidth + nextX;
+				int taken = GetReservation(t, next);
+				if (taken != -1 && taken != agent)
+					continue;
+				int oncoming = GetReservation(t - 1, next);
+				if (oncoming != -1 && oncoming != agent && oncoming == holder)
+					continue;
+
+				int later = GetReservation(t + 1, next);
+				int score = (later == -1 || later == agent) ? 2 : 1;
+				if (score > bestScore)
+				{
+					bestX = nextX;
+					bestY = nextY;
+					bestScore = score;
+				}
+			}
+			// Boxed in, stay and let the conflict be counted
+			x = bestX;
+			y = bestY;
+		}
+
+		stuck.Plan.push_back(Coordinate(x, y));
+		Reserve(t, y * m_MapWidth + x, agent);
+	}
+}
+
+/// <summary>
+/// Holds a cell at a tick of the window for an agent.
+/// </summary>
+/// <param name="tick">The tick, counted from the planning round.</param>
+/// <param name="cell">The cell.</param>
+/// <param name="agent">The agent.</param>
+void CooperativeAStar::Reserve(int tick, int cell, int agent)
+{
+	bool created;
+	Reservation* reservation = m_Reservations.Get((long long)tick * m_MapWidth * m_MapHeight + cell, created);
+	if (created)
+		reservation->Agent = agent;
+}
+
+/// <summary>
+/// Gets the agent holding a cell at a tick of the window.
+/// </summary>
+/// <param name="tick">The tick, counted from the planning round.</param>
+/// <param name="cell">The cell.</param>
+/// <returns>The agent, -1 if the cell is free</returns>
+int CooperativeAStar::GetReservation(int tick, int cell) const
+{
+	const Reservation* reservation = m_Reservations.Find((long long)tick * m_MapWidth * m_MapHeight + cell);
+	return (reservation != nullptr) ? reservation->Agent : -1;
+}
+
+/// <summary>
+/// Gets the true distances to a goal, building them with a reverse search if the goal isn't cached.
+/// </summary>
+/// <param name="goal">The goal.</param>
+/// <returns></returns>
+const FlowField* CooperativeAStar::GetHeuristic(Coordinate goal)
+{
+	int key = goal.Y * m_MapWidth + goal.X;
+	std::map<int, std::pair<FlowField*, std::list<int>::iterator> >::iterator it = m_Fields.find(key);
+	if (it != m_Fields.end())
+	{
+		m_FieldOrder.splice(m_FieldOrder.begin(), m_FieldOrder, it->second.second);
+		return it->second.first;
+	}
+
+	FlowField* field;
+	if (m_Fields.size() >= m_CachedGoals)
+	{
+		// Reuse the field of the goal that was needed longest ago
+		std::map<int, std::pair<FlowField*, std::list<int>::iterator> >::iterator oldest = m_Fields.find(m_FieldOrder.back());
+		field = oldest->second.first;
+		m_Fields.erase(oldest);
+		m_FieldOrder.pop_back();
+	}
+	else
+	{
+		field = new FlowField(m_RawMap);
+	}
+
+	field->Build(goal);
+	m_HeuristicBuilds++;
+	m_FieldOrder.push_front(key);
+	m_Fields[key] = std::make_pair(field, m_FieldOrder.begin());
+	return field;
+}
+
+/// <summary>
+/// Moves every agent to the next cell of its plan, and counts the collisions that happened anyway.
+/// </summary>
+void CooperativeAStar::Execute()
+{
+	unsigned int step = m_Tick - m_PlanTick + 1;
+	for (size_t i = 0; i < m_Agents.size(); i++)
+	{
+		Agent& agent = m_Agents[i];
+		if (agent.Arrived)
+			continue;
+		agent.Previous = agent.Position;
+		m_Occupant[agent.Previous.Y * m_MapWidth + agent.Previous.X] = -1;
+		m_PreviousOccupant[agent.Previous.Y * m_MapWidth + agent.Previous.X] = (int)i;
+		if (step < agent.Plan.size())
+			agent.Position = agent.Plan[step];
+	}
+
+	for (size_t i = 0; i < m_Agents.size(); i++)
+	{
+		Agent& agent = m_Agents[i];
+		if (agent.Arrived)
+			continue;
+		int cell = agent.Position.Y * m_MapWidth + agent.Position.X;
+		if (m_Occupant[cell] != -1)
+			m_VertexConflicts++;
+		m_Occupant[cell] = (int)i;
+
+		// Swapped places with whoever was here before, counted once per pair
+		int other = m_PreviousOccupant[cell];
+		if (other > (int)i && m_Agents[other].Position.X == agent.Previous.X && m_Agents[other].Position.Y == agent.Previous.Y)
+			m_EdgeConflicts++;
+	}
+
+	// Agents leave the map at their goal
+	for (size_t i = 0; i < m_Agents.size(); i++)
+	{
+		Agent& agent = m_Agents[i];
+		if (agent.Arrived)
+			continue;
+		m_PreviousOccupant[agent.Previous.Y * m_MapWidth + agent.Previous.X] = -1;
+		if (agent.Position.X == agent.Goal.X && agent.Position.Y == agent.Goal.Y)
+		{
+			agent.Arrived = true;
+			agent.ArrivalTick = (int)m_Tick + 1;
+			if (m_Occupant[agent.Position.Y * m_MapWidth + agent.Position.X] == (int)i)
+				m_Occupant[agent.Position.Y * m_MapWidth + agent.Position.X] = -1;
+			m_Remaining--;
+		}
+	}
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+inline bool CooperativeAStar::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+#endif
\ No newline at end of file
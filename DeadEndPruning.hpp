@@ -0,0 +1,574 @@
+#ifndef DEADENDPRUNING_HPP
+#define DEADENDPRUNING_HPP
+
+#include <vector>
+#include <algorithm>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Dead-end and swamp pruning for grid searches.
+/// The grid is cut into sectors by every n-th row and column. The walkable runs on those lines
+/// are doorways, straight segments that every path between sectors has to cross, and the
+/// connected parts of each sector's interior are areas. A region that only connects to the rest
+/// of the map through one doorway can't be on an optimal path unless the path starts or ends
+/// inside it: a path that enters and leaves through the same doorway is never shorter than
+/// walking along the doorway. Such regions are found with the block-cut tree of the area graph.
+/// Swamps are the regions cut off from the largest part of the map like this, dead ends are the
+/// regions cut off from a particular query.
+/// </summary>
+class DeadEndPruning
+{
+public:
+	DeadEndPruning(DV1419Map* map, int sectorSize = 16);
+
+	void Prepare(Coordinate start, const std::vector<Coordinate>& goals);
+	bool IsAllowed(int x, int y) const;
+	bool IsSwamp(int x, int y) const;
+
+	int GetAreaCount() const { return m_NodeCount - m_DoorwayCount; }
+	int GetDoorwayCount() const { return m_DoorwayCount; }
+	int GetArticulationDoorwayCount() const;
+	int GetSwampCellCount() const;
+	int GetAllowedCellCount() const;
+
+private:
+	int AddNode(bool doorway);
+	void FloodArea(int x, int y, int node);
+	void ConnectNodes();
+	void FindBlocks();
+	void Spread(std::vector<bool>& reached, std::vector<int>& stack) const;
+	int GetTreeVertex(int node) const;
+	bool IsWalkable(int x, int y) const;
+	bool IsLegalMove(int x, int y, int dx, int dy) const;
+	bool IsOnLine(int x, int y) const { return x % m_SectorSize == 0 || y % m_SectorSize == 0; }
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+	int m_SectorSize;
+
+	// Every walkable cell belongs to one node, either a doorway or an area
+	std::vector<int> m_NodeOf;
+	std::vector<bool> m_IsDoorway;
+	std::vector<int> m_CellCount;
+	std::vector<std::vector<int> > m_Adjacency;
+	int m_NodeCount;
+	int m_DoorwayCount;
+
+	// The block-cut tree. Its vertices are the blocks followed by the articulation nodes.
+	std::vector<std::vector<int> > m_BlockMembers;
+	std::vector<int> m_ArticulationVertex;
+	std::vector<int> m_BlockOf;
+	std::vector<int> m_VertexNode;
+	std::vector<std::vector<int> > m_Tree;
+
+	std::vector<bool> m_Swamp;
+	std::vector<bool> m_Allowed;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="DeadEndPruning"/> class and decomposes the map.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="sectorSize">The distance between the lines that cut the map into sectors.</param>
+DeadEndPruning::DeadEndPruning(DV1419Map* map, int sectorSize)
+	: m_SectorSize(sectorSize), m_NodeCount(0), m_DoorwayCount(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+	m_NodeOf.assign(m_MapWidth * m_MapHeight, -1);
+
+	// Cells where a row and a column line cross are doorways of their own
+	for (int y = 0; y < m_MapHeight; y += m_SectorSize)
+	{
+		for (int x = 0; x < m_MapWidth; x += m_SectorSize)
+		{
+			if (IsWalkable(x, y))
+			{
+				m_NodeOf[y * m_MapWidth + x] = AddNode(true);
+				m_CellCount.back()++;
+			}
+		}
+	}
+
+	// Every walkable run on a line between two crossings is a doorway
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			bool onRow = y % m_SectorSize == 0 && x % m_SectorSize != 0;
+			bool onColumn = x % m_SectorSize == 0 && y % m_SectorSize != 0;
+			if (!(onRow || onColumn) || !IsWalkable(x, y))
+				continue;
+
+			// Continue the run of the previous cell on the same line, if there is one
+			int previous = onRow ? x - 1 : y - 1;
+			int previousIndex = onRow ? y * m_MapWidth + x - 1 : (y - 1) * m_MapWidth + x;
+			bool continues = previous % m_SectorSize != 0 && m_NodeOf[previousIndex] >= 0;
+			m_NodeOf[y * m_MapWidth + x] = continues ? m_NodeOf[previousIndex] : AddNode(true);
+			m_CellCount[m_NodeOf[y * m_MapWidth + x]]++;
+		}
+	}
+
+	// The rest are areas, the connected parts of each sector's interior
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			if (IsWalkable(x, y) && !IsOnLine(x, y) && m_NodeOf[y * m_MapWidth + x] < 0)
+				FloodArea(x, y, AddNode(false));
+		}
+	}
+
+	ConnectNodes();
+	FindBlocks();
+
+	// Swamps are whatever can't be reached from the largest block without going back through a doorway
+	int largest = 0, largestCells = -1;
+	for (size_t block = 0; block < m_BlockMembers.size(); block++)
+	{
+		int cells = 0;
+		for (size_t i = 0; i < m_BlockMembers[block].size(); i++)
+			cells += m_CellCount[m_BlockMembers[block][i]];
+		if (cells > largestCells)
+		{
+			largest = block;
+			largestCells = cells;
+		}
+	}
+	std::vector<bool> reached(m_Tree.size(), false);
+	std::vector<int> stack;
+	if (!m_Tree.empty())
+	{
+		reached[largest] = true;
+		stack.push_back(largest);
+	}
+	Spread(reached, stack);
+	m_Swamp.assign(m_NodeCount, true);
+	for (size_t vertex = 0; vertex < m_Tree.size(); vertex++)
+	{
+		if (!reached[vertex])
+			continue;
+		if (vertex < m_BlockMembers.size())
+			for (size_t i = 0; i < m_BlockMembers[vertex].size(); i++)
+				m_Swamp[m_BlockMembers[vertex][i]] = false;
+		else
+			m_Swamp[m_VertexNode[vertex]] = false;
+	}
+
+	m_Allowed.assign(m_NodeCount, true);
+}
+
+/// <summary>
+/// Works out which cells a search between the start and any of the goals may visit.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goals">The goal coordinates.</param>
+void DeadEndPruning::Prepare(Coordinate start, const std::vector<Coordinate>& goals)
+{
+	std::fill(m_Allowed.begin(), m_Allowed.end(), false);
+	if (!IsWalkable(start.X, start.Y))
+		return;
+
+	// Walk the block-cut tree from the start, the vertices between it and the goals stay
+	int root = GetTreeVertex(m_NodeOf[start.Y * m_MapWidth + start.X]);
+	std::vector<int> parent(m_Tree.size(), -1);
+	std::vector<int> queue(1, root);
+	parent[root] = root;
+	for (size_t i = 0; i < queue.size(); i++)
+	{
+		int vertex = queue[i];
+		for (size_t j = 0; j < m_Tree[vertex].size(); j++)
+		{
+			if (parent[m_Tree[vertex][j]] < 0)
+			{
+				parent[m_Tree[vertex][j]] = vertex;
+				queue.push_back(m_Tree[vertex][j]);
+			}
+		}
+	}
+
+	std::vector<bool> reached(m_Tree.size(), false);
+	std::vector<int> stack;
+	reached[root] = true;
+	stack.push_back(root);
+	for (size_t i = 0; i < goals.size(); i++)
+	{
+		if (!IsWalkable(goals[i].X, goals[i].Y))
+			continue;
+
+		int vertex = GetTreeVertex(m_NodeOf[goals[i].Y * m_MapWidth + goals[i].X]);
+		if (parent[vertex] < 0)
+			continue;
+		for (; !reached[vertex]; vertex = parent[vertex])
+		{
+			reached[vertex] = true;
+			stack.push_back(vertex);
+		}
+	}
+
+	// Everything hanging off that path stays too, unless it hangs off a doorway
+	Spread(reached, stack);
+	for (size_t vertex = 0; vertex < m_Tree.size(); vertex++)
+	{
+		if (!reached[vertex])
+			continue;
+		if (vertex < m_BlockMembers.size())
+			for (size_t i = 0; i < m_BlockMembers[vertex].size(); i++)
+				m_Allowed[m_BlockMembers[vertex][i]] = true;
+		else
+			m_Allowed[m_VertexNode[vertex]] = true;
+	}
+}
+
+/// <summary>
+/// Determines whether the last prepared search may visit a cell.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool DeadEndPruning::IsAllowed(int x, int y) const
+{
+	if (!IsWalkable(x, y))
+		return false;
+
+	return m_Allowed[m_NodeOf[y * m_MapWidth + x]];
+}
+
+/// <summary>
+/// Determines whether a cell lies in a swamp, a region that searches only enter when they start or end in it.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool DeadEndPruning::IsSwamp(int x, int y) const
+{
+	if (!IsWalkable(x, y))
+		return false;
+
+	return m_Swamp[m_NodeOf[y * m_MapWidth + x]];
+}
+
+/// <summary>
+/// Gets the number of doorways that cut the map in two.
+/// </summary>
+/// <returns></returns>
+int DeadEndPruning::GetArticulationDoorwayCount() const
+{
+	int count = 0;
+	for (int node = 0; node < m_NodeCount; node++)
+		count += m_IsDoorway[node] && m_ArticulationVertex[node] >= 0;
+	return count;
+}
+
+/// <summary>
+/// Gets the number of cells in swamps.
+/// </summary>
+/// <returns></returns>
+int DeadEndPruning::GetSwampCellCount() const
+{
+	int count = 0;
+	for (int node = 0; node < m_NodeCount; node++)
+		if (m_Swamp[node])
+			count += m_CellCount[node];
+	return count;
+}
+
+/// <summary>
+/// Gets the number of cells the last prepared search may visit.
+/// </summary>
+/// <returns></returns>
+int DeadEndPruning::GetAllowedCellCount() const
+{
+	int count = 0;
+	for (int node = 0; node < m_NodeCount; node++)
+		if (m_Allowed[node])
+			count += m_CellCount[node];
+	return count;
+}
+
+/// <summary>
+/// Adds a node without any cells.
+/// </summary>
+/// <param name="doorway">Whether the node is a doorway.</param>
+/// <returns>The node</returns>
+int DeadEndPruning::AddNode(bool doorway)
+{
+	m_IsDoorway.push_back(doorway);
+	m_CellCount.push_back(0);
+	m_DoorwayCount += doorway;
+	return m_NodeCount++;
+}
+
+/// <summary>
+/// Assigns every interior cell connected to a cell within its sector to an area.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="node">The area.</param>
+void DeadEndPruning::FloodArea(int x, int y, int node)
+{
+	int sectorX = x / m_SectorSize;
+	int sectorY = y / m_SectorSize;
+	std::vector<int> stack(1, y * m_MapWidth + x);
+	m_NodeOf[y * m_MapWidth + x] = node;
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		m_CellCount[node]++;
+
+		int cellX = index % m_MapWidth;
+		int cellY = index / m_MapWidth;
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				int nextX = cellX + dx;
+				int nextY = cellY + dy;
+				if (!IsLegalMove(cellX, cellY, dx, dy) || IsOnLine(nextX, nextY)
+					|| nextX / m_SectorSize != sectorX || nextY / m_SectorSize != sectorY
+					|| m_NodeOf[nextY * m_MapWidth + nextX] >= 0)
+					continue;
+
+				m_NodeOf[nextY * m_MapWidth + nextX] = node;
+				stack.push_back(nextY * m_MapWidth + nextX);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Connects every pair of nodes that a single move crosses between.
+/// </summary>
+void DeadEndPruning::ConnectNodes()
+{
+	m_Adjacency.assign(m_NodeCount, std::vector<int>());
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			int node = m_NodeOf[y * m_MapWidth + x];
+			if (node < 0)
+				continue;
+
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					if (!IsLegalMove(x, y, dx, dy))
+						continue;
+					int other = m_NodeOf[(y + dy) * m_MapWidth + x + dx];
+					if (other != node)
+						m_Adjacency[node].push_back(other);
+				}
+			}
+		}
+	}
+
+	for (int node = 0; node < m_NodeCount; node++)
+	{
+		std::vector<int>& adjacent = m_Adjacency[node];
+		std::sort(adjacent.begin(), adjacent.end());
+		adjacent.erase(std::unique(adjacent.begin(), adjacent.end()), adjacent.end());
+	}
+}
+
+/// <summary>
+/// Splits the node graph into biconnected blocks with Tarjan's algorithm, without recursion
+/// since the graph can be deep, and builds the block-cut tree.
+/// </summary>
+void DeadEndPruning::FindBlocks()
+{
+	struct Frame
+	{
+		int Node;
+		int Parent;
+		size_t Next;
+	};
+
+	std::vector<int> discovery(m_NodeCount, 0);
+	std::vector<int> low(m_NodeCount, 0);
+	std::vector<int> stamp(m_NodeCount, -1);
+	std::vector<std::pair<int, int> > edges;
+	std::vector<Frame> frames;
+	int time = 0;
+
+	m_BlockMembers.clear();
+	for (int root = 0; root < m_NodeCount; root++)
+	{
+		if (discovery[root] != 0)
+			continue;
+
+		discovery[root] = low[root] = ++time;
+		if (m_Adjacency[root].empty())
+		{
+			m_BlockMembers.push_back(std::vector<int>(1, root));
+			continue;
+		}
+
+		Frame first = { root, -1, 0 };
+		frames.push_back(first);
+		while (!frames.empty())
+		{
+			Frame& frame = frames.back();
+			int node = frame.Node;
+			if (frame.Next < m_Adjacency[node].size())
+			{
+				int next = m_Adjacency[node][frame.Next++];
+				if (discovery[next] == 0)
+				{
+					edges.push_back(std::make_pair(node, next));
+					discovery[next] = low[next] = ++time;
+					Frame child = { next, node, 0 };
+					frames.push_back(child);
+				}
+				else if (next != frame.Parent && discovery[next] < discovery[node])
+				{
+					edges.push_back(std::make_pair(node, next));
+					low[node] = min(low[node], discovery[next]);
+				}
+				continue;
+			}
+
+			frames.pop_back();
+			if (frames.empty())
+				break;
+
+			int parent = frames.back().Node;
+			low[parent] = min(low[parent], low[node]);
+			if (low[node] < discovery[parent])
+				continue;
+
+			// The parent separates this subtree, so the edges down to it form a block
+			int block = m_BlockMembers.size();
+			m_BlockMembers.push_back(std::vector<int>());
+			std::pair<int, int> edge;
+			do
+			{
+				edge = edges.back();
+				edges.pop_back();
+				int ends[2] = { edge.first, edge.second };
+				for (int i = 0; i < 2; i++)
+				{
+					if (stamp[ends[i]] != block)
+					{
+						stamp[ends[i]] = block;
+						m_BlockMembers[block].push_back(ends[i]);
+					}
+				}
+			} while (edge.first != parent || edge.second != node);
+		}
+	}
+
+	// Nodes in more than one block are articulation nodes and get a tree vertex of their own
+	std::vector<int> blockCount(m_NodeCount, 0);
+	m_BlockOf.assign(m_NodeCount, -1);
+	for (size_t block = 0; block < m_BlockMembers.size(); block++)
+	{
+		for (size_t i = 0; i < m_BlockMembers[block].size(); i++)
+		{
+			blockCount[m_BlockMembers[block][i]]++;
+			m_BlockOf[m_BlockMembers[block][i]] = block;
+		}
+	}
+
+	m_Tree.assign(m_BlockMembers.size(), std::vector<int>());
+	m_VertexNode.assign(m_BlockMembers.size(), -1);
+	m_ArticulationVertex.assign(m_NodeCount, -1);
+	for (int node = 0; node < m_NodeCount; node++)
+	{
+		if (blockCount[node] > 1)
+		{
+			m_ArticulationVertex[node] = m_Tree.size();
+			m_Tree.push_back(std::vector<int>());
+			m_VertexNode.push_back(node);
+		}
+	}
+	for (size_t block = 0; block < m_BlockMembers.size(); block++)
+	{
+		for (size_t i = 0; i < m_BlockMembers[block].size(); i++)
+		{
+			int vertex = m_ArticulationVertex[m_BlockMembers[block][i]];
+			if (vertex >= 0)
+			{
+				m_Tree[block].push_back(vertex);
+				m_Tree[vertex].push_back(block);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Marks everything in the block-cut tree that can be reached from the vertices on the stack
+/// without stepping beyond a doorway that cuts the map in two.
+/// </summary>
+/// <param name="reached">The reached vertices, the ones on the stack must already be marked.</param>
+/// <param name="stack">The vertices to spread from.</param>
+void DeadEndPruning::Spread(std::vector<bool>& reached, std::vector<int>& stack) const
+{
+	while (!stack.empty())
+	{
+		int vertex = stack.back();
+		stack.pop_back();
+
+		// Whatever lies beyond a doorway can only be left through the same doorway
+		if (m_VertexNode[vertex] >= 0 && m_IsDoorway[m_VertexNode[vertex]])
+			continue;
+
+		for (size_t i = 0; i < m_Tree[vertex].size(); i++)
+		{
+			if (!reached[m_Tree[vertex][i]])
+			{
+				reached[m_Tree[vertex][i]] = true;
+				stack.push_back(m_Tree[vertex][i]);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Gets the block-cut tree vertex of a node.
+/// </summary>
+/// <param name="node">The node.</param>
+/// <returns></returns>
+int DeadEndPruning::GetTreeVertex(int node) const
+{
+	return (m_ArticulationVertex[node] >= 0) ? m_ArticulationVertex[node] : m_BlockOf[node];
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool DeadEndPruning::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Determines whether a move is legal, without cutting corners. Staying put isn't a move.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="dx">The x-direction.</param>
+/// <param name="dy">The y-direction.</param>
+/// <returns></returns>
+bool DeadEndPruning::IsLegalMove(int x, int y, int dx, int dy) const
+{
+	if ((dx == 0 && dy == 0) || !IsWalkable(x + dx, y + dy))
+		return false;
+
+	return dx == 0 || dy == 0 || (IsWalkable(x + dx, y) && IsWalkable(x, y + dy));
+}
+
+#endif
\ No newline at end of file
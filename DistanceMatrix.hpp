@@ -0,0 +1,133 @@
+#ifndef DISTANCEMATRIX_HPP
+#define DISTANCEMATRIX_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include "DV1419Map.h"
+#include "FlowField.hpp"
+
+/// <summary>
+/// Shortest path distances between every source and every target in one batch.
+/// Moves are symmetric, so a single Dijkstra from a source gives its distance to every
+/// target at once. Each source gets one <see cref="FlowField"/> build that stops as soon as
+/// all targets are settled, and the sources are spread over a pool of threads.
+/// </summary>
+class DistanceMatrix
+{
+public:
+	/// <summary>
+	/// Distance between cells that have no path, matching getPathLength.
+	/// </summary>
+	static const double NoPath;
+
+	DistanceMatrix(DV1419Map* map);
+
+	void Compute(const std::vector<Coordinate>& sources, const std::vector<Coordinate>& targets, int threads, bool withPaths = false);
+
+	int GetSourceCount() const { return m_Sources.size(); }
+	int GetTargetCount() const { return m_Targets.size(); }
+	double GetDistance(int source, int target) const { return m_Distance[source * m_Targets.size() + target]; }
+	const std::vector<Coordinate>& GetPath(int source, int target) const { return m_Paths[source * m_Targets.size() + target]; }
+
+private:
+	void Work(std::atomic<int>* nextSource, bool withPaths);
+
+	DV1419Map* m_RawMap;
+	std::vector<Coordinate> m_Sources;
+	std::vector<Coordinate> m_Targets;
+	std::vector<double> m_Distance;
+	std::vector<std::vector<Coordinate> > m_Paths;
+};
+
+const double DistanceMatrix::NoPath = -1;
+
+/// <summary>
+/// Initializes a new instance of the <see cref="DistanceMatrix"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+DistanceMatrix::DistanceMatrix(DV1419Map* map)
+	: m_RawMap(map)
+{
+}
+
+/// <summary>
+/// Computes the distance from every source to every target.
+/// </summary>
+/// <param name="sources">The sources.</param>
+/// <param name="targets">The targets.</param>
+/// <param name="threads">The number of threads to use.</param>
+/// <param name="withPaths">Also keep the path for every pair, which costs a lot more memory.</param>
+void DistanceMatrix::Compute(const std::vector<Coordinate>& sources, const std::vector<Coordinate>& targets, int threads, bool withPaths)
+{
+	m_Sources = sources;
+	m_Targets = targets;
+	m_Distance.assign(sources.size() * targets.size(), NoPath);
+	m_Paths.clear();
+	if (withPaths)
+		m_Paths.resize(sources.size() * targets.size());
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > (int)sources.size())
+		threads = sources.size();
+
+	// Sources are handed out one at a time, since their cost varies a lot
+	std::atomic<int> nextSource(0);
+	std::vector<std::thread> team;
+	for (int i = 1; i < threads; i++)
+		team.push_back(std::thread(&DistanceMatrix::Work, this, &nextSource, withPaths));
+	Work(&nextSource, withPaths);
+	for (size_t i = 0; i < team.size(); i++)
+		team[i].join();
+}
+
+/// <summary>
+/// Computes rows of the matrix until every source is taken.
+/// </summary>
+/// <param name="nextSource">The index of the next source nobody has taken yet.</param>
+/// <param name="withPaths">Whether to keep the paths.</param>
+void DistanceMatrix::Work(std::atomic<int>* nextSource, bool withPaths)
+{
+	if ((size_t)nextSource->load() >= m_Sources.size())
+		return;
+
+	// Every thread owns its field, which is reused for all of its sources
+	FlowField field(m_RawMap);
+	for (;;)
+	{
+		int source = (*nextSource)++;
+		if (source >= (int)m_Sources.size())
+			return;
+
+		field.Build(m_Sources[source], m_Targets);
+		for (size_t target = 0; target < m_Targets.size(); target++)
+		{
+			Coordinate current = m_Targets[target];
+			if (!field.IsWalkable(current.X, current.Y) || field.GetDistance(current.X, current.Y) == FlowField::Unreachable)
+				continue;
+
+			// The field flows towards the source, so walk it backwards from the target
+			std::vector<Coordinate>* path = withPaths ? &m_Paths[source * m_Targets.size() + target] : nullptr;
+			double length = 0;
+			if (path != nullptr)
+				path->push_back(current);
+			while (field.GetDirection(current.X, current.Y) != FlowField::None)
+			{
+				Coordinate next = field.GetNextMove(current.X, current.Y);
+				length += (next.X != current.X && next.Y != current.Y) ? std::sqrt(2.0) : 1.0;
+				current = next;
+				if (path != nullptr)
+					path->push_back(current);
+			}
+			if (path != nullptr)
+				std::reverse(path->begin(), path->end());
+
+			m_Distance[source * m_Targets.size() + target] = length;
+		}
+	}
+}
+
+#endif
\ No newline at end of file
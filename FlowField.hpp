@@ -0,0 +1,649 @@
+#ifndef FLOWFIELD_HPP
+#define FLOWFIELD_HPP
+
+#include <climits>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Distance and direction field towards a single goal, for many units heading to the same place.
+/// It is built with one reverse Dijkstra from the goal, after which every unit can read its
+/// next move in constant time. Costs use the same 10/14 weights as <see cref="AStar"/>.
+/// </summary>
+class FlowField
+{
+public:
+	/// <summary>
+	/// Distance of cells that can't reach the goal, or lie outside the radius of the field.
+	/// </summary>
+	static const int Unreachable = INT_MAX;
+
+	/// <summary>
+	/// Direction of cells that have no next move, i.e. the goal itself and unreachable cells.
+	/// </summary>
+	static const int None = 8;
+
+	FlowField(DV1419Map* map);
+
+	void Build(Coordinate goal, int radius = 0);
+	void Build(Coordinate goal, const std::vector<Coordinate>& settle);
+	void BuildParallel(Coordinate goal, int threads, int radius = 0);
+	void SetWalkable(int x, int y, bool walkable);
+
+	int GetWidth() const { return m_MapWidth; }
+	int GetHeight() const { return m_MapHeight; }
+	Coordinate GetGoal() const { return m_Goal; }
+	int GetDistance(int x, int y) const { return m_Distance[y * m_MapWidth + x]; }
+	int GetDirection(int x, int y) const { return m_Direction[y * m_MapWidth + x]; }
+	Coordinate GetNextMove(int x, int y) const;
+	bool IsWalkable(int x, int y) const;
+	std::vector<Coordinate>* Path(Coordinate from) const;
+
+	/// <summary>
+	/// Offsets and costs of the eight moves, indexed by direction.
+	/// </summary>
+	static const int DirectionX[8];
+	static const int DirectionY[8];
+	static const int DirectionCost[8];
+
+private:
+	bool IsLegalMove(int x, int y, int direction) const;
+	int Opposite(int direction) const { return (direction + 4) % 8; }
+	void Propagate(std::vector<std::vector<int> >& buckets, int current);
+	void Push(std::vector<std::vector<int> >& buckets, int index);
+	void Repair(const std::vector<int>& seeds);
+	bool Reseed(int index);
+	void ComputeDirections(int firstRow, int lastRow);
+	void Invalidate(int index, std::vector<int>& invalid);
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	Coordinate m_Goal;
+	int m_MaxDistance;
+	std::vector<bool> m_Settle;
+	int m_SettleLeft;
+	std::vector<int> m_Distance;
+	std::vector<unsigned char> m_Direction;
+};
+
+const int FlowField::Unreachable;
+const int FlowField::None;
+
+// Directions go around the compass so that the opposite of d is (d + 4) % 8
+const int FlowField::DirectionX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int FlowField::DirectionY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const int FlowField::DirectionCost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+/// <summary>
+/// Initializes a new instance of the <see cref="FlowField"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+FlowField::FlowField(DV1419Map* map)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	m_Goal = Coordinate(-1, -1);
+	m_MaxDistance = Unreachable;
+	m_Settle.assign(m_MapWidth * m_MapHeight, false);
+	m_SettleLeft = 0;
+	m_Distance.assign(m_MapWidth * m_MapHeight, Unreachable);
+	m_Direction.assign(m_MapWidth * m_MapHeight, None);
+}
+
+/// <summary>
+/// Builds the field with a single threaded Dijkstra search from the goal.
+/// </summary>
+/// <param name="goal">The goal.</param>
+/// <param name="radius">Only cells up to this path distance from the goal are covered, 0 covers the whole map.</param>
+void FlowField::Build(Coordinate goal, int radius)
+{
+	m_Goal = goal;
+	m_MaxDistance = (radius > 0) ? radius * 10 : Unreachable;
+	std::fill(m_Distance.begin(), m_Distance.end(), Unreachable);
+	std::fill(m_Direction.begin(), m_Direction.end(), None);
+
+	if (!IsWalkable(goal.X, goal.Y))
+		return;
+
+	// Costs are small integers, so a ring of buckets (one per cost) replaces the priority queue
+	std::vector<std::vector<int> > buckets(15);
+	int goalIndex = goal.Y * m_MapWidth + goal.X;
+	m_Distance[goalIndex] = 0;
+	buckets[0].push_back(goalIndex);
+	Propagate(buckets, 0);
+}
+
+/// <summary>
+/// Builds the field only as far as needed for the given cells to be final.
+/// Their distances and flow are exact, the rest of the field may not be.
+/// </summary>
+/// <param name="goal">The goal.</param>
+/// <param name="settle">The cells of interest. Cells off the map or blocked are left unreachable.</param>
+void FlowField::Build(Coordinate goal, const std::vector<Coordinate>& settle)
+{
+	m_SettleLeft = 0;
+	for (size_t i = 0; i < settle.size(); i++)
+	{
+		// The search never gets there, so waiting for them would just cover the whole map
+		if (!IsWalkable(settle[i].X, settle[i].Y))
+			continue;
+		int index = settle[i].Y * m_MapWidth + settle[i].X;
+		if (!m_Settle[index])
+		{
+			m_Settle[index] = true;
+			m_SettleLeft++;
+		}
+	}
+
+	Build(goal);
+
+	// Cells that couldn't be reached are still marked
+	for (size_t i = 0; i < settle.size(); i++)
+		if (IsWalkable(settle[i].X, settle[i].Y))
+			m_Settle[settle[i].Y * m_MapWidth + settle[i].X] = false;
+	m_SettleLeft = 0;
+}
+
+/// <summary>
+/// Builds the field with several threads. Every edge costs at least 10, so all cells with a
+/// distance in [10k, 10k + 10) are final at the same time and their whole wavefront can be
+/// expanded in parallel before moving on to the next one.
+/// </summary>
+/// <param name="goal">The goal.</param>
+/// <param name="threads">The number of threads.</param>
+/// <param name="radius">Only cells up to this path distance from the goal are covered, 0 covers the whole map.</param>
+void FlowField::BuildParallel(Coordinate goal, int threads, int radius)
+{
+	m_Goal = goal;
+	m_MaxDistance = (radius > 0) ? radius * 10 : Unreachable;
+	std::fill(m_Direction.begin(), m_Direction.end(), None);
+
+	int size = m_MapWidth * m_MapHeight;
+	std::vector<std::atomic<int> > distance(size);
+	std::vector<std::atomic<bool> > expanded(size);
+	for (int i = 0; i < size; i++)
+	{
+		distance[i].store(Unreachable, std::memory_order_relaxed);
+		expanded[i].store(false, std::memory_order_relaxed);
+	}
+
+	if (IsWalkable(goal.X, goal.Y))
+	{
+		// Wavefronts by bucket index, every thread collects what it generates in its own lists
+		std::vector<std::vector<int> > wavefronts(1);
+		std::vector<std::vector<std::vector<int> > > generated(threads, std::vector<std::vector<int> >(3));
+		int goalIndex = goal.Y * m_MapWidth + goal.X;
+		distance[goalIndex] = 0;
+		wavefronts[0].push_back(goalIndex);
+
+		// Every thread waits for the others after expanding its share, and after thread 0 has merged
+		std::mutex barrierMutex;
+		std::condition_variable barrier;
+		int arrived = 0;
+		unsigned int phase = 0;
+		size_t bucket = 0;
+		bool done = false;
+		auto wait = [&]()
+		{
+			std::unique_lock<std::mutex> lock(barrierMutex);
+			unsigned int myPhase = phase;
+			if (++arrived == threads)
+			{
+				arrived = 0;
+				phase++;
+				barrier.notify_all();
+			}
+			else
+			{
+				barrier.wait(lock, [&]() { return phase != myPhase; });
+			}
+		};
+
+		auto worker = [&](int thread)
+		{
+			while (!done)
+			{
+				const std::vector<int>& wavefront = wavefronts[bucket];
+				int low = (int)bucket * 10;
+				for (size_t i = thread; i < wavefront.size(); i += threads)
+				{
+					int index = wavefront[i];
+					int d = distance[index].load(std::memory_order_relaxed);
+					// Stale entry, the cell improved into an earlier wavefront
+					if (d < low || expanded[index].exchange(true))
+						continue;
+
+					int x = index % m_MapWidth;
+					int y = index / m_MapWidth;
+					for (int direction = 0; direction < 8; direction++)
+					{
+						if (!IsLegalMove(x, y, direction))
+							continue;
+
+						int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+						int candidate = d + DirectionCost[direction];
+						if (candidate > m_MaxDistance)
+							continue;
+
+						// Atomic minimum
+						int current = distance[neighbour].load(std::memory_order_relaxed);
+						while (candidate < current && !distance[neighbour].compare_exchange_weak(current, candidate))
+							;
+						if (candidate < current)
+							generated[thread][candidate / 10 - bucket - 1].push_back(neighbour);
+					}
+				}
+
+				wait();
+				if (thread == 0)
+				{
+					// Merge everything generated into the upcoming wavefronts and find the next non-empty one
+					for (int t = 0; t < threads; t++)
+					{
+						for (size_t ahead = 0; ahead < 3; ahead++)
+						{
+							size_t target = bucket + ahead + 1;
+							if (wavefronts.size() <= target)
+								wavefronts.resize(target + 1);
+							wavefronts[target].insert(wavefronts[target].end(), generated[t][ahead].begin(), generated[t][ahead].end());
+							generated[t][ahead].clear();
+						}
+					}
+					std::vector<int>().swap(wavefronts[bucket]);
+					bucket++;
+					while (bucket < wavefronts.size() && wavefronts[bucket].empty())
+						bucket++;
+					done = (bucket >= wavefronts.size());
+				}
+				wait();
+			}
+		};
+
+		std::vector<std::thread> team;
+		for (int t = 1; t < threads; t++)
+			team.push_back(std::thread(worker, t));
+		worker(0);
+		for (size_t t = 0; t < team.size(); t++)
+			team[t].join();
+	}
+
+	for (int i = 0; i < size; i++)
+		m_Distance[i] = distance[i].load(std::memory_order_relaxed);
+
+	// Directions only depend on the final distances, so rows can be split between threads
+	std::vector<std::thread> team;
+	int rowsPerThread = (m_MapHeight + threads - 1) / threads;
+	for (int t = 0; t < threads; t++)
+	{
+		int firstRow = t * rowsPerThread;
+		int lastRow = std::min(m_MapHeight, firstRow + rowsPerThread) - 1;
+		if (firstRow <= lastRow)
+			team.push_back(std::thread(&FlowField::ComputeDirections, this, firstRow, lastRow));
+	}
+	for (size_t t = 0; t < team.size(); t++)
+		team[t].join();
+}
+
+/// <summary>
+/// Changes the walkability of a cell and repairs the field around it, without rebuilding it.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="walkable">Whether the cell is walkable.</param>
+void FlowField::SetWalkable(int x, int y, bool walkable)
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight || IsWalkable(x, y) == walkable)
+		return;
+
+	int index = y * m_MapWidth + x;
+	std::vector<int> seeds;
+
+	if (!walkable)
+	{
+		// Blocking only makes distances longer. Everything that went through the cell, or squeezed
+		// past it diagonally, has to be recomputed. All other cells are still correct.
+		std::vector<int> invalid;
+		Invalidate(index, invalid);
+		for (int direction = 0; direction < 8; direction += 2)
+		{
+			// A blocked cell is a corner of the diagonal moves between its orthogonal neighbours
+			int nx = x + DirectionX[direction];
+			int ny = y + DirectionY[direction];
+			if (nx < 0 || nx >= m_MapWidth || ny < 0 || ny >= m_MapHeight)
+				continue;
+
+			int neighbour = ny * m_MapWidth + nx;
+			int next = m_Direction[neighbour];
+			if (next != None && next % 2 == 1 && abs(nx + DirectionX[next] - x) + abs(ny + DirectionY[next] - y) == 1)
+				Invalidate(neighbour, invalid);
+		}
+		m_Map[index] = false;
+
+		// Reseed the invalidated region from its still valid border
+		for (size_t i = 0; i < invalid.size(); i++)
+		{
+			if (Reseed(invalid[i]))
+				seeds.push_back(invalid[i]);
+		}
+	}
+	else
+	{
+		// Freeing only makes distances shorter. The cell itself and any diagonal move it used
+		// to block can open up new shortcuts, so look at the whole 3x3 block around it.
+		m_Map[index] = true;
+		if (x == m_Goal.X && y == m_Goal.Y)
+		{
+			m_Distance[index] = 0;
+			m_Direction[index] = None;
+			seeds.push_back(index);
+		}
+
+		for (int cy = y - 1; cy <= y + 1; cy++)
+		{
+			for (int cx = x - 1; cx <= x + 1; cx++)
+			{
+				if (cx >= 0 && cx < m_MapWidth && cy >= 0 && cy < m_MapHeight && Reseed(cy * m_MapWidth + cx))
+					seeds.push_back(cy * m_MapWidth + cx);
+			}
+		}
+	}
+
+	Repair(seeds);
+}
+
+/// <summary>
+/// Gets the cell a unit standing on the given cell should move to next.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>The next cell, or the same cell if it is the goal or can't reach it</returns>
+Coordinate FlowField::GetNextMove(int x, int y) const
+{
+	int direction = m_Direction[y * m_MapWidth + x];
+	if (direction == None)
+		return Coordinate(x, y);
+
+	return Coordinate(x + DirectionX[direction], y + DirectionY[direction]);
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool FlowField::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Follows the field from a cell to the goal.
+/// </summary>
+/// <param name="from">The coordinate to start at.</param>
+/// <returns>A vector of coordinates that represents the path, empty if the goal can't be reached</returns>
+std::vector<Coordinate>* FlowField::Path(Coordinate from) const
+{
+	std::vector<Coordinate>* path = new std::vector<Coordinate>;
+	if (!IsWalkable(from.X, from.Y) || GetDistance(from.X, from.Y) == Unreachable)
+		return path;
+
+	Coordinate current = from;
+	path->push_back(current);
+	while (current.X != m_Goal.X || current.Y != m_Goal.Y)
+	{
+		current = GetNextMove(current.X, current.Y);
+		path->push_back(current);
+	}
+
+	return path;
+}
+
+/// <summary>
+/// Determines whether a move in the given direction is legal, without cutting corners.
+/// Moves are symmetric, so this is also the legality of the move back.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="direction">The direction.</param>
+/// <returns></returns>
+bool FlowField::IsLegalMove(int x, int y, int direction) const
+{
+	int dx = DirectionX[direction];
+	int dy = DirectionY[direction];
+	if (!IsWalkable(x + dx, y + dy))
+		return false;
+
+	// Don't cut corners
+	if (dx != 0 && dy != 0 && (!IsWalkable(x + dx, y) || !IsWalkable(x, y + dy)))
+		return false;
+
+	return true;
+}
+
+/// <summary>
+/// Runs the bucketed Dijkstra search until the buckets run dry.
+/// </summary>
+/// <param name="buckets">Ring of buckets, indexed by distance modulo its size.</param>
+/// <param name="current">The lowest distance in the buckets.</param>
+void FlowField::Propagate(std::vector<std::vector<int> >& buckets, int current)
+{
+	int queued = 0;
+	for (size_t i = 0; i < buckets.size(); i++)
+		queued += buckets[i].size();
+
+	while (queued > 0)
+	{
+		std::vector<int>& bucket = buckets[current % buckets.size()];
+		while (!bucket.empty())
+		{
+			int index = bucket.back();
+			bucket.pop_back();
+			queued--;
+
+			// Stale entry, the cell was improved after it was queued here
+			if (m_Distance[index] != current)
+				continue;
+
+			// Stop as soon as every cell we were asked to settle is final
+			if (m_SettleLeft > 0 && m_Settle[index])
+			{
+				m_Settle[index] = false;
+				if (--m_SettleLeft == 0)
+					return;
+			}
+
+			int x = index % m_MapWidth;
+			int y = index / m_MapWidth;
+			for (int direction = 0; direction < 8; direction++)
+			{
+				if (!IsLegalMove(x, y, direction))
+					continue;
+
+				int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+				int candidate = current + DirectionCost[direction];
+				if (candidate < m_Distance[neighbour] && candidate <= m_MaxDistance)
+				{
+					m_Distance[neighbour] = candidate;
+					// The neighbour steps back the way we came
+					m_Direction[neighbour] = Opposite(direction);
+					Push(buckets, neighbour);
+					queued++;
+				}
+			}
+		}
+		current++;
+	}
+}
+
+/// <summary>
+/// Queues a cell in the bucket for its current distance.
+/// </summary>
+/// <param name="buckets">The buckets.</param>
+/// <param name="index">The cell index.</param>
+void FlowField::Push(std::vector<std::vector<int> >& buckets, int index)
+{
+	buckets[m_Distance[index] % buckets.size()].push_back(index);
+}
+
+/// <summary>
+/// Runs Dijkstra from a set of seed cells with arbitrary distances, for repairs after an edit.
+/// </summary>
+/// <param name="seeds">The cells to start from.</param>
+void FlowField::Repair(const std::vector<int>& seeds)
+{
+	typedef std::pair<int, int> Entry;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > open;
+	for (size_t i = 0; i < seeds.size(); i++)
+		open.push(Entry(m_Distance[seeds[i]], seeds[i]));
+
+	while (!open.empty())
+	{
+		Entry entry = open.top();
+		open.pop();
+
+		int index = entry.second;
+		if (m_Distance[index] != entry.first)
+			continue;
+
+		int x = index % m_MapWidth;
+		int y = index / m_MapWidth;
+		for (int direction = 0; direction < 8; direction++)
+		{
+			if (!IsLegalMove(x, y, direction))
+				continue;
+
+			int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+			int candidate = entry.first + DirectionCost[direction];
+			if (candidate < m_Distance[neighbour] && candidate <= m_MaxDistance)
+			{
+				m_Distance[neighbour] = candidate;
+				m_Direction[neighbour] = Opposite(direction);
+				open.push(Entry(candidate, neighbour));
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Improves a cell from its neighbours, if any of them offers a shorter way to the goal.
+/// </summary>
+/// <param name="index">The cell index.</param>
+/// <returns>True if the cell can reach the goal</returns>
+bool FlowField::Reseed(int index)
+{
+	int x = index % m_MapWidth;
+	int y = index / m_MapWidth;
+	if (!IsWalkable(x, y))
+		return false;
+
+	for (int direction = 0; direction < 8; direction++)
+	{
+		if (!IsLegalMove(x, y, direction))
+			continue;
+
+		int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+		if (m_Distance[neighbour] == Unreachable)
+			continue;
+
+		int candidate = m_Distance[neighbour] + DirectionCost[direction];
+		if (candidate < m_Distance[index] && candidate <= m_MaxDistance)
+		{
+			m_Distance[index] = candidate;
+			m_Direction[index] = direction;
+		}
+	}
+
+	return m_Distance[index] != Unreachable;
+}
+
+/// <summary>
+/// Points every cell in a range of rows at its best neighbour.
+/// </summary>
+/// <param name="firstRow">The first row.</param>
+/// <param name="lastRow">The last row.</param>
+void FlowField::ComputeDirections(int firstRow, int lastRow)
+{
+	for (int y = firstRow; y <= lastRow; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			int index = y * m_MapWidth + x;
+			m_Direction[index] = None;
+			if (m_Distance[index] == Unreachable || m_Distance[index] == 0)
+				continue;
+
+			int best = m_Distance[index];
+			for (int direction = 0; direction < 8; direction++)
+			{
+				if (!IsLegalMove(x, y, direction))
+					continue;
+
+				int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+				if (m_Distance[neighbour] != Unreachable && m_Distance[neighbour] + DirectionCost[direction] <= best)
+				{
+					best = m_Distance[neighbour] + DirectionCost[direction];
+					m_Direction[index] = direction;
+					break;
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Resets a cell and every cell whose flow passes through it.
+/// </summary>
+/// <param name="index">The cell index.</param>
+/// <param name="invalid">Receives the reset cells.</param>
+void FlowField::Invalidate(int index, std::vector<int>& invalid)
+{
+	if (m_Distance[index] == Unreachable)
+		return;
+
+	size_t first = invalid.size();
+	m_Distance[index] = Unreachable;
+	m_Direction[index] = None;
+	invalid.push_back(index);
+
+	// Walk the tree of next moves backwards
+	for (size_t i = first; i < invalid.size(); i++)
+	{
+		int cell = invalid[i];
+		int x = cell % m_MapWidth;
+		int y = cell / m_MapWidth;
+		for (int direction = 0; direction < 8; direction++)
+		{
+			int nx = x + DirectionX[direction];
+			int ny = y + DirectionY[direction];
+			if (nx < 0 || nx >= m_MapWidth || ny < 0 || ny >= m_MapHeight)
+				continue;
+
+			int neighbour = ny * m_MapWidth + nx;
+			if (m_Direction[neighbour] == Opposite(direction) && m_Distance[neighbour] != Unreachable)
+			{
+				m_Distance[neighbour] = Unreachable;
+				m_Direction[neighbour] = None;
+				invalid.push_back(neighbour);
+			}
+		}
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,270 @@
+#ifndef FRINGESEARCH_HPP
+#define FRINGESEARCH_HPP
+
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Fringe Search. Instead of a priority queue it keeps the fringe in a doubly linked list
+/// threaded through the cells, and sweeps it over and over with a rising F limit like IDA*,
+/// but without redoing work between iterations. Nodes above the limit stay in the list for
+/// the next sweep ("later"), the others are expanded right away ("now") and their children are
+/// inserted right behind them, so they are visited in the same sweep.
+/// All per-cell state lives in one flat array, and costs are the same 10/14 as <see cref="AStar"/>.
+/// </summary>
+class FringeSearch
+{
+public:
+	FringeSearch(DV1419Map* map);
+
+	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+	size_t GetMemoryUsage() const;
+
+	unsigned int m_ExpandedNodes;
+	unsigned int m_Iterations;
+
+private:
+	/// <summary>
+	/// The search state of a cell, and its links in the fringe list.
+	/// </summary>
+	struct Cell
+	{
+		int G;
+		int Parent;
+		int Previous;
+		int Next;
+		// The search this cell was last touched by, older cells count as unvisited
+		unsigned int Generation;
+		bool InFringe;
+	};
+
+	bool IsWalkable(int x, int y) const;
+	int Estimate(int index) const;
+	void InsertAfter(int index, int after);
+	void Unlink(int index);
+	std::vector<Coordinate>* ReconstructPath(int index) const;
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	// One cell per map cell, followed by the head of the fringe list
+	std::vector<Cell> m_Cells;
+	int m_Head;
+	unsigned int m_Generation;
+	int m_GoalX, m_GoalY;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="FringeSearch"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+FringeSearch::FringeSearch(DV1419Map* map)
+	: m_ExpandedNodes(0), m_Iterations(0), m_Generation(0), m_GoalX(0), m_GoalY(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	Cell empty = { 0, -1, -1, -1, 0, false };
+	m_Cells.assign(m_MapWidth * m_MapHeight + 1, empty);
+	m_Head = m_MapWidth * m_MapHeight;
+}
+
+/// <summary>
+/// Finds a path.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>A vector of coordinates that represents the path, empty if there is none</returns>
+std::vector<Coordinate>* FringeSearch::Path(Coordinate start, Coordinate goal)
+{
+	m_ExpandedNodes = 0;
+	m_Iterations = 0;
+	if (!IsWalkable(start.X, start.Y) || !IsWalkable(goal.X, goal.Y))
+		return new std::vector<Coordinate>;
+
+	// Start a new generation instead of clearing every cell
+	m_Generation++;
+	if (m_Generation == 0)
+	{
+		for (size_t i = 0; i < m_Cells.size(); i++)
+			m_Cells[i].Generation = 0;
+		m_Generation = 1;
+	}
+	m_GoalX = goal.X;
+	m_GoalY = goal.Y;
+
+	Cell& head = m_Cells[m_Head];
+	head.Previous = m_Head;
+	head.Next = m_Head;
+
+	int startIndex = start.Y * m_MapWidth + start.X;
+	int goalIndex = goal.Y * m_MapWidth + goal.X;
+	Cell& first = m_Cells[startIndex];
+	first.G = 0;
+	first.Parent = -1;
+	first.Generation = m_Generation;
+	first.InFringe = false;
+	InsertAfter(startIndex, m_Head);
+
+	int limit = Estimate(startIndex);
+	while (m_Cells[m_Head].Next != m_Head)
+	{
+		m_Iterations++;
+		int nextLimit = INT_MAX;
+		int index = m_Cells[m_Head].Next;
+		while (index != m_Head)
+		{
+			Cell& cell = m_Cells[index];
+			int f = cell.G + Estimate(index);
+
+			// Later, this one waits for the next sweep
+			if (f > limit)
+			{
+				nextLimit = min(nextLimit, f);
+				index = cell.Next;
+				continue;
+			}
+
+			if (index == goalIndex)
+			{
+				std::vector<Coordinate>* path = ReconstructPath(index);
+				// Leave the list empty for the next search
+				while (m_Cells[m_Head].Next != m_Head)
+					Unlink(m_Cells[m_Head].Next);
+				return path;
+			}
+
+			// Now, expand it and put the children right behind it so this sweep reaches them next.
+			// They are inserted in reverse so they end up in the usual order.
+			m_ExpandedNodes++;
+			int x = index % m_MapWidth;
+			int y = index / m_MapWidth;
+			for (int direction = 7; direction >= 0; direction--)
+			{
+				static const int offsetX[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+				static const int offsetY[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+				int dx = offsetX[direction];
+				int dy = offsetY[direction];
+				if (!IsWalkable(x + dx, y + dy))
+					continue;
+
+				// Don't cut corners
+				bool isDiagonal = dx != 0 && dy != 0;
+				if (isDiagonal && (!IsWalkable(x + dx, y) || !IsWalkable(x, y + dy)))
+					continue;
+
+				int child = index + dy * m_MapWidth + dx;
+				int g = cell.G + (isDiagonal ? 14 : 10);
+				Cell& childCell = m_Cells[child];
+				if (childCell.Generation == m_Generation)
+				{
+					if (g >= childCell.G)
+						continue;
+					if (childCell.InFringe)
+						Unlink(child);
+				}
+
+				childCell.G = g;
+				childCell.Parent = index;
+				childCell.Generation = m_Generation;
+				InsertAfter(child, index);
+			}
+
+			int next = cell.Next;
+			Unlink(index);
+			index = next;
+		}
+
+		limit = nextLimit;
+	}
+
+	return new std::vector<Coordinate>;
+}
+
+/// <summary>
+/// Gets the memory held by the search state, not counting the map it was built from.
+/// </summary>
+/// <returns>The number of bytes</returns>
+size_t FringeSearch::GetMemoryUsage() const
+{
+	return m_Cells.capacity() * sizeof(Cell) + m_Map.capacity() / 8;
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool FringeSearch::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Octile distance to the goal, scaled like G.
+/// </summary>
+/// <param name="index">The cell index.</param>
+/// <returns></returns>
+int FringeSearch::Estimate(int index) const
+{
+	int xDist = abs(index % m_MapWidth - m_GoalX);
+	int yDist = abs(index / m_MapWidth - m_GoalY);
+	return 14 * min(xDist, yDist) + 10 * abs(xDist - yDist);
+}
+
+/// <summary>
+/// Links a cell into the fringe right after another one.
+/// </summary>
+/// <param name="index">The cell to insert.</param>
+/// <param name="after">The cell, or the head, to insert after.</param>
+void FringeSearch::InsertAfter(int index, int after)
+{
+	Cell& cell = m_Cells[index];
+	int next = m_Cells[after].Next;
+	cell.Previous = after;
+	cell.Next = next;
+	m_Cells[after].Next = index;
+	m_Cells[next].Previous = index;
+	cell.InFringe = true;
+}
+
+/// <summary>
+/// Takes a cell out of the fringe.
+/// </summary>
+/// <param name="index">The cell.</param>
+void FringeSearch::Unlink(int index)
+{
+	Cell& cell = m_Cells[index];
+	m_Cells[cell.Previous].Next = cell.Next;
+	m_Cells[cell.Next].Previous = cell.Previous;
+	cell.InFringe = false;
+}
+
+/// <summary>
+/// Reconstructs the path by following the parents back up.
+/// </summary>
+/// <param name="index">The last cell of the path.</param>
+/// <returns>A vector of coordinates that represents the path</returns>
+std::vector<Coordinate>* FringeSearch::ReconstructPath(int index) const
+{
+	std::vector<Coordinate>* path = new std::vector<Coordinate>;
+	for (; index >= 0; index = m_Cells[index].Parent)
+		path->push_back(Coordinate(index % m_MapWidth, index / m_MapWidth));
+	std::reverse(path->begin(), path->end());
+
+	return path;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,412 @@
+#ifndef GOALBOUNDS_HPP
+#define GOALBOUNDS_HPP
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <thread>
+#ifdef _WIN32
+// Keep windows.h from defining min and max macros, the headers after this one use std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "DV1419Map.h"
+
+/// <summary>
+/// Goal bounding. For every walkable cell and each of its 8 moves, holds the bounding box of all
+/// the cells whose optimal path from that cell starts with that move. A search can skip every
+/// move whose box doesn't contain the goal, since that move can't start an optimal path to it.
+/// Building takes one Dijkstra search per walkable cell, so it is spread over all cores and the
+/// result is meant to be saved and memory-mapped at startup.
+/// </summary>
+class GoalBounds
+{
+public:
+	/// <summary>
+	/// A bounding box, inclusive. Boxes of moves that start no optimal path are empty, with MinX > MaxX.
+	/// </summary>
+	struct Box
+	{
+		unsigned short MinX, MinY, MaxX, MaxY;
+	};
+
+	/// <summary>
+	/// Offsets of the eight moves, indexed by direction. The same compass order as <see cref="FlowField"/>.
+	/// </summary>
+	static const int DirectionX[8];
+	static const int DirectionY[8];
+
+	GoalBounds(DV1419Map* map);
+	~GoalBounds();
+
+	void Build(int threads);
+	bool Save(const char* filename) const;
+	bool Load(const char* filename);
+
+	bool IsLoaded() const { return m_Boxes != nullptr; }
+	bool IsMapped() const { return m_MappedView != nullptr; }
+	const Box& GetBox(int x, int y, int direction) const { return m_Boxes[(y * m_MapWidth + x) * 8 + direction]; }
+	bool Allows(int x, int y, int direction, int goalX, int goalY) const;
+	static int GetDirection(int dx, int dy);
+
+private:
+	/// <summary>
+	/// The start of the file, the boxes follow right after it in cell order.
+	/// </summary>
+	struct Header
+	{
+		char Magic[4];
+		unsigned int Version;
+		unsigned int Width;
+		unsigned int Height;
+	};
+
+	void Work(std::atomic<int>* nextCell);
+	void Sweep(int source, std::vector<int>& distance, std::vector<unsigned char>& firstMove, std::vector<int>& reached);
+	bool IsWalkable(int x, int y) const;
+	bool IsLegalMove(int x, int y, int direction) const;
+	void Unmap();
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	// Points either into m_OwnedBoxes or into the mapped file
+	const Box* m_Boxes;
+	std::vector<Box> m_OwnedBoxes;
+	void* m_MappedView;
+	size_t m_MappedSize;
+#ifdef _WIN32
+	HANDLE m_File;
+	HANDLE m_Mapping;
+#endif
+};
+
+const int GoalBounds::DirectionX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int GoalBounds::DirectionY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+/// <summary>
+/// Initializes a new instance of the <see cref="GoalBounds"/> class. There are no bounds until they are built or loaded.
+/// </summary>
+/// <param name="map">The map.</param>
+GoalBounds::GoalBounds(DV1419Map* map)
+	: m_Boxes(nullptr), m_MappedView(nullptr), m_MappedSize(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = NULL;
+#endif
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="GoalBounds"/> class.
+/// </summary>
+GoalBounds::~GoalBounds()
+{
+	Unmap();
+}
+
+/// <summary>
+/// Computes the bounds with one Dijkstra search from every walkable cell.
+/// </summary>
+/// <param name="threads">The number of threads to use.</param>
+void GoalBounds::Build(int threads)
+{
+	Unmap();
+
+	Box empty = { 0xFFFF, 0xFFFF, 0, 0 };
+	m_OwnedBoxes.assign(m_MapWidth * m_MapHeight * 8, empty);
+	m_Boxes = &m_OwnedBoxes[0];
+
+	// Cells are handed out one at a time, every thread only writes the boxes of its own cells
+	std::atomic<int> nextCell(0);
+	std::vector<std::thread> team;
+	for (int i = 1; i < threads; i++)
+		team.push_back(std::thread(&GoalBounds::Work, this, &nextCell));
+	Work(&nextCell);
+	for (size_t i = 0; i < team.size(); i++)
+		team[i].join();
+}
+
+/// <summary>
+/// Writes the bounds to a file that <see cref="Load"/> can map straight into memory.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if there are no bounds or the file couldn't be written</returns>
+bool GoalBounds::Save(const char* filename) const
+{
+	if (m_Boxes == nullptr)
+		return false;
+
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	Header header;
+	memcpy(header.Magic, "GBND", 4);
+	header.Version = 1;
+	header.Width = m_MapWidth;
+	header.Height = m_MapHeight;
+	size_t count = m_MapWidth * m_MapHeight * 8;
+	bool written = fwrite(&header, sizeof(Header), 1, file) == 1
+		&& fwrite(m_Boxes, sizeof(Box), count, file) == count;
+
+	return fclose(file) == 0 && written;
+}
+
+/// <summary>
+/// Maps a file written by <see cref="Save"/>. The boxes are used in place, so only the pages
+/// that queries touch are ever read from disk.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file is missing, malformed or was built for a map of another size</returns>
+bool GoalBounds::Load(const char* filename)
+{
+	Unmap();
+
+	size_t expectedSize = sizeof(Header) + m_MapWidth * m_MapHeight * 8 * sizeof(Box);
+#ifdef _WIN32
+	m_File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size) || (size_t)size.QuadPart != expectedSize)
+	{
+		Unmap();
+		return false;
+	}
+	m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_Mapping == NULL)
+	{
+		Unmap();
+		return false;
+	}
+	m_MappedView = MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || (size_t)status.st_size != expectedSize)
+	{
+		close(file);
+		return false;
+	}
+	m_MappedView = mmap(nullptr, expectedSize, PROT_READ, MAP_SHARED, file, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(file);
+	if (m_MappedView == MAP_FAILED)
+		m_MappedView = nullptr;
+#endif
+	if (m_MappedView == nullptr)
+	{
+		Unmap();
+		return false;
+	}
+	m_MappedSize = expectedSize;
+
+	const Header* header = (const Header*)m_MappedView;
+	if (memcmp(header->Magic, "GBND", 4) != 0 || header->Version != 1
+		|| header->Width != (unsigned int)m_MapWidth || header->Height != (unsigned int)m_MapHeight)
+	{
+		Unmap();
+		return false;
+	}
+
+	m_OwnedBoxes.clear();
+	m_Boxes = (const Box*)(header + 1);
+	return true;
+}
+
+/// <summary>
+/// Determines whether a move can start an optimal path to the goal.
+/// </summary>
+/// <param name="x">The x-coordinate of the cell the move starts at.</param>
+/// <param name="y">The y-coordinate of the cell the move starts at.</param>
+/// <param name="direction">The direction of the move.</param>
+/// <param name="goalX">The x-coordinate of the goal.</param>
+/// <param name="goalY">The y-coordinate of the goal.</param>
+/// <returns></returns>
+bool GoalBounds::Allows(int x, int y, int direction, int goalX, int goalY) const
+{
+	const Box& box = GetBox(x, y, direction);
+	return goalX >= box.MinX && goalX <= box.MaxX && goalY >= box.MinY && goalY <= box.MaxY;
+}
+
+/// <summary>
+/// Gets the direction of a move.
+/// </summary>
+/// <param name="dx">The x-offset, -1 to 1.</param>
+/// <param name="dy">The y-offset, -1 to 1.</param>
+/// <returns>The direction, or -1 if the offset isn't a move</returns>
+int GoalBounds::GetDirection(int dx, int dy)
+{
+	// Indexed by (dy + 1) * 3 + dx + 1
+	static const int directions[9] = { 5, 6, 7, 4, -1, 0, 3, 2, 1 };
+	return directions[(dy + 1) * 3 + dx + 1];
+}
+
+/// <summary>
+/// Fills in the boxes of cells until every cell is taken.
+/// </summary>
+/// <param name="nextCell">The index of the next cell nobody has taken yet.</param>
+void GoalBounds::Work(std::atomic<int>* nextCell)
+{
+	std::vector<int> distance(m_MapWidth * m_MapHeight, INT_MAX);
+	std::vector<unsigned char> firstMove(m_MapWidth * m_MapHeight, 0);
+	std::vector<int> reached;
+	Box* boxes = &m_OwnedBoxes[0];
+
+	for (;;)
+	{
+		int source = (*nextCell)++;
+		if (source >= m_MapWidth * m_MapHeight)
+			return;
+		if (!m_Map[source])
+			continue;
+
+		Sweep(source, distance, firstMove, reached);
+		for (size_t i = 0; i < reached.size(); i++)
+		{
+			int cell = reached[i];
+			unsigned short x = cell % m_MapWidth;
+			unsigned short y = cell / m_MapWidth;
+			Box& box = boxes[source * 8 + firstMove[cell]];
+			box.MinX = min(box.MinX, x);
+			box.MinY = min(box.MinY, y);
+			box.MaxX = max(box.MaxX, x);
+			box.MaxY = max(box.MaxY, y);
+
+			distance[cell] = INT_MAX;
+		}
+		distance[source] = INT_MAX;
+	}
+}
+
+/// <summary>
+/// Dijkstra from one cell that labels every reached cell with the first move of its optimal path.
+/// </summary>
+/// <param name="source">The cell to search from.</param>
+/// <param name="distance">Distances, all unreached on entry. Only the reached cells and the source are set afterwards.</param>
+/// <param name="firstMove">Receives the first move for every reached cell.</param>
+/// <param name="reached">Receives every reached cell but the source.</param>
+void GoalBounds::Sweep(int source, std::vector<int>& distance, std::vector<unsigned char>& firstMove, std::vector<int>& reached)
+{
+	static const int cost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+	reached.clear();
+	// Costs are small integers, so a ring of buckets (one per cost) replaces the priority queue
+	std::vector<std::vector<int> > buckets(15);
+	distance[source] = 0;
+	buckets[0].push_back(source);
+	int queued = 1;
+	for (int current = 0; queued > 0; current++)
+	{
+		std::vector<int>& bucket = buckets[current % buckets.size()];
+		while (!bucket.empty())
+		{
+			int index = bucket.back();
+			bucket.pop_back();
+			queued--;
+			if (distance[index] != current)
+				continue;
+
+			int x = index % m_MapWidth;
+			int y = index / m_MapWidth;
+			for (int direction = 0; direction < 8; direction++)
+			{
+				if (!IsLegalMove(x, y, direction))
+					continue;
+
+				int neighbour = index + DirectionY[direction] * m_MapWidth + DirectionX[direction];
+				int candidate = current + cost[direction];
+				if (candidate < distance[neighbour])
+				{
+					if (distance[neighbour] == INT_MAX)
+						reached.push_back(neighbour);
+					distance[neighbour] = candidate;
+					// Ties keep the first move found, any optimal first move will do
+					firstMove[neighbour] = (index == source) ? direction : firstMove[index];
+					buckets[candidate % buckets.size()].push_back(neighbour);
+					queued++;
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool GoalBounds::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Determines whether a move in the given direction is legal, without cutting corners.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="direction">The direction.</param>
+/// <returns></returns>
+bool GoalBounds::IsLegalMove(int x, int y, int direction) const
+{
+	int dx = DirectionX[direction];
+	int dy = DirectionY[direction];
+	if (!IsWalkable(x + dx, y + dy))
+		return false;
+
+	return dx == 0 || dy == 0 || (IsWalkable(x + dx, y) && IsWalkable(x, y + dy));
+}
+
+/// <summary>
+/// Releases the mapped file, if any.
+/// </summary>
+void GoalBounds::Unmap()
+{
+#ifdef _WIN32
+	if (m_MappedView != nullptr)
+		UnmapViewOfFile(m_MappedView);
+	if (m_Mapping != NULL)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+	m_Mapping = NULL;
+	m_File = INVALID_HANDLE_VALUE;
+#else
+	if (m_MappedView != nullptr)
+		munmap(m_MappedView, m_MappedSize);
+#endif
+	if (m_MappedView != nullptr)
+		m_Boxes = nullptr;
+	m_MappedView = nullptr;
+	m_MappedSize = 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,159 @@
+#ifndef GRIDLAYOUT_HPP
+#define GRIDLAYOUT_HPP
+
+// Grids are stored row by row unless GRID_TILED_LAYOUT is defined, then they are stored as
+// 8x8 tiles so the neighbours of most cells are on the same cache line and page as the cell.
+// Set it in the project's preprocessor definitions, it switches every grid that uses GridLayout.
+
+/// <summary>
+/// Maps grid coordinates to storage indices, and steps from a cell to its neighbours with
+/// precomputed offsets instead of going back through the coordinates.
+/// </summary>
+class GridLayout
+{
+public:
+	static const int TileBits = 3;
+	static const int TileSize = 1 << TileBits;
+
+	GridLayout() : m_Width(0), m_Height(0), m_TilesPerRow(0), m_Size(0) { }
+	GridLayout(int width, int height);
+
+	int GetIndex(int x, int y) const;
+	int GetNeighbour(int index, int dx, int dy) const;
+	int GetSize() const { return m_Size; }
+	double GetCrossingRate(int elementSize, int blockSize) const;
+	static const char* GetName();
+
+private:
+	int m_Width;
+	int m_Height;
+	int m_TilesPerRow;
+	// The number of storage slots, tiles pad the grid up to whole tiles
+	int m_Size;
+
+	// The offset to the cells around a cell, by (dy + 1) * 3 + dx + 1. A row major grid
+	// needs one set, a tiled grid one per position in a tile, shared by every tile.
+#ifdef GRID_TILED_LAYOUT
+	int m_Offsets[TileSize * TileSize][9];
+#else
+	int m_Offsets[9];
+#endif
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="GridLayout"/> class.
+/// </summary>
+/// <param name="width">The width of the grid.</param>
+/// <param name="height">The height of the grid.</param>
+GridLayout::GridLayout(int width, int height)
+	: m_Width(width), m_Height(height)
+{
+	m_TilesPerRow = (width + TileSize - 1) / TileSize;
+#ifdef GRID_TILED_LAYOUT
+	m_Size = m_TilesPerRow * ((height + TileSize - 1) / TileSize) * TileSize * TileSize;
+	for (int localY = 0; localY < TileSize; localY++)
+	{
+		for (int localX = 0; localX < TileSize; localX++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					// Step into the next tile when the move leaves this one
+					int x = localX + dx;
+					int y = localY + dy;
+					int tileX = (x < 0) ? -1 : (x >= TileSize) ? 1 : 0;
+					int tileY = (y < 0) ? -1 : (y >= TileSize) ? 1 : 0;
+					int target = ((tileY * m_TilesPerRow + tileX) << (2 * TileBits)) + (((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1)));
+					m_Offsets[(localY << TileBits) | localX][(dy + 1) * 3 + dx + 1] = target - ((localY << TileBits) | localX);
+				}
+			}
+		}
+	}
+#else
+	m_Size = width * height;
+	for (int dy = -1; dy <= 1; dy++)
+		for (int dx = -1; dx <= 1; dx++)
+			m_Offsets[(dy + 1) * 3 + dx + 1] = dy * width + dx;
+#endif
+}
+
+/// <summary>
+/// Gets the storage index of a cell.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+inline int GridLayout::GetIndex(int x, int y) const
+{
+#ifdef GRID_TILED_LAYOUT
+	int tile = (y >> TileBits) * m_TilesPerRow + (x >> TileBits);
+	return (tile << (2 * TileBits)) | ((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1));
+#else
+	return y * m_Width + x;
+#endif
+}
+
+/// <summary>
+/// Gets the storage index of a neighbour. The neighbour has to be on the grid.
+/// </summary>
+/// <param name="index">The storage index of the cell.</param>
+/// <param name="dx">The x-offset, -1 to 1.</param>
+/// <param name="dy">The y-offset, -1 to 1.</param>
+/// <returns></returns>
+inline int GridLayout::GetNeighbour(int index, int dx, int dy) const
+{
+#ifdef GRID_TILED_LAYOUT
+	return index + m_Offsets[index & (TileSize * TileSize - 1)][(dy + 1) * 3 + dx + 1];
+#else
+	return index + m_Offsets[(dy + 1) * 3 + dx + 1];
+#endif
+}
+
+/// <summary>
+/// Gets how often stepping to a neighbour lands in another block of memory,
+/// for example another cache line or page, over every pair of neighbouring cells.
+/// </summary>
+/// <param name="elementSize">The size of one stored cell in bytes.</param>
+/// <param name="blockSize">The size of a block in bytes.</param>
+/// <returns>The fraction of steps that cross into another block</returns>
+double GridLayout::GetCrossingRate(int elementSize, int blockSize) const
+{
+	unsigned long long steps = 0, crossings = 0;
+	for (int y = 0; y < m_Height; y++)
+	{
+		for (int x = 0; x < m_Width; x++)
+		{
+			int index = GetIndex(x, y);
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					if ((dx == 0 && dy == 0) || x + dx < 0 || x + dx >= m_Width || y + dy < 0 || y + dy >= m_Height)
+						continue;
+
+					steps++;
+					if ((long long)index * elementSize / blockSize != (long long)GetNeighbour(index, dx, dy) * elementSize / blockSize)
+						crossings++;
+				}
+			}
+		}
+	}
+
+	return (steps == 0) ? 0 : (double)crossings / steps;
+}
+
+/// <summary>
+/// Gets the name of the layout this was compiled with.
+/// </summary>
+/// <returns></returns>
+const char* GridLayout::GetName()
+{
+#ifdef GRID_TILED_LAYOUT
+	return "tiled 8x8";
+#else
+	return "row major";
+#endif
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,224 @@
+#ifndef LINEOFSIGHT_HPP
+#define LINEOFSIGHT_HPP
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Grid line-of-sight test on a bit-packed copy of the map.
+/// A line between two cells is rasterized into an 8-connected cell path and is only
+/// considered visible if every move of that path is legal according to the same rules
+/// as <see cref="DV1419Map::getPathLength"/>, i.e. no blocked cells and no corner cutting.
+/// Cells are packed 64 to a word both row by row and column by column, so every
+/// horizontal or vertical run of the rasterized line is checked a word at a time.
+/// </summary>
+class LineOfSight
+{
+public:
+	LineOfSight(DV1419Map* map) { Initialize(map); }
+	void Initialize(DV1419Map* map);
+
+	int GetWidth() const { return m_MapWidth; }
+	int GetHeight() const { return m_MapHeight; }
+	bool IsWalkable(int x, int y) const;
+	bool IsVisible(Coordinate a, Coordinate b) const;
+	void Trace(Coordinate a, Coordinate b, std::vector<Coordinate>& cells) const;
+
+private:
+	static bool IsRunFree(const std::vector<uint64_t>& bits, int wordsPerLine, int lines, int length, int line, int from, int to);
+	static int RunStart(int run, int major, int minor);
+
+	int m_MapWidth;
+	int m_MapHeight;
+	int m_WordsPerRow;
+	int m_WordsPerColumn;
+	std::vector<uint64_t> m_Rows;
+	std::vector<uint64_t> m_Columns;
+};
+
+/// <summary>
+/// Packs the walkable cells of the map into row and column bitboards.
+/// </summary>
+/// <param name="map">The map.</param>
+void LineOfSight::Initialize(DV1419Map* map)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_WordsPerRow = (m_MapWidth + 63) / 64;
+	m_WordsPerColumn = (m_MapHeight + 63) / 64;
+	m_Rows.assign(m_MapHeight * m_WordsPerRow, 0);
+	m_Columns.assign(m_MapWidth * m_WordsPerColumn, 0);
+
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			if (!map->isWalkable(x, y))
+				continue;
+
+			m_Rows[y * m_WordsPerRow + x / 64] |= (uint64_t)1 << (x % 64);
+			m_Columns[x * m_WordsPerColumn + y / 64] |= (uint64_t)1 << (y % 64);
+		}
+	}
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool LineOfSight::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return (m_Rows[y * m_WordsPerRow + x / 64] >> (x % 64)) & 1;
+}
+
+/// <summary>
+/// Determines whether b can be reached from a by following the rasterized line between them.
+/// The result is symmetric in a and b.
+/// </summary>
+/// <param name="a">The first coordinate.</param>
+/// <param name="b">The second coordinate.</param>
+/// <returns>True if every move along the line is legal</returns>
+bool LineOfSight::IsVisible(Coordinate a, Coordinate b) const
+{
+	// Always rasterize in the same direction so that the test is symmetric
+	if (b.X < a.X || (b.X == a.X && b.Y < a.Y))
+		std::swap(a, b);
+
+	int dx = b.X - a.X;
+	int dy = abs(b.Y - a.Y);
+	int sy = (b.Y >= a.Y) ? 1 : -1;
+
+	if (dx >= dy)
+	{
+		// X-major: the line is a sequence of horizontal runs, one per row.
+		// A diagonal step between two runs needs the cell after the run and the
+		// cell before the next run to be free, so runs are widened by one cell.
+		for (int k = 0; k <= dy; k++)
+		{
+			int from = a.X + RunStart(k, dx, dy) - ((k > 0) ? 1 : 0);
+			int to = a.X + RunStart(k + 1, dx, dy) - 1 + ((k < dy) ? 1 : 0);
+			if (!IsRunFree(m_Rows, m_WordsPerRow, m_MapHeight, m_MapWidth, a.Y + sy * k, from, to))
+				return false;
+		}
+	}
+	else
+	{
+		// Y-major: vertical runs, one per column. The line may walk up or down, so
+		// the runs are checked in column space from the lowest y upwards.
+		for (int k = 0; k <= dx; k++)
+		{
+			int runFrom = RunStart(k, dy, dx) - ((k > 0) ? 1 : 0);
+			int runTo = RunStart(k + 1, dy, dx) - 1 + ((k < dx) ? 1 : 0);
+			int from = a.Y + sy * runFrom;
+			int to = a.Y + sy * runTo;
+			if (from > to)
+				std::swap(from, to);
+			if (!IsRunFree(m_Columns, m_WordsPerColumn, m_MapWidth, m_MapHeight, a.X + k, from, to))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Appends the cells of the rasterized line from a to b, excluding a itself.
+/// This is the cell path that <see cref="IsVisible"/> validates.
+/// </summary>
+/// <param name="a">The first coordinate.</param>
+/// <param name="b">The second coordinate.</param>
+/// <param name="cells">The vector to append the cells to.</param>
+void LineOfSight::Trace(Coordinate a, Coordinate b, std::vector<Coordinate>& cells) const
+{
+	bool reversed = (b.X < a.X || (b.X == a.X && b.Y < a.Y));
+	if (reversed)
+		std::swap(a, b);
+
+	int dx = b.X - a.X;
+	int dy = abs(b.Y - a.Y);
+	int sy = (b.Y >= a.Y) ? 1 : -1;
+	int steps = std::max(dx, dy);
+
+	size_t first = cells.size();
+	for (int i = 0; i <= steps; i++)
+	{
+		// Same rounding as RunStart, expressed per step instead of per run
+		int minor = (steps == 0) ? 0 : (2 * i * std::min(dx, dy) + steps) / (2 * steps);
+		if (dx >= dy)
+			cells.push_back(Coordinate(a.X + i, a.Y + sy * minor));
+		else
+			cells.push_back(Coordinate(a.X + minor, a.Y + sy * i));
+	}
+
+	// Drop the origin, which the caller already has
+	if (reversed)
+	{
+		std::reverse(cells.begin() + first, cells.end());
+		cells.erase(cells.begin() + first);
+	}
+	else
+	{
+		cells.erase(cells.begin() + first);
+	}
+}
+
+/// <summary>
+/// Checks that every bit in the inclusive range is set on the given line of a bitboard.
+/// </summary>
+/// <param name="bits">The bitboard.</param>
+/// <param name="wordsPerLine">The number of words per line.</param>
+/// <param name="lines">The number of lines in the bitboard.</param>
+/// <param name="length">The number of cells per line.</param>
+/// <param name="line">The row or column.</param>
+/// <param name="from">The first cell of the run.</param>
+/// <param name="to">The last cell of the run.</param>
+/// <returns></returns>
+bool LineOfSight::IsRunFree(const std::vector<uint64_t>& bits, int wordsPerLine, int lines, int length, int line, int from, int to)
+{
+	if (line < 0 || line >= lines || from < 0 || to >= length || from > to)
+		return false;
+
+	const uint64_t* words = &bits[line * wordsPerLine];
+	int firstWord = from / 64;
+	int lastWord = to / 64;
+	for (int w = firstWord; w <= lastWord; w++)
+	{
+		int lo = (w == firstWord) ? from % 64 : 0;
+		int hi = (w == lastWord) ? to % 64 : 63;
+		uint64_t mask = (hi == 63) ? ~(uint64_t)0 : (((uint64_t)1 << (hi + 1)) - 1);
+		mask &= ~(((uint64_t)1 << lo) - 1);
+		if ((words[w] & mask) != mask)
+			return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Gets the first step along the major axis that belongs to the given run,
+/// where step i lies on run round(i * minor / major).
+/// </summary>
+/// <param name="run">The run index.</param>
+/// <param name="major">The distance along the major axis.</param>
+/// <param name="minor">The distance along the minor axis.</param>
+/// <returns></returns>
+int LineOfSight::RunStart(int run, int major, int minor)
+{
+	if (run <= 0)
+		return 0;
+	if (run > minor)
+		return major + 1;
+
+	// Smallest i with 2 * i * minor + major >= 2 * run * major
+	int numerator = (2 * run - 1) * major;
+	return (numerator + 2 * minor - 1) / (2 * minor);
+}
+
+#endif
\ No newline at end of file
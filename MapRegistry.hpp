@@ -0,0 +1,295 @@
+#ifndef MAPREGISTRY_HPP
+#define MAPREGISTRY_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include "DV1419Map.h"
+#include "ScenarioLoader.h"
+
+/// <summary>
+/// Process-wide set of loaded maps. Every map is loaded once and then shared as an immutable
+/// handle by everything that asks for it, whatever path it was asked for by. Paths are normalized,
+/// and maps that turn out to have the same content as one already loaded share its handle too.
+/// Scenario files name maps by the path they had where the scenarios were made, so a path that
+/// doesn't exist is also looked up by its file name in the search directories.
+/// </summary>
+class MapRegistry
+{
+public:
+	typedef std::shared_ptr<const DV1419Map> Handle;
+
+	static MapRegistry& GetInstance();
+
+	void AddSearchDirectory(const std::string& directory);
+	Handle Get(const std::string& path);
+	Handle Resolve(const Experiment& experiment) { return Get(experiment.GetMapName()); }
+	void Preload(const std::vector<std::string>& paths, int threads);
+
+	size_t GetMapCount();
+	size_t GetDuplicateCount();
+	static std::string Normalize(const std::string& path);
+
+private:
+	MapRegistry() : m_Duplicates(0) { }
+	MapRegistry(const MapRegistry&);
+	MapRegistry& operator=(const MapRegistry&);
+
+	std::string Locate(const std::string& path);
+	Handle Load(const std::string& filename);
+	static unsigned long long Hash(const DV1419Map& map);
+	static bool Exists(const std::string& filename);
+
+	std::mutex m_Lock;
+	std::vector<std::string> m_Directories;
+	// What each asked for path turned out to be, so the file system is only searched once per name
+	std::map<std::string, std::string> m_Located;
+	// By normalized file path, set as soon as loading starts so nobody loads it twice
+	std::map<std::string, std::shared_future<Handle> > m_Maps;
+	// Every distinct map by content hash, to catch the same map under different names
+	std::multimap<unsigned long long, Handle> m_ByContent;
+	size_t m_Duplicates;
+};
+
+/// <summary>
+/// Gets the registry of this process.
+/// </summary>
+/// <returns></returns>
+MapRegistry& MapRegistry::GetInstance()
+{
+	static MapRegistry registry;
+	return registry;
+}
+
+/// <summary>
+/// Adds a directory to look for maps in when a path doesn't exist as given.
+/// </summary>
+/// <param name="directory">The directory.</param>
+void MapRegistry::AddSearchDirectory(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Directories.push_back(Normalize(directory));
+}
+
+/// <summary>
+/// Gets a map, loading it if nobody has yet. Safe to call from any thread, a thread asking for a map
+/// that another thread is loading waits for that load instead of starting its own.
+/// </summary>
+/// <param name="path">The path of the map file.</param>
+/// <returns>The map, or null if it can't be found</returns>
+MapRegistry::Handle MapRegistry::Get(const std::string& path)
+{
+	std::string filename = Locate(path);
+	if (filename.empty())
+		return Handle();
+
+	// Whoever registers the file first loads it, everyone else waits on that load
+	std::promise<Handle> loaded;
+	std::shared_future<Handle> pending;
+	bool loading = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<std::string, std::shared_future<Handle> >::iterator it = m_Maps.find(filename);
+		if (it != m_Maps.end())
+		{
+			pending = it->second;
+		}
+		else
+		{
+			m_Maps[filename] = loaded.get_future().share();
+			loading = true;
+		}
+	}
+	if (!loading)
+		return pending.get();
+
+	Handle handle = Load(filename);
+	loaded.set_value(handle);
+	return handle;
+}
+
+/// <summary>
+/// Loads many maps at once, spread over several threads.
+/// </summary>
+/// <param name="paths">The paths, duplicates are fine.</param>
+/// <param name="threads">The number of threads to use.</param>
+void MapRegistry::Preload(const std::vector<std::string>& paths, int threads)
+{
+	if (threads < 1)
+		threads = 1;
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> team;
+	for (int i = 0; i < threads; i++)
+	{
+		team.push_back(std::thread([this, &paths, &next]()
+		{
+			for (size_t index = next++; index < paths.size(); index = next++)
+				Get(paths[index]);
+		}));
+	}
+	for (size_t i = 0; i < team.size(); i++)
+		team[i].join();
+}
+
+/// <summary>
+/// Gets the number of distinct maps loaded.
+/// </summary>
+/// <returns></returns>
+size_t MapRegistry::GetMapCount()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_ByContent.size();
+}
+
+/// <summary>
+/// Gets the number of map files that were loaded but had the same content as another one.
+/// </summary>
+/// <returns></returns>
+size_t MapRegistry::GetDuplicateCount()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	return m_Duplicates;
+}
+
+/// <summary>
+/// Normalizes a path: forward slashes, no empty or "." parts, and ".." folded into its parent where there is one.
+/// </summary>
+/// <param name="path">The path.</param>
+/// <returns></returns>
+std::string MapRegistry::Normalize(const std::string& path)
+{
+	bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+	std::vector<std::string> parts;
+	std::string part;
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		if (i < path.size() && path[i] != '/' && path[i] != '\\')
+		{
+			part += path[i];
+			continue;
+		}
+
+		if (part == "..")
+		{
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!absolute)
+				parts.push_back(part);
+		}
+		else if (!part.empty() && part != ".")
+		{
+			parts.push_back(part);
+		}
+		part.clear();
+	}
+
+	std::string normalized = absolute ? "/" : "";
+	for (size_t i = 0; i < parts.size(); i++)
+		normalized += (i > 0 ? "/" : "") + parts[i];
+	return normalized;
+}
+
+/// <summary>
+/// Finds the file a path refers to, trying the search directories when it doesn't exist as given.
+/// </summary>
+/// <param name="path">The path.</param>
+/// <returns>The normalized path of the file, empty if there is none</returns>
+std::string MapRegistry::Locate(const std::string& path)
+{
+	std::string normalized = Normalize(path);
+	std::vector<std::string> directories;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<std::string, std::string>::iterator it = m_Located.find(normalized);
+		if (it != m_Located.end())
+			return it->second;
+		directories = m_Directories;
+	}
+
+	std::string filename;
+	if (Exists(normalized))
+	{
+		filename = normalized;
+	}
+	else
+	{
+		std::string name = normalized.substr(normalized.find_last_of('/') + 1);
+		for (size_t i = 0; i < directories.size() && filename.empty(); i++)
+		{
+			std::string candidate = Normalize(directories[i] + "/" + name);
+			if (Exists(candidate))
+				filename = candidate;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Located[normalized] = filename;
+	return filename;
+}
+
+/// <summary>
+/// Loads a map file, or hands out the map already loaded if it has the same content.
+/// </summary>
+/// <param name="filename">The normalized path of an existing file.</param>
+/// <returns></returns>
+MapRegistry::Handle MapRegistry::Load(const std::string& filename)
+{
+	Handle map(new DV1419Map(filename.c_str()));
+	unsigned long long hash = Hash(*map);
+
+	std::lock_guard<std::mutex> lock(m_Lock);
+	typedef std::multimap<unsigned long long, Handle>::iterator Iterator;
+	std::pair<Iterator, Iterator> range = m_ByContent.equal_range(hash);
+	for (Iterator it = range.first; it != range.second; ++it)
+	{
+		const DV1419Map& other = *it->second;
+		if (other.getWidth() == map->getWidth() && other.getHeight() == map->getHeight() && other.toString() == map->toString())
+		{
+			m_Duplicates++;
+			return it->second;
+		}
+	}
+
+	m_ByContent.insert(std::make_pair(hash, map));
+	return map;
+}
+
+/// <summary>
+/// Hashes the size and cells of a map with 64-bit FNV-1a.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <returns></returns>
+unsigned long long MapRegistry::Hash(const DV1419Map& map)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	std::ostringstream size;
+	size << map.getWidth() << "x" << map.getHeight() << ":";
+	std::string content = size.str() + map.toString();
+	for (size_t i = 0; i < content.size(); i++)
+	{
+		hash ^= (unsigned char)content[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+/// <summary>
+/// Determines whether a file can be opened for reading. The map loader doesn't check for itself.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns></returns>
+bool MapRegistry::Exists(const std::string& filename)
+{
+	std::ifstream file(filename.c_str());
+	return file.good();
+}
+
+#endif
\ No newline at end of file
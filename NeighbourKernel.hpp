@@ -0,0 +1,203 @@
+#ifndef NEIGHBOURKERNEL_HPP
+#define NEIGHBOURKERNEL_HPP
+
+#include <climits>
+
+// The vector versions are built on x86 unless NEIGHBOURKERNEL_SCALAR is defined, then only the
+// scalar one is. Which one runs is picked when the program starts, from what the processor has.
+#if !defined(NEIGHBOURKERNEL_SCALAR) && (defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__))
+#define NEIGHBOURKERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC compiles AVX2 intrinsics anywhere, the function just mustn't be called without it
+#define NEIGHBOURKERNEL_AVX2
+#else
+#define NEIGHBOURKERNEL_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+/// <summary>
+/// Decides in one go which of the 8 neighbours of an expanded cell get a better path through it.
+/// The neighbours are packed into slots, in the order <see cref="AStar"/> visits them: the row above
+/// left to right, left and right, then the row below. The walkability of the slots is one bit each,
+/// the corner rule turns it into the legal moves with a few bit operations, and the 8 candidate costs
+/// are compared with the best known ones at once instead of one branch per check. What comes back
+/// is a bit per neighbour that improved, so only those need to be looked at again.
+/// </summary>
+class NeighbourKernel
+{
+public:
+	enum Level
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	/// <summary>
+	/// A kernel. Takes the cost to the expanded cell, the best known cost of every slot and the
+	/// walkability bits of the slots, and gives the bits of the slots the cell improves.
+	/// A slot's known cost is INT_MAX when it has no path yet, and 0 when it mustn't be improved.
+	/// </summary>
+	typedef unsigned int (*RelaxMethod)(int g, const int* neighbourG, unsigned int walkable);
+
+	static const int SlotX[8];
+	static const int SlotY[8];
+	static const int SlotCost[8];
+
+	static unsigned int GetMoves(unsigned int walkable);
+	static int GetLowestSlot(unsigned int slots);
+	static Level GetBestLevel();
+	static RelaxMethod GetMethod(Level level);
+	static const char* GetName(Level level);
+
+	static unsigned int RelaxScalar(int g, const int* neighbourG, unsigned int walkable);
+#ifdef NEIGHBOURKERNEL_X86
+	static unsigned int RelaxSse2(int g, const int* neighbourG, unsigned int walkable);
+	static NEIGHBOURKERNEL_AVX2 unsigned int RelaxAvx2(int g, const int* neighbourG, unsigned int walkable);
+#endif
+};
+
+const int NeighbourKernel::SlotX[8] = { -1, 0, 1, -1, 1, -1, 0, 1 };
+const int NeighbourKernel::SlotY[8] = { -1, -1, -1, 0, 0, 1, 1, 1 };
+const int NeighbourKernel::SlotCost[8] = { 14, 10, 14, 10, 10, 14, 10, 14 };
+
+/// <summary>
+/// Gets the legal moves from the walkable slots. A straight move only needs its slot, a diagonal
+/// one also needs both straight slots beside it so it doesn't cut a corner.
+/// </summary>
+/// <param name="walkable">The walkable slots.</param>
+/// <returns>The slots that can be moved to</returns>
+inline unsigned int NeighbourKernel::GetMoves(unsigned int walkable)
+{
+	unsigned int up = (walkable >> 1) & 1;
+	unsigned int left = (walkable >> 3) & 1;
+	unsigned int right = (walkable >> 4) & 1;
+	unsigned int down = (walkable >> 6) & 1;
+	unsigned int diagonals = ((up & left) << 0) | ((up & right) << 2) | ((down & left) << 5) | ((down & right) << 7);
+
+	return walkable & (0x5A | diagonals);
+}
+
+/// <summary>
+/// Gets the first slot of a set of slots, which must not be empty.
+/// </summary>
+/// <param name="slots">The slots.</param>
+/// <returns></returns>
+inline int NeighbourKernel::GetLowestSlot(unsigned int slots)
+{
+#ifdef _MSC_VER
+	unsigned long slot;
+	_BitScanForward(&slot, slots);
+	return (int)slot;
+#else
+	return __builtin_ctz(slots);
+#endif
+}
+
+/// <summary>
+/// Gets the fastest kernel the processor can run.
+/// </summary>
+/// <returns></returns>
+NeighbourKernel::Level NeighbourKernel::GetBestLevel()
+{
+#ifdef NEIGHBOURKERNEL_X86
+#ifdef _MSC_VER
+	// AVX2 is leaf 7, and the system has to save the wide registers, which XGETBV tells
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return Sse2;
+	__cpuid(info, 1);
+	bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return (avx && (info[1] & (1 << 5)) != 0) ? Avx2 : Sse2;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? Avx2 : Sse2;
+#endif
+#else
+	return Scalar;
+#endif
+}
+
+/// <summary>
+/// Gets the kernel of a level, the best one below it if it isn't built.
+/// </summary>
+/// <param name="level">The level.</param>
+/// <returns></returns>
+NeighbourKernel::RelaxMethod NeighbourKernel::GetMethod(Level level)
+{
+#ifdef NEIGHBOURKERNEL_X86
+	if (level == Avx2)
+		return RelaxAvx2;
+	if (level == Sse2)
+		return RelaxSse2;
+#else
+	(void)level;
+#endif
+
+	return RelaxScalar;
+}
+
+/// <summary>
+/// Gets the name of a level.
+/// </summary>
+/// <param name="level">The level.</param>
+/// <returns></returns>
+const char* NeighbourKernel::GetName(Level level)
+{
+	switch (level)
+	{
+	case Avx2:
+		return "AVX2";
+	case Sse2:
+		return "SSE2";
+	default:
+		return "scalar";
+	}
+}
+
+/// <summary>
+/// The kernel for any processor, without a branch per slot.
+/// </summary>
+unsigned int NeighbourKernel::RelaxScalar(int g, const int* neighbourG, unsigned int walkable)
+{
+	unsigned int improved = 0;
+	for (int slot = 0; slot < 8; slot++)
+		improved |= (unsigned int)(g + SlotCost[slot] < neighbourG[slot]) << slot;
+
+	return improved & GetMoves(walkable);
+}
+
+#ifdef NEIGHBOURKERNEL_X86
+/// <summary>
+/// The kernel for every x86 processor with SSE2, 4 slots at a time.
+/// </summary>
+unsigned int NeighbourKernel::RelaxSse2(int g, const int* neighbourG, unsigned int walkable)
+{
+	__m128i start = _mm_set1_epi32(g);
+	__m128i low = _mm_add_epi32(start, _mm_setr_epi32(14, 10, 14, 10));
+	__m128i high = _mm_add_epi32(start, _mm_setr_epi32(10, 14, 10, 14));
+	low = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)neighbourG), low);
+	high = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)(neighbourG + 4)), high);
+	unsigned int improved = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(low)) | ((unsigned int)_mm_movemask_ps(_mm_castsi128_ps(high)) << 4);
+
+	return improved & GetMoves(walkable);
+}
+
+/// <summary>
+/// The kernel for processors with AVX2, all 8 slots at a time.
+/// </summary>
+NEIGHBOURKERNEL_AVX2 unsigned int NeighbourKernel::RelaxAvx2(int g, const int* neighbourG, unsigned int walkable)
+{
+	__m256i candidates = _mm256_add_epi32(_mm256_set1_epi32(g), _mm256_setr_epi32(14, 10, 14, 10, 10, 14, 10, 14));
+	__m256i known = _mm256_loadu_si256((const __m256i*)neighbourG);
+	unsigned int improved = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(known, candidates)));
+
+	return improved & GetMoves(walkable);
+}
+#endif
+
+#endif
\ No newline at end of file
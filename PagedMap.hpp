@@ -0,0 +1,506 @@
+#ifndef PAGEDMAP_HPP
+#define PAGEDMAP_HPP
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+// Keep windows.h from defining min and max macros, the headers after this one use std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "DV1419Map.h"
+
+/// <summary>
+/// Walkability of a map that doesn't have to fit in memory. The map is stored as 64x64 tiles of
+/// packed bits behind a tile index, and the file is memory-mapped so nothing but the index is read
+/// up front. Tiles are decoded the first time a lookup needs them and kept in a fixed number of
+/// slots, the least recently used one is dropped when a new tile needs room. Tiles that are all
+/// blocked or all free take no space in the file and never need decoding.
+/// </summary>
+class PagedMap
+{
+public:
+	static const int TileBits = 6;
+	static const int TileSize = 1 << TileBits;
+
+	PagedMap(size_t residentTiles);
+	~PagedMap();
+
+	static bool Write(DV1419Map* map, const char* filename);
+	bool Open(const char* filename);
+
+	bool IsOpen() const { return m_MappedView != nullptr; }
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+	bool IsWalkable(int x, int y);
+	void Prefetch(int x, int y);
+	void PrefetchNear(int x, int y);
+
+	void BeginQuery() { m_QueryFaults = 0; m_QueryPrefetches = 0; }
+	unsigned int GetQueryFaults() const { return m_QueryFaults; }
+	unsigned int GetQueryPrefetches() const { return m_QueryPrefetches; }
+	unsigned long long GetTotalFaults() const { return m_TotalFaults; }
+	size_t GetResidentCount() const;
+	size_t GetResidentCapacity() const { return m_SlotTile.size(); }
+
+private:
+	/// <summary>
+	/// The start of the file, followed by one index entry per tile and then the tile data.
+	/// </summary>
+	struct Header
+	{
+		char Magic[4];
+		unsigned int Version;
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int TileSize;
+	};
+
+	// Index entries below this are uniform tiles, anything else is the offset of the tile's bits
+	static const unsigned int BlockedTile = 0;
+	static const unsigned int FreeTile = 1;
+	static const int TileBytes = TileSize * TileSize / 8;
+	// How close to the edge of its tile a search has to get before the next tile is prefetched
+	static const int PrefetchMargin = 8;
+
+	const unsigned char* Resolve(int tile);
+	void Touch(int slot);
+	void Unlink(int slot);
+	void Unmap();
+
+	int m_Width;
+	int m_Height;
+	int m_TilesX;
+	int m_TilesY;
+	const unsigned int* m_Index;
+
+	// The decoded tiles, one byte per cell, and which tile each slot holds
+	std::vector<unsigned char> m_Slots;
+	std::vector<int> m_SlotTile;
+	// Which slot each tile is in, or -1
+	std::vector<int> m_TileSlot;
+	// Tiles already hinted to the operating system since they were last resident
+	std::vector<bool> m_Hinted;
+	// The slots from most to least recently used, -1 ends the list
+	std::vector<int> m_Newer;
+	std::vector<int> m_Older;
+	int m_Newest;
+	int m_Oldest;
+	int m_FreeSlots;
+	std::vector<unsigned char> m_AllBlocked;
+	std::vector<unsigned char> m_AllFree;
+
+	// The tile of the last lookup, most lookups stay in it
+	int m_LastTile;
+	const unsigned char* m_LastCells;
+
+	unsigned int m_QueryFaults;
+	unsigned int m_QueryPrefetches;
+	unsigned long long m_TotalFaults;
+
+	void* m_MappedView;
+	size_t m_MappedSize;
+#ifdef _WIN32
+	HANDLE m_File;
+	HANDLE m_Mapping;
+#endif
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="PagedMap"/> class. Nothing is loaded until <see cref="Open"/>.
+/// </summary>
+/// <param name="residentTiles">The number of decoded tiles kept in memory at most.</param>
+PagedMap::PagedMap(size_t residentTiles)
+	: m_Width(0), m_Height(0), m_TilesX(0), m_TilesY(0), m_Index(nullptr), m_Newest(-1), m_Oldest(-1), m_FreeSlots(0),
+	m_LastTile(-1), m_LastCells(nullptr), m_QueryFaults(0), m_QueryPrefetches(0), m_TotalFaults(0),
+	m_MappedView(nullptr), m_MappedSize(0)
+{
+	if (residentTiles < 1)
+		residentTiles = 1;
+	m_Slots.resize(residentTiles * TileSize * TileSize);
+	m_SlotTile.assign(residentTiles, -1);
+	m_Newer.assign(residentTiles, -1);
+	m_Older.assign(residentTiles, -1);
+	m_AllBlocked.assign(TileSize * TileSize, 0);
+	m_AllFree.assign(TileSize * TileSize, 1);
+
+#ifdef _WIN32
+	m_File = INVALID_HANDLE_VALUE;
+	m_Mapping = NULL;
+#endif
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="PagedMap"/> class.
+/// </summary>
+PagedMap::~PagedMap()
+{
+	Unmap();
+}
+
+/// <summary>
+/// Writes a map in the tiled format.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file couldn't be written</returns>
+bool PagedMap::Write(DV1419Map* map, const char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	Header header;
+	memcpy(header.Magic, "PMAP", 4);
+	header.Version = 1;
+	header.Width = map->getWidth();
+	header.Height = map->getHeight();
+	header.TileSize = TileSize;
+	int tilesX = (map->getWidth() + TileSize - 1) / TileSize;
+	int tilesY = (map->getHeight() + TileSize - 1) / TileSize;
+
+	// Pack every tile first to know which ones are uniform, cells past the edge count as blocked
+	std::vector<unsigned int> index(tilesX * tilesY);
+	std::vector<unsigned char> data;
+	unsigned int offset = (unsigned int)(sizeof(Header) + index.size() * sizeof(unsigned int));
+	for (int tile = 0; tile < tilesX * tilesY; tile++)
+	{
+		unsigned char bits[TileBytes];
+		memset(bits, 0, sizeof(bits));
+		int walkable = 0;
+		for (int y = 0; y < TileSize; y++)
+		{
+			for (int x = 0; x < TileSize; x++)
+			{
+				if (!map->isWalkable((tile % tilesX) * TileSize + x, (tile / tilesX) * TileSize + y))
+					continue;
+				bits[(y * TileSize + x) >> 3] |= 1 << (x & 7);
+				walkable++;
+			}
+		}
+
+		if (walkable == 0)
+		{
+			index[tile] = BlockedTile;
+		}
+		else if (walkable == TileSize * TileSize)
+		{
+			index[tile] = FreeTile;
+		}
+		else
+		{
+			index[tile] = offset + (unsigned int)data.size();
+			data.insert(data.end(), bits, bits + TileBytes);
+		}
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&index[0], sizeof(unsigned int), index.size(), file) == index.size()
+		&& (data.empty() || fwrite(&data[0], 1, data.size(), file) == data.size());
+	return fclose(file) == 0 && written;
+}
+
+/// <summary>
+/// Maps a file written by <see cref="Write"/>. Only the header and the tile index are read now.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file is missing or malformed</returns>
+bool PagedMap::Open(const char* filename)
+{
+	Unmap();
+
+	size_t fileSize = 0;
+#ifdef _WIN32
+	m_File = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size) || (size_t)size.QuadPart < sizeof(Header))
+	{
+		Unmap();
+		return false;
+	}
+	fileSize = (size_t)size.QuadPart;
+	m_Mapping = CreateFileMappingA(m_File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_Mapping == NULL)
+	{
+		Unmap();
+		return false;
+	}
+	m_MappedView = MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat status;
+	if (fstat(file, &status) != 0 || (size_t)status.st_size < sizeof(Header))
+	{
+		close(file);
+		return false;
+	}
+	fileSize = (size_t)status.st_size;
+	m_MappedView = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, file, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(file);
+	if (m_MappedView == MAP_FAILED)
+		m_MappedView = nullptr;
+#endif
+	if (m_MappedView == nullptr)
+	{
+		Unmap();
+		return false;
+	}
+	m_MappedSize = fileSize;
+
+	const Header* header = (const Header*)m_MappedView;
+	if (memcmp(header->Magic, "PMAP", 4) != 0 || header->Version != 1 || header->TileSize != TileSize)
+	{
+		Unmap();
+		return false;
+	}
+	// The sizes have to fit an int, and the whole index the file
+	if (header->Width == 0 || header->Height == 0 || header->Width > INT_MAX - TileSize || header->Height > INT_MAX - TileSize)
+	{
+		Unmap();
+		return false;
+	}
+	m_Width = header->Width;
+	m_Height = header->Height;
+	m_TilesX = (m_Width + TileSize - 1) / TileSize;
+	m_TilesY = (m_Height + TileSize - 1) / TileSize;
+	size_t tiles = (size_t)m_TilesX * m_TilesY;
+	size_t dataStart = sizeof(Header) + tiles * sizeof(unsigned int);
+	if (tiles > INT_MAX || tiles > (fileSize - sizeof(Header)) / sizeof(unsigned int))
+	{
+		Unmap();
+		return false;
+	}
+	m_Index = (const unsigned int*)(header + 1);
+
+	// The bits of every stored tile have to be after the index and inside the file
+	for (size_t tile = 0; tile < tiles; tile++)
+	{
+		if (m_Index[tile] > FreeTile && (m_Index[tile] < dataStart || (size_t)m_Index[tile] + TileBytes > fileSize))
+		{
+			Unmap();
+			return false;
+		}
+	}
+
+	// Start with every slot free
+	m_TileSlot.assign(m_TilesX * m_TilesY, -1);
+	m_Hinted.assign(m_TilesX * m_TilesY, false);
+	for (size_t i = 0; i < m_SlotTile.size(); i++)
+		m_SlotTile[i] = -1;
+	m_Newest = -1;
+	m_Oldest = -1;
+	m_FreeSlots = (int)m_SlotTile.size();
+	m_LastTile = -1;
+	m_LastCells = nullptr;
+	return true;
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable, paging in its tile if needed.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool PagedMap::IsWalkable(int x, int y)
+{
+	if (x < 0 || x >= m_Width || y < 0 || y >= m_Height)
+		return false;
+
+	int tile = (y >> TileBits) * m_TilesX + (x >> TileBits);
+	if (tile != m_LastTile)
+	{
+		m_LastCells = Resolve(tile);
+		m_LastTile = tile;
+	}
+
+	return m_LastCells[((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1))] != 0;
+}
+
+/// <summary>
+/// Hints that the tile of a coordinate will be needed soon. The operating system starts reading
+/// the tile's bits in the background, decoding still waits for the first lookup.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+void PagedMap::Prefetch(int x, int y)
+{
+	if (x < 0 || x >= m_Width || y < 0 || y >= m_Height)
+		return;
+
+	int tile = (y >> TileBits) * m_TilesX + (x >> TileBits);
+	if (m_Index[tile] <= FreeTile || m_TileSlot[tile] >= 0 || m_Hinted[tile])
+		return;
+
+	m_Hinted[tile] = true;
+	m_QueryPrefetches++;
+	const char* bits = (const char*)m_MappedView + m_Index[tile];
+#ifdef _WIN32
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)bits;
+	range.NumberOfBytes = TileBytes;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	// madvise wants a page aligned start
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const char* start = (const char*)((size_t)bits & ~(page - 1));
+	madvise((void*)start, bits + TileBytes - start, MADV_WILLNEED);
+#endif
+}
+
+/// <summary>
+/// Prefetches the tiles next to a coordinate's tile that it is close to, for a search that is
+/// expanding the coordinate and will soon reach them.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+void PagedMap::PrefetchNear(int x, int y)
+{
+	int localX = x & (TileSize - 1);
+	int localY = y & (TileSize - 1);
+	int dx = (localX < PrefetchMargin) ? -1 : (localX >= TileSize - PrefetchMargin) ? 1 : 0;
+	int dy = (localY < PrefetchMargin) ? -1 : (localY >= TileSize - PrefetchMargin) ? 1 : 0;
+	if (dx != 0)
+		Prefetch(x + dx * PrefetchMargin, y);
+	if (dy != 0)
+		Prefetch(x, y + dy * PrefetchMargin);
+	if (dx != 0 && dy != 0)
+		Prefetch(x + dx * PrefetchMargin, y + dy * PrefetchMargin);
+}
+
+/// <summary>
+/// Gets the number of decoded tiles in memory.
+/// </summary>
+/// <returns></returns>
+size_t PagedMap::GetResidentCount() const
+{
+	return m_SlotTile.size() - m_FreeSlots;
+}
+
+/// <summary>
+/// Gets the cells of a tile, decoding it into a slot if it isn't resident.
+/// </summary>
+/// <param name="tile">The tile.</param>
+/// <returns>One byte per cell, row by row</returns>
+const unsigned char* PagedMap::Resolve(int tile)
+{
+	if (m_Index[tile] == BlockedTile)
+		return &m_AllBlocked[0];
+	if (m_Index[tile] == FreeTile)
+		return &m_AllFree[0];
+
+	int slot = m_TileSlot[tile];
+	if (slot >= 0)
+	{
+		Touch(slot);
+		return &m_Slots[slot * TileSize * TileSize];
+	}
+
+	// Take a free slot, or the one that was used the longest time ago
+	if (m_FreeSlots > 0)
+	{
+		slot = (int)m_SlotTile.size() - m_FreeSlots;
+		m_FreeSlots--;
+	}
+	else
+	{
+		slot = m_Oldest;
+		Unlink(slot);
+		m_TileSlot[m_SlotTile[slot]] = -1;
+		m_Hinted[m_SlotTile[slot]] = false;
+	}
+
+	const unsigned char* bits = (const unsigned char*)m_MappedView + m_Index[tile];
+	unsigned char* cells = &m_Slots[slot * TileSize * TileSize];
+	for (int i = 0; i < TileSize * TileSize; i++)
+		cells[i] = (bits[i >> 3] >> (i & 7)) & 1;
+
+	m_SlotTile[slot] = tile;
+	m_TileSlot[tile] = slot;
+	Touch(slot);
+	m_QueryFaults++;
+	m_TotalFaults++;
+	return cells;
+}
+
+/// <summary>
+/// Moves a slot to the front of the recently used list.
+/// </summary>
+/// <param name="slot">The slot.</param>
+void PagedMap::Touch(int slot)
+{
+	if (slot == m_Newest)
+		return;
+
+	// A slot that is linked has a neighbour, unless it is alone and so already the newest
+	if (m_Newer[slot] >= 0 || m_Older[slot] >= 0)
+		Unlink(slot);
+	m_Older[slot] = m_Newest;
+	m_Newer[slot] = -1;
+	if (m_Newest >= 0)
+		m_Newer[m_Newest] = slot;
+	m_Newest = slot;
+	if (m_Oldest < 0)
+		m_Oldest = slot;
+}
+
+/// <summary>
+/// Takes a slot out of the recently used list.
+/// </summary>
+/// <param name="slot">The slot.</param>
+void PagedMap::Unlink(int slot)
+{
+	int newer = m_Newer[slot];
+	int older = m_Older[slot];
+	if (newer >= 0)
+		m_Older[newer] = older;
+	else
+		m_Newest = older;
+	if (older >= 0)
+		m_Newer[older] = newer;
+	else
+		m_Oldest = newer;
+	m_Newer[slot] = -1;
+	m_Older[slot] = -1;
+}
+
+/// <summary>
+/// Releases the mapped file, if any.
+/// </summary>
+void PagedMap::Unmap()
+{
+#ifdef _WIN32
+	if (m_MappedView != nullptr)
+		UnmapViewOfFile(m_MappedView);
+	if (m_Mapping != NULL)
+		CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+	m_Mapping = NULL;
+	m_File = INVALID_HANDLE_VALUE;
+#else
+	if (m_MappedView != nullptr)
+		munmap(m_MappedView, m_MappedSize);
+#endif
+	m_MappedView = nullptr;
+	m_MappedSize = 0;
+	m_Index = nullptr;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,431 @@
+#ifndef PARALLELASTAR_HPP
+#define PARALLELASTAR_HPP
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <climits>
+#include <cstdlib>
+#include <algorithm>
+#include "DV1419Map.h"
+#include "AStar.hpp"
+#include "ConcurrentQueue.hpp"
+
+/// <summary>
+/// Hash distributed A* (HDA*) for single long queries. Every cell is owned by one thread, picked
+/// by hashing the 4x4 block it lies in, and only the owner ever touches its G and parent. A thread
+/// expands its own open list and sends every successor to its owner through a lock-free queue.
+/// Threads keep going until nothing is left below the best goal cost found so far, so the path is
+/// still optimal even though nodes are not expanded in global F order.
+/// Queries shorter than the threshold go to a plain <see cref="AStar"/>, where the threads would only cost time.
+/// </summary>
+class ParallelAStar
+{
+public:
+	ParallelAStar(DV1419Map* map, int threads);
+	~ParallelAStar();
+
+	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+	void SetThreads(int threads);
+	int GetThreads() const { return (int)m_Workers.size(); }
+	void SetThreshold(int distance) { m_Threshold = distance; }
+	int GetThreshold() const { return m_Threshold; }
+	bool WasParallel() const { return m_WasParallel; }
+
+	unsigned int m_ExpandedNodes;
+	// Successors handed to another thread during the last search
+	unsigned long long m_Messages;
+
+private:
+	/// <summary>
+	/// A successor sent to the thread that owns it.
+	/// </summary>
+	struct Message
+	{
+		int Index;
+		int G;
+		int Parent;
+	};
+
+	/// <summary>
+	/// A message that didn't fit in the owner's queue yet.
+	/// </summary>
+	struct Pending
+	{
+		int Owner;
+		Message Data;
+	};
+
+	/// <summary>
+	/// An open list entry. Entries are left behind when a cell gets a lower G, and skipped later.
+	/// </summary>
+	struct Entry
+	{
+		int F;
+		int G;
+		int Index;
+
+		// Orders the heap by lowest F, preferring the higher G on ties
+		bool operator<(const Entry& r) const
+		{
+			return F > r.F || (F == r.F && G < r.G);
+		}
+	};
+
+	/// <summary>
+	/// The state of one thread. Allocated separately to keep the threads off each other's cache lines.
+	/// </summary>
+	struct Worker
+	{
+		Worker() : Inbox(4096), Expanded(0), Sent(0) { }
+
+		ConcurrentQueue<Message> Inbox;
+		std::vector<Entry> Open;
+		std::vector<Pending> Outbox;
+		unsigned int Expanded;
+		unsigned long long Sent;
+		char Padding[64];
+	};
+
+	void Run(int id);
+	void Receive(Worker& worker, const Message& message);
+	void Expand(int id, Worker& worker, const Entry& entry);
+	int GetOwner(int index) const;
+	bool IsWalkable(int x, int y) const;
+	int Estimate(int index) const;
+
+	AStar m_Serial;
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+	int m_Threshold;
+	bool m_WasParallel;
+
+	// Per cell, each only ever written by the cell's owner
+	std::vector<int> m_G;
+	std::vector<int> m_Parent;
+	std::vector<unsigned int> m_Generation;
+	unsigned int m_CurrentGeneration;
+
+	std::vector<Worker*> m_Workers;
+	int m_GoalIndex;
+	int m_GoalX, m_GoalY;
+	// The cost of the best path to the goal so far, only written by the goal's owner
+	std::atomic<int> m_Incumbent;
+	// Threads still working plus messages not yet handled, the search is over once this hits zero
+	std::atomic<long> m_Work;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="ParallelAStar"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="threads">The number of threads a parallel search uses.</param>
+ParallelAStar::ParallelAStar(DV1419Map* map, int threads)
+	: m_ExpandedNodes(0), m_Messages(0), m_Serial(map), m_Threshold(0), m_WasParallel(false),
+	m_CurrentGeneration(0), m_GoalIndex(-1), m_GoalX(0), m_GoalY(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	m_G.assign(m_MapWidth * m_MapHeight, INT_MAX);
+	m_Parent.assign(m_MapWidth * m_MapHeight, -1);
+	m_Generation.assign(m_MapWidth * m_MapHeight, 0);
+	m_Incumbent.store(INT_MAX);
+	m_Work.store(0);
+	SetThreads(threads);
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="ParallelAStar"/> class.
+/// </summary>
+ParallelAStar::~ParallelAStar()
+{
+	for (size_t i = 0; i < m_Workers.size(); i++)
+		delete m_Workers[i];
+}
+
+/// <summary>
+/// Sets the number of threads used by the following searches.
+/// </summary>
+/// <param name="threads">The number of threads.</param>
+void ParallelAStar::SetThreads(int threads)
+{
+	if (threads < 1)
+		threads = 1;
+
+	for (size_t i = 0; i < m_Workers.size(); i++)
+		delete m_Workers[i];
+	m_Workers.clear();
+	for (int i = 0; i < threads; i++)
+		m_Workers.push_back(new Worker());
+}
+
+/// <summary>
+/// Finds a path, in parallel if the goal is at least the threshold away.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>A vector of coordinates that represents the path, empty if there is none</returns>
+std::vector<Coordinate>* ParallelAStar::Path(Coordinate start, Coordinate goal)
+{
+	m_ExpandedNodes = 0;
+	m_Messages = 0;
+	m_GoalX = goal.X;
+	m_GoalY = goal.Y;
+	int startIndex = start.Y * m_MapWidth + start.X;
+
+	// Short queries don't make up for starting the threads
+	m_WasParallel = IsWalkable(start.X, start.Y) && IsWalkable(goal.X, goal.Y) && Estimate(startIndex) >= m_Threshold * 10;
+	if (!m_WasParallel)
+	{
+		std::vector<Coordinate>* path = m_Serial.Path(start, goal);
+		m_ExpandedNodes = m_Serial.m_ExpandedNodes;
+		return path;
+	}
+
+	// Start a new generation instead of clearing every cell
+	m_CurrentGeneration++;
+	if (m_CurrentGeneration == 0)
+	{
+		std::fill(m_Generation.begin(), m_Generation.end(), 0);
+		m_CurrentGeneration = 1;
+	}
+
+	m_GoalIndex = goal.Y * m_MapWidth + goal.X;
+	m_Incumbent.store(INT_MAX);
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		m_Workers[i]->Open.clear();
+		m_Workers[i]->Outbox.clear();
+		m_Workers[i]->Expanded = 0;
+		m_Workers[i]->Sent = 0;
+	}
+
+	// Every thread starts out working
+	Message first = { startIndex, 0, -1 };
+	Receive(*m_Workers[GetOwner(startIndex)], first);
+	m_Work.store((long)m_Workers.size());
+
+	std::vector<std::thread> team;
+	for (size_t i = 1; i < m_Workers.size(); i++)
+		team.push_back(std::thread(&ParallelAStar::Run, this, (int)i));
+	Run(0);
+	for (size_t i = 0; i < team.size(); i++)
+		team[i].join();
+
+	for (size_t i = 0; i < m_Workers.size(); i++)
+	{
+		m_ExpandedNodes += m_Workers[i]->Expanded;
+		m_Messages += m_Workers[i]->Sent;
+	}
+
+	std::vector<Coordinate>* path = new std::vector<Coordinate>;
+	if (m_Incumbent.load() == INT_MAX)
+		return path;
+
+	// G only ever drops, so following the parents always leads back to the start
+	for (int index = m_GoalIndex; index >= 0; index = m_Parent[index])
+		path->push_back(Coordinate(index % m_MapWidth, index / m_MapWidth));
+	std::reverse(path->begin(), path->end());
+
+	return path;
+}
+
+/// <summary>
+/// The loop of one thread.
+/// </summary>
+/// <param name="id">The index of the thread.</param>
+void ParallelAStar::Run(int id)
+{
+	Worker& worker = *m_Workers[id];
+	bool working = true;
+	for (;;)
+	{
+		// Waking up counts as work before the message is let go, so the total never touches zero early
+		Message message;
+		while (worker.Inbox.TryPop(message))
+		{
+			if (!working)
+			{
+				m_Work.fetch_add(1);
+				working = true;
+			}
+			Receive(worker, message);
+			m_Work.fetch_sub(1);
+		}
+
+		for (size_t i = 0; i < worker.Outbox.size(); )
+		{
+			if (m_Workers[worker.Outbox[i].Owner]->Inbox.TryPush(worker.Outbox[i].Data))
+			{
+				worker.Outbox[i] = worker.Outbox.back();
+				worker.Outbox.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		// Drop entries that were improved on since they were pushed
+		std::vector<Entry>& open = worker.Open;
+		while (!open.empty() && open.front().G > m_G[open.front().Index])
+		{
+			std::pop_heap(open.begin(), open.end());
+			open.pop_back();
+		}
+
+		if (!open.empty() && open.front().F < m_Incumbent.load())
+		{
+			Entry entry = open.front();
+			std::pop_heap(open.begin(), open.end());
+			open.pop_back();
+			Expand(id, worker, entry);
+			continue;
+		}
+
+		// Nothing here can beat the incumbent any more, and it only gets better
+		open.clear();
+		if (!worker.Outbox.empty())
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		if (working)
+		{
+			m_Work.fetch_sub(1);
+			working = false;
+		}
+		if (m_Work.load() == 0)
+			break;
+		std::this_thread::yield();
+	}
+}
+
+/// <summary>
+/// Handles a successor owned by this thread.
+/// </summary>
+/// <param name="worker">The owning thread.</param>
+/// <param name="message">The successor.</param>
+void ParallelAStar::Receive(Worker& worker, const Message& message)
+{
+	int index = message.Index;
+	if (m_Generation[index] != m_CurrentGeneration)
+	{
+		m_Generation[index] = m_CurrentGeneration;
+		m_G[index] = INT_MAX;
+	}
+	if (message.G >= m_G[index])
+		return;
+
+	m_G[index] = message.G;
+	m_Parent[index] = message.Parent;
+	if (index == m_GoalIndex)
+	{
+		if (message.G < m_Incumbent.load())
+			m_Incumbent.store(message.G);
+		return;
+	}
+
+	Entry entry = { message.G + Estimate(index), message.G, index };
+	if (entry.F >= m_Incumbent.load())
+		return;
+	worker.Open.push_back(entry);
+	std::push_heap(worker.Open.begin(), worker.Open.end());
+}
+
+/// <summary>
+/// Expands a node and hands every successor to its owner.
+/// </summary>
+/// <param name="id">The index of the expanding thread.</param>
+/// <param name="worker">The expanding thread.</param>
+/// <param name="entry">The node.</param>
+void ParallelAStar::Expand(int id, Worker& worker, const Entry& entry)
+{
+	worker.Expanded++;
+	int incumbent = m_Incumbent.load();
+	int x = entry.Index % m_MapWidth;
+	int y = entry.Index / m_MapWidth;
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			if (dx == 0 && dy == 0)
+				continue;
+			if (!IsWalkable(x + dx, y + dy))
+				continue;
+
+			// Don't cut corners
+			bool isDiagonal = dx != 0 && dy != 0;
+			if (isDiagonal && (!IsWalkable(x + dx, y) || !IsWalkable(x, y + dy)))
+				continue;
+
+			int child = entry.Index + dy * m_MapWidth + dx;
+			int g = entry.G + (isDiagonal ? 14 : 10);
+			if (g + Estimate(child) >= incumbent)
+				continue;
+
+			Message message = { child, g, entry.Index };
+			int owner = GetOwner(child);
+			if (owner == id)
+			{
+				Receive(worker, message);
+				continue;
+			}
+
+			m_Work.fetch_add(1);
+			worker.Sent++;
+			if (!m_Workers[owner]->Inbox.TryPush(message))
+			{
+				Pending pending = { owner, message };
+				worker.Outbox.push_back(pending);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Gets the thread that owns a cell. Whole 4x4 blocks share an owner so most successors stay local.
+/// </summary>
+/// <param name="index">The cell index.</param>
+/// <returns></returns>
+int ParallelAStar::GetOwner(int index) const
+{
+	unsigned int block = (unsigned int)((index / m_MapWidth >> 2) * ((m_MapWidth + 3) >> 2) + (index % m_MapWidth >> 2));
+	unsigned int hash = block * 2654435761u;
+	return (int)((hash >> 16) % m_Workers.size());
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool ParallelAStar::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Octile distance to the goal, scaled like G.
+/// </summary>
+/// <param name="index">The cell index.</param>
+/// <returns></returns>
+int ParallelAStar::Estimate(int index) const
+{
+	int xDist = abs(index % m_MapWidth - m_GoalX);
+	int yDist = abs(index / m_MapWidth - m_GoalY);
+	return 14 * min(xDist, yDist) + 10 * abs(xDist - yDist);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,233 @@
+#ifndef PATHBATCH_HPP
+#define PATHBATCH_HPP
+
+#include <vector>
+#include <algorithm>
+#include "DV1419Map.h"
+#include "AStar.hpp"
+#include "FlowField.hpp"
+
+/// <summary>
+/// Answers a burst of path queries in one call. The queries are run in the order of a Hilbert
+/// curve through their start cells instead of the order they came in, so searches that follow
+/// each other touch the same part of the map and the same nodes while they are still in the cache.
+/// Queries that share a goal, or a start, are answered together from one <see cref="FlowField"/>
+/// once there are enough of them, and identical queries share one search. The paths come back in
+/// the order of the queries.
+/// </summary>
+class PathBatch
+{
+public:
+	/// <summary>
+	/// One path to find.
+	/// </summary>
+	struct Query
+	{
+		Coordinate Start;
+		Coordinate Goal;
+	};
+
+	PathBatch(DV1419Map* map);
+
+	void Run(const Query* queries, size_t count, std::vector<std::vector<Coordinate>*>& paths);
+	void SetOrdering(bool enabled) { m_Ordering = enabled; }
+	void SetSharingThreshold(int queries) { m_SharingThreshold = queries; }
+	unsigned int GetHilbertIndex(int x, int y) const;
+
+	AStar& GetSearch() { return m_Search; }
+	unsigned int GetSearchCount() const { return m_SearchCount; }
+	unsigned int GetFieldCount() const { return m_FieldCount; }
+	unsigned int GetSharedCount() const { return m_SharedCount; }
+	unsigned int GetDuplicateCount() const { return m_DuplicateCount; }
+
+private:
+	/// <summary>
+	/// A query and where it goes in the run order.
+	/// </summary>
+	struct Entry
+	{
+		unsigned long long Key;
+		int Query;
+
+		bool operator<(const Entry& other) const { return Key < other.Key; }
+	};
+
+	void Sort(const Query* queries, std::vector<Entry>& entries, bool byGoal) const;
+	void Share(const Query* queries, const std::vector<Entry>& entries, size_t first, size_t last, bool byGoal, std::vector<std::vector<Coordinate>*>& paths);
+	bool CanShare() const { return m_SharingThreshold > 0 && m_Search.GetSearchMode() == AStar::Optimal && m_Search.GetAgentSize() == 1 && m_Search.GetSnapshot() == nullptr; }
+	static bool IsSame(Coordinate a, Coordinate b) { return a.X == b.X && a.Y == b.Y; }
+
+	AStar m_Search;
+	FlowField m_Field;
+	// The curve covers a square of 2^m_Order cells a side
+	int m_Order;
+	bool m_Ordering;
+	// How many queries have to share an end for a field to be built, 0 never builds one
+	int m_SharingThreshold;
+
+	std::vector<Entry> m_Entries;
+	std::vector<Entry> m_Rest;
+	std::vector<Coordinate> m_Settle;
+
+	unsigned int m_SearchCount;
+	unsigned int m_FieldCount;
+	unsigned int m_SharedCount;
+	unsigned int m_DuplicateCount;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="PathBatch"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+PathBatch::PathBatch(DV1419Map* map)
+	: m_Search(map), m_Field(map), m_Order(0), m_Ordering(true), m_SharingThreshold(8),
+	m_SearchCount(0), m_FieldCount(0), m_SharedCount(0), m_DuplicateCount(0)
+{
+	while ((1 << m_Order) < max(map->getWidth(), map->getHeight()))
+		m_Order++;
+}
+
+/// <summary>
+/// Finds the paths of a batch of queries.
+/// </summary>
+/// <param name="queries">The queries.</param>
+/// <param name="count">The number of queries.</param>
+/// <param name="paths">Set to a path for every query, in the same order, empty where there is none. The caller deletes them.</param>
+void PathBatch::Run(const Query* queries, size_t count, std::vector<std::vector<Coordinate>*>& paths)
+{
+	paths.assign(count, nullptr);
+	m_Entries.resize(count);
+	for (size_t i = 0; i < count; i++)
+		m_Entries[i].Query = (int)i;
+
+	// Queries with a common goal come out next to each other, and get a field from the goal
+	// if there are enough of them. What is left is tried the same way by start.
+	bool share = CanShare();
+	if (share)
+	{
+		for (int pass = 0; pass < 2; pass++)
+		{
+			bool byGoal = (pass == 0);
+			Sort(queries, m_Entries, byGoal);
+			m_Rest.clear();
+			size_t first = 0;
+			while (first < m_Entries.size())
+			{
+				const Query& query = queries[m_Entries[first].Query];
+				size_t last = first + 1;
+				while (last < m_Entries.size() && IsSame(byGoal ? query.Goal : query.Start,
+					byGoal ? queries[m_Entries[last].Query].Goal : queries[m_Entries[last].Query].Start))
+					last++;
+
+				if ((int)(last - first) >= m_SharingThreshold)
+					Share(queries, m_Entries, first, last, byGoal, paths);
+				else
+					m_Rest.insert(m_Rest.end(), m_Entries.begin() + first, m_Entries.begin() + last);
+				first = last;
+			}
+			m_Entries.swap(m_Rest);
+		}
+	}
+
+	// Searches for the rest, along the curve through their starts. Equal queries end up next to
+	// each other and copy the path of the first one.
+	if (m_Ordering)
+		Sort(queries, m_Entries, false);
+	for (size_t i = 0; i < m_Entries.size(); i++)
+	{
+		const Query& query = queries[m_Entries[i].Query];
+		if (i > 0 && m_Ordering)
+		{
+			const Query& previous = queries[m_Entries[i - 1].Query];
+			if (IsSame(query.Start, previous.Start) && IsSame(query.Goal, previous.Goal))
+			{
+				paths[m_Entries[i].Query] = new std::vector<Coordinate>(*paths[m_Entries[i - 1].Query]);
+				m_DuplicateCount++;
+				continue;
+			}
+		}
+
+		paths[m_Entries[i].Query] = m_Search.Path(query.Start, query.Goal);
+		m_SearchCount++;
+	}
+}
+
+/// <summary>
+/// Gets the position of a cell along a Hilbert curve through the map. Cells close on the curve
+/// are close on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+unsigned int PathBatch::GetHilbertIndex(int x, int y) const
+{
+	unsigned int index = 0;
+	for (int side = (1 << m_Order) / 2; side > 0; side /= 2)
+	{
+		int quadrantX = (x & side) ? 1 : 0;
+		int quadrantY = (y & side) ? 1 : 0;
+		index += (unsigned int)side * side * ((3 * quadrantX) ^ quadrantY);
+
+		// Turn the quadrant so the curve inside it runs the same way as the whole
+		if (quadrantY == 0)
+		{
+			if (quadrantX == 1)
+			{
+				x = side - 1 - (x & (side - 1));
+				y = side - 1 - (y & (side - 1));
+			}
+			std::swap(x, y);
+		}
+	}
+
+	return index;
+}
+
+/// <summary>
+/// Sorts queries along the curve, by one end and then the other.
+/// </summary>
+/// <param name="queries">The queries.</param>
+/// <param name="entries">The entries to sort.</param>
+/// <param name="byGoal">Whether the goal comes first instead of the start.</param>
+void PathBatch::Sort(const Query* queries, std::vector<Entry>& entries, bool byGoal) const
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		const Query& query = queries[entries[i].Query];
+		Coordinate first = byGoal ? query.Goal : query.Start;
+		Coordinate second = byGoal ? query.Start : query.Goal;
+		entries[i].Key = ((unsigned long long)GetHilbertIndex(first.X, first.Y) << 32) | GetHilbertIndex(second.X, second.Y);
+	}
+	std::sort(entries.begin(), entries.end());
+}
+
+/// <summary>
+/// Answers queries that share an end with one field from there. Moves are symmetric, so a field
+/// from a common start is read from each goal and turned around.
+/// </summary>
+/// <param name="queries">The queries.</param>
+/// <param name="entries">The entries.</param>
+/// <param name="first">The first entry of the group.</param>
+/// <param name="last">One past the last entry of the group.</param>
+/// <param name="byGoal">Whether the group shares its goal instead of its start.</param>
+/// <param name="paths">The paths of the queries.</param>
+void PathBatch::Share(const Query* queries, const std::vector<Entry>& entries, size_t first, size_t last, bool byGoal, std::vector<std::vector<Coordinate>*>& paths)
+{
+	m_Settle.clear();
+	for (size_t i = first; i < last; i++)
+		m_Settle.push_back(byGoal ? queries[entries[i].Query].Start : queries[entries[i].Query].Goal);
+	const Query& shared = queries[entries[first].Query];
+	m_Field.Build(byGoal ? shared.Goal : shared.Start, m_Settle);
+	m_FieldCount++;
+
+	for (size_t i = first; i < last; i++)
+	{
+		std::vector<Coordinate>* path = m_Field.Path(m_Settle[i - first]);
+		if (!byGoal)
+			std::reverse(path->begin(), path->end());
+		paths[entries[i].Query] = path;
+		m_SharedCount++;
+	}
+}
+
+#endif
\ No newline at end of file
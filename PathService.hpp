@@ -0,0 +1,403 @@
+#ifndef PATHSERVICE_HPP
+#define PATHSERVICE_HPP
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "DV1419Map.h"
+#include "AStar.hpp"
+#include "ConcurrentQueue.hpp"
+
+/// <summary>
+/// In-process asynchronous pathfinding service.
+/// Any thread can request a path and either wait on a future or get a callback. Requests
+/// are passed to a fixed pool of worker threads through a lock-free queue, and every worker
+/// owns its own <see cref="AStar"/> search context. Requests for the same start and goal
+/// that are in flight at the same time share a single search.
+/// </summary>
+class PathService
+{
+public:
+	/// <summary>
+	/// How a request ended.
+	/// </summary>
+	enum Status
+	{
+		Found,
+		NoPath,
+		Cancelled
+	};
+
+	/// <summary>
+	/// The outcome of a request.
+	/// </summary>
+	struct Result
+	{
+		Result() : Code(NoPath) { }
+
+		Status Code;
+		std::vector<Coordinate> Path;
+	};
+
+	/// <summary>
+	/// Called on the worker thread once a request is done. Never called for cancelled requests.
+	/// </summary>
+	typedef std::function<void(const Result& result)> Callback;
+
+	/// <summary>
+	/// Handed out for every request, the id is used to cancel it.
+	/// </summary>
+	struct Ticket
+	{
+		unsigned int Id;
+		std::shared_future<Result> Future;
+	};
+
+	PathService(DV1419Map* map, int workers, size_t queueCapacity = 4096);
+	~PathService();
+
+	Ticket Request(Coordinate start, Coordinate goal, Callback onComplete = Callback());
+	bool Cancel(unsigned int id);
+
+	int GetWorkerCount() const { return m_Workers.size(); }
+	unsigned int GetRequestCount() const { return m_RequestCount; }
+	unsigned int GetCoalescedCount() const { return m_CoalescedCount; }
+	unsigned int GetSearchCount() const { return m_SearchCount; }
+	unsigned int GetCancelledCount() const { return m_CancelledCount; }
+
+private:
+	/// <summary>
+	/// Somebody waiting for a search.
+	/// </summary>
+	struct Waiter
+	{
+		unsigned int Id;
+		std::shared_ptr<std::promise<Result> > Promise;
+		Callback OnComplete;
+		bool Delivered;
+	};
+
+	/// <summary>
+	/// One search, shared by every waiter that asked for the same start and goal.
+	/// </summary>
+	struct Job
+	{
+		Coordinate Start;
+		Coordinate Goal;
+		unsigned long long Key;
+		std::atomic<bool> Cancelled;
+		std::vector<Waiter> Waiters;
+	};
+
+	void Work(AStar* context);
+	void Search(AStar* context, Job* job, Result& result);
+	void Complete(Job* job, const Result& result);
+	static unsigned long long GetKey(Coordinate start, Coordinate goal);
+
+	DV1419Map* m_RawMap;
+	std::vector<std::thread> m_Workers;
+	std::vector<AStar*> m_Contexts;
+	ConcurrentQueue<Job*> m_Queue;
+
+	// Sleeping workers wait here, the queue itself is never locked
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeUp;
+	std::atomic<int> m_Queued;
+	std::atomic<bool> m_Stopping;
+
+	// Book-keeping for coalescing and cancellation
+	std::mutex m_Mutex;
+	std::map<unsigned long long, Job*> m_InFlight;
+	std::map<unsigned int, Job*> m_Tickets;
+	unsigned int m_NextId;
+
+	std::atomic<unsigned int> m_RequestCount;
+	std::atomic<unsigned int> m_CoalescedCount;
+	std::atomic<unsigned int> m_SearchCount;
+	// Searches that ended without a result because nobody wanted it anymore
+	std::atomic<unsigned int> m_CancelledCount;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="PathService"/> class and starts the workers.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="workers">The number of worker threads.</param>
+/// <param name="queueCapacity">The number of searches that can be queued before Request blocks.</param>
+PathService::PathService(DV1419Map* map, int workers, size_t queueCapacity)
+	: m_RawMap(map), m_Queue(queueCapacity), m_NextId(1)
+{
+	m_Queued = 0;
+	m_Stopping = false;
+	m_RequestCount = 0;
+	m_CoalescedCount = 0;
+	m_SearchCount = 0;
+	m_CancelledCount = 0;
+
+	// Create every context before starting any thread, they each copy the map and allocate their
+	// nodes up front so the first requests aren't slowed down by it
+	for (int i = 0; i < workers; i++)
+	{
+		m_Contexts.push_back(new AStar(map, AStar::Heuristics::Diagonal));
+		m_Contexts.back()->ReserveDenseState();
+	}
+	for (int i = 0; i < workers; i++)
+		m_Workers.push_back(std::thread(&PathService::Work, this, m_Contexts[i]));
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="PathService"/> class.
+/// Requests that haven't been searched yet are completed as cancelled.
+/// </summary>
+PathService::~PathService()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_SleepMutex);
+		m_Stopping = true;
+	}
+	m_WakeUp.notify_all();
+	for (size_t i = 0; i < m_Workers.size(); i++)
+		m_Workers[i].join();
+
+	Job* job;
+	Result cancelled;
+	cancelled.Code = Cancelled;
+	while (m_Queue.TryPop(job))
+	{
+		job->Cancelled = true;
+		Complete(job, cancelled);
+	}
+
+	for (size_t i = 0; i < m_Contexts.size(); i++)
+		delete m_Contexts[i];
+}
+
+/// <summary>
+/// Requests a path. Safe to call from any thread, including from a callback.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <param name="onComplete">Optional callback, called on a worker thread.</param>
+/// <returns>A ticket with the request id and a future for the result</returns>
+PathService::Ticket PathService::Request(Coordinate start, Coordinate goal, Callback onComplete)
+{
+	Waiter waiter;
+	waiter.Promise = std::make_shared<std::promise<Result> >();
+	waiter.OnComplete = onComplete;
+	waiter.Delivered = false;
+
+	Ticket ticket;
+	ticket.Future = waiter.Promise->get_future().share();
+
+	Job* newJob = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		waiter.Id = m_NextId++;
+		ticket.Id = waiter.Id;
+
+		// Piggyback on an identical search that is already queued or running
+		unsigned long long key = GetKey(start, goal);
+		std::map<unsigned long long, Job*>::iterator it = m_InFlight.find(key);
+		if (it != m_InFlight.end())
+		{
+			it->second->Waiters.push_back(waiter);
+			m_Tickets[waiter.Id] = it->second;
+			m_CoalescedCount++;
+		}
+		else
+		{
+			newJob = new Job();
+			newJob->Start = start;
+			newJob->Goal = goal;
+			newJob->Key = key;
+			newJob->Cancelled = false;
+			newJob->Waiters.push_back(waiter);
+			m_InFlight[key] = newJob;
+			m_Tickets[waiter.Id] = newJob;
+		}
+	}
+	m_RequestCount++;
+
+	if (newJob != nullptr)
+	{
+		// The queue is bounded, so back off while the workers catch up
+		while (!m_Queue.TryPush(newJob))
+			std::this_thread::yield();
+
+		m_Queued++;
+		// Take the lock so a worker that is just about to sleep can't miss the wake up
+		{
+			std::lock_guard<std::mutex> lock(m_SleepMutex);
+		}
+		m_WakeUp.notify_one();
+	}
+
+	return ticket;
+}
+
+/// <summary>
+/// Cancels a request. Its future is completed as cancelled right away and its callback is never called.
+/// The search itself is only abandoned once every coalesced request for it is cancelled.
+/// </summary>
+/// <param name="id">The request id.</param>
+/// <returns>False if the request is unknown or already completed</returns>
+bool PathService::Cancel(unsigned int id)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	std::map<unsigned int, Job*>::iterator it = m_Tickets.find(id);
+	if (it == m_Tickets.end())
+		return false;
+
+	Job* job = it->second;
+	m_Tickets.erase(it);
+
+	bool anyoneLeft = false;
+	for (size_t i = 0; i < job->Waiters.size(); i++)
+	{
+		Waiter& waiter = job->Waiters[i];
+		if (waiter.Id == id)
+		{
+			Result cancelled;
+			cancelled.Code = Cancelled;
+			waiter.Promise->set_value(cancelled);
+			waiter.Delivered = true;
+		}
+		anyoneLeft |= !waiter.Delivered;
+	}
+
+	if (!anyoneLeft)
+	{
+		// Nobody wants this search anymore. New requests for the same path get a fresh one.
+		job->Cancelled = true;
+		std::map<unsigned long long, Job*>::iterator inFlight = m_InFlight.find(job->Key);
+		if (inFlight != m_InFlight.end() && inFlight->second == job)
+			m_InFlight.erase(inFlight);
+	}
+
+	return true;
+}
+
+/// <summary>
+/// The worker loop.
+/// </summary>
+/// <param name="context">The search context owned by this worker.</param>
+void PathService::Work(AStar* context)
+{
+	for (;;)
+	{
+		Job* job;
+		if (m_Queue.TryPop(job))
+		{
+			m_Queued--;
+
+			Result result;
+			result.Code = Cancelled;
+			if (!job->Cancelled)
+				Search(context, job, result);
+			Complete(job, result);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		if (m_Stopping)
+			return;
+		m_WakeUp.wait(lock, [this]() { return m_Queued > 0 || m_Stopping; });
+		if (m_Stopping)
+			return;
+	}
+}
+
+/// <summary>
+/// Runs the search for a job, giving up early if it gets cancelled.
+/// </summary>
+/// <param name="context">The search context.</param>
+/// <param name="job">The job.</param>
+/// <param name="result">Receives the result.</param>
+void PathService::Search(AStar* context, Job* job, Result& result)
+{
+	m_SearchCount++;
+
+	result.Code = NoPath;
+	if (!m_RawMap->isWalkable(job->Start) || !m_RawMap->isWalkable(job->Goal))
+		return;
+
+	context->Prepare(job->Start, job->Goal);
+	AStar::Node* foundGoal = nullptr;
+	for (unsigned int expansions = 0; foundGoal == nullptr; expansions++)
+	{
+		// Checking an atomic on every expansion would be wasteful
+		if ((expansions & 255) == 0 && job->Cancelled)
+		{
+			result.Code = Cancelled;
+			return;
+		}
+		foundGoal = context->Update();
+	}
+
+	std::vector<Coordinate>* path = context->ReconstructPath(foundGoal);
+	if (!path->empty())
+	{
+		result.Code = Found;
+		result.Path.swap(*path);
+	}
+	delete path;
+}
+
+/// <summary>
+/// Delivers the result to everyone still waiting for the job and frees it.
+/// </summary>
+/// <param name="job">The job.</param>
+/// <param name="result">The result.</param>
+void PathService::Complete(Job* job, const Result& result)
+{
+	if (result.Code == Cancelled)
+		m_CancelledCount++;
+
+	std::vector<Waiter> waiters;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::map<unsigned long long, Job*>::iterator inFlight = m_InFlight.find(job->Key);
+		if (inFlight != m_InFlight.end() && inFlight->second == job)
+			m_InFlight.erase(inFlight);
+
+		for (size_t i = 0; i < job->Waiters.size(); i++)
+		{
+			if (!job->Waiters[i].Delivered)
+			{
+				m_Tickets.erase(job->Waiters[i].Id);
+				waiters.push_back(job->Waiters[i]);
+			}
+		}
+	}
+	delete job;
+
+	// Callbacks run outside the lock, they are allowed to make new requests
+	for (size_t i = 0; i < waiters.size(); i++)
+	{
+		waiters[i].Promise->set_value(result);
+		if (waiters[i].OnComplete && result.Code != Cancelled)
+			waiters[i].OnComplete(result);
+	}
+}
+
+/// <summary>
+/// Packs a start and goal into a key for coalescing.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns></returns>
+unsigned long long PathService::GetKey(Coordinate start, Coordinate goal)
+{
+	return ((unsigned long long)(unsigned short)start.X << 48)
+		| ((unsigned long long)(unsigned short)start.Y << 32)
+		| ((unsigned long long)(unsigned short)goal.X << 16)
+		| (unsigned long long)(unsigned short)goal.Y;
+}
+
+#endif
\ No newline at end of file
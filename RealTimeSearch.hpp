@@ -0,0 +1,395 @@
+#ifndef REALTIMESEARCH_HPP
+#define REALTIMESEARCH_HPP
+
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include "DV1419Map.h"
+#include "SparseNodeTable.hpp"
+
+/// <summary>
+/// Real-time agent search, LSS-LRTA*. Instead of planning the whole path before the first move, the
+/// agent runs an A* around itself that stops after a fixed number of expansions, raises the heuristic
+/// of the cells it expanded to what it learned about them, and walks to the most promising cell on
+/// the edge of the search before looking again. The work for a move only depends on the lookahead,
+/// never on the size of the map or how far away the goal is.
+/// The learned heuristic is kept per goal for as long as the instance lives, so agents that come back
+/// to the same goal move better every time, and after enough trials along an optimal path.
+/// Costs are the same 10/14 as <see cref="AStar"/>, without corner cutting.
+/// </summary>
+class RealTimeSearch
+{
+public:
+	/// <summary>
+	/// What a move did.
+	/// </summary>
+	enum Status
+	{
+		Moving,
+		Arrived,
+		// The goal can't be reached from where the agent is
+		NoPath
+	};
+
+	RealTimeSearch(DV1419Map* map, int lookahead);
+
+	void SetLookahead(int expansions) { m_Lookahead = max(expansions, 1); }
+	int GetLookahead() const { return m_Lookahead; }
+	void Begin(Coordinate start, Coordinate goal);
+	Status Move(Coordinate& next);
+	std::vector<Coordinate>* Run(Coordinate start, Coordinate goal, unsigned int maxMoves);
+	void ForgetLearning() { m_Learned.clear(); }
+	size_t GetLearnedCount() const;
+
+	Coordinate GetPosition() const { return Coordinate(m_Position % m_MapWidth, m_Position / m_MapWidth); }
+
+	// The expansions of the current trial, and the most any single move needed
+	unsigned int m_ExpandedNodes;
+	unsigned int m_MostExpandedPerMove;
+	unsigned int m_Searches;
+
+private:
+	/// <summary>
+	/// The state of a cell in the current local search.
+	/// </summary>
+	struct Cell
+	{
+		int G;
+		int Parent;
+		// The local search this cell was last touched by, older cells count as unvisited
+		unsigned int Generation;
+		bool Closed;
+	};
+
+	typedef std::pair<int, int> Entry;
+	typedef std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry> > Queue;
+
+	bool IsLegalMove(int x, int y, int direction) const;
+	int GetHeuristic(int index);
+	void SetHeuristic(int index, int h);
+	bool Search();
+	void Learn();
+
+	static const int DirectionX[8];
+	static const int DirectionY[8];
+	static const int DirectionCost[8];
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+	int m_Lookahead;
+
+	// The learned heuristic of every goal, only for cells it was raised on
+	std::map<int, SparseNodeTable<int> > m_Learned;
+	SparseNodeTable<int>* m_GoalLearned;
+
+	int m_Position;
+	int m_Goal;
+	// The cells to walk to before searching again, last one first
+	std::vector<int> m_Plan;
+
+	std::vector<Cell> m_Cells;
+	unsigned int m_Generation;
+	Queue m_Open;
+	std::vector<int> m_ClosedCells;
+};
+
+// Directions go around the compass so that the opposite of d is (d + 4) % 8
+const int RealTimeSearch::DirectionX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int RealTimeSearch::DirectionY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const int RealTimeSearch::DirectionCost[8] = { 10, 14, 10, 14, 10, 14, 10, 14 };
+
+/// <summary>
+/// Initializes a new instance of the <see cref="RealTimeSearch"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="lookahead">The number of cells a local search expands at most.</param>
+RealTimeSearch::RealTimeSearch(DV1419Map* map, int lookahead)
+	: m_ExpandedNodes(0), m_MostExpandedPerMove(0), m_Searches(0), m_Lookahead(max(lookahead, 1)),
+	m_GoalLearned(nullptr), m_Position(0), m_Goal(0), m_Generation(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	Cell empty = { 0, -1, 0, false };
+	m_Cells.assign(m_MapWidth * m_MapHeight, empty);
+}
+
+/// <summary>
+/// Puts the agent at the start of a new trial, keeping what it learned about the goal before.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+void RealTimeSearch::Begin(Coordinate start, Coordinate goal)
+{
+	m_Position = start.Y * m_MapWidth + start.X;
+	m_Goal = goal.Y * m_MapWidth + goal.X;
+	m_GoalLearned = &m_Learned[m_Goal];
+	m_Plan.clear();
+	m_ExpandedNodes = 0;
+	m_MostExpandedPerMove = 0;
+	m_Searches = 0;
+}
+
+/// <summary>
+/// Makes the next move, searching first if the agent has walked to the end of its last search.
+/// </summary>
+/// <param name="next">Set to the cell the agent moved to, or where it is if it didn't move.</param>
+/// <returns>Whether the agent moved, is at the goal or is stuck</returns>
+RealTimeSearch::Status RealTimeSearch::Move(Coordinate& next)
+{
+	next = GetPosition();
+	if (m_Position == m_Goal)
+		return Arrived;
+	if (!m_Map[m_Position] || !m_Map[m_Goal])
+		return NoPath;
+
+	if (m_Plan.empty())
+	{
+		unsigned int expanded = m_ExpandedNodes;
+		bool found = Search();
+		m_MostExpandedPerMove = max(m_MostExpandedPerMove, m_ExpandedNodes - expanded);
+		if (!found)
+			return NoPath;
+	}
+
+	m_Position = m_Plan.back();
+	m_Plan.pop_back();
+	next = GetPosition();
+	return (m_Position == m_Goal) ? Arrived : Moving;
+}
+
+/// <summary>
+/// Runs a whole trial, moving the agent until it reaches the goal.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <param name="maxMoves">The number of moves to give up after.</param>
+/// <returns>The cells the agent went through, from the start. Ends at the goal unless it gave up or there is no path.</returns>
+std::vector<Coordinate>* RealTimeSearch::Run(Coordinate start, Coordinate goal, unsigned int maxMoves)
+{
+	std::vector<Coordinate>* trajectory = new std::vector<Coordinate>;
+	Begin(start, goal);
+	trajectory->push_back(start);
+
+	Coordinate next;
+	Status status = Moving;
+	for (unsigned int move = 0; move < maxMoves && status == Moving; move++)
+	{
+		status = Move(next);
+		if (status != NoPath && (next.X != trajectory->back().X || next.Y != trajectory->back().Y))
+			trajectory->push_back(next);
+	}
+
+	return trajectory;
+}
+
+/// <summary>
+/// Gets the number of cells with a learned heuristic, over every goal.
+/// </summary>
+/// <returns></returns>
+size_t RealTimeSearch::GetLearnedCount() const
+{
+	size_t count = 0;
+	for (std::map<int, SparseNodeTable<int> >::const_iterator it = m_Learned.begin(); it != m_Learned.end(); ++it)
+		count += it->second.GetCount();
+
+	return count;
+}
+
+/// <summary>
+/// Runs the local A* from where the agent is, learns from it and plans the walk to the best cell
+/// on its edge, or to the goal if the search reached it.
+/// </summary>
+/// <returns>Whether there is a way on, false if the agent is walled off from the goal</returns>
+bool RealTimeSearch::Search()
+{
+	m_Searches++;
+	m_Generation++;
+	if (m_Generation == 0)
+	{
+		for (size_t i = 0; i < m_Cells.size(); i++)
+			m_Cells[i].Generation = 0;
+		m_Generation = 1;
+	}
+	m_Open = Queue();
+	m_ClosedCells.clear();
+
+	// Learning leaves cells that are walled off from the goal at an infinite heuristic
+	if (GetHeuristic(m_Position) == INT_MAX)
+		return false;
+
+	Cell& start = m_Cells[m_Position];
+	start.G = 0;
+	start.Parent = -1;
+	start.Generation = m_Generation;
+	start.Closed = false;
+	m_Open.push(Entry(GetHeuristic(m_Position), m_Position));
+
+	int target = -1;
+	while (!m_Open.empty())
+	{
+		Entry top = m_Open.top();
+		Cell& cell = m_Cells[top.second];
+		// Skip entries that were replaced by a better path
+		if (cell.Closed || top.first != cell.G + GetHeuristic(top.second))
+		{
+			m_Open.pop();
+			continue;
+		}
+
+		// The goal, or the lookahead is used up and this is the best cell on the edge
+		if (top.second == m_Goal || (int)m_ClosedCells.size() >= m_Lookahead)
+		{
+			target = top.second;
+			break;
+		}
+
+		m_Open.pop();
+		cell.Closed = true;
+		m_ClosedCells.push_back(top.second);
+		m_ExpandedNodes++;
+
+		int x = top.second % m_MapWidth;
+		int y = top.second / m_MapWidth;
+		for (int direction = 0; direction < 8; direction++)
+		{
+			if (!IsLegalMove(x, y, direction))
+				continue;
+
+			int index = (y + DirectionY[direction]) * m_MapWidth + x + DirectionX[direction];
+			int h = GetHeuristic(index);
+			if (h == INT_MAX)
+				continue;
+			Cell& neighbour = m_Cells[index];
+			int g = cell.G + DirectionCost[direction];
+			if (neighbour.Generation != m_Generation)
+			{
+				neighbour.Generation = m_Generation;
+				neighbour.Closed = false;
+			}
+			else if (neighbour.Closed || g >= neighbour.G)
+				continue;
+
+			neighbour.G = g;
+			neighbour.Parent = top.second;
+			m_Open.push(Entry(g + h, index));
+		}
+	}
+	if (target < 0)
+		return false;
+
+	Learn();
+
+	for (int index = target; index != m_Position; index = m_Cells[index].Parent)
+		m_Plan.push_back(index);
+	return true;
+}
+
+/// <summary>
+/// Raises the heuristic of every cell the search expanded to the cheapest way from it to the edge
+/// of the search plus the heuristic there, with a Dijkstra inwards from the open cells.
+/// The heuristic stays consistent, so it never overestimates.
+/// </summary>
+void RealTimeSearch::Learn()
+{
+	for (size_t i = 0; i < m_ClosedCells.size(); i++)
+		SetHeuristic(m_ClosedCells[i], INT_MAX);
+
+	// What is left in the open list is the edge, stale entries included, they are skipped below.
+	// Entries are re-keyed by the bare heuristic.
+	Queue edge;
+	while (!m_Open.empty())
+	{
+		int index = m_Open.top().second;
+		m_Open.pop();
+		if (!m_Cells[index].Closed)
+			edge.push(Entry(GetHeuristic(index), index));
+	}
+
+	while (!edge.empty())
+	{
+		Entry top = edge.top();
+		edge.pop();
+		if (top.first != GetHeuristic(top.second))
+			continue;
+
+		int x = top.second % m_MapWidth;
+		int y = top.second / m_MapWidth;
+		for (int direction = 0; direction < 8; direction++)
+		{
+			if (!IsLegalMove(x, y, direction))
+				continue;
+
+			// Moves are symmetric, so this is also the move from the neighbour here
+			int index = (y + DirectionY[direction]) * m_MapWidth + x + DirectionX[direction];
+			const Cell& neighbour = m_Cells[index];
+			if (neighbour.Generation != m_Generation || !neighbour.Closed)
+				continue;
+
+			int h = top.first + DirectionCost[direction];
+			if (h < GetHeuristic(index))
+			{
+				SetHeuristic(index, h);
+				edge.push(Entry(h, index));
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Gets the heuristic of a cell, the learned one if there is one, else the octile distance to the goal.
+/// </summary>
+/// <param name="index">The index of the cell.</param>
+/// <returns></returns>
+int RealTimeSearch::GetHeuristic(int index)
+{
+	const int* learned = m_GoalLearned->Find(index);
+	if (learned != nullptr)
+		return *learned;
+
+	int dx = abs(index % m_MapWidth - m_Goal % m_MapWidth);
+	int dy = abs(index / m_MapWidth - m_Goal / m_MapWidth);
+	return 14 * min(dx, dy) + 10 * (max(dx, dy) - min(dx, dy));
+}
+
+/// <summary>
+/// Learns the heuristic of a cell.
+/// </summary>
+/// <param name="index">The index of the cell.</param>
+/// <param name="h">The heuristic.</param>
+void RealTimeSearch::SetHeuristic(int index, int h)
+{
+	bool created;
+	*m_GoalLearned->Get(index, created) = h;
+}
+
+/// <summary>
+/// Determines whether a move in the given direction is legal, without cutting corners.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="direction">The direction.</param>
+/// <returns></returns>
+bool RealTimeSearch::IsLegalMove(int x, int y, int direction) const
+{
+	int toX = x + DirectionX[direction];
+	int toY = y + DirectionY[direction];
+	if (toX < 0 || toX >= m_MapWidth || toY < 0 || toY >= m_MapHeight || !m_Map[toY * m_MapWidth + toX])
+		return false;
+
+	// A diagonal needs both of the cells it passes
+	if (direction % 2 == 1)
+		return m_Map[y * m_MapWidth + toX] && m_Map[toY * m_MapWidth + x];
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,242 @@
+#ifndef RECTANGLESYMMETRY_HPP
+#define RECTANGLESYMMETRY_HPP
+
+#include <vector>
+#include <algorithm>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Rectangular Symmetry Reduction. The free space of the map is cut into empty rectangles, and a
+/// search only visits the cells on their perimeters: every path across an empty rectangle is as long
+/// as the straight octile one, so the interior can be jumped over with macro edges from each
+/// perimeter cell to the far side. A perimeter cell gets an edge to every cell of the opposite side
+/// within its diagonal cone, and to the cell on each adjacent side that it reaches going diagonally
+/// first, which together with the ordinary moves along the perimeter keeps every optimal path.
+/// A start or goal inside a rectangle is joined to its perimeter during the search.
+/// Meant for 8-connected 10/14 searches without corner cutting, like <see cref="AStar"/>.
+/// </summary>
+class RectangleSymmetry
+{
+public:
+	/// <summary>
+	/// A macro edge.
+	/// </summary>
+	struct Successor
+	{
+		int X, Y;
+		int Cost;
+	};
+
+	RectangleSymmetry(const DV1419Map* map);
+
+	bool IsPruned(int x, int y) const;
+	bool IsSameRectangle(int x1, int y1, int x2, int y2) const;
+	void GetSuccessors(int x, int y, std::vector<Successor>& successors) const;
+	static int GetCost(int dx, int dy);
+
+	int GetRectangleCount() const { return (int)m_Rectangles.size(); }
+	int GetFreeCellCount() const { return m_FreeCells; }
+	int GetPerimeterCellCount() const { return m_PerimeterCells; }
+
+private:
+	struct Rectangle
+	{
+		int Left, Top, Right, Bottom;
+	};
+
+	bool IsFree(int x, int y) const;
+	void AddSuccessor(int x, int y, int toX, int toY, std::vector<Successor>& successors) const;
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	// The rectangle of every cell, -1 for blocked cells
+	std::vector<int> m_RectangleOf;
+	std::vector<Rectangle> m_Rectangles;
+	int m_FreeCells;
+	int m_PerimeterCells;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="RectangleSymmetry"/> class and decomposes the map.
+/// Rectangles are placed greedily from the first free cell in reading order, each the largest
+/// one that fits with its top left corner there.
+/// </summary>
+/// <param name="map">The map.</param>
+RectangleSymmetry::RectangleSymmetry(const DV1419Map* map)
+	: m_FreeCells(0), m_PerimeterCells(0)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+	m_RectangleOf.assign(m_MapWidth * m_MapHeight, -1);
+
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			if (!IsFree(x, y))
+				continue;
+
+			// Take the largest rectangle with its top left corner here: go down row by row,
+			// narrowing to the free run every row allows
+			Rectangle rectangle = { x, y, x, y };
+			int runWidth = m_MapWidth;
+			for (int bottom = y; bottom < m_MapHeight && IsFree(x, bottom); bottom++)
+			{
+				int width = 0;
+				while (width < runWidth && IsFree(x + width, bottom))
+					width++;
+				runWidth = width;
+				if ((long long)width * (bottom - y + 1) > (long long)(rectangle.Right - x + 1) * (rectangle.Bottom - y + 1))
+				{
+					rectangle.Right = x + width - 1;
+					rectangle.Bottom = bottom;
+				}
+			}
+
+			for (int i = rectangle.Top; i <= rectangle.Bottom; i++)
+				for (int j = rectangle.Left; j <= rectangle.Right; j++)
+					m_RectangleOf[i * m_MapWidth + j] = (int)m_Rectangles.size();
+			m_Rectangles.push_back(rectangle);
+
+			int width = rectangle.Right - rectangle.Left + 1;
+			int height = rectangle.Bottom - rectangle.Top + 1;
+			m_FreeCells += width * height;
+			m_PerimeterCells += width * height - max(width - 2, 0) * max(height - 2, 0);
+		}
+	}
+}
+
+/// <summary>
+/// Determines whether a cell is inside a rectangle, away from its perimeter, so a search can skip it.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+inline bool RectangleSymmetry::IsPruned(int x, int y) const
+{
+	int index = m_RectangleOf[y * m_MapWidth + x];
+	if (index < 0)
+		return false;
+
+	const Rectangle& rectangle = m_Rectangles[index];
+	return x > rectangle.Left && x < rectangle.Right && y > rectangle.Top && y < rectangle.Bottom;
+}
+
+/// <summary>
+/// Determines whether two cells are in the same rectangle, so the straight octile path between them is free.
+/// </summary>
+/// <returns></returns>
+bool RectangleSymmetry::IsSameRectangle(int x1, int y1, int x2, int y2) const
+{
+	int index = m_RectangleOf[y1 * m_MapWidth + x1];
+	return index >= 0 && index == m_RectangleOf[y2 * m_MapWidth + x2];
+}
+
+/// <summary>
+/// Gets the macro edges out of a cell, across its rectangle. A cell inside the rectangle, the
+/// start of a search, gets an edge to every perimeter cell instead. Cells next to the cell
+/// are left to the ordinary moves.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="successors">Cleared and filled with the edges.</param>
+void RectangleSymmetry::GetSuccessors(int x, int y, std::vector<Successor>& successors) const
+{
+	successors.clear();
+	int index = m_RectangleOf[y * m_MapWidth + x];
+	if (index < 0)
+		return;
+
+	const Rectangle& r = m_Rectangles[index];
+	int width = r.Right - r.Left;
+	int height = r.Bottom - r.Top;
+	// Without an interior there is nothing to jump over
+	if (width < 2 || height < 2)
+		return;
+
+	if (IsPruned(x, y))
+	{
+		for (int i = r.Left; i <= r.Right; i++)
+		{
+			AddSuccessor(x, y, i, r.Top, successors);
+			AddSuccessor(x, y, i, r.Bottom, successors);
+		}
+		for (int i = r.Top + 1; i < r.Bottom; i++)
+		{
+			AddSuccessor(x, y, r.Left, i, successors);
+			AddSuccessor(x, y, r.Right, i, successors);
+		}
+		return;
+	}
+
+	// A corner is on two sides, and gets the edges of both
+	if (x == r.Left || x == r.Right)
+	{
+		int farX = (x == r.Left) ? r.Right : r.Left;
+		for (int i = max(r.Top, y - width); i <= min(r.Bottom, y + width); i++)
+			AddSuccessor(x, y, farX, i, successors);
+		int step = (x == r.Left) ? 1 : -1;
+		if (y - r.Top < width)
+			AddSuccessor(x, y, x + step * (y - r.Top), r.Top, successors);
+		if (r.Bottom - y < width)
+			AddSuccessor(x, y, x + step * (r.Bottom - y), r.Bottom, successors);
+	}
+	if (y == r.Top || y == r.Bottom)
+	{
+		int farY = (y == r.Top) ? r.Bottom : r.Top;
+		for (int i = max(r.Left, x - height); i <= min(r.Right, x + height); i++)
+			AddSuccessor(x, y, i, farY, successors);
+		int step = (y == r.Top) ? 1 : -1;
+		if (x - r.Left < height)
+			AddSuccessor(x, y, r.Left, y + step * (x - r.Left), successors);
+		if (r.Right - x < height)
+			AddSuccessor(x, y, r.Right, y + step * (r.Right - x), successors);
+	}
+}
+
+/// <summary>
+/// Gets the cost of the octile path across a free area, in the 10/14 units of the searches.
+/// </summary>
+/// <param name="dx">The x-distance.</param>
+/// <param name="dy">The y-distance.</param>
+/// <returns></returns>
+int RectangleSymmetry::GetCost(int dx, int dy)
+{
+	dx = abs(dx);
+	dy = abs(dy);
+	return 14 * min(dx, dy) + 10 * (max(dx, dy) - min(dx, dy));
+}
+
+/// <summary>
+/// Determines whether a cell is on the map, walkable and not in a rectangle yet.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool RectangleSymmetry::IsFree(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x] && m_RectangleOf[y * m_MapWidth + x] < 0;
+}
+
+/// <summary>
+/// Adds a macro edge, unless it would only be an ordinary move.
+/// </summary>
+void RectangleSymmetry::AddSuccessor(int x, int y, int toX, int toY, std::vector<Successor>& successors) const
+{
+	if (abs(toX - x) <= 1 && abs(toY - y) <= 1)
+		return;
+
+	Successor successor = { toX, toY, GetCost(toX - x, toY - y) };
+	successors.push_back(successor);
+}
+
+#endif
\ No newline at end of file
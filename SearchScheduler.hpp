@@ -0,0 +1,343 @@
+#ifndef SEARCHSCHEDULER_HPP
+#define SEARCHSCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include "DV1419Map.h"
+#include "AStar.hpp"
+
+/// <summary>
+/// Runs many path queries side by side under a per-tick budget, using the incremental
+/// <see cref="AStar::Prepare"/>/<see cref="AStar::Update"/> interface.
+/// Every running query owns one search context (an <see cref="AStar"/> instance) out of a
+/// fixed pool, the rest wait in a pending list until a context frees up. Running queries
+/// share the budget through deficit round robin weighted by priority, and pending queries
+/// age so that low priorities are never starved.
+/// </summary>
+class SearchScheduler
+{
+public:
+	/// <summary>
+	/// Called once a query is finished. The receiver owns the path, which is empty if no path exists.
+	/// </summary>
+	typedef std::function<void(unsigned int id, std::vector<Coordinate>* path)> Callback;
+
+	/// <summary>
+	/// What the budget passed to <see cref="Tick"/> is measured in.
+	/// </summary>
+	enum BudgetType
+	{
+		Expansions,
+		Microseconds
+	};
+
+	/// <summary>
+	/// A query that has been requested but not yet delivered.
+	/// </summary>
+	struct Query
+	{
+		unsigned int Id;
+		Coordinate Start;
+		Coordinate Goal;
+		int Priority;
+		unsigned int RequestTick;
+		unsigned int Expansions;
+		double Deficit;
+		AStar* Context;
+		Callback OnComplete;
+	};
+
+	SearchScheduler(DV1419Map* map, int contexts);
+	~SearchScheduler();
+
+	unsigned int Request(Coordinate start, Coordinate goal, int priority, Callback onComplete);
+	bool Cancel(unsigned int id);
+	unsigned int Tick(BudgetType type, unsigned int budget);
+
+	int GetPendingCount() const { return m_Pending.size(); }
+	int GetRunningCount() const { return m_Running.size(); }
+	int GetUndeliveredCount() const { return m_Finished.size(); }
+	unsigned int GetCurrentTick() const { return m_Tick; }
+
+	/// <summary>
+	/// Expansions a query of priority 0 may do per turn before the next query gets to run.
+	/// </summary>
+	unsigned int m_Quantum;
+	/// <summary>
+	/// Number of ticks a pending query has to wait to be treated as one priority level higher.
+	/// </summary>
+	unsigned int m_AgingTicks;
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+	typedef std::pair<Query, std::vector<Coordinate>*> Result;
+
+	void Admit();
+	bool Step(Query& query);
+	void Deliver();
+	bool IsPastDeadline() const { return m_BudgetType == Microseconds && Clock::now() >= m_Deadline; }
+
+	DV1419Map* m_RawMap;
+	std::vector<AStar*> m_Contexts;
+	std::vector<AStar*> m_FreeContexts;
+	std::vector<Query> m_Pending;
+	std::vector<Query> m_Running;
+	unsigned int m_NextId;
+	unsigned int m_Tick;
+	size_t m_RoundRobin;
+	// Finished queries whose callbacks haven't been called yet, the ones past a tick's deadline wait for the next
+	std::deque<Result> m_Finished;
+	// The budget of the running tick
+	BudgetType m_BudgetType;
+	Clock::time_point m_Deadline;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="SearchScheduler"/> class.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="contexts">The number of queries that can be searched at the same time.</param>
+SearchScheduler::SearchScheduler(DV1419Map* map, int contexts)
+	: m_Quantum(32), m_AgingTicks(8), m_RawMap(map), m_NextId(1), m_Tick(0), m_RoundRobin(0), m_BudgetType(Expansions)
+{
+	for (int i = 0; i < contexts; i++)
+	{
+		AStar* context = new AStar(map, AStar::Heuristics::Diagonal);
+		// Allocate the nodes here, so the first tick doesn't pay for them in every context
+		context->ReserveDenseState();
+		m_Contexts.push_back(context);
+		m_FreeContexts.push_back(context);
+	}
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="SearchScheduler"/> class.
+/// </summary>
+SearchScheduler::~SearchScheduler()
+{
+	for (size_t i = 0; i < m_Contexts.size(); i++)
+		delete m_Contexts[i];
+	for (size_t i = 0; i < m_Finished.size(); i++)
+		delete m_Finished[i].second;
+}
+
+/// <summary>
+/// Queues a path query.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <param name="priority">The priority, higher is more important. Must not be negative.</param>
+/// <param name="onComplete">Called from within <see cref="Tick"/> when the path is found.</param>
+/// <returns>The id of the query</returns>
+unsigned int SearchScheduler::Request(Coordinate start, Coordinate goal, int priority, Callback onComplete)
+{
+	Query query;
+	query.Id = m_NextId++;
+	query.Start = start;
+	query.Goal = goal;
+	query.Priority = (priority < 0) ? 0 : priority;
+	query.RequestTick = m_Tick;
+	query.Expansions = 0;
+	query.Deficit = 0;
+	query.Context = nullptr;
+	query.OnComplete = onComplete;
+	m_Pending.push_back(query);
+
+	return query.Id;
+}
+
+/// <summary>
+/// Cancels a query that hasn't been delivered yet. Its callback will never be called.
+/// </summary>
+/// <param name="id">The id of the query.</param>
+/// <returns>False if the query was unknown or already delivered</returns>
+bool SearchScheduler::Cancel(unsigned int id)
+{
+	for (size_t i = 0; i < m_Pending.size(); i++)
+	{
+		if (m_Pending[i].Id == id)
+		{
+			m_Pending.erase(m_Pending.begin() + i);
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < m_Running.size(); i++)
+	{
+		if (m_Running[i].Id == id)
+		{
+			m_FreeContexts.push_back(m_Running[i].Context);
+			m_Running.erase(m_Running.begin() + i);
+			if (m_RoundRobin > i)
+				m_RoundRobin--;
+			return true;
+		}
+	}
+
+	for (size_t i = 0; i < m_Finished.size(); i++)
+	{
+		if (m_Finished[i].first.Id == id)
+		{
+			delete m_Finished[i].second;
+			m_Finished.erase(m_Finished.begin() + i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Advances the queries until the budget is spent or every query is done.
+/// Completed queries are delivered through their callbacks at the end of the tick. A budget in
+/// microseconds covers all of the tick: admitting queries, searching, building their paths and
+/// delivering them. Whatever doesn't fit waits for the next tick.
+/// </summary>
+/// <param name="type">What the budget is measured in.</param>
+/// <param name="budget">The budget.</param>
+/// <returns>The number of expansions done this tick</returns>
+unsigned int SearchScheduler::Tick(BudgetType type, unsigned int budget)
+{
+	m_BudgetType = type;
+	m_Deadline = Clock::now() + std::chrono::microseconds(budget);
+
+	unsigned int expansions = 0;
+	bool outOfBudget = IsPastDeadline();
+	// Reading the clock is not free, so only do it every few expansions, and right after
+	// anything that may take longer than an expansion
+	int untilClock = 0;
+
+	if (!outOfBudget)
+		Admit();
+	while (!m_Running.empty() && !outOfBudget)
+	{
+		if (m_RoundRobin >= m_Running.size())
+			m_RoundRobin = 0;
+
+		// Give the next query its share, a larger share for higher priorities
+		Query& query = m_Running[m_RoundRobin];
+		query.Deficit += m_Quantum * (query.Priority + 1);
+
+		bool done = false;
+		while (query.Deficit >= 1 && !done)
+		{
+			if (type == Expansions && expansions >= budget)
+			{
+				outOfBudget = true;
+				break;
+			}
+			if (type == Microseconds && --untilClock < 0)
+			{
+				if (IsPastDeadline())
+				{
+					outOfBudget = true;
+					break;
+				}
+				untilClock = 15;
+			}
+
+			done = Step(query);
+			query.Deficit -= 1;
+			expansions++;
+		}
+
+		if (done)
+		{
+			// A finished query doesn't keep its deficit, and the next one moves into its place.
+			// Building its path took time, so look at the clock before admitting.
+			m_FreeContexts.push_back(query.Context);
+			m_Running.erase(m_Running.begin() + m_RoundRobin);
+			outOfBudget = IsPastDeadline();
+			if (!outOfBudget)
+				Admit();
+			untilClock = 0;
+		}
+		else if (!outOfBudget)
+		{
+			m_RoundRobin++;
+		}
+	}
+
+	m_Tick++;
+	Deliver();
+
+	return expansions;
+}
+
+/// <summary>
+/// Moves the most important pending queries into free search contexts, as long as the tick has time left.
+/// </summary>
+void SearchScheduler::Admit()
+{
+	while (!m_FreeContexts.empty() && !m_Pending.empty() && !IsPastDeadline())
+	{
+		// Pick the highest priority, counting waiting time as extra priority
+		size_t best = 0;
+		double bestPriority = -1;
+		for (size_t i = 0; i < m_Pending.size(); i++)
+		{
+			double priority = m_Pending[i].Priority + (double)(m_Tick - m_Pending[i].RequestTick) / m_AgingTicks;
+			if (priority > bestPriority)
+			{
+				best = i;
+				bestPriority = priority;
+			}
+		}
+
+		Query query = m_Pending[best];
+		m_Pending.erase(m_Pending.begin() + best);
+
+		query.Context = m_FreeContexts.back();
+		m_FreeContexts.pop_back();
+
+		if (m_RawMap->isWalkable(query.Start) && m_RawMap->isWalkable(query.Goal))
+			query.Context->Prepare(query.Start, query.Goal);
+		m_Running.push_back(query);
+	}
+}
+
+/// <summary>
+/// Expands a single node of a query.
+/// </summary>
+/// <param name="query">The query.</param>
+/// <returns>True if the query is finished, it is then waiting to be delivered</returns>
+bool SearchScheduler::Step(Query& query)
+{
+	// Queries that can't have a path finish right away
+	if (!m_RawMap->isWalkable(query.Start) || !m_RawMap->isWalkable(query.Goal))
+	{
+		m_Finished.push_back(Result(query, new std::vector<Coordinate>));
+		return true;
+	}
+
+	query.Expansions++;
+	AStar::Node* foundGoal = query.Context->Update();
+	if (foundGoal == nullptr)
+		return false;
+
+	m_Finished.push_back(Result(query, query.Context->ReconstructPath(foundGoal)));
+	return true;
+}
+
+/// <summary>
+/// Calls the callbacks of finished queries, oldest first, until the tick runs out of time.
+/// At least one is delivered every tick so a slow callback can't hold the rest back for good.
+/// Called once the scheduler is in a consistent state, since callbacks may queue more work.
+/// </summary>
+void SearchScheduler::Deliver()
+{
+	for (bool first = true; !m_Finished.empty() && (first || !IsPastDeadline()); first = false)
+	{
+		// Take the result out first, a callback may cancel other finished queries
+		Result result = m_Finished.front();
+		m_Finished.pop_front();
+		if (result.first.OnComplete)
+			result.first.OnComplete(result.first.Id, result.second);
+		else
+			delete result.second;
+	}
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,293 @@
+#ifndef SEARCHTRACE_HPP
+#define SEARCHTRACE_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "DV1419Map.h"
+
+// Searches only report to a SearchTrace when SEARCH_TRACE is defined. Without it the calls aren't
+// compiled in at all, so a build that doesn't trace pays nothing for it. Set it in the project's
+// preprocessor definitions to record.
+
+/// <summary>
+/// Records what a search does as a stream of compact events: which cells were expanded, generated
+/// and given a better path, in order and with a timestamp. Events go into a ring buffer that keeps
+/// the most recent ones, or, when a file is open, is written out every time it fills up so a whole
+/// scenario run can be recorded and looked at later, see <see cref="TraceHeatmap"/>.
+/// </summary>
+class SearchTrace
+{
+public:
+	enum EventType
+	{
+		// A new search, at its start cell, followed by one QueryGoal per goal
+		QueryStart,
+		QueryGoal,
+		Expand,
+		// A cell put in the open list for the first time this search
+		Generate,
+		// A cell in the open list that was given a better path
+		Improve,
+		// A closed cell put back in the open list with a better path
+		Reopen,
+		EventTypeCount
+	};
+
+	/// <summary>
+	/// One event, eight bytes.
+	/// </summary>
+	struct Event
+	{
+		unsigned short X;
+		unsigned short Y;
+		// The type in the low bits, above it the time since the search started in 16 ns ticks, as of the latest expansion
+		unsigned int Stamp;
+
+		EventType GetType() const { return (EventType)(Stamp & TypeMask); }
+		unsigned long long GetTime() const { return (unsigned long long)(Stamp >> TypeBits) << TickBits; }
+	};
+
+	SearchTrace(size_t capacity);
+	~SearchTrace();
+
+	bool Open(const char* filename, const std::string& mapName, int width, int height);
+	bool Close();
+	static bool Load(const char* filename, std::string& mapName, int& width, int& height, std::vector<Event>& events);
+	static bool IsCompiledIn();
+
+	void BeginQuery(Coordinate start, const std::vector<Coordinate>& goals);
+	void Record(EventType type, int x, int y);
+	void Clear() { m_Head = 0; m_Written = 0; }
+
+	size_t GetCount() const;
+	const Event& GetEvent(size_t i) const;
+	unsigned long long GetRecordedCount() const { return m_Head; }
+
+private:
+	/// <summary>
+	/// The start of a trace file, followed by the map name and then the events up to the end of the file.
+	/// </summary>
+	struct Header
+	{
+		char Magic[4];
+		unsigned int Version;
+		unsigned int Width;
+		unsigned int Height;
+		unsigned int NameLength;
+	};
+
+	static const int TypeBits = 3;
+	static const unsigned int TypeMask = (1 << TypeBits) - 1;
+	// A 29 bit count of 16 ns ticks runs for more than eight seconds per search
+	static const int TickBits = 4;
+
+	bool Flush();
+
+	std::vector<Event> m_Events;
+	size_t m_Mask;
+	// The number of events recorded, and how many of those are in the file
+	unsigned long long m_Head;
+	unsigned long long m_Written;
+	FILE* m_File;
+	std::chrono::steady_clock::time_point m_QueryStart;
+	// The time of the last expansion
+	unsigned int m_Ticks;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="SearchTrace"/> class.
+/// </summary>
+/// <param name="capacity">The number of events to keep, rounded up to a power of two.</param>
+SearchTrace::SearchTrace(size_t capacity)
+	: m_Head(0), m_Written(0), m_File(nullptr), m_Ticks(0)
+{
+	size_t size = 1;
+	while (size < capacity)
+		size *= 2;
+	m_Events.resize(size);
+	m_Mask = size - 1;
+	m_QueryStart = std::chrono::steady_clock::now();
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="SearchTrace"/> class.
+/// </summary>
+SearchTrace::~SearchTrace()
+{
+	Close();
+}
+
+/// <summary>
+/// Starts writing every event to a file, from the next one recorded on.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <param name="mapName">The file of the map that is going to be searched.</param>
+/// <param name="width">The width of the map.</param>
+/// <param name="height">The height of the map.</param>
+/// <returns>Whether the file could be created</returns>
+bool SearchTrace::Open(const char* filename, const std::string& mapName, int width, int height)
+{
+	Close();
+	m_File = fopen(filename, "wb");
+	if (m_File == nullptr)
+		return false;
+
+	Header header;
+	memcpy(header.Magic, "STRC", 4);
+	header.Version = 1;
+	header.Width = width;
+	header.Height = height;
+	header.NameLength = (unsigned int)mapName.size();
+	m_Written = m_Head;
+	if (fwrite(&header, sizeof(header), 1, m_File) != 1 || fwrite(mapName.data(), 1, mapName.size(), m_File) != mapName.size())
+	{
+		fclose(m_File);
+		m_File = nullptr;
+		return false;
+	}
+
+	return true;
+}
+
+/// <summary>
+/// Writes what is left in the buffer and closes the file, if one is open.
+/// </summary>
+/// <returns>Whether everything was written</returns>
+bool SearchTrace::Close()
+{
+	if (m_File == nullptr)
+		return true;
+
+	bool written = Flush();
+	written = (fclose(m_File) == 0) && written;
+	m_File = nullptr;
+	return written;
+}
+
+/// <summary>
+/// Reads a trace file back.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <param name="mapName">Set to the file of the map that was searched.</param>
+/// <param name="width">Set to the width of the map.</param>
+/// <param name="height">Set to the height of the map.</param>
+/// <param name="events">Set to the events, oldest first.</param>
+/// <returns>Whether the file is a trace</returns>
+bool SearchTrace::Load(const char* filename, std::string& mapName, int& width, int& height, std::vector<Event>& events)
+{
+	FILE* file = fopen(filename, "rb");
+	if (file == nullptr)
+		return false;
+
+	Header header;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.Magic, "STRC", 4) == 0 && header.Version == 1;
+	if (valid)
+	{
+		mapName.resize(header.NameLength);
+		valid = header.NameLength == 0 || fread(&mapName[0], 1, header.NameLength, file) == header.NameLength;
+	}
+	if (valid)
+	{
+		width = header.Width;
+		height = header.Height;
+		events.clear();
+		Event buffer[4096];
+		size_t count;
+		while ((count = fread(buffer, sizeof(Event), 4096, file)) > 0)
+			events.insert(events.end(), buffer, buffer + count);
+	}
+
+	fclose(file);
+	return valid;
+}
+
+/// <summary>
+/// Determines whether the searches were compiled to report to a trace, see SEARCH_TRACE.
+/// </summary>
+/// <returns></returns>
+bool SearchTrace::IsCompiledIn()
+{
+#ifdef SEARCH_TRACE
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// <summary>
+/// Marks the start of a search. The times of the events that follow count from here.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goals">The goal coordinates.</param>
+void SearchTrace::BeginQuery(Coordinate start, const std::vector<Coordinate>& goals)
+{
+	m_QueryStart = std::chrono::steady_clock::now();
+	Record(QueryStart, start.X, start.Y);
+	for (size_t i = 0; i < goals.size(); i++)
+		Record(QueryGoal, goals[i].X, goals[i].Y);
+}
+
+/// <summary>
+/// Records an event of the current search.
+/// </summary>
+/// <param name="type">The type.</param>
+/// <param name="x">The x-coordinate of the cell.</param>
+/// <param name="y">The y-coordinate of the cell.</param>
+inline void SearchTrace::Record(EventType type, int x, int y)
+{
+	// Reading the clock costs more than the rest of this, so the events a node's expansion
+	// causes share its time
+	if (type == Expand || type == QueryStart)
+		m_Ticks = (unsigned int)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_QueryStart).count() >> TickBits);
+	Event& event = m_Events[m_Head & m_Mask];
+	event.X = (unsigned short)x;
+	event.Y = (unsigned short)y;
+	event.Stamp = (m_Ticks << TypeBits) | type;
+
+	// A full buffer goes to the file before it wraps around, without one the oldest events are dropped
+	if ((++m_Head & m_Mask) == 0 && m_File != nullptr)
+		Flush();
+}
+
+/// <summary>
+/// Gets the number of events still in the buffer.
+/// </summary>
+/// <returns></returns>
+size_t SearchTrace::GetCount() const
+{
+	return (m_Head < m_Events.size()) ? (size_t)m_Head : m_Events.size();
+}
+
+/// <summary>
+/// Gets an event in the buffer.
+/// </summary>
+/// <param name="i">The position, zero is the oldest event still in the buffer.</param>
+/// <returns></returns>
+const SearchTrace::Event& SearchTrace::GetEvent(size_t i) const
+{
+	return m_Events[(m_Head - GetCount() + i) & m_Mask];
+}
+
+/// <summary>
+/// Writes the events that aren't in the file yet.
+/// </summary>
+/// <returns>Whether they were written</returns>
+bool SearchTrace::Flush()
+{
+	bool written = true;
+	while (m_Written < m_Head)
+	{
+		// Write up to the end of the buffer, then from the start
+		size_t first = (size_t)(m_Written & m_Mask);
+		size_t count = (size_t)min(m_Head - m_Written, (unsigned long long)(m_Events.size() - first));
+		written = fwrite(&m_Events[first], sizeof(Event), count, m_File) == count && written;
+		m_Written += count;
+	}
+
+	return written;
+}
+
+#endif
\ No newline at end of file
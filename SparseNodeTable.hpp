@@ -0,0 +1,176 @@
+#ifndef SPARSENODETABLE_HPP
+#define SPARSENODETABLE_HPP
+
+#include <vector>
+#include <cstddef>
+
+/// <summary>
+/// Open addressing hash table from a cell index to a record, for searches that only touch a small
+/// part of a large map. Records are kept in fixed size chunks so pointers to them stay valid
+/// while the table grows, and clearing only visits the slots that were used. The key can be made
+/// wider than an int for indices that don't fit one, like a cell at a tick.
+/// </summary>
+template <typename T, typename K = int>
+class SparseNodeTable
+{
+public:
+	SparseNodeTable();
+
+	T* Get(K key, bool& created);
+	const T* Find(K key) const;
+	void Clear();
+	size_t GetCount() const { return m_Count; }
+	size_t GetMemoryUsage() const;
+
+private:
+	static const int ChunkBits = 10;
+	static const int ChunkSize = 1 << ChunkBits;
+
+	struct Entry
+	{
+		K Key;
+		unsigned int Item;
+	};
+
+	unsigned int GetSlot(K key) const;
+	void Grow();
+
+	// Capacity is a power of two, kept at most half full
+	std::vector<Entry> m_Entries;
+	unsigned int m_Mask;
+	int m_Shift;
+	// The slots in use, so clearing doesn't have to visit the whole table
+	std::vector<unsigned int> m_Used;
+	// A chunk never grows after it is made, so moving the outer vector leaves the records in place
+	std::vector<std::vector<T> > m_Chunks;
+	size_t m_Count;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="SparseNodeTable"/> class.
+/// </summary>
+template <typename T, typename K>
+SparseNodeTable<T, K>::SparseNodeTable()
+	: m_Mask(1023), m_Shift(22), m_Count(0)
+{
+	Entry empty = { -1, 0 };
+	m_Entries.assign(m_Mask + 1, empty);
+}
+
+/// <summary>
+/// Gets the record of a key, adding a default one if there is none yet.
+/// </summary>
+/// <param name="key">The key, not negative.</param>
+/// <param name="created">Set to whether the record was just added.</param>
+/// <returns>The record, valid until the table is cleared</returns>
+template <typename T, typename K>
+T* SparseNodeTable<T, K>::Get(K key, bool& created)
+{
+	unsigned int slot = GetSlot(key);
+	for (;;)
+	{
+		Entry& entry = m_Entries[slot];
+		if (entry.Key == key)
+		{
+			created = false;
+			return &m_Chunks[entry.Item >> ChunkBits][entry.Item & (ChunkSize - 1)];
+		}
+		if (entry.Key < 0)
+			break;
+		slot = (slot + 1) & m_Mask;
+	}
+
+	// Records are reused between searches, so give it a fresh one
+	unsigned int item = (unsigned int)m_Count++;
+	if ((item >> ChunkBits) >= m_Chunks.size())
+		m_Chunks.push_back(std::vector<T>(ChunkSize));
+	T* record = &m_Chunks[item >> ChunkBits][item & (ChunkSize - 1)];
+	*record = T();
+
+	m_Entries[slot].Key = key;
+	m_Entries[slot].Item = item;
+	m_Used.push_back(slot);
+	if (m_Count * 2 > m_Entries.size())
+		Grow();
+
+	created = true;
+	return record;
+}
+
+/// <summary>
+/// Finds the record of a key.
+/// </summary>
+/// <param name="key">The key.</param>
+/// <returns>The record, or null if there is none</returns>
+template <typename T, typename K>
+const T* SparseNodeTable<T, K>::Find(K key) const
+{
+	for (unsigned int slot = GetSlot(key); m_Entries[slot].Key >= 0; slot = (slot + 1) & m_Mask)
+		if (m_Entries[slot].Key == key)
+			return &m_Chunks[m_Entries[slot].Item >> ChunkBits][m_Entries[slot].Item & (ChunkSize - 1)];
+
+	return nullptr;
+}
+
+/// <summary>
+/// Removes every record. The memory is kept for the next search.
+/// </summary>
+template <typename T, typename K>
+void SparseNodeTable<T, K>::Clear()
+{
+	for (size_t i = 0; i < m_Used.size(); i++)
+		m_Entries[m_Used[i]].Key = -1;
+	m_Used.clear();
+	m_Count = 0;
+}
+
+/// <summary>
+/// Gets the memory held by the table and its records.
+/// </summary>
+/// <returns>The number of bytes</returns>
+template <typename T, typename K>
+size_t SparseNodeTable<T, K>::GetMemoryUsage() const
+{
+	return m_Entries.capacity() * sizeof(Entry) + m_Used.capacity() * sizeof(unsigned int)
+		+ m_Chunks.size() * ChunkSize * sizeof(T);
+}
+
+/// <summary>
+/// Gets the home slot of a key, by Fibonacci hashing.
+/// </summary>
+/// <param name="key">The key.</param>
+/// <returns></returns>
+template <typename T, typename K>
+unsigned int SparseNodeTable<T, K>::GetSlot(K key) const
+{
+	// The top bits of the 64-bit product, so every bit of a wide key counts
+	return (unsigned int)(((unsigned long long)key * 11400714819323198485ull) >> (32 + m_Shift));
+}
+
+/// <summary>
+/// Doubles the capacity and puts every entry back in. The records don't move.
+/// </summary>
+template <typename T, typename K>
+void SparseNodeTable<T, K>::Grow()
+{
+	std::vector<Entry> old;
+	old.swap(m_Entries);
+	Entry empty = { -1, 0 };
+	m_Entries.assign(old.size() * 2, empty);
+	m_Mask = (unsigned int)m_Entries.size() - 1;
+	m_Shift--;
+
+	m_Used.clear();
+	for (size_t i = 0; i < old.size(); i++)
+	{
+		if (old[i].Key < 0)
+			continue;
+		unsigned int slot = GetSlot(old[i].Key);
+		while (m_Entries[slot].Key >= 0)
+			slot = (slot + 1) & m_Mask;
+		m_Entries[slot] = old[i];
+		m_Used.push_back(slot);
+	}
+}
+
+#endif
\ No newline at end of file
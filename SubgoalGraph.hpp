@@ -0,0 +1,854 @@
+#ifndef SUBGOALGRAPH_HPP
+#define SUBGOALGRAPH_HPP
+
+#include <climits>
+#include <cstdlib>
+#include <vector>
+#include <queue>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include "DV1419Map.h"
+
+/// <summary>
+/// Simple Subgoal Graph, with an optional two-level variant.
+/// Subgoals are placed next to the convex corners of obstacles and connected to the subgoals
+/// that are directly h-reachable from them, i.e. that can be reached along a diagonal-first
+/// octile path without passing another subgoal. A query connects the start and goal to the
+/// graph, searches the graph, and refines every edge back into cells.
+/// The two-level variant makes every subgoal that isn't needed for optimal paths between
+/// other subgoals local: it is only used when it is right next to the start or goal.
+/// </summary>
+class SubgoalGraph
+{
+public:
+	/// <summary>
+	/// An edge. Edges added by the two-level pruning pass through a local subgoal, which refinement goes through.
+	/// </summary>
+	struct Edge
+	{
+		int To;
+		int Cost;
+		int Via;
+	};
+
+	/// <summary>
+	/// A subgoal. Local subgoals keep the edges they had when they were pruned.
+	/// </summary>
+	struct Subgoal
+	{
+		int X, Y;
+		bool Global;
+		std::vector<Edge> Edges;
+	};
+
+	SubgoalGraph(DV1419Map* map);
+
+	void Build(bool twoLevel = false);
+	bool Save(const char* filename) const;
+	bool Load(const char* filename);
+	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+
+	bool IsTwoLevel() const { return m_TwoLevel; }
+	int GetSubgoalCount() const { return m_Subgoals.size(); }
+	int GetGlobalCount() const;
+	int GetEdgeCount() const;
+
+	unsigned int m_ExpandedNodes;
+
+private:
+	typedef std::pair<int, int> QueueEntry;
+	typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry> > Queue;
+
+	bool IsWalkable(int x, int y) const;
+	bool CanMove(int x, int y, int dx, int dy) const;
+	bool IsCorner(int x, int y) const;
+	int Clearance(int x, int y, int dx, int dy, int& subgoal) const;
+	void GetDirectHReachable(int x, int y, std::vector<int>& found) const;
+	int Octile(int from, int to) const;
+	void AddEdge(int from, int to, int cost, int via);
+	void RemoveEdge(int from, int to);
+	int FindVia(int from, int to) const;
+	void Prune();
+	void Refine(int from, int to, int via, std::vector<Coordinate>& path) const;
+	bool AppendFreespace(Coordinate from, Coordinate to, std::vector<Coordinate>& path) const;
+
+	std::vector<bool> m_Map;
+	int m_MapWidth;
+	int m_MapHeight;
+	bool m_TwoLevel;
+
+	// Subgoal index of every cell, -1 for cells that aren't subgoals
+	std::vector<int> m_SubgoalId;
+	std::vector<Subgoal> m_Subgoals;
+
+	// Per-node query state, kept between queries so only the touched entries need a reset
+	std::vector<int> m_GoalCost;
+	std::vector<int> m_GoalNext;
+	std::vector<int> m_GoalVia;
+	std::vector<int> m_Distance;
+	std::vector<int> m_Parent;
+	std::vector<int> m_ParentVia;
+	std::vector<bool> m_Closed;
+	std::vector<int> m_Touched;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="SubgoalGraph"/> class. The graph is empty until it is built or loaded.
+/// </summary>
+/// <param name="map">The map.</param>
+SubgoalGraph::SubgoalGraph(DV1419Map* map)
+	: m_ExpandedNodes(0), m_TwoLevel(false)
+{
+	m_MapWidth = map->getWidth();
+	m_MapHeight = map->getHeight();
+	m_Map.resize(m_MapWidth * m_MapHeight);
+	for (int y = 0; y < m_MapHeight; y++)
+		for (int x = 0; x < m_MapWidth; x++)
+			m_Map[y * m_MapWidth + x] = map->isWalkable(x, y);
+
+	m_SubgoalId.assign(m_MapWidth * m_MapHeight, -1);
+}
+
+/// <summary>
+/// Places the subgoals and connects them.
+/// </summary>
+/// <param name="twoLevel">Also prune the subgoals that optimal paths between other subgoals don't need.</param>
+void SubgoalGraph::Build(bool twoLevel)
+{
+	m_Subgoals.clear();
+	std::fill(m_SubgoalId.begin(), m_SubgoalId.end(), -1);
+	m_TwoLevel = false;
+
+	for (int y = 0; y < m_MapHeight; y++)
+	{
+		for (int x = 0; x < m_MapWidth; x++)
+		{
+			if (!IsCorner(x, y))
+				continue;
+
+			Subgoal subgoal;
+			subgoal.X = x;
+			subgoal.Y = y;
+			subgoal.Global = true;
+			m_SubgoalId[y * m_MapWidth + x] = m_Subgoals.size();
+			m_Subgoals.push_back(subgoal);
+		}
+	}
+
+	std::vector<int> found;
+	for (size_t i = 0; i < m_Subgoals.size(); i++)
+	{
+		found.clear();
+		GetDirectHReachable(m_Subgoals[i].X, m_Subgoals[i].Y, found);
+		for (size_t j = 0; j < found.size(); j++)
+		{
+			// Direct h-reachability isn't symmetric, so an edge may be found from either end
+			int cost = Octile(i, found[j]);
+			AddEdge(i, found[j], cost, -1);
+			AddEdge(found[j], i, cost, -1);
+		}
+	}
+
+	if (twoLevel)
+		Prune();
+}
+
+/// <summary>
+/// Writes the graph to a file, so it doesn't have to be built at every startup.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file couldn't be written</returns>
+bool SubgoalGraph::Save(const char* filename) const
+{
+	std::ofstream file(filename);
+	if (!file)
+		return false;
+
+	file << "subgoalgraph 1" << std::endl;
+	file << "width " << m_MapWidth << std::endl;
+	file << "height " << m_MapHeight << std::endl;
+	file << "levels " << (m_TwoLevel ? 2 : 1) << std::endl;
+	file << "subgoals " << m_Subgoals.size() << std::endl;
+	for (size_t i = 0; i < m_Subgoals.size(); i++)
+	{
+		const Subgoal& subgoal = m_Subgoals[i];
+		file << subgoal.X << " " << subgoal.Y << " " << subgoal.Global << " " << subgoal.Edges.size();
+		for (size_t j = 0; j < subgoal.Edges.size(); j++)
+			file << " " << subgoal.Edges[j].To << " " << subgoal.Edges[j].Cost << " " << subgoal.Edges[j].Via;
+		file << std::endl;
+	}
+
+	return file.good();
+}
+
+/// <summary>
+/// Reads a graph written by <see cref="Save"/>.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <returns>False if the file is missing, malformed or was built for a map of another size</returns>
+bool SubgoalGraph::Load(const char* filename)
+{
+	std::ifstream file(filename);
+	std::string id;
+	int version = 0, width = 0, height = 0, levels = 0;
+	size_t count = 0;
+	file >> id >> version;
+	if (!file || id != "subgoalgraph" || version != 1)
+		return false;
+	file >> id >> width >> id >> height >> id >> levels >> id >> count;
+	// There is at most one subgoal per cell
+	if (!file || width != m_MapWidth || height != m_MapHeight || count > (size_t)m_MapWidth * m_MapHeight)
+		return false;
+
+	std::vector<Subgoal> subgoals(count);
+	std::vector<bool> taken(m_MapWidth * m_MapHeight, false);
+	for (size_t i = 0; i < count; i++)
+	{
+		Subgoal& subgoal = subgoals[i];
+		size_t edgeCount = 0;
+		file >> subgoal.X >> subgoal.Y >> subgoal.Global >> edgeCount;
+		if (!file || !IsWalkable(subgoal.X, subgoal.Y) || taken[subgoal.Y * m_MapWidth + subgoal.X] || edgeCount >= count)
+			return false;
+		taken[subgoal.Y * m_MapWidth + subgoal.X] = true;
+
+		subgoal.Edges.resize(edgeCount);
+		for (size_t j = 0; j < edgeCount; j++)
+		{
+			Edge& edge = subgoal.Edges[j];
+			file >> edge.To >> edge.Cost >> edge.Via;
+			if (!file || edge.To < 0 || (size_t)edge.To >= count || edge.To == (int)i || edge.Cost <= 0
+				|| edge.Via < -1 || edge.Via >= (int)count || edge.Via == (int)i || edge.Via == edge.To)
+				return false;
+		}
+	}
+
+	// An edge through a local subgoal is refined through that subgoal's own edges to both ends.
+	// Those have to exist and be shorter, or refining would never end.
+	for (size_t i = 0; i < count; i++)
+	{
+		for (size_t j = 0; j < subgoals[i].Edges.size(); j++)
+		{
+			const Edge& edge = subgoals[i].Edges[j];
+			if (edge.Via < 0)
+				continue;
+			if (subgoals[edge.Via].Global)
+				return false;
+
+			int found = 0;
+			const std::vector<Edge>& viaEdges = subgoals[edge.Via].Edges;
+			for (size_t k = 0; k < viaEdges.size(); k++)
+			{
+				if ((viaEdges[k].To == (int)i || viaEdges[k].To == edge.To) && viaEdges[k].Cost < edge.Cost)
+					found++;
+			}
+			if (found != 2)
+				return false;
+		}
+	}
+
+	m_Subgoals.swap(subgoals);
+	m_TwoLevel = (levels == 2);
+	std::fill(m_SubgoalId.begin(), m_SubgoalId.end(), -1);
+	for (size_t i = 0; i < m_Subgoals.size(); i++)
+		m_SubgoalId[m_Subgoals[i].Y * m_MapWidth + m_Subgoals[i].X] = i;
+
+	return true;
+}
+
+/// <summary>
+/// Finds a path.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>A vector of coordinates that represents the path, empty if there is none</returns>
+std::vector<Coordinate>* SubgoalGraph::Path(Coordinate start, Coordinate goal)
+{
+	std::vector<Coordinate>* path = new std::vector<Coordinate>;
+	m_ExpandedNodes = 0;
+	if (!IsWalkable(start.X, start.Y) || !IsWalkable(goal.X, goal.Y))
+		return path;
+	if (start.X == goal.X && start.Y == goal.Y)
+	{
+		path->push_back(start);
+		return path;
+	}
+
+	// The start and goal join the graph for the duration of the query
+	int subgoalCount = m_Subgoals.size();
+	int startNode = subgoalCount;
+	int goalNode = subgoalCount + 1;
+	int startIndex = start.Y * m_MapWidth + start.X;
+	int goalIndex = goal.Y * m_MapWidth + goal.X;
+	int startSubgoal = m_SubgoalId[startIndex];
+	int goalSubgoal = m_SubgoalId[goalIndex];
+
+	Subgoal endpoint;
+	endpoint.Global = false;
+	endpoint.X = start.X;
+	endpoint.Y = start.Y;
+	m_Subgoals.push_back(endpoint);
+	endpoint.X = goal.X;
+	endpoint.Y = goal.Y;
+	m_Subgoals.push_back(endpoint);
+	if (startSubgoal < 0)
+		m_SubgoalId[startIndex] = startNode;
+	if (goalSubgoal < 0)
+		m_SubgoalId[goalIndex] = goalNode;
+
+	std::vector<int> found;
+	if (startSubgoal < 0)
+	{
+		GetDirectHReachable(start.X, start.Y, found);
+		for (size_t i = 0; i < found.size(); i++)
+		{
+			Edge edge = { found[i], Octile(startNode, found[i]), -1 };
+			m_Subgoals[startNode].Edges.push_back(edge);
+		}
+	}
+	else
+	{
+		Edge edge = { startSubgoal, 0, -1 };
+		m_Subgoals[startNode].Edges.push_back(edge);
+	}
+
+	if (m_Distance.size() != m_Subgoals.size())
+	{
+		m_GoalCost.assign(m_Subgoals.size(), INT_MAX);
+		m_GoalNext.assign(m_Subgoals.size(), -1);
+		m_GoalVia.assign(m_Subgoals.size(), -1);
+		m_Distance.assign(m_Subgoals.size(), INT_MAX);
+		m_Parent.assign(m_Subgoals.size(), -1);
+		m_ParentVia.assign(m_Subgoals.size(), -1);
+		m_Closed.assign(m_Subgoals.size(), false);
+	}
+	std::vector<int>& goalCost = m_GoalCost;
+	std::vector<int>& goalNext = m_GoalNext;
+	std::vector<int>& goalVia = m_GoalVia;
+	std::vector<int>& distance = m_Distance;
+	std::vector<int>& parent = m_Parent;
+	std::vector<int>& parentVia = m_ParentVia;
+	std::vector<bool>& closed = m_Closed;
+
+	// Work out the cost from every node that can see the goal side of the graph to the goal.
+	// Global subgoals have no edges to local ones, so local subgoals next to the goal are
+	// walked through towards the global subgoals they were pruned from.
+	Queue queue;
+	if (goalSubgoal < 0)
+	{
+		found.clear();
+		GetDirectHReachable(goal.X, goal.Y, found);
+		for (size_t i = 0; i < found.size(); i++)
+		{
+			int cost = Octile(goalNode, found[i]);
+			if (cost < goalCost[found[i]])
+			{
+				m_Touched.push_back(found[i]);
+				goalCost[found[i]] = cost;
+				goalNext[found[i]] = goalNode;
+				queue.push(QueueEntry(cost, found[i]));
+			}
+		}
+	}
+	else
+	{
+		m_Touched.push_back(goalSubgoal);
+		goalCost[goalSubgoal] = 0;
+		goalNext[goalSubgoal] = goalNode;
+		queue.push(QueueEntry(0, goalSubgoal));
+	}
+	while (!queue.empty())
+	{
+		QueueEntry entry = queue.top();
+		queue.pop();
+		int node = entry.second;
+		if (entry.first != goalCost[node] || m_Subgoals[node].Global || node >= subgoalCount)
+			continue;
+
+		const std::vector<Edge>& edges = m_Subgoals[node].Edges;
+		for (size_t i = 0; i < edges.size(); i++)
+		{
+			int cost = entry.first + edges[i].Cost;
+			if (cost < goalCost[edges[i].To])
+			{
+				m_Touched.push_back(edges[i].To);
+				goalCost[edges[i].To] = cost;
+				goalNext[edges[i].To] = node;
+				goalVia[edges[i].To] = edges[i].Via;
+				queue.push(QueueEntry(cost, edges[i].To));
+			}
+		}
+	}
+
+	// A* over the graph, with the goal side folded in as one more edge per node. The start can
+	// also reach the goal with a direct edge, then there is no goal side to walk afterwards.
+	bool goalFolded = false;
+	m_Touched.push_back(startNode);
+	distance[startNode] = 0;
+	queue.push(QueueEntry(Octile(startNode, goalNode), startNode));
+	while (!queue.empty())
+	{
+		int node = queue.top().second;
+		queue.pop();
+		if (closed[node])
+			continue;
+		closed[node] = true;
+		m_ExpandedNodes++;
+		if (node == goalNode)
+			break;
+
+		const std::vector<Edge>& edges = m_Subgoals[node].Edges;
+		for (size_t i = 0; i <= edges.size(); i++)
+		{
+			int to, cost, via;
+			if (i < edges.size())
+			{
+				to = edges[i].To;
+				cost = edges[i].Cost;
+				via = edges[i].Via;
+			}
+			else if (goalCost[node] != INT_MAX)
+			{
+				to = goalNode;
+				cost = goalCost[node];
+				via = -1;
+			}
+			else
+				break;
+
+			if (closed[to] || distance[node] + cost >= distance[to])
+				continue;
+			m_Touched.push_back(to);
+			distance[to] = distance[node] + cost;
+			parent[to] = node;
+			parentVia[to] = via;
+			if (to == goalNode)
+				goalFolded = (i == edges.size());
+			queue.push(QueueEntry(distance[to] + Octile(to, goalNode), to));
+		}
+	}
+
+	if (closed[goalNode])
+	{
+		// Collect the hops, first the searched part and then the goal side
+		std::vector<std::pair<int, int> > hops;
+		int last = goalFolded ? parent[goalNode] : goalNode;
+		for (int node = last; node != startNode; node = parent[node])
+			hops.push_back(std::make_pair(node, parentVia[node]));
+		hops.push_back(std::make_pair(startNode, -1));
+		std::reverse(hops.begin(), hops.end());
+		if (goalFolded)
+		{
+			for (int node = last; node != goalNode; node = goalNext[node])
+				hops.push_back(std::make_pair(goalNext[node], goalVia[node]));
+		}
+
+		path->push_back(start);
+		for (size_t i = 1; i < hops.size(); i++)
+			Refine(hops[i - 1].first, hops[i].first, hops[i].second, *path);
+	}
+
+	for (size_t i = 0; i < m_Touched.size(); i++)
+	{
+		int node = m_Touched[i];
+		goalCost[node] = INT_MAX;
+		goalNext[node] = -1;
+		goalVia[node] = -1;
+		distance[node] = INT_MAX;
+		parent[node] = -1;
+		parentVia[node] = -1;
+		closed[node] = false;
+	}
+	m_Touched.clear();
+
+	m_SubgoalId[startIndex] = startSubgoal;
+	m_SubgoalId[goalIndex] = goalSubgoal;
+	m_Subgoals.resize(subgoalCount);
+
+	return path;
+}
+
+/// <summary>
+/// Gets the number of global subgoals.
+/// </summary>
+/// <returns></returns>
+int SubgoalGraph::GetGlobalCount() const
+{
+	int count = 0;
+	for (size_t i = 0; i < m_Subgoals.size(); i++)
+		count += m_Subgoals[i].Global;
+	return count;
+}
+
+/// <summary>
+/// Gets the number of edges between global subgoals, each counted once.
+/// </summary>
+/// <returns></returns>
+int SubgoalGraph::GetEdgeCount() const
+{
+	int count = 0;
+	for (size_t i = 0; i < m_Subgoals.size(); i++)
+		if (m_Subgoals[i].Global)
+			count += m_Subgoals[i].Edges.size();
+	return count / 2;
+}
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable on the map.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool SubgoalGraph::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_MapWidth || y < 0 || y >= m_MapHeight)
+		return false;
+
+	return m_Map[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Determines whether a single move is legal, without cutting corners.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="dx">The x-direction.</param>
+/// <param name="dy">The y-direction.</param>
+/// <returns></returns>
+bool SubgoalGraph::CanMove(int x, int y, int dx, int dy) const
+{
+	if (!IsWalkable(x + dx, y + dy))
+		return false;
+
+	return dx == 0 || dy == 0 || (IsWalkable(x + dx, y) && IsWalkable(x, y + dy));
+}
+
+/// <summary>
+/// Determines whether a cell sits diagonally next to the convex corner of an obstacle, which makes it a subgoal.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+bool SubgoalGraph::IsCorner(int x, int y) const
+{
+	if (!IsWalkable(x, y))
+		return false;
+
+	for (int dy = -1; dy <= 1; dy += 2)
+	{
+		for (int dx = -1; dx <= 1; dx += 2)
+		{
+			if (!IsWalkable(x + dx, y + dy) && IsWalkable(x + dx, y) && IsWalkable(x, y + dy))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/// <summary>
+/// Counts the moves that can be made in one direction before running into an obstacle or a subgoal.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="dx">The x-direction.</param>
+/// <param name="dy">The y-direction.</param>
+/// <param name="subgoal">Receives the subgoal that was run into, or -1.</param>
+/// <returns>The number of moves</returns>
+int SubgoalGraph::Clearance(int x, int y, int dx, int dy, int& subgoal) const
+{
+	int moves = 0;
+	subgoal = -1;
+	while (CanMove(x, y, dx, dy))
+	{
+		x += dx;
+		y += dy;
+		subgoal = m_SubgoalId[y * m_MapWidth + x];
+		if (subgoal >= 0)
+			return moves;
+		moves++;
+	}
+
+	return moves;
+}
+
+/// <summary>
+/// Finds every subgoal that is directly h-reachable from a cell. Each diagonal sector is swept
+/// row by row, and every row stops short of where an earlier row met a subgoal or an obstacle.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="found">The subgoals are added here.</param>
+void SubgoalGraph::GetDirectHReachable(int x, int y, std::vector<int>& found) const
+{
+	int subgoal;
+	for (int direction = 0; direction < 4; direction++)
+	{
+		int dx = (direction == 0) ? 1 : (direction == 1) ? -1 : 0;
+		int dy = (direction == 2) ? 1 : (direction == 3) ? -1 : 0;
+		Clearance(x, y, dx, dy, subgoal);
+		if (subgoal >= 0)
+			found.push_back(subgoal);
+	}
+
+	for (int dy = -1; dy <= 1; dy += 2)
+	{
+		for (int dx = -1; dx <= 1; dx += 2)
+		{
+			int maxX = Clearance(x, y, dx, 0, subgoal);
+			int maxY = Clearance(x, y, 0, dy, subgoal);
+			int diagonal = Clearance(x, y, dx, dy, subgoal);
+			if (subgoal >= 0)
+				found.push_back(subgoal);
+
+			for (int i = 1; i <= diagonal; i++)
+			{
+				int rowX = x + i * dx;
+				int rowY = y + i * dy;
+
+				int moves = Clearance(rowX, rowY, dx, 0, subgoal);
+				if (subgoal >= 0 && moves <= maxX)
+				{
+					found.push_back(subgoal);
+					moves--;
+				}
+				maxX = min(maxX, moves);
+
+				moves = Clearance(rowX, rowY, 0, dy, subgoal);
+				if (subgoal >= 0 && moves <= maxY)
+				{
+					found.push_back(subgoal);
+					moves--;
+				}
+				maxY = min(maxY, moves);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Gets the octile distance between two nodes, scaled by 10 like <see cref="AStar"/>.
+/// </summary>
+/// <param name="from">The first node.</param>
+/// <param name="to">The second node.</param>
+/// <returns></returns>
+int SubgoalGraph::Octile(int from, int to) const
+{
+	int xDist = abs(m_Subgoals[from].X - m_Subgoals[to].X);
+	int yDist = abs(m_Subgoals[from].Y - m_Subgoals[to].Y);
+	return 14 * min(xDist, yDist) + 10 * abs(xDist - yDist);
+}
+
+/// <summary>
+/// Adds an edge, or makes an existing one cheaper.
+/// </summary>
+/// <param name="from">The node the edge starts at.</param>
+/// <param name="to">The node the edge ends at.</param>
+/// <param name="cost">The cost.</param>
+/// <param name="via">The local subgoal the edge passes through, or -1.</param>
+void SubgoalGraph::AddEdge(int from, int to, int cost, int via)
+{
+	std::vector<Edge>& edges = m_Subgoals[from].Edges;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		if (edges[i].To == to)
+		{
+			if (cost < edges[i].Cost)
+			{
+				edges[i].Cost = cost;
+				edges[i].Via = via;
+			}
+			return;
+		}
+	}
+
+	Edge edge = { to, cost, via };
+	edges.push_back(edge);
+}
+
+/// <summary>
+/// Removes an edge.
+/// </summary>
+/// <param name="from">The node the edge starts at.</param>
+/// <param name="to">The node the edge ends at.</param>
+void SubgoalGraph::RemoveEdge(int from, int to)
+{
+	std::vector<Edge>& edges = m_Subgoals[from].Edges;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		if (edges[i].To == to)
+		{
+			edges.erase(edges.begin() + i);
+			return;
+		}
+	}
+}
+
+/// <summary>
+/// Looks up which local subgoal the edge between two nodes passes through.
+/// </summary>
+/// <param name="from">The node the edge starts at.</param>
+/// <param name="to">The node the edge ends at.</param>
+/// <returns>The local subgoal, or -1 for a direct edge</returns>
+int SubgoalGraph::FindVia(int from, int to) const
+{
+	const std::vector<Edge>& edges = m_Subgoals[from].Edges;
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		if (edges[i].To == to)
+			return edges[i].Via;
+	}
+
+	return -1;
+}
+
+/// <summary>
+/// Turns subgoals into local subgoals where that doesn't change any distance between the
+/// remaining global subgoals. For every pair of neighbours, either a path around the subgoal is
+/// as short, or the pair is h-reachable through it and gets an edge of its own.
+/// </summary>
+void SubgoalGraph::Prune()
+{
+	int count = m_Subgoals.size();
+	std::vector<int> distance(count, INT_MAX);
+	std::vector<int> touched;
+	std::vector<Edge> pending;
+
+	for (int subgoal = 0; subgoal < count; subgoal++)
+	{
+		const std::vector<Edge> neighbours = m_Subgoals[subgoal].Edges;
+		int farthest = 0;
+		for (size_t i = 0; i < neighbours.size(); i++)
+			farthest = max(farthest, neighbours[i].Cost);
+
+		pending.clear();
+		bool needed = false;
+		for (size_t p = 0; p < neighbours.size() && !needed; p++)
+		{
+			// Dijkstra around the subgoal, just far enough to judge every pair starting at p
+			int bound = neighbours[p].Cost + farthest;
+			Queue queue;
+			distance[neighbours[p].To] = 0;
+			touched.push_back(neighbours[p].To);
+			queue.push(QueueEntry(0, neighbours[p].To));
+			while (!queue.empty())
+			{
+				QueueEntry entry = queue.top();
+				queue.pop();
+				if (entry.first != distance[entry.second])
+					continue;
+
+				const std::vector<Edge>& edges = m_Subgoals[entry.second].Edges;
+				for (size_t i = 0; i < edges.size(); i++)
+				{
+					int cost = entry.first + edges[i].Cost;
+					if (edges[i].To == subgoal || cost > bound || cost >= distance[edges[i].To])
+						continue;
+					if (distance[edges[i].To] == INT_MAX)
+						touched.push_back(edges[i].To);
+					distance[edges[i].To] = cost;
+					queue.push(QueueEntry(cost, edges[i].To));
+				}
+			}
+
+			for (size_t q = p + 1; q < neighbours.size(); q++)
+			{
+				int through = neighbours[p].Cost + neighbours[q].Cost;
+				if (distance[neighbours[q].To] <= through)
+					continue;
+
+				if (Octile(neighbours[p].To, neighbours[q].To) == through)
+				{
+					Edge edge = { neighbours[q].To, through, neighbours[p].To };
+					pending.push_back(edge);
+				}
+				else
+				{
+					needed = true;
+					break;
+				}
+			}
+
+			for (size_t i = 0; i < touched.size(); i++)
+				distance[touched[i]] = INT_MAX;
+			touched.clear();
+		}
+
+		if (needed)
+			continue;
+
+		// The subgoal keeps its edges for queries that start or end next to it
+		m_Subgoals[subgoal].Global = false;
+		for (size_t i = 0; i < neighbours.size(); i++)
+			RemoveEdge(neighbours[i].To, subgoal);
+		for (size_t i = 0; i < pending.size(); i++)
+		{
+			// Via holds the other end here, the edge itself passes through the pruned subgoal
+			AddEdge(pending[i].Via, pending[i].To, pending[i].Cost, subgoal);
+			AddEdge(pending[i].To, pending[i].Via, pending[i].Cost, subgoal);
+		}
+	}
+
+	m_TwoLevel = true;
+}
+
+/// <summary>
+/// Turns an edge into cells, going through the local subgoals it was built from.
+/// </summary>
+/// <param name="from">The node the edge starts at.</param>
+/// <param name="to">The node the edge ends at.</param>
+/// <param name="via">The local subgoal the edge passes through, or -1.</param>
+/// <param name="path">The cells after the start of the edge are added here.</param>
+void SubgoalGraph::Refine(int from, int to, int via, std::vector<Coordinate>& path) const
+{
+	if (via >= 0)
+	{
+		Refine(from, via, FindVia(via, from), path);
+		Refine(via, to, FindVia(via, to), path);
+		return;
+	}
+
+	Coordinate a = Coordinate(m_Subgoals[from].X, m_Subgoals[from].Y);
+	Coordinate b = Coordinate(m_Subgoals[to].X, m_Subgoals[to].Y);
+	if (AppendFreespace(a, b, path))
+		return;
+
+	// The edge was found from the other end, so its diagonal-first path runs the other way
+	std::vector<Coordinate> reverse;
+	reverse.push_back(b);
+	AppendFreespace(b, a, reverse);
+	for (int i = (int)reverse.size() - 2; i >= 0; i--)
+		path.push_back(reverse[i]);
+}
+
+/// <summary>
+/// Appends the diagonal-first octile path between two cells, if it is free.
+/// </summary>
+/// <param name="from">The first cell, which isn't added.</param>
+/// <param name="to">The last cell.</param>
+/// <param name="path">The path to add to.</param>
+/// <returns>False, leaving the path as it was, if the diagonal-first path is blocked</returns>
+bool SubgoalGraph::AppendFreespace(Coordinate from, Coordinate to, std::vector<Coordinate>& path) const
+{
+	size_t size = path.size();
+	int dx = (to.X > from.X) ? 1 : (to.X < from.X) ? -1 : 0;
+	int dy = (to.Y > from.Y) ? 1 : (to.Y < from.Y) ? -1 : 0;
+	Coordinate current = from;
+	while (current.X != to.X || current.Y != to.Y)
+	{
+		int stepX = (current.X != to.X) ? dx : 0;
+		int stepY = (current.Y != to.Y) ? dy : 0;
+		if (!CanMove(current.X, current.Y, stepX, stepY))
+		{
+			path.resize(size);
+			return false;
+		}
+		current = Coordinate(current.X + stepX, current.Y + stepY);
+		path.push_back(current);
+	}
+
+	return true;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,423 @@
+#ifndef THETASTAR_HPP
+#define THETASTAR_HPP
+
+#include <cmath>
+#include <set>
+#include <limits>
+#include "DV1419Map.h"
+#include "LineOfSight.hpp"
+
+/// <summary>
+/// Any-angle pathfinder. Instead of a cell path it returns a short list of waypoints
+/// where every consecutive pair is connected by a straight line of sight, which can be
+/// expanded back into a cell path that is valid on the grid.
+/// </summary>
+class ThetaStar
+{
+public:
+	struct Node;
+
+	/// <summary>
+	/// Which flavour of Theta* to run.
+	/// Basic checks line of sight for every generated node, Lazy defers the check
+	/// until the node is expanded, which needs far fewer checks.
+	/// </summary>
+	enum Variant
+	{
+		Basic,
+		Lazy
+	};
+
+	/// <summary>
+	/// Comparison function for priority queue
+	/// </summary>
+	struct LowestFCost
+	{
+		bool operator()(const Node* l, const Node* r) const
+		{
+			return l->F < r->F;
+		}
+	};
+
+	/// <summary>
+	/// An internal node structure.
+	/// </summary>
+	struct Node
+	{
+		Node() : X(0), Y(0), G(0), H(0), F(0), Open(false), Closed(false), Parent(nullptr) { }
+
+		int X, Y;
+		double G, H, F;
+
+		bool Open;
+		bool Closed;
+
+		Node* Parent;
+
+		std::multiset<Node*, LowestFCost>::iterator Iterator;
+	};
+
+	ThetaStar(DV1419Map* map) : m_LineOfSight(map), m_Variant(Lazy) { Initialize(); }
+	ThetaStar(DV1419Map* map, Variant variant) : m_LineOfSight(map), m_Variant(variant) { Initialize(); }
+	void Initialize();
+	~ThetaStar();
+
+	std::vector<Coordinate>* Path(Coordinate start, Coordinate goal);
+	std::vector<Coordinate>* ExpandPath(const std::vector<Coordinate>& waypoints) const;
+	std::vector<Coordinate>* SmoothPath(const std::vector<Coordinate>& path) const;
+	static double GetWaypointLength(const std::vector<Coordinate>& waypoints);
+
+	unsigned int m_ExpandedNodes;
+	unsigned int m_LineOfSightChecks;
+
+private:
+	void Prepare(Coordinate start, Coordinate goal);
+	void SetVertex(Node* node);
+	void UpdateVertex(Node* node, Node* neighbour);
+	bool IsVisible(Node* from, Node* to);
+	bool IsLegalMove(int x, int y, int dx, int dy) const;
+	Node* GetNode(int x, int y);
+	std::vector<Coordinate>* ReconstructPath(Node* finalNode);
+	static double Distance(const Node* from, const Node* to);
+
+	LineOfSight m_LineOfSight;
+	Variant m_Variant;
+	int m_MapWidth;
+	int m_MapHeight;
+
+	Node* m_Nodes;
+	std::multiset<Node*, LowestFCost> m_OpenList;
+	Node* m_StartNode;
+	Node* m_GoalNode;
+};
+
+/// <summary>
+/// Initializes this instance.
+/// </summary>
+void ThetaStar::Initialize()
+{
+	m_MapWidth = m_LineOfSight.GetWidth();
+	m_MapHeight = m_LineOfSight.GetHeight();
+	m_ExpandedNodes = 0;
+	m_LineOfSightChecks = 0;
+
+	// Create a pool of nodes
+	m_Nodes = new Node[m_MapWidth * m_MapHeight];
+	for (int x = 0; x < m_MapWidth; x++)
+	{
+		for (int y = 0; y < m_MapHeight; y++)
+		{
+			m_Nodes[y * m_MapWidth + x].X = x;
+			m_Nodes[y * m_MapWidth + x].Y = y;
+		}
+	}
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="ThetaStar"/> class.
+/// </summary>
+ThetaStar::~ThetaStar()
+{
+	delete[] m_Nodes;
+}
+
+/// <summary>
+/// Finds an any-angle path.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+/// <returns>A vector of waypoints, empty if there is no path</returns>
+std::vector<Coordinate>* ThetaStar::Path(Coordinate start, Coordinate goal)
+{
+	if (!m_LineOfSight.IsWalkable(start.X, start.Y) || !m_LineOfSight.IsWalkable(goal.X, goal.Y))
+		return new std::vector<Coordinate>;
+
+	Prepare(start, goal);
+
+	while (!m_OpenList.empty())
+	{
+		// Look for the lowest F cost node in the open list
+		auto it = m_OpenList.begin();
+		Node* current = *it;
+		m_OpenList.erase(it);
+		current->Open = false;
+
+		// Lazy Theta* assumed line of sight to the parent when the node was generated,
+		// now is the time to check that assumption
+		if (m_Variant == Lazy)
+			SetVertex(current);
+
+		if (current == m_GoalNode)
+			return ReconstructPath(current);
+
+		current->Closed = true;
+		m_ExpandedNodes++;
+
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int x = -1; x <= 1; x++)
+			{
+				if (x == 0 && y == 0)
+					continue;
+				if (!IsLegalMove(current->X, current->Y, x, y))
+					continue;
+
+				Node* neighbour = GetNode(current->X + x, current->Y + y);
+				if (neighbour->Closed)
+					continue;
+
+				if (!neighbour->Open)
+				{
+					neighbour->G = std::numeric_limits<double>::infinity();
+					neighbour->H = Distance(neighbour, m_GoalNode);
+					neighbour->Parent = nullptr;
+				}
+
+				UpdateVertex(current, neighbour);
+			}
+		}
+	}
+
+	return new std::vector<Coordinate>;
+}
+
+/// <summary>
+/// Expands a list of waypoints into the cell path that the line of sight test validated.
+/// </summary>
+/// <param name="waypoints">The waypoints.</param>
+/// <returns>A vector of coordinates that can be measured with <see cref="DV1419Map::getPathLength"/></returns>
+std::vector<Coordinate>* ThetaStar::ExpandPath(const std::vector<Coordinate>& waypoints) const
+{
+	std::vector<Coordinate>* cells = new std::vector<Coordinate>;
+	if (waypoints.empty())
+		return cells;
+
+	cells->push_back(waypoints.front());
+	for (size_t i = 1; i < waypoints.size(); i++)
+		m_LineOfSight.Trace(waypoints[i - 1], waypoints[i], *cells);
+
+	return cells;
+}
+
+/// <summary>
+/// Post-smooths a cell path by greedily skipping every waypoint that is in line of sight,
+/// for comparison with the any-angle search.
+/// </summary>
+/// <param name="path">The cell path.</param>
+/// <returns>A vector of waypoints</returns>
+std::vector<Coordinate>* ThetaStar::SmoothPath(const std::vector<Coordinate>& path) const
+{
+	std::vector<Coordinate>* waypoints = new std::vector<Coordinate>;
+	if (path.empty())
+		return waypoints;
+
+	size_t anchor = 0;
+	waypoints->push_back(path[anchor]);
+	while (anchor < path.size() - 1)
+	{
+		// Walk forward for as long as the next cell is still visible from the anchor
+		size_t next = anchor + 1;
+		while (next + 1 < path.size() && m_LineOfSight.IsVisible(path[anchor], path[next + 1]))
+			next++;
+
+		waypoints->push_back(path[next]);
+		anchor = next;
+	}
+
+	return waypoints;
+}
+
+/// <summary>
+/// Gets the euclidean length of a list of waypoints.
+/// </summary>
+/// <param name="waypoints">The waypoints.</param>
+/// <returns></returns>
+double ThetaStar::GetWaypointLength(const std::vector<Coordinate>& waypoints)
+{
+	double length = 0;
+	for (size_t i = 1; i < waypoints.size(); i++)
+	{
+		double dx = waypoints[i].X - waypoints[i - 1].X;
+		double dy = waypoints[i].Y - waypoints[i - 1].Y;
+		length += sqrt(dx * dx + dy * dy);
+	}
+
+	return length;
+}
+
+/// <summary>
+/// Prepares the pathfinder.
+/// </summary>
+/// <param name="start">The start coordinate.</param>
+/// <param name="goal">The goal coordinate.</param>
+void ThetaStar::Prepare(Coordinate start, Coordinate goal)
+{
+	m_ExpandedNodes = 0;
+	m_LineOfSightChecks = 0;
+
+	// Reset the pooled nodes
+	for (int i = 0; i < m_MapWidth * m_MapHeight; i++)
+	{
+		m_Nodes[i].G = 0;
+		m_Nodes[i].H = 0;
+		m_Nodes[i].F = 0;
+		m_Nodes[i].Open = false;
+		m_Nodes[i].Closed = false;
+		m_Nodes[i].Parent = nullptr;
+	}
+	// Reset the open list
+	m_OpenList.clear();
+
+	// The start node is its own parent, so every node always has one to look back at
+	m_StartNode = GetNode(start.X, start.Y);
+	m_GoalNode = GetNode(goal.X, goal.Y);
+	m_StartNode->H = Distance(m_StartNode, m_GoalNode);
+	m_StartNode->F = m_StartNode->H;
+	m_StartNode->Parent = m_StartNode;
+	m_StartNode->Open = true;
+	m_StartNode->Iterator = m_OpenList.insert(m_StartNode);
+}
+
+/// <summary>
+/// Verifies the parent of a node that is about to be expanded, and falls back to the
+/// best expanded grid neighbour if the parent turns out not to be visible.
+/// </summary>
+/// <param name="node">The node.</param>
+void ThetaStar::SetVertex(Node* node)
+{
+	if (IsVisible(node->Parent, node))
+		return;
+
+	node->G = std::numeric_limits<double>::infinity();
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			if (x == 0 && y == 0)
+				continue;
+			if (!IsLegalMove(node->X, node->Y, x, y))
+				continue;
+
+			Node* neighbour = GetNode(node->X + x, node->Y + y);
+			if (!neighbour->Closed)
+				continue;
+
+			double g = neighbour->G + Distance(neighbour, node);
+			if (g < node->G)
+			{
+				node->G = g;
+				node->Parent = neighbour;
+			}
+		}
+	}
+	node->F = node->G + node->H;
+}
+
+/// <summary>
+/// Tries to improve a neighbour either straight from the parent of the expanded node
+/// or through the expanded node itself.
+/// </summary>
+/// <param name="node">The node being expanded.</param>
+/// <param name="neighbour">The neighbour.</param>
+void ThetaStar::UpdateVertex(Node* node, Node* neighbour)
+{
+	Node* parent = node;
+	// Path 2: skip the expanded node if the grand parent can see the neighbour.
+	// Lazy Theta* just assumes it can and lets SetVertex sort it out later.
+	if (m_Variant == Lazy || IsVisible(node->Parent, neighbour))
+		parent = node->Parent;
+
+	double g = parent->G + Distance(parent, neighbour);
+	if (g < neighbour->G)
+	{
+		if (neighbour->Open)
+			m_OpenList.erase(neighbour->Iterator);
+
+		neighbour->G = g;
+		neighbour->F = g + neighbour->H;
+		neighbour->Parent = parent;
+		neighbour->Open = true;
+		neighbour->Iterator = m_OpenList.insert(neighbour);
+	}
+}
+
+/// <summary>
+/// Checks line of sight between two nodes and counts the check.
+/// </summary>
+/// <param name="from">From.</param>
+/// <param name="to">To.</param>
+/// <returns></returns>
+bool ThetaStar::IsVisible(Node* from, Node* to)
+{
+	m_LineOfSightChecks++;
+	return m_LineOfSight.IsVisible(Coordinate(from->X, from->Y), Coordinate(to->X, to->Y));
+}
+
+/// <summary>
+/// Determines whether a single grid move is legal, using the same corner rules as A*.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <param name="dx">The x-direction.</param>
+/// <param name="dy">The y-direction.</param>
+/// <returns></returns>
+bool ThetaStar::IsLegalMove(int x, int y, int dx, int dy) const
+{
+	if (!m_LineOfSight.IsWalkable(x + dx, y + dy))
+		return false;
+
+	// Don't cut corners
+	if (dx != 0 && dy != 0
+		&& (!m_LineOfSight.IsWalkable(x + dx, y) || !m_LineOfSight.IsWalkable(x, y + dy)))
+		return false;
+
+	return true;
+}
+
+/// <summary>
+/// Gets the node that corresponds to the X and Y coordinates.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>A node</returns>
+ThetaStar::Node* ThetaStar::GetNode(int x, int y)
+{
+	return &m_Nodes[y * m_MapWidth + x];
+}
+
+/// <summary>
+/// Reconstructs the waypoints by following the parents back up.
+/// </summary>
+/// <param name="finalNode">The final node.</param>
+/// <returns>A vector of waypoints</returns>
+std::vector<Coordinate>* ThetaStar::ReconstructPath(Node* finalNode)
+{
+	std::vector<Coordinate>* waypoints = new std::vector<Coordinate>;
+
+	// The start node is its own parent
+	while (finalNode != m_StartNode)
+	{
+		waypoints->push_back(Coordinate(finalNode->X, finalNode->Y));
+		finalNode = finalNode->Parent;
+	}
+	waypoints->push_back(Coordinate(m_StartNode->X, m_StartNode->Y));
+	// Reverse the vector so the start is at the beginning
+	std::reverse(waypoints->begin(), waypoints->end());
+
+	return waypoints;
+}
+
+/// <summary>
+/// Euclidean distance between two nodes.
+/// </summary>
+/// <param name="from">From.</param>
+/// <param name="to">To.</param>
+/// <returns></returns>
+double ThetaStar::Distance(const Node* from, const Node* to)
+{
+	double dx = to->X - from->X;
+	double dy = to->Y - from->Y;
+	return sqrt(dx * dx + dy * dy);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,374 @@
+#ifndef TRACEHEATMAP_HPP
+#define TRACEHEATMAP_HPP
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <algorithm>
+#include "DV1419Map.h"
+#include "SearchTrace.hpp"
+
+/// <summary>
+/// Adds up the events of recorded searches per cell, and draws them over the map as PNG images.
+/// Needs no window, so traces can be looked at on a machine without a display.
+/// </summary>
+class TraceHeatmap
+{
+public:
+	TraceHeatmap(int width, int height);
+
+	void Add(const std::vector<SearchTrace::Event>& events);
+	void Add(const SearchTrace& trace);
+
+	bool WriteExpansions(const DV1419Map* map, const char* filename) const;
+	bool WriteOrder(const DV1419Map* map, const char* filename) const;
+	bool WriteReopens(const DV1419Map* map, const char* filename) const;
+	void PrintStatistics(std::ostream& out, int regionSize, int regionCount) const;
+
+	unsigned int GetQueryCount() const { return m_Queries; }
+
+private:
+	void AddEvent(const SearchTrace::Event& event);
+	void EndQuery();
+	bool Write(const DV1419Map* map, const char* filename, const std::vector<double>& values) const;
+	static bool WritePng(const char* filename, int width, int height, const std::vector<unsigned char>& pixels);
+	static void Ramp(double value, unsigned char* pixel);
+	static unsigned int Crc(const unsigned char* data, size_t length, unsigned int crc);
+
+	int m_Width;
+	int m_Height;
+	// Per cell: the times it was expanded, the times it was given a better path, and the sum
+	// of how far into its search it was expanded, from 0 for the first to 1 for the last expansion
+	std::vector<unsigned int> m_Expansions;
+	std::vector<unsigned int> m_Reopens;
+	std::vector<double> m_OrderSum;
+	std::vector<unsigned int> m_OrderCount;
+
+	unsigned int m_Queries;
+	unsigned long long m_EventCounts[SearchTrace::EventTypeCount];
+	unsigned long long m_TotalTime;
+	unsigned long long m_LongestTime;
+	// The search that is being read, finished when the next one starts
+	std::vector<int> m_QueryExpansions;
+	unsigned long long m_QueryTime;
+};
+
+/// <summary>
+/// Initializes a new instance of the <see cref="TraceHeatmap"/> class.
+/// </summary>
+/// <param name="width">The width of the map.</param>
+/// <param name="height">The height of the map.</param>
+TraceHeatmap::TraceHeatmap(int width, int height)
+	: m_Width(width), m_Height(height), m_Queries(0), m_TotalTime(0), m_LongestTime(0), m_QueryTime(0)
+{
+	m_Expansions.assign(width * height, 0);
+	m_Reopens.assign(width * height, 0);
+	m_OrderSum.assign(width * height, 0);
+	m_OrderCount.assign(width * height, 0);
+	for (int i = 0; i < SearchTrace::EventTypeCount; i++)
+		m_EventCounts[i] = 0;
+}
+
+/// <summary>
+/// Adds the events of a trace file, see <see cref="SearchTrace::Load"/>.
+/// </summary>
+/// <param name="events">The events, oldest first.</param>
+void TraceHeatmap::Add(const std::vector<SearchTrace::Event>& events)
+{
+	for (size_t i = 0; i < events.size(); i++)
+		AddEvent(events[i]);
+	EndQuery();
+}
+
+/// <summary>
+/// Adds the events still in the buffer of a trace.
+/// </summary>
+/// <param name="trace">The trace.</param>
+void TraceHeatmap::Add(const SearchTrace& trace)
+{
+	for (size_t i = 0; i < trace.GetCount(); i++)
+		AddEvent(trace.GetEvent(i));
+	EndQuery();
+}
+
+/// <summary>
+/// Counts one event.
+/// </summary>
+/// <param name="event">The event.</param>
+void TraceHeatmap::AddEvent(const SearchTrace::Event& event)
+{
+	SearchTrace::EventType type = event.GetType();
+	if (type == SearchTrace::QueryStart)
+		EndQuery();
+	if (type >= SearchTrace::EventTypeCount || event.X >= m_Width || event.Y >= m_Height)
+		return;
+
+	m_EventCounts[type]++;
+	m_QueryTime = max(m_QueryTime, event.GetTime());
+	int cell = event.Y * m_Width + event.X;
+	if (type == SearchTrace::Expand)
+	{
+		m_Expansions[cell]++;
+		m_QueryExpansions.push_back(cell);
+	}
+	else if (type == SearchTrace::Improve || type == SearchTrace::Reopen)
+	{
+		m_Reopens[cell]++;
+	}
+}
+
+/// <summary>
+/// Finishes the search being read, now that its number of expansions is known.
+/// </summary>
+void TraceHeatmap::EndQuery()
+{
+	if (m_EventCounts[SearchTrace::QueryStart] == m_Queries)
+		return;
+
+	for (size_t i = 0; i < m_QueryExpansions.size(); i++)
+	{
+		m_OrderSum[m_QueryExpansions[i]] += (m_QueryExpansions.size() > 1) ? (double)i / (m_QueryExpansions.size() - 1) : 0;
+		m_OrderCount[m_QueryExpansions[i]]++;
+	}
+	m_Queries++;
+	m_TotalTime += m_QueryTime;
+	m_LongestTime = max(m_LongestTime, m_QueryTime);
+	m_QueryExpansions.clear();
+	m_QueryTime = 0;
+}
+
+/// <summary>
+/// Draws how often each cell was expanded, on a log scale.
+/// </summary>
+/// <param name="map">The map the searches ran on.</param>
+/// <param name="filename">The filename of the PNG.</param>
+/// <returns>Whether the image was written</returns>
+bool TraceHeatmap::WriteExpansions(const DV1419Map* map, const char* filename) const
+{
+	unsigned int most = 0;
+	for (size_t i = 0; i < m_Expansions.size(); i++)
+		most = max(most, m_Expansions[i]);
+
+	std::vector<double> values(m_Expansions.size(), -1);
+	for (size_t i = 0; i < m_Expansions.size(); i++)
+		if (m_Expansions[i] > 0)
+			values[i] = log(1.0 + m_Expansions[i]) / log(1.0 + most);
+	return Write(map, filename, values);
+}
+
+/// <summary>
+/// Draws when cells get expanded on average, early in their searches cold and late hot.
+/// </summary>
+/// <param name="map">The map the searches ran on.</param>
+/// <param name="filename">The filename of the PNG.</param>
+/// <returns>Whether the image was written</returns>
+bool TraceHeatmap::WriteOrder(const DV1419Map* map, const char* filename) const
+{
+	std::vector<double> values(m_OrderSum.size(), -1);
+	for (size_t i = 0; i < m_OrderSum.size(); i++)
+		if (m_OrderCount[i] > 0)
+			values[i] = m_OrderSum[i] / m_OrderCount[i];
+	return Write(map, filename, values);
+}
+
+/// <summary>
+/// Draws how often each cell was given a better path after it was first generated, on a log scale.
+/// </summary>
+/// <param name="map">The map the searches ran on.</param>
+/// <param name="filename">The filename of the PNG.</param>
+/// <returns>Whether the image was written</returns>
+bool TraceHeatmap::WriteReopens(const DV1419Map* map, const char* filename) const
+{
+	unsigned int most = 0;
+	for (size_t i = 0; i < m_Reopens.size(); i++)
+		most = max(most, m_Reopens[i]);
+
+	std::vector<double> values(m_Reopens.size(), -1);
+	for (size_t i = 0; i < m_Reopens.size(); i++)
+		if (m_Reopens[i] > 0)
+			values[i] = log(1.0 + m_Reopens[i]) / log(1.0 + most);
+	return Write(map, filename, values);
+}
+
+/// <summary>
+/// Prints the totals of every search added, and the squares of the map the searches spent the most expansions in.
+/// </summary>
+/// <param name="out">The stream to print to.</param>
+/// <param name="regionSize">The side of the squares.</param>
+/// <param name="regionCount">The number of squares to list.</param>
+void TraceHeatmap::PrintStatistics(std::ostream& out, int regionSize, int regionCount) const
+{
+	const char* names[SearchTrace::EventTypeCount] = { "Queries", "Goals", "Expanded", "Generated", "Improved", "Reopened" };
+	unsigned int queries = max(m_Queries, 1u);
+	out << "Searches: " << m_Queries << ", mean time " << m_TotalTime / 1000.0 / queries << " us, longest " << m_LongestTime / 1000.0 << " us" << std::endl;
+	out << "Event\t\tTotal\t\tPer search" << std::endl;
+	for (int i = SearchTrace::Expand; i < SearchTrace::EventTypeCount; i++)
+		out << names[i] << "\t" << m_EventCounts[i] << "\t\t" << (double)m_EventCounts[i] / queries << std::endl;
+
+	int regionsX = (m_Width + regionSize - 1) / regionSize;
+	int regionsY = (m_Height + regionSize - 1) / regionSize;
+	std::vector<std::pair<unsigned long long, int> > regions(regionsX * regionsY);
+	std::vector<unsigned long long> reopens(regions.size(), 0);
+	for (size_t i = 0; i < regions.size(); i++)
+		regions[i] = std::make_pair(0ULL, (int)i);
+	for (int y = 0; y < m_Height; y++)
+	{
+		for (int x = 0; x < m_Width; x++)
+		{
+			int region = (y / regionSize) * regionsX + x / regionSize;
+			regions[region].first += m_Expansions[y * m_Width + x];
+			reopens[region] += m_Reopens[y * m_Width + x];
+		}
+	}
+	std::sort(regions.begin(), regions.end(), std::greater<std::pair<unsigned long long, int> >());
+
+	unsigned long long total = max(m_EventCounts[SearchTrace::Expand], 1ULL);
+	out << "Most expanded " << regionSize << "x" << regionSize << " squares" << std::endl;
+	out << "X\tY\tExpanded\tShare\tImproved" << std::endl;
+	for (int i = 0; i < regionCount && i < (int)regions.size() && regions[i].first > 0; i++)
+	{
+		int region = regions[i].second;
+		out << (region % regionsX) * regionSize << "\t" << (region / regionsX) * regionSize << "\t" << regions[i].first << "\t\t"
+			<< 100.0 * regions[i].first / total << "%\t" << reopens[region] << std::endl;
+	}
+}
+
+/// <summary>
+/// Draws a value per cell over the map. Blocked cells are black, cells without a value grey.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="filename">The filename of the PNG.</param>
+/// <param name="values">The value of every cell from 0 to 1, negative for none.</param>
+/// <returns>Whether the image was written</returns>
+bool TraceHeatmap::Write(const DV1419Map* map, const char* filename, const std::vector<double>& values) const
+{
+	std::vector<unsigned char> pixels(m_Width * m_Height * 3);
+	for (int y = 0; y < m_Height; y++)
+	{
+		for (int x = 0; x < m_Width; x++)
+		{
+			unsigned char* pixel = &pixels[(y * m_Width + x) * 3];
+			double value = values[y * m_Width + x];
+			if (value >= 0)
+				Ramp(value, pixel);
+			else
+				pixel[0] = pixel[1] = pixel[2] = map->isWalkable(x, y) ? 96 : 0;
+		}
+	}
+
+	return WritePng(filename, m_Width, m_Height, pixels);
+}
+
+/// <summary>
+/// Writes an 8-bit RGB PNG. The image data is stored without compression,
+/// which every reader supports and needs no zlib.
+/// </summary>
+/// <param name="filename">The filename.</param>
+/// <param name="width">The width of the image.</param>
+/// <param name="height">The height of the image.</param>
+/// <param name="pixels">Three bytes per pixel, row by row.</param>
+/// <returns>Whether the file was written</returns>
+bool TraceHeatmap::WritePng(const char* filename, int width, int height, const std::vector<unsigned char>& pixels)
+{
+	// Every row starts with its filter type, none
+	std::vector<unsigned char> raw;
+	raw.reserve((width * 3 + 1) * height);
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		raw.insert(raw.end(), pixels.begin() + y * width * 3, pixels.begin() + (y + 1) * width * 3);
+	}
+
+	// A zlib stream of stored deflate blocks, at most 65535 bytes each
+	std::vector<unsigned char> data;
+	data.push_back(0x78);
+	data.push_back(0x01);
+	size_t offset = 0;
+	do
+	{
+		size_t length = min(raw.size() - offset, (size_t)65535);
+		data.push_back((offset + length == raw.size()) ? 1 : 0);
+		data.push_back(length & 0xFF);
+		data.push_back((length >> 8) & 0xFF);
+		data.push_back(~length & 0xFF);
+		data.push_back((~length >> 8) & 0xFF);
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+		offset += length;
+	} while (offset < raw.size());
+	unsigned int a = 1, b = 0;
+	for (size_t i = 0; i < raw.size(); i++)
+	{
+		a = (a + raw[i]) % 65521;
+		b = (b + a) % 65521;
+	}
+	unsigned int adler = (b << 16) | a;
+	for (int shift = 24; shift >= 0; shift -= 8)
+		data.push_back((adler >> shift) & 0xFF);
+
+	unsigned char header[13] = { 0, 0, 0, 0, 0, 0, 0, 0, 8, 2, 0, 0, 0 };
+	for (int i = 0; i < 4; i++)
+	{
+		header[i] = (width >> (24 - 8 * i)) & 0xFF;
+		header[4 + i] = (height >> (24 - 8 * i)) & 0xFF;
+	}
+
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	bool written = fwrite(signature, 1, 8, file) == 8;
+	const char* types[3] = { "IHDR", "IDAT", "IEND" };
+	const unsigned char* contents[3] = { header, data.empty() ? nullptr : &data[0], nullptr };
+	size_t lengths[3] = { sizeof(header), data.size(), 0 };
+	for (int chunk = 0; chunk < 3; chunk++)
+	{
+		// Length, type, contents, and a CRC of the type and contents
+		unsigned char length[4] = { (unsigned char)(lengths[chunk] >> 24), (unsigned char)(lengths[chunk] >> 16), (unsigned char)(lengths[chunk] >> 8), (unsigned char)lengths[chunk] };
+		unsigned int crc = Crc((const unsigned char*)types[chunk], 4, 0xFFFFFFFFu);
+		crc = Crc(contents[chunk], lengths[chunk], crc) ^ 0xFFFFFFFFu;
+		unsigned char check[4] = { (unsigned char)(crc >> 24), (unsigned char)(crc >> 16), (unsigned char)(crc >> 8), (unsigned char)crc };
+		written = written && fwrite(length, 1, 4, file) == 4 && fwrite(types[chunk], 1, 4, file) == 4
+			&& fwrite(contents[chunk], 1, lengths[chunk], file) == lengths[chunk] && fwrite(check, 1, 4, file) == 4;
+	}
+
+	return (fclose(file) == 0) && written;
+}
+
+/// <summary>
+/// Colours a value from blue for 0 through green and yellow to red for 1.
+/// </summary>
+/// <param name="value">The value.</param>
+/// <param name="pixel">The red, green and blue bytes to set.</param>
+void TraceHeatmap::Ramp(double value, unsigned char* pixel)
+{
+	const double stops[4][3] = { { 40, 60, 255 }, { 40, 220, 80 }, { 255, 230, 40 }, { 255, 30, 30 } };
+	double position = min(max(value, 0.0), 1.0) * 3;
+	int stop = min((int)position, 2);
+	double t = position - stop;
+	for (int i = 0; i < 3; i++)
+		pixel[i] = (unsigned char)(stops[stop][i] + (stops[stop + 1][i] - stops[stop][i]) * t);
+}
+
+/// <summary>
+/// Continues a CRC-32 as PNG uses it, bit by bit since images are only written once.
+/// </summary>
+/// <param name="data">The data.</param>
+/// <param name="length">The length of the data.</param>
+/// <param name="crc">The CRC so far.</param>
+/// <returns></returns>
+unsigned int TraceHeatmap::Crc(const unsigned char* data, size_t length, unsigned int crc)
+{
+	for (size_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+	}
+
+	return crc;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,590 @@
+#ifndef VERSIONEDMAP_HPP
+#define VERSIONEDMAP_HPP
+
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <climits>
+#include "DV1419Map.h"
+
+/// <summary>
+/// One published version of a <see cref="VersionedMap"/>. Never changes once published, so any
+/// number of threads can read it without locking. Besides the cells it holds the data derived from
+/// them: the legal moves out of every cell and which cells are connected to each other.
+/// </summary>
+class MapSnapshot
+{
+public:
+	static const int TileBits = 6;
+	static const int TileSize = 1 << TileBits;
+
+	/// <summary>
+	/// Offsets of the eight moves, indexed by the bits of <see cref="GetSuccessors"/>.
+	/// </summary>
+	static const int DirectionX[8];
+	static const int DirectionY[8];
+
+	unsigned int GetVersion() const { return m_Version; }
+	int GetWidth() const { return m_Width; }
+	int GetHeight() const { return m_Height; }
+	bool IsWalkable(int x, int y) const;
+	unsigned char GetSuccessors(int x, int y) const;
+	bool AreConnected(int x1, int y1, int x2, int y2) const;
+
+private:
+	friend class VersionedMap;
+
+	/// <summary>
+	/// A square of cells with its derived data. Snapshots share the tiles that didn't change between them.
+	/// </summary>
+	struct Tile
+	{
+		unsigned char Cells[TileSize * TileSize];
+		// A bit per legal move, in the order of DirectionX
+		unsigned char Successors[TileSize * TileSize];
+		// Connected parts of the tile on its own, NoComponent for blocked cells
+		unsigned short Components[TileSize * TileSize];
+		int ComponentCount;
+		// The number of snapshots holding this tile, only touched by writers
+		int References;
+	};
+
+	static const unsigned short NoComponent = 0xFFFF;
+
+	MapSnapshot() : m_Width(0), m_Height(0), m_TilesX(0), m_TilesY(0), m_Version(0), m_RetiredAt(0) { }
+	int GetComponent(int x, int y) const;
+
+	int m_Width;
+	int m_Height;
+	int m_TilesX;
+	int m_TilesY;
+	unsigned int m_Version;
+	std::vector<Tile*> m_Tiles;
+	// The first global component of each tile, and the representative of every global component
+	std::vector<int> m_ComponentBase;
+	std::vector<int> m_Roots;
+	// The epoch this snapshot was replaced in
+	unsigned long long m_RetiredAt;
+};
+
+const int MapSnapshot::DirectionX[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int MapSnapshot::DirectionY[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+
+/// <summary>
+/// A map that can be edited while other threads search it, read-copy-update style. Readers pin the
+/// current <see cref="MapSnapshot"/> for a query without taking any lock. Writers hand in a batch of
+/// cell edits, which becomes a new snapshot that copies only the tiles the edits touched, and is
+/// published with one atomic store. Replaced snapshots are freed once every reader that could still
+/// see them has moved on, tracked with epochs: a reader notes the epoch when it pins, and a
+/// snapshot retired in an epoch is only freed when every pinned reader noted a later one.
+/// </summary>
+class VersionedMap
+{
+public:
+	static const int MaxReaders = 64;
+
+	/// <summary>
+	/// A change to one cell.
+	/// </summary>
+	struct CellEdit
+	{
+		int X, Y;
+		bool Walkable;
+	};
+
+	/// <summary>
+	/// Keeps a snapshot alive for as long as it exists. Meant to live for one query on one thread.
+	/// </summary>
+	class Pin
+	{
+	public:
+		Pin(VersionedMap& map, int reader);
+		~Pin();
+		const MapSnapshot* Get() const { return m_Snapshot; }
+		const MapSnapshot* operator->() const { return m_Snapshot; }
+
+	private:
+		Pin(const Pin&);
+		Pin& operator=(const Pin&);
+
+		VersionedMap& m_Map;
+		int m_Reader;
+		const MapSnapshot* m_Snapshot;
+	};
+
+	VersionedMap(const DV1419Map* map);
+	~VersionedMap();
+
+	int RegisterReader();
+	void UnregisterReader(int reader);
+	unsigned int Publish(const std::vector<CellEdit>& edits);
+
+	unsigned int GetVersion() const { return m_Version.load(); }
+	size_t GetRetiredCount();
+	unsigned long long GetTilesCopied() const { return m_TilesCopied; }
+	unsigned long long GetSnapshotsFreed() const { return m_SnapshotsFreed; }
+
+private:
+	/// <summary>
+	/// What one reader has pinned, on its own cache line.
+	/// </summary>
+	struct ReaderSlot
+	{
+		// The epoch the reader pinned in, zero when it isn't reading
+		std::atomic<unsigned long long> Epoch;
+		std::atomic<bool> InUse;
+		char Padding[64 - sizeof(std::atomic<unsigned long long>) - sizeof(std::atomic<bool>)];
+	};
+
+	static void UpdateSuccessors(MapSnapshot* snapshot, int x, int y);
+	static void LabelTile(MapSnapshot* snapshot, int tile);
+	static void ConnectTiles(MapSnapshot* snapshot);
+	static int Find(std::vector<int>& parents, int component);
+	void Reclaim();
+	void Free(MapSnapshot* snapshot);
+
+	std::atomic<MapSnapshot*> m_Current;
+	// The version of m_Current, kept apart so it can be read without pinning the snapshot
+	std::atomic<unsigned int> m_Version;
+	std::atomic<unsigned long long> m_Epoch;
+	ReaderSlot m_Readers[MaxReaders];
+
+	// Writers take turns, and only they touch the retired list and the tile references
+	std::mutex m_WriteLock;
+	std::vector<MapSnapshot*> m_Retired;
+	unsigned long long m_TilesCopied;
+	unsigned long long m_SnapshotsFreed;
+
+	VersionedMap(const VersionedMap&);
+	VersionedMap& operator=(const VersionedMap&);
+};
+
+/// <summary>
+/// Determines whether the specified coordinate is walkable in this version.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns></returns>
+inline bool MapSnapshot::IsWalkable(int x, int y) const
+{
+	if (x < 0 || x >= m_Width || y < 0 || y >= m_Height)
+		return false;
+
+	const Tile* tile = m_Tiles[(y >> TileBits) * m_TilesX + (x >> TileBits)];
+	return tile->Cells[((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1))] != 0;
+}
+
+/// <summary>
+/// Gets the legal moves out of a cell, corner cutting already ruled out.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>A bit per move, in the order of <see cref="DirectionX"/></returns>
+inline unsigned char MapSnapshot::GetSuccessors(int x, int y) const
+{
+	if (x < 0 || x >= m_Width || y < 0 || y >= m_Height)
+		return 0;
+
+	const Tile* tile = m_Tiles[(y >> TileBits) * m_TilesX + (x >> TileBits)];
+	return tile->Successors[((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1))];
+}
+
+/// <summary>
+/// Determines whether there is any path between two cells in this version.
+/// </summary>
+/// <returns></returns>
+bool MapSnapshot::AreConnected(int x1, int y1, int x2, int y2) const
+{
+	int first = GetComponent(x1, y1);
+	int second = GetComponent(x2, y2);
+	return first >= 0 && first == second;
+}
+
+/// <summary>
+/// Gets the representative global component of a cell.
+/// </summary>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+/// <returns>The component, -1 for blocked cells</returns>
+int MapSnapshot::GetComponent(int x, int y) const
+{
+	if (!IsWalkable(x, y))
+		return -1;
+
+	int tile = (y >> TileBits) * m_TilesX + (x >> TileBits);
+	int local = m_Tiles[tile]->Components[((y & (TileSize - 1)) << TileBits) | (x & (TileSize - 1))];
+	return m_Roots[m_ComponentBase[tile] + local];
+}
+
+/// <summary>
+/// Initializes a new instance of the <see cref="VersionedMap"/> class with the map as version 1.
+/// </summary>
+/// <param name="map">The map.</param>
+VersionedMap::VersionedMap(const DV1419Map* map)
+	: m_TilesCopied(0), m_SnapshotsFreed(0)
+{
+	MapSnapshot* snapshot = new MapSnapshot();
+	snapshot->m_Width = map->getWidth();
+	snapshot->m_Height = map->getHeight();
+	snapshot->m_TilesX = (snapshot->m_Width + MapSnapshot::TileSize - 1) / MapSnapshot::TileSize;
+	snapshot->m_TilesY = (snapshot->m_Height + MapSnapshot::TileSize - 1) / MapSnapshot::TileSize;
+	snapshot->m_Version = 1;
+	snapshot->m_Tiles.resize(snapshot->m_TilesX * snapshot->m_TilesY);
+	for (size_t tile = 0; tile < snapshot->m_Tiles.size(); tile++)
+	{
+		MapSnapshot::Tile* cells = new MapSnapshot::Tile();
+		cells->References = 1;
+		int left = (int)(tile % snapshot->m_TilesX) * MapSnapshot::TileSize;
+		int top = (int)(tile / snapshot->m_TilesX) * MapSnapshot::TileSize;
+		for (int y = 0; y < MapSnapshot::TileSize; y++)
+			for (int x = 0; x < MapSnapshot::TileSize; x++)
+				cells->Cells[(y << MapSnapshot::TileBits) | x] = map->isWalkable(left + x, top + y) ? 1 : 0;
+		snapshot->m_Tiles[tile] = cells;
+	}
+
+	for (int y = 0; y < snapshot->m_Height; y++)
+		for (int x = 0; x < snapshot->m_Width; x++)
+			UpdateSuccessors(snapshot, x, y);
+	for (size_t tile = 0; tile < snapshot->m_Tiles.size(); tile++)
+		LabelTile(snapshot, (int)tile);
+	ConnectTiles(snapshot);
+
+	m_Current.store(snapshot);
+	m_Version.store(snapshot->m_Version);
+	m_Epoch.store(1);
+	for (int i = 0; i < MaxReaders; i++)
+	{
+		m_Readers[i].Epoch.store(0);
+		m_Readers[i].InUse.store(false);
+	}
+}
+
+/// <summary>
+/// Finalizes an instance of the <see cref="VersionedMap"/> class. No reader may be pinned any more.
+/// </summary>
+VersionedMap::~VersionedMap()
+{
+	for (size_t i = 0; i < m_Retired.size(); i++)
+		Free(m_Retired[i]);
+	Free(m_Current.load());
+}
+
+/// <summary>
+/// Claims a reader slot for a thread that is going to pin snapshots.
+/// </summary>
+/// <returns>The slot, or -1 if all <see cref="MaxReaders"/> are taken</returns>
+int VersionedMap::RegisterReader()
+{
+	for (int i = 0; i < MaxReaders; i++)
+	{
+		bool expected = false;
+		if (m_Readers[i].InUse.compare_exchange_strong(expected, true))
+			return i;
+	}
+
+	return -1;
+}
+
+/// <summary>
+/// Gives a reader slot back.
+/// </summary>
+/// <param name="reader">The slot.</param>
+void VersionedMap::UnregisterReader(int reader)
+{
+	m_Readers[reader].Epoch.store(0);
+	m_Readers[reader].InUse.store(false);
+}
+
+/// <summary>
+/// Applies a batch of edits as a new version, and frees whatever old versions nobody can see any more.
+/// Safe to call from several threads, the batches are applied one after the other.
+/// </summary>
+/// <param name="edits">The edits.</param>
+/// <returns>The new version</returns>
+unsigned int VersionedMap::Publish(const std::vector<CellEdit>& edits)
+{
+	std::lock_guard<std::mutex> lock(m_WriteLock);
+	MapSnapshot* old = m_Current.load();
+	MapSnapshot* snapshot = new MapSnapshot(*old);
+	snapshot->m_Version = old->m_Version + 1;
+
+	// An edit changes the moves of every cell around it, so copy each tile within one cell of an edit
+	std::vector<bool> copied(snapshot->m_Tiles.size(), false);
+	for (size_t i = 0; i < edits.size(); i++)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				int x = edits[i].X + dx;
+				int y = edits[i].Y + dy;
+				if (x < 0 || x >= snapshot->m_Width || y < 0 || y >= snapshot->m_Height)
+					continue;
+				int tile = (y >> MapSnapshot::TileBits) * snapshot->m_TilesX + (x >> MapSnapshot::TileBits);
+				if (copied[tile])
+					continue;
+				snapshot->m_Tiles[tile] = new MapSnapshot::Tile(*snapshot->m_Tiles[tile]);
+				snapshot->m_Tiles[tile]->References = 0;
+				copied[tile] = true;
+				m_TilesCopied++;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < edits.size(); i++)
+	{
+		int x = edits[i].X;
+		int y = edits[i].Y;
+		if (x < 0 || x >= snapshot->m_Width || y < 0 || y >= snapshot->m_Height)
+			continue;
+		MapSnapshot::Tile* tile = snapshot->m_Tiles[(y >> MapSnapshot::TileBits) * snapshot->m_TilesX + (x >> MapSnapshot::TileBits)];
+		tile->Cells[((y & (MapSnapshot::TileSize - 1)) << MapSnapshot::TileBits) | (x & (MapSnapshot::TileSize - 1))] = edits[i].Walkable ? 1 : 0;
+	}
+	for (size_t i = 0; i < edits.size(); i++)
+		for (int dy = -1; dy <= 1; dy++)
+			for (int dx = -1; dx <= 1; dx++)
+				UpdateSuccessors(snapshot, edits[i].X + dx, edits[i].Y + dy);
+
+	// Only the copied tiles need new local components, joining them up is cheap enough to redo
+	for (size_t tile = 0; tile < copied.size(); tile++)
+		if (copied[tile])
+			LabelTile(snapshot, (int)tile);
+	ConnectTiles(snapshot);
+
+	for (size_t tile = 0; tile < snapshot->m_Tiles.size(); tile++)
+		snapshot->m_Tiles[tile]->References++;
+
+	// Publish, then retire the old version in the epoch it was replaced in
+	m_Current.store(snapshot);
+	m_Version.store(snapshot->m_Version);
+	old->m_RetiredAt = m_Epoch.load();
+	m_Retired.push_back(old);
+	m_Epoch.fetch_add(1);
+	Reclaim();
+
+	return snapshot->m_Version;
+}
+
+/// <summary>
+/// Gets the number of replaced versions that are still kept for readers.
+/// </summary>
+/// <returns></returns>
+size_t VersionedMap::GetRetiredCount()
+{
+	std::lock_guard<std::mutex> lock(m_WriteLock);
+	return m_Retired.size();
+}
+
+/// <summary>
+/// Recomputes the legal moves out of a cell.
+/// </summary>
+/// <param name="snapshot">The snapshot, the cell's tile must be its own copy.</param>
+/// <param name="x">The x-coordinate.</param>
+/// <param name="y">The y-coordinate.</param>
+void VersionedMap::UpdateSuccessors(MapSnapshot* snapshot, int x, int y)
+{
+	if (x < 0 || x >= snapshot->m_Width || y < 0 || y >= snapshot->m_Height)
+		return;
+
+	unsigned char successors = 0;
+	if (snapshot->IsWalkable(x, y))
+	{
+		for (int direction = 0; direction < 8; direction++)
+		{
+			int dx = MapSnapshot::DirectionX[direction];
+			int dy = MapSnapshot::DirectionY[direction];
+			if (!snapshot->IsWalkable(x + dx, y + dy))
+				continue;
+			// Don't cut corners
+			if (dx != 0 && dy != 0 && (!snapshot->IsWalkable(x + dx, y) || !snapshot->IsWalkable(x, y + dy)))
+				continue;
+			successors |= 1 << direction;
+		}
+	}
+
+	MapSnapshot::Tile* tile = snapshot->m_Tiles[(y >> MapSnapshot::TileBits) * snapshot->m_TilesX + (x >> MapSnapshot::TileBits)];
+	tile->Successors[((y & (MapSnapshot::TileSize - 1)) << MapSnapshot::TileBits) | (x & (MapSnapshot::TileSize - 1))] = successors;
+}
+
+/// <summary>
+/// Labels the parts of a tile that are connected by moves within the tile.
+/// </summary>
+/// <param name="snapshot">The snapshot, the tile must be its own copy.</param>
+/// <param name="tile">The tile.</param>
+void VersionedMap::LabelTile(MapSnapshot* snapshot, int tile)
+{
+	MapSnapshot::Tile* cells = snapshot->m_Tiles[tile];
+	for (int i = 0; i < MapSnapshot::TileSize * MapSnapshot::TileSize; i++)
+		cells->Components[i] = MapSnapshot::NoComponent;
+	cells->ComponentCount = 0;
+
+	std::vector<int> stack;
+	for (int start = 0; start < MapSnapshot::TileSize * MapSnapshot::TileSize; start++)
+	{
+		if (!cells->Cells[start] || cells->Components[start] != MapSnapshot::NoComponent)
+			continue;
+
+		unsigned short component = (unsigned short)cells->ComponentCount++;
+		cells->Components[start] = component;
+		stack.push_back(start);
+		while (!stack.empty())
+		{
+			int cell = stack.back();
+			stack.pop_back();
+			int x = cell & (MapSnapshot::TileSize - 1);
+			int y = cell >> MapSnapshot::TileBits;
+			for (int direction = 0; direction < 8; direction++)
+			{
+				if (!(cells->Successors[cell] & (1 << direction)))
+					continue;
+				int nextX = x + MapSnapshot::DirectionX[direction];
+				int nextY = y + MapSnapshot::DirectionY[direction];
+				if (nextX < 0 || nextX >= MapSnapshot::TileSize || nextY < 0 || nextY >= MapSnapshot::TileSize)
+					continue;
+				int next = (nextY << MapSnapshot::TileBits) | nextX;
+				if (cells->Components[next] != MapSnapshot::NoComponent)
+					continue;
+				cells->Components[next] = component;
+				stack.push_back(next);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Joins the local components of neighbouring tiles that a move crosses between.
+/// Only the cells along the tile edges are visited.
+/// </summary>
+/// <param name="snapshot">The snapshot.</param>
+void VersionedMap::ConnectTiles(MapSnapshot* snapshot)
+{
+	int components = 0;
+	snapshot->m_ComponentBase.resize(snapshot->m_Tiles.size());
+	for (size_t tile = 0; tile < snapshot->m_Tiles.size(); tile++)
+	{
+		snapshot->m_ComponentBase[tile] = components;
+		components += snapshot->m_Tiles[tile]->ComponentCount;
+	}
+	std::vector<int> parents(components);
+	for (int i = 0; i < components; i++)
+		parents[i] = i;
+
+	for (int tileY = 0; tileY < snapshot->m_TilesY; tileY++)
+	{
+		for (int tileX = 0; tileX < snapshot->m_TilesX; tileX++)
+		{
+			int left = tileX * MapSnapshot::TileSize;
+			int top = tileY * MapSnapshot::TileSize;
+			for (int i = 0; i < 4 * MapSnapshot::TileSize; i++)
+			{
+				// Walk the four edges of the tile
+				int side = i / MapSnapshot::TileSize;
+				int offset = i % MapSnapshot::TileSize;
+				int x = left + ((side == 0) ? offset : (side == 1) ? MapSnapshot::TileSize - 1 : (side == 2) ? offset : 0);
+				int y = top + ((side == 0) ? 0 : (side == 1) ? offset : (side == 2) ? MapSnapshot::TileSize - 1 : offset);
+				unsigned char successors = snapshot->GetSuccessors(x, y);
+				for (int direction = 0; direction < 8; direction++)
+				{
+					if (!(successors & (1 << direction)))
+						continue;
+					int nextX = x + MapSnapshot::DirectionX[direction];
+					int nextY = y + MapSnapshot::DirectionY[direction];
+					if ((nextX >> MapSnapshot::TileBits) == tileX && (nextY >> MapSnapshot::TileBits) == tileY)
+						continue;
+
+					int tile = tileY * snapshot->m_TilesX + tileX;
+					int nextTile = (nextY >> MapSnapshot::TileBits) * snapshot->m_TilesX + (nextX >> MapSnapshot::TileBits);
+					int from = snapshot->m_ComponentBase[tile] + snapshot->m_Tiles[tile]->Components[((y & (MapSnapshot::TileSize - 1)) << MapSnapshot::TileBits) | (x & (MapSnapshot::TileSize - 1))];
+					int to = snapshot->m_ComponentBase[nextTile] + snapshot->m_Tiles[nextTile]->Components[((nextY & (MapSnapshot::TileSize - 1)) << MapSnapshot::TileBits) | (nextX & (MapSnapshot::TileSize - 1))];
+					parents[Find(parents, from)] = Find(parents, to);
+				}
+			}
+		}
+	}
+
+	snapshot->m_Roots.resize(components);
+	for (int i = 0; i < components; i++)
+		snapshot->m_Roots[i] = Find(parents, i);
+}
+
+/// <summary>
+/// Finds the representative of a component, halving the path on the way.
+/// </summary>
+/// <param name="parents">The parent of every component.</param>
+/// <param name="component">The component.</param>
+/// <returns></returns>
+int VersionedMap::Find(std::vector<int>& parents, int component)
+{
+	while (parents[component] != component)
+	{
+		parents[component] = parents[parents[component]];
+		component = parents[component];
+	}
+
+	return component;
+}
+
+/// <summary>
+/// Frees the retired snapshots that no pinned reader can still be using.
+/// </summary>
+void VersionedMap::Reclaim()
+{
+	unsigned long long oldestPin = ULLONG_MAX;
+	for (int i = 0; i < MaxReaders; i++)
+	{
+		unsigned long long epoch = m_Readers[i].Epoch.load();
+		if (epoch != 0 && epoch < oldestPin)
+			oldestPin = epoch;
+	}
+
+	// A reader that pinned after a snapshot was retired can only have seen the newer one
+	for (size_t i = 0; i < m_Retired.size(); )
+	{
+		if (m_Retired[i]->m_RetiredAt < oldestPin)
+		{
+			Free(m_Retired[i]);
+			m_SnapshotsFreed++;
+			m_Retired[i] = m_Retired.back();
+			m_Retired.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+}
+
+/// <summary>
+/// Frees a snapshot and the tiles no other snapshot holds.
+/// </summary>
+/// <param name="snapshot">The snapshot.</param>
+void VersionedMap::Free(MapSnapshot* snapshot)
+{
+	for (size_t tile = 0; tile < snapshot->m_Tiles.size(); tile++)
+		if (--snapshot->m_Tiles[tile]->References == 0)
+			delete snapshot->m_Tiles[tile];
+	delete snapshot;
+}
+
+/// <summary>
+/// Pins the current snapshot.
+/// </summary>
+/// <param name="map">The map.</param>
+/// <param name="reader">The reader slot of this thread, see <see cref="RegisterReader"/>.</param>
+VersionedMap::Pin::Pin(VersionedMap& map, int reader)
+	: m_Map(map), m_Reader(reader)
+{
+	// Note the epoch before looking at the snapshot, so a writer can't free it in between
+	m_Map.m_Readers[m_Reader].Epoch.store(m_Map.m_Epoch.load());
+	m_Snapshot = m_Map.m_Current.load();
+}
+
+/// <summary>
+/// Unpins the snapshot.
+/// </summary>
+VersionedMap::Pin::~Pin()
+{
+	m_Map.m_Readers[m_Reader].Epoch.store(0);
+}
+
+#endif
\ No newline at end of file
@@ -2,11 +2,43 @@
 #include "DV1419Map.h"
 #include "ScenarioLoader.h"
 #include "AStar.hpp"
+#include "ThetaStar.hpp"
+#include "SearchScheduler.hpp"
+#include "PathService.hpp"
+#include "FlowField.hpp"
+#include "DistanceMatrix.hpp"
+#include "SubgoalGraph.hpp"
+#include "GoalBounds.hpp"
+#include "FringeSearch.hpp"
+#include "ParallelAStar.hpp"
+#include "GridLayout.hpp"
+#include "PagedMap.hpp"
+#include "MapRegistry.hpp"
+#include "VersionedMap.hpp"
+#include "SearchTrace.hpp"
+#include "TraceHeatmap.hpp"
+#include "CooperativeAStar.hpp"
+#include "RectangleSymmetry.hpp"
+#include "PathBatch.hpp"
+#include "RealTimeSearch.hpp"
+#include "ContractionHierarchy.hpp"
+#include "NeighbourKernel.hpp"
 #include "timer.h"
 #include <SFML/Graphics.hpp>
 #include <SFML/Window/Keyboard.hpp>
 #include <string>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
 
 void graphical(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment)
 {
@@ -166,8 +198,7 @@ void graphical(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int start
 		{
 			for (int y = 0; y < map.getHeight(); y++)
 			{
-				int i = y * map.getWidth() + x;
-				AStar::Node* node = aStar.m_Nodes[i];
+				AStar::Node* node = aStar.GetNode(x, y);
 				if (node != nullptr)
 				{
 					if (node->Open)
@@ -289,8 +320,7 @@ void graphical2(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int star
 		{
 			for (int y = 0; y < map.getHeight(); y++)
 			{
-				int i = y * map.getWidth() + x;
-				AStar::Node* node = aStar.m_Nodes[i];
+				AStar::Node* node = aStar.GetNode(x, y);
 				if (node != nullptr)
 				{
 					if (node->Open)
@@ -434,6 +464,2141 @@ void tests()
 
 }
 
+void anyAngleBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	ThetaStar thetaStar = ThetaStar(&map, ThetaStar::Lazy);
+
+	Timer timer;
+	unsigned int aStarTime = 0, thetaStarTime = 0;
+	unsigned int aStarWaypoints = 0, thetaStarWaypoints = 0;
+	double aStarLength = 0, thetaStarLength = 0;
+	unsigned int lineOfSightChecks = 0;
+	int invalidCount = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+		Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+		// A* followed by a smoothing pass
+		timer.start();
+		std::vector<Coordinate>* cellPath = aStar.Path(start, goal);
+		std::vector<Coordinate>* smoothed = thetaStar.SmoothPath(*cellPath);
+		timer.stamp();
+		unsigned int smoothTime = timer.getTimePassed();
+
+		// Any-angle search
+		timer.start();
+		std::vector<Coordinate>* waypoints = thetaStar.Path(start, goal);
+		timer.stamp();
+		unsigned int anyAngleTime = timer.getTimePassed();
+
+		// The expanded waypoints have to be a valid grid path
+		std::vector<Coordinate>* expanded = thetaStar.ExpandPath(*waypoints);
+		bool invalid = !expanded->empty() && map.getPathLength(*expanded) < 0;
+		if (invalid)
+			invalidCount++;
+
+		double smoothedLength = ThetaStar::GetWaypointLength(*smoothed);
+		double anyAngleLength = ThetaStar::GetWaypointLength(*waypoints);
+
+		std::cout << "#" << i << std::endl;
+		std::cout << "A* + smoothing: " << smoothed->size() << " waypoints, length " << smoothedLength << ", " << smoothTime << " microseconds" << std::endl;
+		std::cout << "Lazy Theta*: " << waypoints->size() << " waypoints, length " << anyAngleLength << ", " << anyAngleTime << " microseconds, " << thetaStar.m_LineOfSightChecks << " line of sight checks" << std::endl;
+		if (invalid)
+			std::cout << "------- INVALID EXPANDED PATH -------" << std::endl;
+
+		aStarTime += smoothTime;
+		thetaStarTime += anyAngleTime;
+		aStarWaypoints += smoothed->size();
+		thetaStarWaypoints += waypoints->size();
+		aStarLength += smoothedLength;
+		thetaStarLength += anyAngleLength;
+		lineOfSightChecks += thetaStar.m_LineOfSightChecks;
+
+		delete cellPath;
+		delete smoothed;
+		delete waypoints;
+		delete expanded;
+	}
+
+	std::cout << std::endl;
+	std::cout << "A* + smoothing: " << aStarWaypoints << " waypoints, total length " << aStarLength << ", total time " << aStarTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Lazy Theta*: " << thetaStarWaypoints << " waypoints, total length " << thetaStarLength << ", total time " << thetaStarTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Line of sight checks: " << lineOfSightChecks << std::endl;
+	std::cout << "Invalid expanded paths: " << invalidCount << std::endl;
+}
+
+void schedulerBenchmark(DV1419Map &map, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	const int contexts = 8;
+	const unsigned int tickBudget = 2000;
+	SearchScheduler scheduler = SearchScheduler(&map, contexts);
+
+	// Every query is requested up front, like a burst of agents asking for paths in the same frame.
+	// Every fourth query is marked as important.
+	std::vector<unsigned int> requestTick(endExperiment + 1, 0);
+	std::vector<unsigned int> latency(endExperiment + 1, 0);
+	int failCount = 0;
+	int delivered = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+		Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+		int priority = (i % 4 == 0) ? 2 : 0;
+		scheduler.Request(start, goal, priority, [&, i, experiment](unsigned int, std::vector<Coordinate>* path)
+		{
+			double pathLength = 0;
+			if (path->size() != 0)
+				pathLength = map.getPathLength(*path);
+			if (abs(pathLength - experiment.GetDistance()) >= 1)
+				failCount++;
+			latency[i] = scheduler.GetCurrentTick();
+			delivered++;
+			delete path;
+		});
+	}
+
+	Timer timer;
+	unsigned int totalTime = 0;
+	unsigned int worstTick = 0;
+	unsigned int ticks = 0;
+	unsigned int overBudget = 0;
+	while (scheduler.GetPendingCount() + scheduler.GetRunningCount() + scheduler.GetUndeliveredCount() > 0)
+	{
+		timer.start();
+		scheduler.Tick(SearchScheduler::Microseconds, tickBudget);
+		timer.stamp();
+		totalTime += timer.getTimePassed();
+		if (timer.getTimePassed() > worstTick)
+			worstTick = timer.getTimePassed();
+		// A tick can only stop between expansions, so it is over when it runs a tenth longer
+		if (timer.getTimePassed() > tickBudget + tickBudget / 10)
+			overBudget++;
+		ticks++;
+	}
+
+	double importantLatency = 0, normalLatency = 0;
+	int importantCount = 0, normalCount = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		if (i % 4 == 0)
+		{
+			importantLatency += latency[i];
+			importantCount++;
+		}
+		else
+		{
+			normalLatency += latency[i];
+			normalCount++;
+		}
+	}
+
+	std::cout << "Queries delivered: " << delivered << " in " << ticks << " ticks of " << tickBudget << " microseconds" << std::endl;
+	std::cout << "Total time: " << totalTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Worst tick: " << worstTick << " microseconds" << std::endl;
+	std::cout << "Ticks over budget by a tenth: " << overBudget << " (" << 100.0 * overBudget / max(ticks, 1u) << "%)" << std::endl;
+	if (importantCount > 0)
+		std::cout << "Average latency (priority 2): " << importantLatency / importantCount << " ticks" << std::endl;
+	if (normalCount > 0)
+		std::cout << "Average latency (priority 0): " << normalLatency / normalCount << " ticks" << std::endl;
+	std::cout << "Failure rate: " << failCount << " / " << delivered << std::endl;
+}
+
+/// <summary>
+/// Replays experiments against the path service as a closed loop: at most a number of clients
+/// each have one request outstanding, and new requests are issued at most at the given rate.
+/// Some requests repeat the pair of the one before, so they can share its search, and some are
+/// cancelled right after they are issued. A cancelled request must have its future completed as
+/// cancelled at once and must never get its callback.
+/// </summary>
+/// <param name="service">The service.</param>
+/// <param name="experiments">The experiments to replay, in order and wrapping around.</param>
+/// <param name="clients">The number of clients.</param>
+/// <param name="rate">Requests per second, or 0 to issue as fast as the clients allow.</param>
+/// <param name="requests">The number of requests to issue.</param>
+/// <param name="duplicateEvery">Every this many requests one repeats the previous pair, 0 for none.</param>
+/// <param name="cancelEvery">Every this many requests one is cancelled, 0 for none.</param>
+/// <param name="latencies">Receives the latency of every request that wasn't cancelled in microseconds.</param>
+/// <param name="cancelled">Receives the number of requests that were cancelled before they completed.</param>
+/// <param name="cancelErrors">Receives the number of those that didn't complete as cancelled or got their callback.</param>
+/// <returns>The achieved throughput in requests per second</returns>
+double replayLoad(PathService &service, const std::vector<Experiment> &experiments, int clients, double rate, int requests,
+	int duplicateEvery, int cancelEvery, std::vector<double> &latencies, int &cancelled, int &cancelErrors)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	std::vector<double> allLatencies(requests, 0);
+	// Written before completed is counted up, so they can be read once it is
+	std::vector<char> calledBack(requests, 0);
+	std::vector<char> wasCancelled(requests, 0);
+	std::atomic<int> outstanding(0);
+	std::atomic<int> completed(0);
+	cancelled = 0;
+	cancelErrors = 0;
+
+	Clock::time_point begin = Clock::now();
+	Clock::time_point nextIssue = begin;
+	size_t nextExperiment = 0;
+	for (int issued = 0; issued < requests; )
+	{
+		Clock::time_point now = Clock::now();
+		if (outstanding >= clients || (rate > 0 && now < nextIssue))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		bool duplicate = duplicateEvery > 0 && issued % duplicateEvery == duplicateEvery - 1 && nextExperiment > 0;
+		if (!duplicate)
+			nextExperiment++;
+		const Experiment &experiment = experiments[(nextExperiment - 1) % experiments.size()];
+		outstanding++;
+		PathService::Ticket ticket = service.Request(
+			Coordinate(experiment.GetStartX(), experiment.GetStartY()),
+			Coordinate(experiment.GetGoalX(), experiment.GetGoalY()),
+			[&, issued, now](const PathService::Result &)
+			{
+				allLatencies[issued] = (double)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - now).count();
+				calledBack[issued] = 1;
+				outstanding--;
+				completed++;
+			});
+
+		// Only counts if the request was still in flight, otherwise it completes as usual
+		if (cancelEvery > 0 && issued % cancelEvery == cancelEvery / 2 && service.Cancel(ticket.Id))
+		{
+			wasCancelled[issued] = 1;
+			cancelled++;
+			outstanding--;
+			if (ticket.Future.wait_for(std::chrono::seconds(0)) != std::future_status::ready || ticket.Future.get().Code != PathService::Cancelled)
+				cancelErrors++;
+		}
+
+		issued++;
+		if (rate > 0)
+			nextIssue += std::chrono::microseconds((long long)(1000000 / rate));
+	}
+	while (completed < requests - cancelled)
+		std::this_thread::yield();
+
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin).count() / 1000000.0;
+	latencies.clear();
+	for (int i = 0; i < requests; i++)
+	{
+		if (!wasCancelled[i])
+			latencies.push_back(allLatencies[i]);
+		else if (calledBack[i])
+			cancelErrors++;
+	}
+	return requests / seconds;
+}
+
+void serviceBenchmark(DV1419Map &map, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	int workers = std::thread::hardware_concurrency();
+	if (workers < 1)
+		workers = 1;
+	PathService service(&map, workers);
+
+	std::vector<Experiment> experiments;
+	for (int i = startExperiment; i <= endExperiment; i++)
+		experiments.push_back(scenario.GetNthExperiment(i));
+
+	// Every fourth request repeats the one before, and every fifth is cancelled while in flight
+	const int requests = 1000;
+	const int duplicateEvery = 4;
+	const int cancelEvery = 5;
+	std::cout << "Workers: " << workers << std::endl;
+	std::cout << "clients\trate\tthroughput\tp50 ms\tp90 ms\tp99 ms\tmax ms\tcoalesced\tcancelled" << std::endl;
+
+	// First find the saturation throughput by adding clients until throughput stops growing,
+	// then look at latency at fractions of that rate
+	double saturation = 0;
+	std::vector<double> latencies;
+	int cancelledTotal = 0;
+	int cancelErrorTotal = 0;
+	std::vector<std::pair<int, double> > levels;
+	for (int clients = 1; clients <= workers * 16; clients *= 2)
+		levels.push_back(std::make_pair(clients, 0.0));
+	for (size_t level = 0; level < levels.size() + 3; level++)
+	{
+		int clients = workers * 16;
+		double rate = 0;
+		if (level < levels.size())
+			clients = levels[level].first;
+		else
+			rate = saturation * (level - levels.size() + 1) / 4;
+
+		unsigned int coalescedBefore = service.GetCoalescedCount();
+		int cancelled, cancelErrors;
+		double throughput = replayLoad(service, experiments, clients, rate, requests, duplicateEvery, cancelEvery, latencies, cancelled, cancelErrors);
+		cancelledTotal += cancelled;
+		cancelErrorTotal += cancelErrors;
+		if (throughput > saturation && rate == 0)
+			saturation = throughput;
+
+		std::sort(latencies.begin(), latencies.end());
+		std::cout << clients << "\t" << (rate > 0 ? rate : 0) << "\t" << throughput << "\t"
+			<< latencies[latencies.size() / 2] / 1000.0 << "\t"
+			<< latencies[latencies.size() * 9 / 10] / 1000.0 << "\t"
+			<< latencies[latencies.size() * 99 / 100] / 1000.0 << "\t"
+			<< latencies.back() / 1000.0 << "\t"
+			<< service.GetCoalescedCount() - coalescedBefore << "\t\t" << cancelled << std::endl;
+	}
+
+	std::cout << std::endl;
+	std::cout << "Saturation throughput: " << saturation << " requests per second" << std::endl;
+	std::cout << "Searches run: " << service.GetSearchCount() << " for " << service.GetRequestCount() << " requests, "
+		<< service.GetCoalescedCount() << " coalesced" << std::endl;
+	std::cout << "Requests cancelled: " << cancelledTotal << ", searches cancelled: " << service.GetCancelledCount() << std::endl;
+	std::cout << "Cancelled requests not completed as cancelled or called back: " << cancelErrorTotal << std::endl;
+}
+
+void flowFieldBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	// Every unit heads for the goal of the first experiment, starting where the experiments start
+	Experiment rally = scenario.GetNthExperiment(startExperiment);
+	Coordinate goal = Coordinate(rally.GetGoalX(), rally.GetGoalY());
+	std::vector<Coordinate> units;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		units.push_back(Coordinate(experiment.GetStartX(), experiment.GetStartY()));
+	}
+	std::cout << "Units: " << units.size() << ", goal: " << goal.toString() << std::endl;
+
+	Timer timer;
+	std::vector<double> aStarLengths;
+	timer.start();
+	for (size_t i = 0; i < units.size(); i++)
+	{
+		std::vector<Coordinate>* path = aStar.Path(units[i], goal);
+		aStarLengths.push_back(path->empty() ? 0 : map.getPathLength(*path));
+		delete path;
+	}
+	timer.stamp();
+	unsigned int aStarTime = timer.getTimePassed();
+
+	FlowField field = FlowField(&map);
+	timer.start();
+	field.Build(goal);
+	timer.stamp();
+	unsigned int buildTime = timer.getTimePassed();
+
+	int failCount = 0;
+	timer.start();
+	for (size_t i = 0; i < units.size(); i++)
+	{
+		std::vector<Coordinate>* path = field.Path(units[i]);
+		double length = path->empty() ? 0 : map.getPathLength(*path);
+		if (abs(length - aStarLengths[i]) >= 1)
+			failCount++;
+		delete path;
+	}
+	timer.stamp();
+	unsigned int readTime = timer.getTimePassed();
+
+	int threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	timer.start();
+	field.BuildParallel(goal, threads);
+	timer.stamp();
+	unsigned int parallelTime = timer.getTimePassed();
+
+	const int radius = 64;
+	timer.start();
+	field.Build(goal, radius);
+	timer.stamp();
+	unsigned int radiusTime = timer.getTimePassed();
+
+	// Drop a wall onto the path of the first unit and take it away again
+	field.Build(goal);
+	std::vector<Coordinate>* path = field.Path(units[0]);
+	unsigned int blockTime = 0, freeTime = 0;
+	if (path->size() > 2)
+	{
+		Coordinate wall = (*path)[path->size() / 2];
+		timer.start();
+		field.SetWalkable(wall.X, wall.Y, false);
+		timer.stamp();
+		blockTime = timer.getTimePassed();
+		timer.start();
+		field.SetWalkable(wall.X, wall.Y, true);
+		timer.stamp();
+		freeTime = timer.getTimePassed();
+	}
+	delete path;
+
+	std::cout << units.size() << " A* queries: " << aStarTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Flow field build: " << buildTime / 1000.0f << " ms, " << units.size() << " path reads: " << readTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Parallel build with " << threads << " threads: " << parallelTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Build with radius " << radius << ": " << radiusTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Refresh after blocking a cell: " << blockTime << " microseconds, after freeing it: " << freeTime << " microseconds" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << units.size() << std::endl;
+}
+
+void multiTargetBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	// The starts of the experiments double as the candidate goals and as the matrix points
+	std::vector<Coordinate> points;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		points.push_back(Coordinate(experiment.GetStartX(), experiment.GetStartY()));
+	}
+
+	// Nearest of K: one multi-goal search per experiment against K separate searches
+	const int goalCount = 8;
+	Timer timer;
+	unsigned int nearestTime = 0, separateTime = 0;
+	int failCount = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+		std::vector<Coordinate> goals;
+		for (int k = 0; k < goalCount; k++)
+		{
+			Experiment other = scenario.GetNthExperiment(startExperiment + (i - startExperiment + k * 7 + 1) % (endExperiment - startExperiment + 1));
+			goals.push_back(Coordinate(other.GetGoalX(), other.GetGoalY()));
+		}
+
+		timer.start();
+		std::vector<Coordinate>* nearest = aStar.PathToNearest(start, goals);
+		timer.stamp();
+		nearestTime += timer.getTimePassed();
+
+		double best = -1;
+		timer.start();
+		for (size_t k = 0; k < goals.size(); k++)
+		{
+			std::vector<Coordinate>* path = aStar.Path(start, goals[k]);
+			if (!path->empty())
+			{
+				double length = map.getPathLength(*path);
+				if (best < 0 || length < best)
+					best = length;
+			}
+			delete path;
+		}
+		timer.stamp();
+		separateTime += timer.getTimePassed();
+
+		double length = nearest->empty() ? -1 : map.getPathLength(*nearest);
+		if (abs(length - best) >= 1)
+			failCount++;
+		delete nearest;
+	}
+
+	// Many to many: every point to every point
+	int threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+	DistanceMatrix matrix = DistanceMatrix(&map);
+	timer.start();
+	matrix.Compute(points, points, 1);
+	timer.stamp();
+	unsigned int matrixTime = timer.getTimePassed();
+	timer.start();
+	matrix.Compute(points, points, threads);
+	timer.stamp();
+	unsigned int parallelTime = timer.getTimePassed();
+
+	int matrixFailCount = 0;
+	timer.start();
+	for (size_t s = 0; s < points.size(); s++)
+	{
+		for (size_t t = 0; t < points.size(); t++)
+		{
+			std::vector<Coordinate>* path = aStar.Path(points[s], points[t]);
+			double length = path->empty() ? DistanceMatrix::NoPath : map.getPathLength(*path);
+			if (abs(length - matrix.GetDistance(s, t)) >= 1)
+				matrixFailCount++;
+			delete path;
+		}
+	}
+	timer.stamp();
+	unsigned int pairTime = timer.getTimePassed();
+
+	std::cout << "Nearest of " << goalCount << " goals, " << points.size() << " queries" << std::endl;
+	std::cout << "Multi-goal A*: " << nearestTime / 1000.0f << " ms, separate A*: " << separateTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << points.size() << std::endl;
+	std::cout << std::endl;
+	std::cout << points.size() << "x" << points.size() << " distance matrix" << std::endl;
+	std::cout << "Matrix: " << matrixTime / 1000.0f << " ms, with " << threads << " threads: " << parallelTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Pairwise A*: " << pairTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Length mismatches: " << matrixFailCount << " / " << points.size() * points.size() << std::endl;
+}
+
+void boundedBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	struct Setting
+	{
+		AStar::SearchMode Mode;
+		const char* Name;
+		double Epsilon;
+	};
+	const Setting settings[] = {
+		{ AStar::Optimal, "A*", 0 },
+		{ AStar::Weighted, "Weighted", 0.1 }, { AStar::Weighted, "Weighted", 0.5 }, { AStar::Weighted, "Weighted", 1.0 },
+		{ AStar::Focal, "Focal", 0.1 }, { AStar::Focal, "Focal", 0.5 }, { AStar::Focal, "Focal", 1.0 },
+		{ AStar::Optimistic, "Optimistic", 0.1 }, { AStar::Optimistic, "Optimistic", 0.5 }, { AStar::Optimistic, "Optimistic", 1.0 }
+	};
+	const int settingCount = sizeof(settings) / sizeof(settings[0]);
+
+	int lastBucket = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+		lastBucket = max(lastBucket, scenario.GetNthExperiment(i).GetBucket());
+
+	std::cout << "Bucket\tMode\t\tEpsilon\tQueries\tExpanded\tTime (ms)\tMean ratio\tMax ratio" << std::endl;
+	Timer timer;
+	int violations = 0;
+	for (int bucket = 0; bucket <= lastBucket; bucket++)
+	{
+		for (int s = 0; s < settingCount; s++)
+		{
+			aStar.SetSearchMode(settings[s].Mode, settings[s].Epsilon);
+
+			int queries = 0;
+			unsigned long long expanded = 0, time = 0;
+			double ratioSum = 0, maxRatio = 0;
+			for (int i = startExperiment; i <= endExperiment; i++)
+			{
+				Experiment experiment = scenario.GetNthExperiment(i);
+				if (experiment.GetBucket() != bucket || experiment.GetDistance() <= 0)
+					continue;
+
+				timer.start();
+				std::vector<Coordinate>* path = aStar.Path(
+					Coordinate(experiment.GetStartX(), experiment.GetStartY()),
+					Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+				timer.stamp();
+
+				if (!path->empty())
+				{
+					// Costs are 10/14 rather than 1/sqrt(2), so leave a little room on the bound
+					double ratio = map.getPathLength(*path) / experiment.GetDistance();
+					if (ratio > (1 + settings[s].Epsilon) * 1.01)
+						violations++;
+					ratioSum += ratio;
+					maxRatio = max(maxRatio, ratio);
+					expanded += aStar.m_ExpandedNodes;
+					time += timer.getTimePassed();
+					queries++;
+				}
+				delete path;
+			}
+
+			if (queries == 0)
+				continue;
+			std::cout << bucket << "\t" << settings[s].Name << (settings[s].Name[1] == '*' ? "\t\t" : "\t")
+				<< settings[s].Epsilon << "\t" << queries << "\t"
+				<< expanded / queries << "\t\t"
+				<< time / (double)queries / 1000.0 << "\t\t"
+				<< ratioSum / queries << "\t\t" << maxRatio << std::endl;
+		}
+	}
+	aStar.SetSearchMode(AStar::Optimal);
+
+	std::cout << "Paths outside the bound: " << violations << std::endl;
+}
+
+void anytimeBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	const double epsilon = 2.0;
+	const double fractions[] = { 0.1, 0.25, 0.5, 1.0, 2.0 };
+	const int fractionCount = sizeof(fractions) / sizeof(fractions[0]);
+
+	std::vector<Experiment> experiments;
+	std::vector<double> aStarTimes;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		if (experiment.GetDistance() > 0)
+			experiments.push_back(experiment);
+	}
+
+	// Plain A* for the time an optimal path takes
+	Timer timer;
+	aStar.SetSearchMode(AStar::Optimal);
+	for (size_t i = 0; i < experiments.size(); i++)
+	{
+		timer.start();
+		delete aStar.Path(Coordinate(experiments[i].GetStartX(), experiments[i].GetStartY()), Coordinate(experiments[i].GetGoalX(), experiments[i].GetGoalY()));
+		timer.stamp();
+		aStarTimes.push_back(max(timer.getTimePassed(), 1u));
+	}
+
+	// Every round of the anytime search with no deadline, timed from the call
+	aStar.SetSearchMode(AStar::Anytime, epsilon);
+	double firstTime = 0, firstRatio = 0, firstBound = 0, finalTime = 0, rounds = 0, aStarTotal = 0;
+	int violations = 0, mismatches = 0;
+	for (size_t i = 0; i < experiments.size(); i++)
+	{
+		const Experiment& experiment = experiments[i];
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		int round = 0;
+		auto onSolution = [&](const std::vector<Coordinate>& path, double bound)
+		{
+			double ratio = map.getPathLength(path) / experiment.GetDistance();
+			if (ratio > bound * 1.01)
+				violations++;
+			if (round++ == 0)
+			{
+				firstTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+				firstRatio += ratio;
+				firstBound += bound;
+			}
+		};
+		std::vector<Coordinate>* path = aStar.PathAnytime(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()),
+			std::chrono::steady_clock::time_point::max(), onSolution);
+		finalTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count();
+		rounds += round;
+		aStarTotal += aStarTimes[i];
+		if (path->empty() || abs(map.getPathLength(*path) - experiment.GetDistance()) >= 1)
+			mismatches++;
+		delete path;
+	}
+
+	double queries = (double)max((int)experiments.size(), 1);
+	std::cout << "Queries: " << experiments.size() << ", epsilon " << epsilon << " lowered by 0.25 per round" << std::endl;
+	std::cout << "A*: " << aStarTotal / queries / 1000.0 << " ms per query" << std::endl;
+	std::cout << "First path: " << firstTime / queries / 1000.0 << " ms, " << firstRatio / queries << " times optimal, proven within " << firstBound / queries << std::endl;
+	std::cout << "Optimal path: " << finalTime / queries / 1000.0 << " ms after " << rounds / queries << " rounds, " << finalTime / max(aStarTotal, 1.0) << " times A*" << std::endl;
+	std::cout << "Final paths that aren't optimal: " << mismatches << std::endl;
+
+	// Deadlines as a fraction of the time A* takes on each query
+	std::cout << std::endl << "Deadline\tFound\tMean ratio\tMean bound" << std::endl;
+	for (int f = 0; f < fractionCount; f++)
+	{
+		int found = 0;
+		double ratioSum = 0, boundSum = 0;
+		for (size_t i = 0; i < experiments.size(); i++)
+		{
+			const Experiment& experiment = experiments[i];
+			double bound = 0;
+			auto onSolution = [&](const std::vector<Coordinate>&, double pathBound) { bound = pathBound; };
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(aStarTimes[i] * fractions[f]));
+			std::vector<Coordinate>* path = aStar.PathAnytime(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()),
+				deadline, onSolution);
+			if (!path->empty())
+			{
+				double ratio = map.getPathLength(*path) / experiment.GetDistance();
+				if (ratio > bound * 1.01)
+					violations++;
+				found++;
+				ratioSum += ratio;
+				boundSum += bound;
+			}
+			delete path;
+		}
+
+		std::cout << fractions[f] << "x A*\t" << 100.0 * found / queries << "%\t"
+			<< ratioSum / max(found, 1) << "\t\t" << boundSum / max(found, 1) << std::endl;
+	}
+	aStar.SetSearchMode(AStar::Optimal);
+
+	std::cout << "Paths outside their bound: " << violations << std::endl;
+}
+
+void realTimeBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	// A spread of queries over every bucket, repeated so the agents can learn
+	const int sampleCount = 40;
+	const int trials = 10;
+	const int lookaheads[] = { 1, 16, 64, 256 };
+	const int lookaheadCount = sizeof(lookaheads) / sizeof(lookaheads[0]);
+	std::vector<Experiment> experiments;
+	int range = endExperiment - startExperiment + 1;
+	for (int i = 0; i < min(sampleCount, range); i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(startExperiment + (int)((long long)i * range / min(sampleCount, range)));
+		if (experiment.GetDistance() > 0)
+			experiments.push_back(experiment);
+	}
+
+	// A* has to finish its whole search before the first move
+	Timer timer;
+	unsigned int aStarTime = 0, mostAStarTime = 0;
+	unsigned long long aStarExpanded = 0;
+	for (size_t i = 0; i < experiments.size(); i++)
+	{
+		timer.start();
+		delete aStar.Path(Coordinate(experiments[i].GetStartX(), experiments[i].GetStartY()), Coordinate(experiments[i].GetGoalX(), experiments[i].GetGoalY()));
+		timer.stamp();
+		aStarTime += timer.getTimePassed();
+		mostAStarTime = max(mostAStarTime, timer.getTimePassed());
+		aStarExpanded += aStar.m_ExpandedNodes;
+	}
+	std::cout << "Queries: " << experiments.size() << ", A* before the first move: " << aStarTime / 1000.0 / max((int)experiments.size(), 1) << " ms on average, "
+		<< mostAStarTime / 1000.0 << " ms at most, " << aStarExpanded / max((int)experiments.size(), 1) << " expansions" << std::endl;
+
+	std::cout << "Lookahead\tTrial\tMean ratio\tMoves\tExpanded/move\tMost/move\tus/move\tp99 us\tMost us\tConverged" << std::endl;
+	for (int l = 0; l < lookaheadCount; l++)
+	{
+		RealTimeSearch agent(&map, lookaheads[l]);
+		std::vector<std::vector<Coordinate> > previous(experiments.size());
+		for (int trial = 1; trial <= trials; trial++)
+		{
+			double ratioSum = 0, moveTime = 0;
+			std::vector<float> moveTimes;
+			unsigned long long moves = 0, expanded = 0;
+			unsigned int mostExpanded = 0;
+			int converged = 0, failed = 0;
+			for (size_t i = 0; i < experiments.size(); i++)
+			{
+				const Experiment& experiment = experiments[i];
+				std::vector<Coordinate> trajectory(1, Coordinate(experiment.GetStartX(), experiment.GetStartY()));
+				agent.Begin(trajectory[0], Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+
+				// Time every move on its own, the worst one is what an agent has to budget for
+				RealTimeSearch::Status status = RealTimeSearch::Moving;
+				while (status == RealTimeSearch::Moving && trajectory.size() < 1000000)
+				{
+					Coordinate next;
+					std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+					status = agent.Move(next);
+					double time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count() / 1000.0;
+					moveTime += time;
+					moveTimes.push_back((float)time);
+					if (status != RealTimeSearch::NoPath)
+						trajectory.push_back(next);
+				}
+				if (status != RealTimeSearch::Arrived)
+					failed++;
+
+				ratioSum += map.getPathLength(trajectory) / experiment.GetDistance();
+				moves += trajectory.size() - 1;
+				expanded += agent.m_ExpandedNodes;
+				mostExpanded = max(mostExpanded, agent.m_MostExpandedPerMove);
+				if (trajectory.size() == previous[i].size() && std::equal(trajectory.begin(), trajectory.end(), previous[i].begin(),
+					[](const Coordinate& a, const Coordinate& b) { return a.X == b.X && a.Y == b.Y; }))
+					converged++;
+				previous[i].swap(trajectory);
+			}
+
+			if (trial == 1 || trial == 2 || trial == 5 || trial == trials)
+			{
+				std::sort(moveTimes.begin(), moveTimes.end());
+				std::cout << lookaheads[l] << "\t\t" << trial << "\t" << ratioSum / experiments.size() << "\t\t" << moves << "\t"
+					<< (double)expanded / max(moves, 1ULL) << "\t\t" << mostExpanded << "\t\t" << moveTime / max(moves, 1ULL) << "\t"
+					<< moveTimes[moveTimes.size() * 99 / 100] << "\t" << moveTimes.back() << "\t\t" << converged << " / " << experiments.size() << std::endl;
+			}
+			if (failed > 0)
+				std::cout << "------- " << failed << " AGENTS DIDN'T ARRIVE -------" << std::endl;
+		}
+		std::cout << "Learned heuristic values: " << agent.GetLearnedCount() << std::endl;
+	}
+}
+
+void subgoalBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, std::string mapFile, int startExperiment, int endExperiment)
+{
+	Timer timer;
+	unsigned int aStarTime = 0;
+	unsigned long long aStarExpanded = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		timer.start();
+		std::vector<Coordinate>* path = aStar.Path(
+			Coordinate(experiment.GetStartX(), experiment.GetStartY()),
+			Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+		timer.stamp();
+		aStarTime += timer.getTimePassed();
+		aStarExpanded += aStar.m_ExpandedNodes;
+		delete path;
+	}
+	int queries = endExperiment - startExperiment + 1;
+	std::cout << "A*: " << aStarTime / 1000.0f << " ms, " << aStarExpanded / queries << " expansions per query" << std::endl;
+
+	for (int levels = 1; levels <= 2; levels++)
+	{
+		SubgoalGraph graph = SubgoalGraph(&map);
+		timer.start();
+		graph.Build(levels == 2);
+		timer.stamp();
+		unsigned int buildTime = timer.getTimePassed();
+
+		// Save and load it again, the way it would be used at startup
+		std::ostringstream graphFile;
+		graphFile << mapFile << ((levels == 2) ? ".tsg" : ".ssg");
+		graph.Save(graphFile.str().c_str());
+		SubgoalGraph loaded = SubgoalGraph(&map);
+		timer.start();
+		bool loadedOk = loaded.Load(graphFile.str().c_str());
+		timer.stamp();
+		unsigned int loadTime = timer.getTimePassed();
+
+		int failCount = 0;
+		unsigned int queryTime = 0;
+		unsigned long long expanded = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			timer.start();
+			std::vector<Coordinate>* path = loaded.Path(
+				Coordinate(experiment.GetStartX(), experiment.GetStartY()),
+				Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+			timer.stamp();
+			queryTime += timer.getTimePassed();
+			expanded += loaded.m_ExpandedNodes;
+
+			double length = path->empty() ? 0 : map.getPathLength(*path);
+			if (abs(length - experiment.GetDistance()) >= 1)
+				failCount++;
+			delete path;
+		}
+
+		// Goals a few free cells straight right of the starts, which the start reaches with a direct
+		// edge instead of through the goal side
+		int directCount = 0;
+		int directFailCount = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			int steps = 0;
+			while (steps < 8 && map.isWalkable(start.X + steps + 1, start.Y))
+				steps++;
+			if (steps < 2)
+				continue;
+
+			std::vector<Coordinate>* path = loaded.Path(start, Coordinate(start.X + steps, start.Y));
+			double length = path->empty() ? 0 : map.getPathLength(*path);
+			if (abs(length - steps) >= 1)
+				directFailCount++;
+			directCount++;
+			delete path;
+		}
+
+		std::cout << std::endl;
+		std::cout << ((levels == 2) ? "Two-level subgoal graph" : "Simple subgoal graph") << std::endl;
+		std::cout << "Build: " << buildTime / 1000.0f << " ms, load from " << graphFile.str() << ": " << loadTime / 1000.0f << " ms"
+			<< (loadedOk ? "" : " (FAILED)") << std::endl;
+		std::cout << "Subgoals: " << graph.GetSubgoalCount() << ", global: " << graph.GetGlobalCount() << ", edges: " << graph.GetEdgeCount() << std::endl;
+		std::cout << "Queries: " << queryTime / 1000.0f << " ms, " << expanded / queries << " expansions per query" << std::endl;
+		std::cout << "Length mismatches: " << failCount << " / " << queries << std::endl;
+		std::cout << "Direct goal mismatches: " << directFailCount << " / " << directCount << std::endl;
+	}
+}
+
+void goalBoundsBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, std::string mapFile, int startExperiment, int endExperiment)
+{
+	int threads = std::thread::hardware_concurrency();
+	if (threads < 1)
+		threads = 1;
+
+	// Build once and keep the file, building takes one Dijkstra search per walkable cell
+	std::ostringstream boundsFile;
+	boundsFile << mapFile << ".gb";
+	Timer timer;
+	unsigned int buildTime = 0;
+	GoalBounds bounds = GoalBounds(&map);
+	timer.start();
+	bool loaded = bounds.Load(boundsFile.str().c_str());
+	timer.stamp();
+	unsigned int loadTime = timer.getTimePassed();
+	if (!loaded)
+	{
+		timer.start();
+		bounds.Build(threads);
+		timer.stamp();
+		buildTime = timer.getTimePassed();
+		bounds.Save(boundsFile.str().c_str());
+	}
+
+	unsigned int plainTime = 0, boundedTime = 0;
+	unsigned long long plainExpanded = 0, boundedExpanded = 0;
+	int failCount = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+		Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+		aStar.SetGoalBounds(nullptr);
+		timer.start();
+		std::vector<Coordinate>* path = aStar.Path(start, goal);
+		timer.stamp();
+		plainTime += timer.getTimePassed();
+		plainExpanded += aStar.m_ExpandedNodes;
+		double plainLength = path->empty() ? 0 : map.getPathLength(*path);
+		delete path;
+
+		aStar.SetGoalBounds(&bounds);
+		timer.start();
+		path = aStar.Path(start, goal);
+		timer.stamp();
+		boundedTime += timer.getTimePassed();
+		boundedExpanded += aStar.m_ExpandedNodes;
+		double boundedLength = path->empty() ? 0 : map.getPathLength(*path);
+		delete path;
+
+		if (abs(boundedLength - plainLength) >= 1)
+			failCount++;
+	}
+	aStar.SetGoalBounds(nullptr);
+
+	int queries = endExperiment - startExperiment + 1;
+	if (loaded)
+		std::cout << "Mapped " << boundsFile.str() << " in " << loadTime / 1000.0f << " ms" << std::endl;
+	else
+		std::cout << "Built with " << threads << " threads in " << buildTime / 1000.0f << " ms, saved to " << boundsFile.str() << std::endl;
+	std::cout << "A*: " << plainTime / 1000.0f << " ms, " << plainExpanded / queries << " expansions per query" << std::endl;
+	std::cout << "A* with goal bounds: " << boundedTime / 1000.0f << " ms, " << boundedExpanded / queries << " expansions per query" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << queries << std::endl;
+}
+
+void deadEndBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	Timer timer;
+	timer.start();
+	DeadEndPruning pruning = DeadEndPruning(&map);
+	timer.stamp();
+
+	int walkable = 0;
+	for (int y = 0; y < map.getHeight(); y++)
+		for (int x = 0; x < map.getWidth(); x++)
+			walkable += map.isWalkable(x, y);
+	std::cout << "Decomposed in " << timer.getTimePassed() / 1000.0f << " ms: " << pruning.GetAreaCount() << " areas, "
+		<< pruning.GetDoorwayCount() << " doorways, " << pruning.GetArticulationDoorwayCount() << " of them cut the map" << std::endl;
+	std::cout << "Swamp cells: " << pruning.GetSwampCellCount() << " / " << walkable << std::endl;
+
+	int lastBucket = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+		lastBucket = max(lastBucket, scenario.GetNthExperiment(i).GetBucket());
+
+	std::cout << "Bucket\tQueries\tExpanded\tPruned\t\tEliminated\tA* (ms)\t\tPruned (ms)" << std::endl;
+	unsigned long long totalPlain = 0, totalPruned = 0;
+	int failCount = 0;
+	for (int bucket = 0; bucket <= lastBucket; bucket++)
+	{
+		int queries = 0;
+		unsigned long long plainExpanded = 0, prunedExpanded = 0;
+		unsigned int plainTime = 0, prunedTime = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			if (experiment.GetBucket() != bucket)
+				continue;
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+			aStar.SetDeadEndPruning(nullptr);
+			timer.start();
+			std::vector<Coordinate>* path = aStar.Path(start, goal);
+			timer.stamp();
+			plainTime += timer.getTimePassed();
+			plainExpanded += aStar.m_ExpandedNodes;
+			double plainLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			aStar.SetDeadEndPruning(&pruning);
+			timer.start();
+			path = aStar.Path(start, goal);
+			timer.stamp();
+			prunedTime += timer.getTimePassed();
+			prunedExpanded += aStar.m_ExpandedNodes;
+			double prunedLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			if (abs(prunedLength - plainLength) >= 1)
+				failCount++;
+			queries++;
+		}
+		aStar.SetDeadEndPruning(nullptr);
+
+		if (queries == 0)
+			continue;
+		totalPlain += plainExpanded;
+		totalPruned += prunedExpanded;
+		std::cout << bucket << "\t" << queries << "\t" << plainExpanded / queries << "\t\t" << prunedExpanded / queries << "\t\t"
+			<< 100.0 * (1.0 - (double)prunedExpanded / max(plainExpanded, 1ULL)) << "%\t\t"
+			<< plainTime / 1000.0f << "\t\t" << prunedTime / 1000.0f << std::endl;
+	}
+
+	std::cout << "Expansions eliminated overall: " << 100.0 * (1.0 - (double)totalPruned / max(totalPlain, 1ULL)) << "%" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << endExperiment - startExperiment + 1 << std::endl;
+}
+
+/// <summary>
+/// Starts counting the hardware cache misses of this thread, where the platform allows it.
+/// </summary>
+/// <returns>A handle for <see cref="stopCacheMissCounter"/>, or -1 if there is no counter</returns>
+int startCacheMissCounter()
+{
+#ifdef __linux__
+	perf_event_attr attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.size = sizeof(attributes);
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+/// <summary>
+/// Stops a counter from <see cref="startCacheMissCounter"/>.
+/// </summary>
+/// <param name="counter">The handle.</param>
+/// <returns>The number of cache misses, or -1 if there is no counter</returns>
+long long stopCacheMissCounter(int counter)
+{
+	long long misses = -1;
+#ifdef __linux__
+	if (counter >= 0)
+	{
+		if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+			misses = -1;
+		close(counter);
+	}
+#endif
+	return misses;
+}
+
+void agentSizeBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, const std::string &mapFile, int startExperiment, int endExperiment)
+{
+	// Check every size against plain A* on a copy of the map eroded for that size,
+	// which is what each size needed before clearance
+	std::cout << "Size\tSolvable\tClearance (ms)\tEroded (ms)\tMismatches" << std::endl;
+	for (int size = 1; size <= 3; size++)
+	{
+		std::string erodedFile = mapFile + ".eroded.tmp";
+		{
+			std::ofstream out(erodedFile.c_str());
+			out << "type octile" << std::endl << "height " << map.getHeight() << std::endl << "width " << map.getWidth() << std::endl << "map" << std::endl;
+			for (int y = 0; y < map.getHeight(); y++)
+			{
+				for (int x = 0; x < map.getWidth(); x++)
+					out << ((aStar.GetClearance(x, y) >= size) ? '.' : '@');
+				out << std::endl;
+			}
+		}
+		DV1419Map eroded = DV1419Map(erodedFile.c_str());
+		std::remove(erodedFile.c_str());
+		AStar erodedAStar = AStar(&eroded, *AStar::Heuristics::Diagonal);
+
+		aStar.SetAgentSize(size);
+		Timer timer;
+		unsigned int clearanceTime = 0, erodedTime = 0;
+		int solvable = 0, failCount = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+			if (aStar.GetClearance(start.X, start.Y) < size || aStar.GetClearance(goal.X, goal.Y) < size)
+				continue;
+
+			timer.start();
+			std::vector<Coordinate>* path = aStar.Path(start, goal);
+			timer.stamp();
+			clearanceTime += timer.getTimePassed();
+			double length = path->empty() ? 0 : map.getPathLength(*path);
+			// Every cell the agent covers along the way has to be open
+			for (size_t c = 0; c < path->size(); c++)
+				if (aStar.GetClearance((*path)[c].X, (*path)[c].Y) < size)
+					length = -1;
+			delete path;
+
+			timer.start();
+			path = erodedAStar.Path(start, goal);
+			timer.stamp();
+			erodedTime += timer.getTimePassed();
+			double erodedLength = path->empty() ? 0 : eroded.getPathLength(*path);
+			delete path;
+
+			if (abs(length - erodedLength) >= 1)
+				failCount++;
+			solvable++;
+		}
+
+		std::cout << size << "x" << size << "\t" << solvable << "\t\t" << clearanceTime / 1000.0f << "\t\t" << erodedTime / 1000.0f << "\t\t" << failCount << std::endl;
+	}
+	aStar.SetAgentSize(1);
+}
+
+void pagedBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, const std::string &mapFile, int startExperiment, int endExperiment)
+{
+	std::string pagedFile = mapFile + ".pmap";
+	if (!PagedMap::Write(&map, pagedFile.c_str()))
+	{
+		std::cout << "Couldn't write " << pagedFile << std::endl;
+		return;
+	}
+
+	const int capacities[] = { 4, 16, 64 };
+	std::cout << "Resident\tTime (ms)\tA* (ms)\t\tFaults/query\tMax faults\tPrefetches/query\tMismatches" << std::endl;
+	for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+	{
+		PagedMap paged(capacities[c]);
+		if (!paged.Open(pagedFile.c_str()))
+		{
+			std::cout << "Couldn't map " << pagedFile << std::endl;
+			break;
+		}
+		AStar pagedAStar(&paged);
+
+		Timer timer;
+		unsigned int pagedTime = 0, plainTime = 0;
+		unsigned long long faults = 0, prefetches = 0;
+		unsigned int maxFaults = 0;
+		int failCount = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+			timer.start();
+			std::vector<Coordinate>* path = pagedAStar.Path(start, goal);
+			timer.stamp();
+			pagedTime += timer.getTimePassed();
+			faults += paged.GetQueryFaults();
+			prefetches += paged.GetQueryPrefetches();
+			maxFaults = max(maxFaults, paged.GetQueryFaults());
+			double pagedLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			timer.start();
+			path = aStar.Path(start, goal);
+			timer.stamp();
+			plainTime += timer.getTimePassed();
+			double plainLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			if (abs(pagedLength - plainLength) >= 1)
+				failCount++;
+		}
+
+		int queries = endExperiment - startExperiment + 1;
+		std::cout << capacities[c] << " tiles\t" << pagedTime / 1000.0f << "\t\t" << plainTime / 1000.0f << "\t\t"
+			<< (double)faults / queries << "\t\t" << maxFaults << "\t\t" << (double)prefetches / queries << "\t\t\t" << failCount << std::endl;
+	}
+
+	std::remove(pagedFile.c_str());
+}
+
+void sparseBenchmark(DV1419Map &map, ScenarioLoader &scenario, const std::string &mapFile, int startExperiment, int endExperiment)
+{
+	// Tile the map into bigger and bigger worlds and run the same queries in the top left copy,
+	// so the searches stay the same size while the map grows
+	const long long maxCells = 1 << 22;
+	std::cout << "Size\t\tDense (ms)\tSparse (ms)\tPool setup (ms)\tDense (KB)\tSparse (KB)\tAutomatic sparse\tMismatches" << std::endl;
+	for (int copies = 1; (long long)map.getWidth() * map.getHeight() * copies * copies <= maxCells; copies *= 2)
+	{
+		std::ostringstream stitchedFile;
+		stitchedFile << mapFile << ".x" << copies << ".tmp";
+		{
+			std::ofstream out(stitchedFile.str().c_str());
+			out << "type octile" << std::endl << "height " << map.getHeight() * copies << std::endl << "width " << map.getWidth() * copies << std::endl << "map" << std::endl;
+			std::string cells = map.toString();
+			for (int y = 0; y < map.getHeight() * copies; y++)
+			{
+				for (int c = 0; c < copies; c++)
+					out << cells.substr((y % map.getHeight()) * map.getWidth(), map.getWidth());
+				out << std::endl;
+			}
+		}
+		DV1419Map world = DV1419Map(stitchedFile.str().c_str());
+		std::remove(stitchedFile.str().c_str());
+
+		Timer timer;
+		AStar dense = AStar(&world, *AStar::Heuristics::Diagonal);
+		AStar sparse = AStar(&world, *AStar::Heuristics::Diagonal);
+		AStar automatic = AStar(&world, *AStar::Heuristics::Diagonal);
+		sparse.SetStateBackend(AStar::SparseState);
+		automatic.SetStateBackend(AStar::AutomaticState);
+
+		// The dense pool is made by the first search, time that on its own
+		Experiment first = scenario.GetNthExperiment(startExperiment);
+		timer.start();
+		dense.Prepare(Coordinate(first.GetStartX(), first.GetStartY()), Coordinate(first.GetGoalX(), first.GetGoalY()));
+		timer.stamp();
+		unsigned int setupTime = timer.getTimePassed();
+
+		unsigned int denseTime = 0, sparseTime = 0;
+		int failCount = 0, automaticSparse = 0;
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+			timer.start();
+			std::vector<Coordinate>* densePath = dense.Path(start, goal);
+			timer.stamp();
+			denseTime += timer.getTimePassed();
+
+			timer.start();
+			std::vector<Coordinate>* sparsePath = sparse.Path(start, goal);
+			timer.stamp();
+			sparseTime += timer.getTimePassed();
+
+			double denseLength = densePath->empty() ? 0 : world.getPathLength(*densePath);
+			double sparseLength = sparsePath->empty() ? 0 : world.getPathLength(*sparsePath);
+			if (abs(denseLength - sparseLength) >= 1)
+				failCount++;
+			delete densePath;
+			delete sparsePath;
+
+			delete automatic.Path(start, goal);
+			if (automatic.IsUsingSparseState())
+				automaticSparse++;
+		}
+
+		std::cout << world.getWidth() << "x" << world.getHeight() << "\t" << denseTime / 1000.0f << "\t\t" << sparseTime / 1000.0f << "\t\t"
+			<< setupTime / 1000.0f << "\t\t" << dense.GetStateMemoryUsage() / 1024 << "\t\t" << sparse.GetStateMemoryUsage() / 1024 << "\t\t"
+			<< automaticSparse << " / " << endExperiment - startExperiment + 1 << "\t\t" << failCount << std::endl;
+	}
+}
+
+void layoutBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	// The layout is picked at compile time, so run this once per build to compare them
+	GridLayout layout = GridLayout(map.getWidth(), map.getHeight());
+	std::cout << "Layout: " << GridLayout::GetName() << std::endl;
+	std::cout << "Neighbour steps to another cache line of the map: " << 100.0 * layout.GetCrossingRate(sizeof(bool), 64) << "%" << std::endl;
+	std::cout << "Neighbour steps to another page of the nodes: " << 100.0 * layout.GetCrossingRate(sizeof(AStar::Node), 4096) << "%" << std::endl;
+
+	Timer timer;
+	unsigned int totalTime = 0;
+	unsigned long long expanded = 0;
+	int failCount = 0;
+	int counter = startCacheMissCounter();
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		timer.start();
+		std::vector<Coordinate>* path = aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+		timer.stamp();
+		totalTime += timer.getTimePassed();
+		expanded += aStar.m_ExpandedNodes;
+		double length = path->empty() ? 0 : map.getPathLength(*path);
+		if (abs(length - experiment.GetDistance()) >= 1)
+			failCount++;
+		delete path;
+	}
+	long long misses = stopCacheMissCounter(counter);
+
+	int queries = endExperiment - startExperiment + 1;
+	std::cout << "Queries: " << queries << ", total time " << totalTime / 1000.0f << " ms, " << totalTime / 1000.0f / queries << " ms per query" << std::endl;
+	std::cout << "Expanded nodes: " << expanded << ", " << (double)totalTime * 1000 / max(expanded, 1ULL) << " ns per expansion" << std::endl;
+	if (misses >= 0)
+		std::cout << "Cache misses: " << misses << ", " << (double)misses / max(expanded, 1ULL) << " per expansion" << std::endl;
+	else
+		std::cout << "Cache misses: no hardware counter available, use a profiler" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << queries << std::endl;
+}
+
+void parallelBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	const int topBuckets = 3;
+	std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+	int lastBucket = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+		lastBucket = max(lastBucket, scenario.GetNthExperiment(i).GetBucket());
+
+	// Only the longest queries are worth going parallel for, so time those alone
+	std::vector<int> experiments;
+	for (int i = startExperiment; i <= endExperiment; i++)
+		if (scenario.GetNthExperiment(i).GetBucket() > lastBucket - topBuckets)
+			experiments.push_back(i);
+	std::cout << "Buckets " << max(lastBucket - topBuckets + 1, 0) << " through " << lastBucket << ", " << experiments.size() << " queries" << std::endl;
+
+	Timer timer;
+	unsigned int serialTime = 0;
+	unsigned long long serialExpanded = 0;
+	std::vector<double> lengths;
+	for (size_t e = 0; e < experiments.size(); e++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(experiments[e]);
+		timer.start();
+		std::vector<Coordinate>* path = aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+		timer.stamp();
+		serialTime += timer.getTimePassed();
+		serialExpanded += aStar.m_ExpandedNodes;
+		lengths.push_back(path->empty() ? 0 : map.getPathLength(*path));
+		delete path;
+	}
+	std::cout << "Threads\tTotal (ms)\tMean (ms)\tSpeedup\tExpanded\tMessages\tMismatches" << std::endl;
+	std::cout << "A*\t" << serialTime / 1000.0f << "\t\t" << serialTime / 1000.0f / max((int)experiments.size(), 1) << "\t\t1\t"
+		<< serialExpanded / max((int)experiments.size(), 1) << "\t\t-\t\t-" << std::endl;
+
+	ParallelAStar parallel(&map, 1);
+	for (size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++)
+	{
+		parallel.SetThreads(threadCounts[t]);
+		unsigned int parallelTime = 0;
+		unsigned long long expanded = 0, messages = 0;
+		int failCount = 0;
+		for (size_t e = 0; e < experiments.size(); e++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(experiments[e]);
+			timer.start();
+			std::vector<Coordinate>* path = parallel.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+			timer.stamp();
+			parallelTime += timer.getTimePassed();
+			expanded += parallel.m_ExpandedNodes;
+			messages += parallel.m_Messages;
+			double length = path->empty() ? 0 : map.getPathLength(*path);
+			if (abs(length - lengths[e]) >= 1)
+				failCount++;
+			delete path;
+		}
+
+		std::cout << threadCounts[t] << "\t" << parallelTime / 1000.0f << "\t\t" << parallelTime / 1000.0f / max((int)experiments.size(), 1) << "\t\t"
+			<< (double)serialTime / max(parallelTime, 1u) << "\t" << expanded / max((int)experiments.size(), 1) << "\t\t"
+			<< messages / max((int)experiments.size(), 1) << "\t\t" << failCount << std::endl;
+	}
+
+	// With a threshold, shorter queries never leave the calling thread
+	parallel.SetThreshold(100);
+	int routed = 0;
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		delete parallel.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+		if (parallel.WasParallel())
+			routed++;
+	}
+	std::cout << "Queries searched in parallel with a threshold of " << parallel.GetThreshold() << ": " << routed << " / " << endExperiment - startExperiment + 1 << std::endl;
+}
+
+void traceBenchmark(const std::vector<std::string>& mapFiles)
+{
+	// Interleave the scenarios of every map into one trace, like a service hosting them all would see
+	std::vector<ScenarioLoader> scenarios;
+	MapRegistry& registry = MapRegistry::GetInstance();
+	for (size_t m = 0; m < mapFiles.size(); m++)
+	{
+		scenarios.push_back(ScenarioLoader((mapFiles[m] + ".scen").c_str()));
+		std::string directory = MapRegistry::Normalize(mapFiles[m]);
+		registry.AddSearchDirectory(directory.substr(0, directory.find_last_of('/') + 1));
+	}
+	std::vector<Experiment> trace;
+	for (int i = 0; ; i++)
+	{
+		size_t before = trace.size();
+		for (size_t m = 0; m < scenarios.size(); m++)
+			if (i < scenarios[m].GetNumExperiments())
+				trace.push_back(scenarios[m].GetNthExperiment(i));
+		if (trace.size() == before)
+			break;
+	}
+
+	// Load every map the trace names up front, in parallel
+	std::vector<std::string> names;
+	for (size_t i = 0; i < trace.size(); i++)
+		names.push_back(trace[i].GetMapName());
+	Timer timer;
+	timer.start();
+	registry.Preload(names, max((int)std::thread::hardware_concurrency(), 1));
+	timer.stamp();
+	std::cout << "Preloaded " << registry.GetMapCount() << " maps for " << trace.size() << " queries in " << timer.getTimePassed() / 1000.0f << " ms, "
+		<< registry.GetDuplicateCount() << " duplicates shared" << std::endl;
+
+	// One searcher per map, all built on the shared handles
+	std::map<const DV1419Map*, AStar*> searchers;
+	unsigned int totalTime = 0;
+	int failCount = 0, missing = 0;
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		MapRegistry::Handle map = registry.Resolve(trace[i]);
+		if (!map)
+		{
+			missing++;
+			continue;
+		}
+		AStar*& searcher = searchers[map.get()];
+		if (searcher == nullptr)
+			searcher = new AStar(map.get(), *AStar::Heuristics::Diagonal);
+
+		timer.start();
+		std::vector<Coordinate>* path = searcher->Path(Coordinate(trace[i].GetStartX(), trace[i].GetStartY()), Coordinate(trace[i].GetGoalX(), trace[i].GetGoalY()));
+		timer.stamp();
+		totalTime += timer.getTimePassed();
+		double length = path->empty() ? 0 : map->getPathLength(*path);
+		if (abs(length - trace[i].GetDistance()) >= 1)
+			failCount++;
+		delete path;
+	}
+
+	std::cout << "Searchers: " << searchers.size() << ", total time " << totalTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Maps that couldn't be found: " << missing << " queries" << std::endl;
+	std::cout << "Length mismatches: " << failCount << " / " << trace.size() - missing << std::endl;
+	for (std::map<const DV1419Map*, AStar*>::iterator it = searchers.begin(); it != searchers.end(); ++it)
+		delete it->second;
+}
+
+void fringeBenchmark(const std::vector<std::string>& mapFiles)
+{
+	std::cout << "Map\t\tQueries\tA* (ms)\t\tFringe (ms)\tA* expanded\tFringe expanded\tSweeps\tA* (KB)\t\tFringe (KB)\tMismatches" << std::endl;
+	unsigned long long totalAStarTime = 0, totalFringeTime = 0;
+	int totalQueries = 0, totalMismatches = 0;
+	for (size_t m = 0; m < mapFiles.size(); m++)
+	{
+		std::ostringstream scenarioFile;
+		scenarioFile << mapFiles[m] << ".scen";
+		DV1419Map map = DV1419Map(mapFiles[m].c_str());
+		ScenarioLoader scenario = ScenarioLoader(scenarioFile.str().c_str());
+		AStar aStar = AStar(&map, *AStar::Heuristics::Diagonal);
+		FringeSearch fringe = FringeSearch(&map);
+
+		Timer timer;
+		unsigned int aStarTime = 0, fringeTime = 0;
+		unsigned long long aStarExpanded = 0, fringeExpanded = 0, sweeps = 0;
+		size_t peakOpen = 0;
+		int mismatches = 0;
+		for (int i = 0; i < scenario.GetNumExperiments(); i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+			timer.start();
+			std::vector<Coordinate>* path = aStar.Path(start, goal);
+			timer.stamp();
+			aStarTime += timer.getTimePassed();
+			aStarExpanded += aStar.m_ExpandedNodes;
+			peakOpen = max(peakOpen, aStar.m_OpenList.size());
+			double aStarLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			timer.start();
+			path = fringe.Path(start, goal);
+			timer.stamp();
+			fringeTime += timer.getTimePassed();
+			fringeExpanded += fringe.m_ExpandedNodes;
+			sweeps += fringe.m_Iterations;
+			double fringeLength = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			if (abs(fringeLength - aStarLength) >= 1 || abs(fringeLength - experiment.GetDistance()) >= 1)
+				mismatches++;
+		}
+
+		// A* keeps a heap allocated node and a pointer per cell, its map and an open list of
+		// tree nodes, estimated here at four pointers each on top of the stored node pointer
+		size_t cells = map.getWidth() * map.getHeight();
+		size_t aStarMemory = cells * (sizeof(AStar::Node) + sizeof(AStar::Node*) + sizeof(bool)) + peakOpen * 5 * sizeof(void*);
+		int queries = scenario.GetNumExperiments();
+		std::cout << scenario.GetScenarioName() << "\t" << queries << "\t" << aStarTime / 1000.0f << "\t\t" << fringeTime / 1000.0f << "\t\t"
+			<< aStarExpanded / max(queries, 1) << "\t\t" << fringeExpanded / max(queries, 1) << "\t\t" << sweeps / max(queries, 1) << "\t"
+			<< aStarMemory / 1024 << "\t\t" << fringe.GetMemoryUsage() / 1024 << "\t\t" << mismatches << std::endl;
+
+		totalAStarTime += aStarTime;
+		totalFringeTime += fringeTime;
+		totalQueries += queries;
+		totalMismatches += mismatches;
+	}
+
+	std::cout << std::endl;
+	std::cout << "A*: total time " << totalAStarTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Fringe Search: total time " << totalFringeTime / 1000.0f << " ms" << std::endl;
+	std::cout << "Length mismatches: " << totalMismatches << " / " << totalQueries << std::endl;
+}
+
+void versionedBenchmark(DV1419Map &map, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	const int readerCount = 4;
+	const int doorCount = 256;
+	const int batchSize = 8;
+	const int versionCount = 200;
+
+	// Doors are open cells that the writer keeps closing and opening again
+	VersionedMap versions(&map);
+	std::mt19937 random(1419);
+	std::vector<VersionedMap::CellEdit> doors;
+	while ((int)doors.size() < doorCount)
+	{
+		VersionedMap::CellEdit door = { (int)(random() % map.getWidth()), (int)(random() % map.getHeight()), true };
+		if (map.isWalkable(door.X, door.Y))
+			doors.push_back(door);
+	}
+
+	// Every reader searches whatever version is current when its query starts, and checks the path against it
+	std::atomic<bool> stop(false);
+	std::atomic<int> queries(0), unreachable(0), invalid(0);
+	std::vector<std::thread> readers;
+	for (int r = 0; r < readerCount; r++)
+	{
+		readers.push_back(std::thread([&, r]()
+		{
+			AStar aStar(&map);
+			int reader = versions.RegisterReader();
+			for (int i = startExperiment + r; !stop; i = (i + readerCount > endExperiment) ? startExperiment + r : i + readerCount)
+			{
+				Experiment experiment = scenario.GetNthExperiment(min(i, endExperiment));
+				VersionedMap::Pin snapshot(versions, reader);
+				aStar.SetSnapshot(snapshot.Get());
+				std::vector<Coordinate>* path = aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+				for (size_t p = 1; p < path->size(); p++)
+				{
+					int dx = (*path)[p].X - (*path)[p - 1].X;
+					int dy = (*path)[p].Y - (*path)[p - 1].Y;
+					int direction = 0;
+					while (direction < 8 && (MapSnapshot::DirectionX[direction] != dx || MapSnapshot::DirectionY[direction] != dy))
+						direction++;
+					if (direction == 8 || !(snapshot->GetSuccessors((*path)[p - 1].X, (*path)[p - 1].Y) & (1 << direction)))
+					{
+						invalid++;
+						break;
+					}
+				}
+				if (path->empty())
+					unreachable++;
+				queries++;
+				delete path;
+				aStar.SetSnapshot(nullptr);
+			}
+			versions.UnregisterReader(reader);
+		}));
+	}
+
+	Timer timer;
+	unsigned int publishTime = 0;
+	size_t mostRetired = 0;
+	for (int v = 0; v < versionCount; v++)
+	{
+		std::vector<VersionedMap::CellEdit> batch;
+		for (int e = 0; e < batchSize; e++)
+		{
+			VersionedMap::CellEdit& door = doors[random() % doors.size()];
+			door.Walkable = !door.Walkable;
+			batch.push_back(door);
+		}
+		timer.start();
+		versions.Publish(batch);
+		timer.stamp();
+		publishTime += timer.getTimePassed();
+		mostRetired = max(mostRetired, versions.GetRetiredCount());
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	stop = true;
+	for (size_t r = 0; r < readers.size(); r++)
+		readers[r].join();
+
+	std::cout << "Readers: " << readerCount << ", versions published: " << versions.GetVersion() - 1 << " of " << batchSize << " edits each" << std::endl;
+	std::cout << "Publish: " << publishTime / 1000.0f / versionCount << " ms mean, " << (double)versions.GetTilesCopied() / versionCount << " tiles copied of "
+		<< ((map.getWidth() + MapSnapshot::TileSize - 1) / MapSnapshot::TileSize) * ((map.getHeight() + MapSnapshot::TileSize - 1) / MapSnapshot::TileSize) << std::endl;
+	std::cout << "Snapshots freed: " << versions.GetSnapshotsFreed() << ", most kept for readers at once: " << mostRetired << std::endl;
+	std::cout << "Queries: " << queries << ", no path in their version: " << unreachable << ", invalid paths: " << invalid << std::endl;
+
+	// The derived data of the last version was built up edit by edit, so check it against the cells
+	int reader = versions.RegisterReader();
+	int wrongSuccessors = 0, wrongComponents = 0;
+	VersionedMap::Pin snapshot(versions, reader);
+	for (int y = 0; y < map.getHeight(); y++)
+	{
+		for (int x = 0; x < map.getWidth(); x++)
+		{
+			unsigned char successors = 0;
+			for (int direction = 0; direction < 8 && snapshot->IsWalkable(x, y); direction++)
+			{
+				int dx = MapSnapshot::DirectionX[direction];
+				int dy = MapSnapshot::DirectionY[direction];
+				if (snapshot->IsWalkable(x + dx, y + dy) && snapshot->IsWalkable(x + dx, y) && snapshot->IsWalkable(x, y + dy))
+					successors |= 1 << direction;
+			}
+			if (successors != snapshot->GetSuccessors(x, y))
+				wrongSuccessors++;
+		}
+	}
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		std::vector<bool> reached(map.getWidth() * map.getHeight(), false);
+		std::vector<Coordinate> stack;
+		if (snapshot->IsWalkable(experiment.GetStartX(), experiment.GetStartY()))
+		{
+			reached[experiment.GetStartY() * map.getWidth() + experiment.GetStartX()] = true;
+			stack.push_back(Coordinate(experiment.GetStartX(), experiment.GetStartY()));
+		}
+		while (!stack.empty())
+		{
+			Coordinate cell = stack.back();
+			stack.pop_back();
+			for (int direction = 0; direction < 8; direction++)
+			{
+				Coordinate next = Coordinate(cell.X + MapSnapshot::DirectionX[direction], cell.Y + MapSnapshot::DirectionY[direction]);
+				if ((snapshot->GetSuccessors(cell.X, cell.Y) & (1 << direction)) && !reached[next.Y * map.getWidth() + next.X])
+				{
+					reached[next.Y * map.getWidth() + next.X] = true;
+					stack.push_back(next);
+				}
+			}
+		}
+		if (reached[experiment.GetGoalY() * map.getWidth() + experiment.GetGoalX()] != snapshot->AreConnected(experiment.GetStartX(), experiment.GetStartY(), experiment.GetGoalX(), experiment.GetGoalY()))
+			wrongComponents++;
+	}
+	std::cout << "Last version checked from scratch: " << wrongSuccessors << " cells with wrong moves, " << wrongComponents << " / " << endExperiment - startExperiment + 1 << " queries with wrong connectivity" << std::endl;
+}
+
+void recordBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, const std::string &mapFile, int startExperiment, int endExperiment)
+{
+	if (!SearchTrace::IsCompiledIn())
+	{
+		std::cout << "Searches aren't traced in this build, define SEARCH_TRACE to record" << std::endl;
+		return;
+	}
+
+	// Run the scenarios once untraced and once into the trace file, to see what recording costs
+	std::string traceFile = mapFile.substr(mapFile.find_last_of("/\\") + 1) + ".trace";
+	SearchTrace trace(1 << 16);
+	if (!trace.Open(traceFile.c_str(), mapFile, map.getWidth(), map.getHeight()))
+	{
+		std::cout << "Couldn't write " << traceFile << std::endl;
+		return;
+	}
+
+	Timer timer;
+	unsigned int times[2] = { 0, 0 };
+	for (int traced = 0; traced < 2; traced++)
+	{
+		aStar.SetTrace(traced ? &trace : nullptr);
+		for (int i = startExperiment; i <= endExperiment; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			timer.start();
+			std::vector<Coordinate>* path = aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+			timer.stamp();
+			times[traced] += timer.getTimePassed();
+			delete path;
+		}
+	}
+	aStar.SetTrace(nullptr);
+	bool written = trace.Close();
+
+	unsigned long long events = trace.GetRecordedCount();
+	std::cout << "Untraced: " << times[0] / 1000.0f << " ms, traced: " << times[1] / 1000.0f << " ms, "
+		<< (times[1] > times[0] ? (times[1] - times[0]) * 1000.0 / max(events, 1ULL) : 0) << " ns per event" << std::endl;
+	std::cout << "Recorded " << events << " events, " << events * sizeof(SearchTrace::Event) / 1024 << " KB, to " << traceFile << (written ? "" : " (write failed)") << std::endl;
+}
+
+void heatmapReport(const std::vector<std::string>& traceFiles)
+{
+	for (size_t t = 0; t < traceFiles.size(); t++)
+	{
+		std::string mapName;
+		int width, height;
+		std::vector<SearchTrace::Event> events;
+		if (!SearchTrace::Load(traceFiles[t].c_str(), mapName, width, height, events))
+		{
+			std::cout << "Couldn't read " << traceFiles[t] << std::endl;
+			continue;
+		}
+		MapRegistry::Handle map = MapRegistry::GetInstance().Get(mapName);
+		if (!map || map->getWidth() != width || map->getHeight() != height)
+		{
+			std::cout << "Couldn't find the map " << mapName << " of " << traceFiles[t] << std::endl;
+			continue;
+		}
+
+		TraceHeatmap heatmap(width, height);
+		heatmap.Add(events);
+		std::cout << traceFiles[t] << " on " << mapName << std::endl;
+		heatmap.PrintStatistics(std::cout, 32, 5);
+
+		std::string expansions = traceFiles[t] + ".expansions.png";
+		std::string order = traceFiles[t] + ".order.png";
+		std::string reopens = traceFiles[t] + ".reopens.png";
+		if (heatmap.WriteExpansions(map.get(), expansions.c_str()) && heatmap.WriteOrder(map.get(), order.c_str()) && heatmap.WriteReopens(map.get(), reopens.c_str()))
+			std::cout << "Wrote " << expansions << ", " << order << " and " << reopens << std::endl;
+		else
+			std::cout << "Couldn't write the images of " << traceFiles[t] << std::endl;
+		std::cout << std::endl;
+	}
+}
+
+void cooperativeBenchmark(DV1419Map &map, AStar &aStar)
+{
+	const int agentCounts[] = { 250, 500, 1000, 2000 };
+	const int goalCount = 32;
+
+	// Units head for a handful of rally points, like they would in a game
+	std::mt19937 random(201);
+	std::vector<Coordinate> goals;
+	std::vector<FlowField*> fields;
+	while ((int)goals.size() < goalCount)
+	{
+		Coordinate goal = Coordinate(random() % map.getWidth(), random() % map.getHeight());
+		if (!map.isWalkable(goal.X, goal.Y))
+			continue;
+		goals.push_back(goal);
+		fields.push_back(new FlowField(&map));
+		fields.back()->Build(goal);
+	}
+
+	std::cout << "Agents\tTicks\tTime (ms)\tms/tick\tAgent moves/s\tExpanded/plan\tFailed plans\tHeuristics\tConflicts\tIndependent conflicts\tArrived" << std::endl;
+	for (size_t c = 0; c < sizeof(agentCounts) / sizeof(agentCounts[0]); c++)
+	{
+		// Distinct starts that can reach their goal
+		std::vector<bool> taken(map.getWidth() * map.getHeight(), false);
+		std::vector<Coordinate> starts;
+		std::vector<int> goalOf;
+		int longest = 0;
+		for (int attempts = 0; (int)starts.size() < agentCounts[c] && attempts < 100 * agentCounts[c]; attempts++)
+		{
+			Coordinate start = Coordinate(random() % map.getWidth(), random() % map.getHeight());
+			int goal = random() % goalCount;
+			int distance = map.isWalkable(start.X, start.Y) ? fields[goal]->GetDistance(start.X, start.Y) : FlowField::Unreachable;
+			if (distance == FlowField::Unreachable || distance == 0 || taken[start.Y * map.getWidth() + start.X])
+				continue;
+			taken[start.Y * map.getWidth() + start.X] = true;
+			starts.push_back(start);
+			goalOf.push_back(goal);
+			longest = max(longest, distance / 10);
+		}
+
+		// Without cooperation every unit follows its own shortest path and walks through the others
+		std::vector<std::vector<Coordinate>*> paths;
+		size_t longestPath = 0;
+		for (size_t a = 0; a < starts.size(); a++)
+		{
+			paths.push_back(aStar.Path(starts[a], goals[goalOf[a]]));
+			longestPath = max(longestPath, paths.back()->size());
+		}
+		unsigned long long independentConflicts = 0;
+		for (size_t tick = 1; tick < longestPath; tick++)
+		{
+			std::map<std::pair<int, int>, int> occupied;
+			std::set<std::pair<std::pair<int, int>, std::pair<int, int> > > moves;
+			for (size_t a = 0; a < paths.size(); a++)
+			{
+				// Units leave the map at their goal
+				if (tick >= paths[a]->size())
+					continue;
+				Coordinate from = (*paths[a])[tick - 1];
+				Coordinate to = (*paths[a])[tick];
+				if (occupied[std::make_pair(to.X, to.Y)]++ > 0)
+					independentConflicts++;
+				if (moves.count(std::make_pair(std::make_pair(to.X, to.Y), std::make_pair(from.X, from.Y))) > 0)
+					independentConflicts++;
+				moves.insert(std::make_pair(std::make_pair(from.X, from.Y), std::make_pair(to.X, to.Y)));
+			}
+		}
+		for (size_t a = 0; a < paths.size(); a++)
+			delete paths[a];
+
+		CooperativeAStar cooperative(&map);
+		for (size_t a = 0; a < starts.size(); a++)
+			cooperative.AddAgent(starts[a], goals[goalOf[a]]);
+
+		Timer timer;
+		unsigned long long moves = 0;
+		unsigned int maxTicks = 4 * longest + 100;
+		timer.start();
+		while (!cooperative.IsFinished() && cooperative.GetTick() < maxTicks)
+		{
+			for (int a = 0; a < cooperative.GetAgentCount(); a++)
+				if (!cooperative.HasArrived(a))
+					moves++;
+			cooperative.Step();
+		}
+		timer.stamp();
+		unsigned int time = timer.getTimePassed();
+
+		int arrived = 0;
+		for (int a = 0; a < cooperative.GetAgentCount(); a++)
+			if (cooperative.HasArrived(a))
+				arrived++;
+		std::cout << starts.size() << "\t" << cooperative.GetTick() << "\t" << time / 1000.0f << "\t\t" << time / 1000.0f / max(cooperative.GetTick(), 1u) << "\t"
+			<< (unsigned long long)(moves * 1000000.0 / max(time, 1u)) << "\t\t" << (double)cooperative.m_ExpandedNodes / max(cooperative.m_Plans, 1ULL) << "\t\t"
+			<< cooperative.m_FailedPlans << "\t\t" << cooperative.m_HeuristicBuilds << "\t\t" << cooperative.m_VertexConflicts + cooperative.m_EdgeConflicts << "\t\t"
+			<< independentConflicts << "\t\t\t" << arrived << std::endl;
+	}
+
+	for (size_t g = 0; g < fields.size(); g++)
+		delete fields[g];
+}
+
+void batchBenchmark(DV1419Map &map, AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	// The scenarios as they are, and the same starts all heading for a few rally points
+	std::vector<PathBatch::Query> workloads[2];
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		Experiment rally = scenario.GetNthExperiment(startExperiment + (i - startExperiment) % min(8, endExperiment - startExperiment + 1));
+		PathBatch::Query query;
+		query.Start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+		query.Goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+		workloads[0].push_back(query);
+		query.Goal = Coordinate(rally.GetGoalX(), rally.GetGoalY());
+		workloads[1].push_back(query);
+	}
+	const char* names[2] = { "Scenarios", "8 rally points" };
+
+	PathBatch batch(&map);
+	Timer timer;
+	std::cout << "Workload\tQueries\tMode\t\tms\tqueries/s\tSpeedup\tSearches\tFields\tMismatches" << std::endl;
+	for (int workload = 0; workload < 2; workload++)
+	{
+		const std::vector<PathBatch::Query>& queries = workloads[workload];
+
+		// One Path call per query in the order they came in. Every mode is timed a few times and
+		// the best run is kept, to leave out what else the machine was doing.
+		const int runs = 3;
+		std::vector<double> lengths(queries.size());
+		unsigned int sequentialTime = UINT_MAX;
+		for (int run = 0; run < runs; run++)
+		{
+			timer.start();
+			for (size_t i = 0; i < queries.size(); i++)
+			{
+				std::vector<Coordinate>* path = aStar.Path(queries[i].Start, queries[i].Goal);
+				lengths[i] = path->empty() ? 0 : map.getPathLength(*path);
+				delete path;
+			}
+			timer.stamp();
+			sequentialTime = min(sequentialTime, timer.getTimePassed());
+		}
+		std::cout << names[workload] << "\t" << queries.size() << "\tSequential\t" << sequentialTime / 1000.0f << "\t"
+			<< queries.size() * 1000000.0 / max(sequentialTime, 1u) << "\t\t1\t" << queries.size() << "\t\t0\t0" << std::endl;
+
+		// The batch with only the ordering, and with shared fields as well
+		for (int mode = 0; mode < 2; mode++)
+		{
+			batch.SetSharingThreshold(mode == 0 ? 0 : 8);
+			unsigned int searches = batch.GetSearchCount();
+			unsigned int fields = batch.GetFieldCount();
+			unsigned int batchTime = UINT_MAX;
+			int mismatches = 0;
+			for (int run = 0; run < runs; run++)
+			{
+				std::vector<std::vector<Coordinate>*> paths;
+				timer.start();
+				batch.Run(&queries[0], queries.size(), paths);
+				timer.stamp();
+				batchTime = min(batchTime, timer.getTimePassed());
+
+				mismatches = 0;
+				for (size_t i = 0; i < paths.size(); i++)
+				{
+					double length = paths[i]->empty() ? 0 : map.getPathLength(*paths[i]);
+					if (abs(length - lengths[i]) >= 1)
+						mismatches++;
+					delete paths[i];
+				}
+			}
+
+			std::cout << names[workload] << "\t" << queries.size() << "\t" << (mode == 0 ? "Hilbert order" : "Order + sharing") << "\t" << batchTime / 1000.0f << "\t"
+				<< queries.size() * 1000000.0 / max(batchTime, 1u) << "\t\t" << (double)sequentialTime / max(batchTime, 1u) << "\t"
+				<< (batch.GetSearchCount() - searches) / runs << "\t\t" << (batch.GetFieldCount() - fields) / runs << "\t" << mismatches << std::endl;
+		}
+	}
+}
+
+void symmetryBenchmark(const std::vector<std::string>& mapFiles)
+{
+	std::cout << "Map\t\tRectangles\tNodes kept\tBuild (ms)\tA* (ms)\t\tRSR (ms)\tSpeedup\tA* expanded\tRSR expanded\tMismatches" << std::endl;
+	for (size_t m = 0; m < mapFiles.size(); m++)
+	{
+		DV1419Map map = DV1419Map(mapFiles[m].c_str());
+		ScenarioLoader scenario = ScenarioLoader((mapFiles[m] + ".scen").c_str());
+		AStar aStar = AStar(&map, *AStar::Heuristics::Diagonal);
+
+		Timer timer;
+		timer.start();
+		RectangleSymmetry symmetry(&map);
+		timer.stamp();
+		unsigned int buildTime = timer.getTimePassed();
+
+		unsigned int times[2] = { 0, 0 };
+		unsigned long long expanded[2] = { 0, 0 };
+		int mismatches = 0;
+		for (int i = 0; i < scenario.GetNumExperiments(); i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+			double lengths[2];
+			for (int reduced = 0; reduced < 2; reduced++)
+			{
+				aStar.SetSymmetryReduction(reduced ? &symmetry : nullptr);
+				timer.start();
+				std::vector<Coordinate>* path = aStar.Path(start, goal);
+				timer.stamp();
+				times[reduced] += timer.getTimePassed();
+				expanded[reduced] += aStar.m_ExpandedNodes;
+				lengths[reduced] = path->empty() ? 0 : map.getPathLength(*path);
+
+				// The expanded path has to be a real one, one step at a time without cutting corners
+				for (size_t p = 1; reduced && p < path->size(); p++)
+				{
+					Coordinate from = (*path)[p - 1];
+					Coordinate to = (*path)[p];
+					if (max(abs(to.X - from.X), abs(to.Y - from.Y)) != 1 || !map.isWalkable(to.X, to.Y) || !map.isWalkable(from.X, to.Y) || !map.isWalkable(to.X, from.Y))
+					{
+						lengths[reduced] = -1;
+						break;
+					}
+				}
+				delete path;
+			}
+			if (abs(lengths[1] - lengths[0]) >= 1 || abs(lengths[0] - experiment.GetDistance()) >= 1)
+				mismatches++;
+		}
+		aStar.SetSymmetryReduction(nullptr);
+
+		int queries = max(scenario.GetNumExperiments(), 1);
+		std::cout << scenario.GetScenarioName() << "\t" << symmetry.GetRectangleCount() << "\t\t"
+			<< 100.0 * symmetry.GetPerimeterCellCount() / max(symmetry.GetFreeCellCount(), 1) << "%\t\t" << buildTime / 1000.0f << "\t\t"
+			<< times[0] / 1000.0f << "\t\t" << times[1] / 1000.0f << "\t\t" << (double)times[0] / max(times[1], 1u) << "\t"
+			<< expanded[0] / queries << "\t\t" << expanded[1] / queries << "\t\t" << mismatches << std::endl;
+	}
+}
+
+void hierarchyBenchmark(const std::vector<std::string>& mapFiles)
+{
+	std::cout << "Map\t\tNodes\tEdges\tShortcuts\tBuild (ms)\tLoad (ms)\tMemory (KB)\tA* (us)\tCH distance (us)\tCH path (us)\tSettled\tSpeedup\tMismatches" << std::endl;
+	int totalMismatches = 0;
+	for (size_t m = 0; m < mapFiles.size(); m++)
+	{
+		std::ostringstream scenarioFile;
+		scenarioFile << mapFiles[m] << ".scen";
+		DV1419Map map = DV1419Map(mapFiles[m].c_str());
+		ScenarioLoader scenario = ScenarioLoader(scenarioFile.str().c_str());
+		AStar aStar = AStar(&map, *AStar::Heuristics::Diagonal);
+
+		Timer timer;
+		ContractionHierarchy hierarchy = ContractionHierarchy(&map);
+		timer.start();
+		hierarchy.Build();
+		timer.stamp();
+		unsigned int buildTime = timer.getTimePassed();
+
+		// Save and load it again, the way it would be used at startup
+		std::ostringstream hierarchyFile;
+		hierarchyFile << mapFiles[m] << ".ch";
+		hierarchy.Save(hierarchyFile.str().c_str());
+		ContractionHierarchy loaded = ContractionHierarchy(&map);
+		timer.start();
+		bool loadedOk = loaded.Load(hierarchyFile.str().c_str());
+		timer.stamp();
+		unsigned int loadTime = timer.getTimePassed();
+
+		unsigned long long aStarTime = 0, distanceTime = 0, pathTime = 0, settled = 0;
+		int mismatches = 0;
+		int queries = scenario.GetNumExperiments();
+		for (int i = 0; i < queries; i++)
+		{
+			Experiment experiment = scenario.GetNthExperiment(i);
+			Coordinate start = Coordinate(experiment.GetStartX(), experiment.GetStartY());
+			Coordinate goal = Coordinate(experiment.GetGoalX(), experiment.GetGoalY());
+
+			timer.start();
+			std::vector<Coordinate>* path = aStar.Path(start, goal);
+			timer.stamp();
+			aStarTime += timer.getTimePassed();
+			// The cost in the 10/14 units the hierarchy reports
+			int aStarCost = path->empty() ? -1 : 0;
+			for (size_t j = 1; j < path->size(); j++)
+				aStarCost += ((*path)[j].X != (*path)[j - 1].X && (*path)[j].Y != (*path)[j - 1].Y) ? 14 : 10;
+			delete path;
+
+			timer.start();
+			int distance = loaded.GetDistance(start, goal);
+			timer.stamp();
+			distanceTime += timer.getTimePassed();
+			settled += loaded.m_SettledNodes;
+
+			timer.start();
+			path = loaded.Path(start, goal);
+			timer.stamp();
+			pathTime += timer.getTimePassed();
+			double length = path->empty() ? 0 : map.getPathLength(*path);
+			delete path;
+
+			if (distance != aStarCost || abs(length - experiment.GetDistance()) >= 1)
+				mismatches++;
+		}
+		remove(hierarchyFile.str().c_str());
+
+		std::cout << scenario.GetScenarioName() << "\t" << hierarchy.GetNodeCount() << "\t" << hierarchy.GetEdgeCount() << "\t" << hierarchy.GetShortcutCount() << "\t\t"
+			<< buildTime / 1000.0f << "\t\t" << loadTime / 1000.0f << (loadedOk ? "" : " (FAILED)") << "\t\t" << loaded.GetMemoryUsage() / 1024 << "\t\t"
+			<< (double)aStarTime / max(queries, 1) << "\t" << (double)distanceTime / max(queries, 1) << "\t\t\t" << (double)pathTime / max(queries, 1) << "\t\t"
+			<< settled / max(queries, 1) << "\t" << (double)aStarTime / max(distanceTime, 1ULL) << "\t" << mismatches << std::endl;
+		totalMismatches += mismatches;
+	}
+
+	std::cout << "Mismatches: " << totalMismatches << std::endl;
+}
+
+// An expansion as the neighbour kernel saw it, recorded by recordingKernel for kernelBenchmark to replay
+struct KernelCall
+{
+	int G;
+	int NeighbourG[8];
+	unsigned int Walkable;
+};
+std::vector<KernelCall> recordedKernelCalls;
+
+unsigned int recordingKernel(int g, const int* neighbourG, unsigned int walkable)
+{
+	if (recordedKernelCalls.size() < 4000000)
+	{
+		KernelCall call;
+		call.G = g;
+		std::copy(neighbourG, neighbourG + 8, call.NeighbourG);
+		call.Walkable = walkable;
+		recordedKernelCalls.push_back(call);
+	}
+	return NeighbourKernel::RelaxScalar(g, neighbourG, walkable);
+}
+
+// The checks of the loop in AStar::Update one branch at a time, on the inputs of a kernel
+unsigned int branchingKernel(int g, const int* neighbourG, unsigned int walkable)
+{
+	unsigned int improved = 0;
+	for (int slot = 0; slot < 8; slot++)
+	{
+		int x = NeighbourKernel::SlotX[slot];
+		int y = NeighbourKernel::SlotY[slot];
+		if (!(walkable & (1 << slot)))
+			continue;
+		// Closed
+		if (neighbourG[slot] == 0)
+			continue;
+		// The straight slots beside a diagonal one are 1 or 6 above and below, 3 or 4 left and right
+		if (x != 0 && y != 0 && (!(walkable & (1 << (x < 0 ? 3 : 4))) || !(walkable & (1 << (y < 0 ? 1 : 6)))))
+			continue;
+		if (g + NeighbourKernel::SlotCost[slot] >= neighbourG[slot])
+			continue;
+		improved |= 1 << slot;
+	}
+
+	return improved;
+}
+
+void kernelBenchmark(AStar &aStar, ScenarioLoader &scenario, int startExperiment, int endExperiment)
+{
+	NeighbourKernel::Level best = NeighbourKernel::GetBestLevel();
+	std::cout << "Best kernel on this processor: " << NeighbourKernel::GetName(best) << std::endl;
+
+	// Record the expansions of the scenarios, to time the kernels on real inputs and nothing else
+	recordedKernelCalls.clear();
+	aStar.SetNeighbourKernel(recordingKernel);
+	for (int i = startExperiment; i <= endExperiment; i++)
+	{
+		Experiment experiment = scenario.GetNthExperiment(i);
+		delete aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+	}
+	if (recordedKernelCalls.empty())
+	{
+		std::cout << "No expansions to replay" << std::endl;
+		return;
+	}
+
+	std::vector<NeighbourKernel::RelaxMethod> kernels;
+	std::vector<std::string> names;
+	kernels.push_back(branchingKernel);
+	names.push_back("branching");
+	for (int level = NeighbourKernel::Scalar; level <= best; level++)
+	{
+		kernels.push_back(NeighbourKernel::GetMethod((NeighbourKernel::Level)level));
+		names.push_back(NeighbourKernel::GetName((NeighbourKernel::Level)level));
+	}
+
+	// Every kernel replays the recording until it has done about 20 million expansions, best of 3
+	size_t calls = recordedKernelCalls.size();
+	int repeats = (int)max((size_t)1, 20000000 / calls);
+	std::cout << "Expansions recorded: " << calls << ", replayed " << repeats << " times" << std::endl;
+	std::cout << "Kernel\t\tns/expansion\tImproved/expansion\tMismatches" << std::endl;
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		double bestTime = 1e300;
+		unsigned long long improved = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			improved = 0;
+			auto start = std::chrono::steady_clock::now();
+			for (int repeat = 0; repeat < repeats; repeat++)
+			{
+				for (size_t i = 0; i < calls; i++)
+				{
+					const KernelCall& call = recordedKernelCalls[i];
+					improved += kernels[k](call.G, call.NeighbourG, call.Walkable);
+				}
+			}
+			bestTime = min(bestTime, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+			// Only keeps the compiler from dropping the calls
+			volatile unsigned long long sink = improved;
+			(void)sink;
+		}
+
+		int mismatches = 0;
+		unsigned long long improvedCount = 0;
+		for (size_t i = 0; i < calls; i++)
+		{
+			const KernelCall& call = recordedKernelCalls[i];
+			unsigned int slots = kernels[k](call.G, call.NeighbourG, call.Walkable);
+			if (slots != branchingKernel(call.G, call.NeighbourG, call.Walkable))
+				mismatches++;
+			for (; slots != 0; slots &= slots - 1)
+				improvedCount++;
+		}
+
+		std::cout << names[k] << (names[k].size() < 8 ? "\t\t" : "\t") << bestTime / ((double)calls * repeats) << "\t\t"
+			<< (double)improvedCount / calls << "\t\t\t" << mismatches << std::endl;
+	}
+	recordedKernelCalls.clear();
+	recordedKernelCalls.shrink_to_fit();
+
+	// The whole search with the loop and with every kernel, best of 3
+	Timer timer;
+	std::vector<std::vector<Coordinate> > loopPaths;
+	std::cout << "Search\t\tms\tns/expansion\tSpeedup\tDifferent paths" << std::endl;
+	unsigned int loopTime = 0;
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		aStar.SetNeighbourKernel(k == 0 ? nullptr : kernels[k]);
+		unsigned int totalTime = UINT_MAX;
+		unsigned long long expanded = 0;
+		int different = 0;
+		for (int run = 0; run < 3; run++)
+		{
+			unsigned int runTime = 0;
+			expanded = 0;
+			different = 0;
+			for (int i = startExperiment; i <= endExperiment; i++)
+			{
+				Experiment experiment = scenario.GetNthExperiment(i);
+				timer.start();
+				std::vector<Coordinate>* path = aStar.Path(Coordinate(experiment.GetStartX(), experiment.GetStartY()), Coordinate(experiment.GetGoalX(), experiment.GetGoalY()));
+				timer.stamp();
+				runTime += timer.getTimePassed();
+				expanded += aStar.m_ExpandedNodes;
+
+				// The kernels relax in the same order as the loop, so the paths should be the very same
+				if (k == 0 && run == 0)
+					loopPaths.push_back(*path);
+				else if (path->size() != loopPaths[i - startExperiment].size()
+					|| !std::equal(path->begin(), path->end(), loopPaths[i - startExperiment].begin(), [](const Coordinate& a, const Coordinate& b) { return a.X == b.X && a.Y == b.Y; }))
+					different++;
+				delete path;
+			}
+			totalTime = min(totalTime, runTime);
+		}
+		if (k == 0)
+			loopTime = totalTime;
+
+		std::string name = (k == 0) ? "loop" : names[k];
+		std::cout << name << (name.size() < 8 ? "\t\t" : "\t") << totalTime / 1000.0f << "\t" << (double)totalTime * 1000 / max(expanded, 1ULL) << "\t\t"
+			<< (double)loopTime / max(totalTime, 1u) << "\t" << different << std::endl;
+	}
+	aStar.SetNeighbourKernel(NeighbourKernel::GetMethod(best));
+}
+
 int main(int argc, char* argv[])
 {
 	//graphical();
@@ -441,6 +2606,45 @@ int main(int argc, char* argv[])
 
 	if (argc > 1)
 	{
+		// A trailing flag selects the mode, so don't mistake it for an experiment number
+		std::string lastArg = argv[argc - 1];
+		int numberArgs = (lastArg[0] == '-') ? argc - 1 : argc;
+
+		// Race Fringe Search against A* on every scenario of every map passed if -fringe is passed
+		if (lastArg == "-fringe")
+		{
+			fringeBenchmark(std::vector<std::string>(argv + 1, argv + argc - 1));
+			return 0;
+		}
+
+		// Compare A* with and without rectangular symmetry reduction on every map passed if -rsr is passed
+		if (lastArg == "-rsr")
+		{
+			symmetryBenchmark(std::vector<std::string>(argv + 1, argv + argc - 1));
+			return 0;
+		}
+
+		// Build contraction hierarchies for every map passed and race them against A* if -ch is passed
+		if (lastArg == "-ch")
+		{
+			hierarchyBenchmark(std::vector<std::string>(argv + 1, argv + argc - 1));
+			return 0;
+		}
+
+		// Turn every search trace file passed into heatmaps and statistics if -heatmap is passed
+		if (lastArg == "-heatmap")
+		{
+			heatmapReport(std::vector<std::string>(argv + 1, argv + argc - 1));
+			return 0;
+		}
+
+		// Run the scenarios of every map passed as one interleaved trace through the map registry if -trace is passed
+		if (lastArg == "-trace")
+		{
+			traceBenchmark(std::vector<std::string>(argv + 1, argv + argc - 1));
+			return 0;
+		}
+
 		std::string mapFile = argv[1];
 		std::ostringstream scenarioFile;
 		scenarioFile << mapFile << ".scen";
@@ -456,13 +2660,13 @@ int main(int argc, char* argv[])
 		int endExperiment = scenario.GetNumExperiments() - 1;
 
 		// Run a specific experiment if a second argument is supplied
-		if (argc > 2)
+		if (numberArgs > 2)
 		{
 			istringstream(argv[2]) >> startExperiment;
 			endExperiment = startExperiment;
 		}
 		// Run a range of experiments if a third argument is supplied
-		if (argc > 3)
+		if (numberArgs > 3)
 		{
 			istringstream(argv[3]) >> endExperiment;
 			if (endExperiment > scenario.GetNumExperiments() - 1)
@@ -470,13 +2674,159 @@ int main(int argc, char* argv[])
 		}
 
 		// Run graphical if -g is passed
-		std::string lastArg = argv[argc - 1];
 		if (lastArg == "-g")
 		{
 			graphical2(map, aStar, scenario, startExperiment);
 			return 0;
 		}
 
+		// Compare any-angle search against smoothed A* paths if -theta is passed
+		if (lastArg == "-theta")
+		{
+			anyAngleBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Run every experiment through the time-sliced scheduler if -sched is passed
+		if (lastArg == "-sched")
+		{
+			schedulerBenchmark(map, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Load test the asynchronous path service if -async is passed
+		if (lastArg == "-async")
+		{
+			serviceBenchmark(map, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Compare a shared flow field against one A* query per unit if -flow is passed
+		if (lastArg == "-flow")
+		{
+			flowFieldBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Compare nearest-goal and distance matrix queries against plain A* if -multi is passed
+		if (lastArg == "-multi")
+		{
+			multiTargetBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Chart bounded-suboptimal search modes per bucket if -bounded is passed
+		if (lastArg == "-bounded")
+		{
+			boundedBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Chart how fast anytime search finds paths and how good they are by a deadline if -anytime is passed
+		if (lastArg == "-anytime")
+		{
+			anytimeBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Chart how real-time agents with a few lookaheads learn over repeated trials if -realtime is passed
+		if (lastArg == "-realtime")
+		{
+			realTimeBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Build, save, load and query subgoal graphs if -subgoal is passed
+		if (lastArg == "-subgoal")
+		{
+			subgoalBenchmark(map, aStar, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Compare A* with and without goal bounding if -bounds is passed
+		if (lastArg == "-bounds")
+		{
+			goalBoundsBenchmark(map, aStar, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Report how much of the search dead-end pruning saves per bucket if -deadend is passed
+		if (lastArg == "-deadend")
+		{
+			deadEndBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Time the neighbour kernels on recorded expansions and in whole searches if -kernel is passed
+		if (lastArg == "-kernel")
+		{
+			kernelBenchmark(aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Search for 1x1, 2x2 and 3x3 agents on the one map if -sizes is passed
+		if (lastArg == "-sizes")
+		{
+			agentSizeBenchmark(map, aStar, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Search a memory-mapped tiled copy of the map with a few cache sizes if -paged is passed
+		if (lastArg == "-paged")
+		{
+			pagedBenchmark(map, aStar, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Compare sparse and dense search state on ever bigger copies of the map if -sparse is passed
+		if (lastArg == "-sparse")
+		{
+			sparseBenchmark(map, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Time A* with the grid layout it was compiled with if -layout is passed
+		if (lastArg == "-layout")
+		{
+			layoutBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Chart the latency of the parallel search against its thread count if -parallel is passed
+		if (lastArg == "-parallel")
+		{
+			parallelBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Search while another thread keeps opening and closing doors on the map if -versioned is passed
+		if (lastArg == "-versioned")
+		{
+			versionedBenchmark(map, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Record every search of the scenarios to a trace file if -record is passed
+		if (lastArg == "-record")
+		{
+			recordBenchmark(map, aStar, scenario, mapFile, startExperiment, endExperiment);
+			return 0;
+		}
+
+		// Move thousands of units through the map at once with reservations if -cooperative is passed
+		if (lastArg == "-cooperative")
+		{
+			cooperativeBenchmark(map, aStar);
+			return 0;
+		}
+
+		// Compare batched queries against one Path call at a time if -batch is passed
+		if (lastArg == "-batch")
+		{
+			batchBenchmark(map, aStar, scenario, startExperiment, endExperiment);
+			return 0;
+		}
+
 		std::cout << "Running experiment";
 		if (startExperiment == endExperiment)
 			std::cout << " " << startExperiment << std::endl;